@@ -0,0 +1,113 @@
+#include <stddef.h>
+#include "acpi.h"
+#include "mm.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_hex(uint32_t value);
+
+static acpi_rsdp_t* acpi_rsdp = NULL;
+static acpi_sdt_header_t* acpi_root = NULL;
+static int acpi_root_is_xsdt = 0;
+
+static int acpi_checksum_ok(const void* data, uint32_t length) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+// Tables live in firmware-reserved RAM; identity map the pages they span
+static void acpi_map(uint32_t phys, uint32_t length) {
+    page_directory_t* dir = paging_get_kernel_directory();
+    uint32_t start = phys & ~(PAGE_SIZE - 1);
+    uint32_t end = phys + length;
+
+    for (uint32_t addr = start; addr < end && addr >= start; addr += PAGE_SIZE) {
+        if (!paging_get_physical_addr(dir, addr)) {
+            paging_map_page(dir, addr, addr, PAGE_PRESENT | PAGE_WRITABLE);
+        }
+    }
+}
+
+// Map a whole table and check it; returns NULL if it is corrupt
+static acpi_sdt_header_t* acpi_map_table(uint32_t phys) {
+    acpi_map(phys, sizeof(acpi_sdt_header_t));
+    acpi_sdt_header_t* table = (acpi_sdt_header_t*)phys;
+    acpi_map(phys, table->length);
+    return acpi_checksum_ok(table, table->length) ? table : NULL;
+}
+
+// The RSDP sits on a 16-byte boundary
+static acpi_rsdp_t* acpi_scan_rsdp(uint32_t start, uint32_t end) {
+    for (uint32_t addr = start; addr + 20 <= end; addr += 16) {
+        acpi_rsdp_t* rsdp = (acpi_rsdp_t*)addr;
+        if (memcmp(rsdp->signature, "RSD PTR ", 8) == 0 && acpi_checksum_ok(rsdp, 20)) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+int acpi_init(void) {
+    // First KB of the EBDA, then the BIOS read-only area. The pointer goes
+    // through a register so the compiler does not treat low memory as NULL.
+    uint32_t bda = ACPI_EBDA_PTR;
+    __asm__ ("" : "+r"(bda));
+    uint32_t ebda = (uint32_t)(*(volatile uint16_t*)bda) << 4;
+    if (ebda) {
+        acpi_rsdp = acpi_scan_rsdp(ebda, ebda + 1024);
+    }
+    if (!acpi_rsdp) {
+        acpi_rsdp = acpi_scan_rsdp(ACPI_BIOS_START, ACPI_BIOS_END);
+    }
+    if (!acpi_rsdp) {
+        return -1;
+    }
+
+    // Prefer the XSDT when it is reachable with 32-bit addresses
+    if (acpi_rsdp->revision >= 2 && acpi_rsdp->xsdt_address &&
+        (acpi_rsdp->xsdt_address >> 32) == 0) {
+        acpi_root = acpi_map_table((uint32_t)acpi_rsdp->xsdt_address);
+        acpi_root_is_xsdt = acpi_root != NULL;
+    }
+    if (!acpi_root) {
+        acpi_root = acpi_map_table(acpi_rsdp->rsdt_address);
+    }
+    if (!acpi_root) {
+        return -1;
+    }
+
+    terminal_writestring("ACPI: ");
+    terminal_writestring(acpi_root_is_xsdt ? "XSDT" : "RSDT");
+    terminal_writestring(" at 0x");
+    terminal_write_hex((uint32_t)acpi_root);
+    terminal_writestring("\n");
+    return 0;
+}
+
+acpi_sdt_header_t* acpi_find_table(const char* signature) {
+    if (!acpi_root) {
+        return NULL;
+    }
+
+    uint32_t entry_size = acpi_root_is_xsdt ? 8 : 4;
+    uint32_t entries = (acpi_root->length - sizeof(acpi_sdt_header_t)) / entry_size;
+    uint8_t* list = (uint8_t*)acpi_root + sizeof(acpi_sdt_header_t);
+
+    for (uint32_t i = 0; i < entries; i++) {
+        uint32_t phys = *(uint32_t*)(list + i * entry_size);
+        if (acpi_root_is_xsdt && *(uint32_t*)(list + i * entry_size + 4)) {
+            continue; // Above 4GB
+        }
+
+        acpi_map(phys, sizeof(acpi_sdt_header_t));
+        acpi_sdt_header_t* table = (acpi_sdt_header_t*)phys;
+        if (memcmp(table->signature, signature, 4) == 0) {
+            return acpi_map_table(phys);
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,63 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+
+// RSDP search areas
+#define ACPI_EBDA_PTR        0x040E     // BDA word holding the EBDA segment
+#define ACPI_BIOS_START      0x000E0000
+#define ACPI_BIOS_END        0x00100000
+
+// Root System Description Pointer
+typedef struct acpi_rsdp {
+    char signature[8];      // "RSD PTR "
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;       // 0 = ACPI 1.0, 2+ = has XSDT
+    uint32_t rsdt_address;
+    // ACPI 2.0+
+    uint32_t length;
+    uint64_t xsdt_address;
+    uint8_t extended_checksum;
+    uint8_t reserved[3];
+} __attribute__((packed)) acpi_rsdp_t;
+
+// Header common to every system description table
+typedef struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_sdt_header_t;
+
+// Generic address structure
+typedef struct acpi_gas {
+    uint8_t address_space;  // 0 = memory, 1 = I/O
+    uint8_t bit_width;
+    uint8_t bit_offset;
+    uint8_t access_size;
+    uint64_t address;
+} __attribute__((packed)) acpi_gas_t;
+
+// HPET description table
+typedef struct acpi_hpet {
+    acpi_sdt_header_t header;
+    uint32_t event_timer_block_id;
+    acpi_gas_t base_address;
+    uint8_t hpet_number;
+    uint16_t min_tick;
+    uint8_t page_protection;
+} __attribute__((packed)) acpi_hpet_t;
+
+// Locate the RSDP and root table; returns 0 if ACPI is present
+int acpi_init(void);
+
+// Find a table by its 4-character signature (NULL if absent)
+acpi_sdt_header_t* acpi_find_table(const char* signature);
+
+#endif // ACPI_H
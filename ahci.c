@@ -0,0 +1,548 @@
+#include <stddef.h>
+#include "ahci.h"
+#include "blkdev.h"
+#include "pci.h"
+#include "mm.h"
+#include "dma.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+
+// One SATA disk behind an HBA port
+typedef struct ahci_port {
+    blkdev_t blk;
+    struct ahci_hba* hba;
+    volatile uint8_t* regs;
+    uint8_t port_num;
+    int ncq;                        // Native command queuing in use
+    uint32_t num_slots;
+
+    // Command list, received FIS and command tables share one coherent block
+    void* dma_mem;
+    uint32_t dma_size;
+    dma_addr_t dma_handle;
+    ahci_cmd_header_t* cmd_list;    // 32 headers, 1KB aligned
+    uint8_t* fis_area;              // Received FIS, 256-byte aligned
+    ahci_cmd_table_t* cmd_tables;   // One per slot, 128-byte aligned
+
+    blk_request_t* slot_req[AHCI_MAX_SLOTS];
+    dma_sg_list_t* slot_sg;         // Data buffer mapping per slot
+    uint32_t busy_slots;            // Slots holding a request
+    uint32_t pending_issue;         // Built but not yet issued
+    uint32_t issued;                // Issued and not yet reaped
+} ahci_port_t;
+
+// Host bus adapter
+typedef struct ahci_hba {
+    pci_device_t* pci;
+    volatile uint8_t* abar;
+    uint32_t cap;
+    int coalescing;
+    uint32_t ccc_int;               // IS bit used for coalesced interrupts
+    ahci_port_t* ports[AHCI_MAX_PORTS];
+} ahci_hba_t;
+
+static ahci_hba_t ahci_hba;
+static ahci_port_t ahci_ports[AHCI_MAX_DISKS];
+static int ahci_num_disks = 0;
+
+static int ahci_probe(pci_device_t* dev, const pci_device_id_t* id);
+
+static const pci_device_id_t ahci_ids[] = {
+    {PCI_ANY_ID, PCI_ANY_ID, AHCI_CLASS_ID},
+    {0, 0, 0}
+};
+
+static pci_driver_t ahci_driver = {
+    "ahci",
+    ahci_ids,
+    ahci_probe
+};
+
+// MMIO accessors
+static inline uint32_t ahci_read(volatile uint8_t* base, uint32_t reg) {
+    return *(volatile uint32_t*)(base + reg);
+}
+
+static inline void ahci_write(volatile uint8_t* base, uint32_t reg, uint32_t value) {
+    *(volatile uint32_t*)(base + reg) = value;
+}
+
+static inline uint32_t ahci_irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void ahci_irq_restore(uint32_t flags) {
+    __asm__ volatile ("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+// Bus address of something inside the port's coherent block
+static dma_addr_t ahci_port_dma(ahci_port_t* port, void* addr) {
+    return port->dma_handle + ((uint8_t*)addr - (uint8_t*)port->dma_mem);
+}
+
+// Stop the command and FIS receive engines
+static int ahci_port_stop(ahci_port_t* port) {
+    uint32_t cmd = ahci_read(port->regs, AHCI_PxCMD);
+    ahci_write(port->regs, AHCI_PxCMD, cmd & ~(AHCI_PxCMD_ST | AHCI_PxCMD_FRE));
+
+    for (uint32_t timeout = 0; timeout < 1000000; timeout++) {
+        if (!(ahci_read(port->regs, AHCI_PxCMD) & (AHCI_PxCMD_CR | AHCI_PxCMD_FR))) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void ahci_port_start(ahci_port_t* port) {
+    for (uint32_t timeout = 0; timeout < 1000000; timeout++) {
+        if (!(ahci_read(port->regs, AHCI_PxTFD) & (AHCI_TFD_BSY | AHCI_TFD_DRQ))) {
+            break;
+        }
+    }
+
+    uint32_t cmd = ahci_read(port->regs, AHCI_PxCMD);
+    ahci_write(port->regs, AHCI_PxCMD, cmd | AHCI_PxCMD_FRE);
+    ahci_write(port->regs, AHCI_PxCMD, cmd | AHCI_PxCMD_FRE | AHCI_PxCMD_ST);
+}
+
+// Convert a mapped buffer into PRD entries, splitting segments at the 4MB
+// byte-count limit; returns the entry count or -1 if it does not fit.
+static int ahci_build_prdt(ahci_cmd_table_t* table, const dma_sg_list_t* sgl) {
+    int count = 0;
+
+    for (uint32_t i = 0; i < sgl->count; i++) {
+        dma_addr_t addr = sgl->entries[i].addr;
+        uint32_t length = sgl->entries[i].len;
+
+        while (length > 0) {
+            uint32_t chunk = length > 0x400000 ? 0x400000 : length;
+            if (count == AHCI_MAX_PRDS) {
+                return -1;
+            }
+            table->prdt[count].dba = addr;
+            table->prdt[count].dbau = 0;
+            table->prdt[count].reserved = 0;
+            table->prdt[count].dbc = chunk - 1;
+            count++;
+
+            addr += chunk;
+            length -= chunk;
+        }
+    }
+
+    return count;
+}
+
+// Fill the command FIS for a read/write in a slot
+static void ahci_build_fis(ahci_port_t* port, ahci_cmd_table_t* table, uint32_t slot,
+                           blk_request_t* req) {
+    uint8_t* fis = table->cfis;
+    memset(fis, 0, 20);
+
+    uint64_t lba = req->sector;
+    fis[0] = FIS_TYPE_REG_H2D;
+    fis[1] = 0x80;                  // Command, not control
+    fis[4] = lba & 0xFF;
+    fis[5] = (lba >> 8) & 0xFF;
+    fis[6] = (lba >> 16) & 0xFF;
+    fis[7] = 0x40;                  // LBA mode
+    fis[8] = (lba >> 24) & 0xFF;
+    fis[9] = (lba >> 32) & 0xFF;
+    fis[10] = (lba >> 40) & 0xFF;
+
+    if (port->ncq) {
+        // FPDMA QUEUED: sector count in FEATURES, tag in COUNT[7:3]
+        fis[2] = req->op == BLK_OP_WRITE ? ATA_CMD_WRITE_FPDMA_QUEUED : ATA_CMD_READ_FPDMA_QUEUED;
+        fis[3] = req->count & 0xFF;
+        fis[11] = (req->count >> 8) & 0xFF;
+        fis[12] = slot << 3;
+    } else {
+        fis[2] = req->op == BLK_OP_WRITE ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+        fis[12] = req->count & 0xFF;
+        fis[13] = (req->count >> 8) & 0xFF;
+    }
+}
+
+// Prepare a command slot; it is issued by the next unplug
+static int ahci_submit(blkdev_t* blk, blk_request_t* req) {
+    ahci_port_t* port = (ahci_port_t*)blk->driver_data;
+    uint32_t flags = ahci_irq_save();
+
+    uint32_t slot_mask = port->num_slots == 32 ? 0xFFFFFFFF : (1u << port->num_slots) - 1;
+    uint32_t free_slots = ~port->busy_slots & slot_mask;
+    if (!free_slots) {
+        ahci_irq_restore(flags);
+        return -1;
+    }
+
+    uint32_t slot;
+    __asm__ ("bsf %1, %0" : "=r"(slot) : "r"(free_slots));
+
+    ahci_cmd_table_t* table = &port->cmd_tables[slot];
+    dma_sg_list_t* sgl = &port->slot_sg[slot];
+    dma_direction_t direction = req->op == BLK_OP_WRITE ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
+    int prds = -1;
+    if (req->count <= 0xFFFF &&
+        dma_map_sg(sgl, req->buffer, req->count * BLKDEV_SECTOR_SIZE, direction, DMA_MASK_32BIT) > 0) {
+        prds = ahci_build_prdt(table, sgl);
+    }
+    if (prds < 0) {
+        dma_unmap_sg(sgl);
+        ahci_irq_restore(flags);
+        req->status = BLK_STATUS_ERROR; // Unmappable or too fragmented for one command
+        if (req->complete) {
+            req->complete(req);
+        }
+        return 0;
+    }
+    ahci_build_fis(port, table, slot, req);
+
+    ahci_cmd_header_t* header = &port->cmd_list[slot];
+    header->flags = 5;              // H2D FIS is 5 dwords
+    if (req->op == BLK_OP_WRITE) {
+        header->flags |= AHCI_CMD_WRITE;
+    }
+    header->prdtl = prds;
+    header->prdbc = 0;
+
+    port->slot_req[slot] = req;
+    port->busy_slots |= 1u << slot;
+    port->pending_issue |= 1u << slot;
+
+    ahci_irq_restore(flags);
+    return 0;
+}
+
+// Issue every prepared slot with a single SACT/CI write
+static void ahci_unplug(blkdev_t* blk) {
+    ahci_port_t* port = (ahci_port_t*)blk->driver_data;
+    uint32_t flags = ahci_irq_save();
+
+    uint32_t batch = port->pending_issue;
+    if (batch) {
+        __asm__ volatile ("" : : : "memory");
+        if (port->ncq) {
+            ahci_write(port->regs, AHCI_PxSACT, batch);
+        }
+        ahci_write(port->regs, AHCI_PxCI, batch);
+        port->issued |= batch;
+        port->pending_issue = 0;
+        blk->notifications++;
+    }
+
+    ahci_irq_restore(flags);
+}
+
+// Finish a set of slots with the given status
+static int ahci_complete_slots(ahci_port_t* port, uint32_t done, int status) {
+    int completed = 0;
+
+    while (done) {
+        uint32_t slot;
+        __asm__ ("bsf %1, %0" : "=r"(slot) : "r"(done));
+        done &= done - 1;
+
+        blk_request_t* req = port->slot_req[slot];
+        port->slot_req[slot] = NULL;
+        dma_unmap_sg(&port->slot_sg[slot]);
+        port->busy_slots &= ~(1u << slot);
+        port->issued &= ~(1u << slot);
+
+        if (req) {
+            req->status = status;
+            if (req->complete) {
+                req->complete(req);
+            }
+            completed++;
+        }
+    }
+
+    return completed;
+}
+
+// Reap every slot the device has finished
+static int ahci_port_reap(ahci_port_t* port) {
+    uint32_t port_is = ahci_read(port->regs, AHCI_PxIS);
+    ahci_write(port->regs, AHCI_PxIS, port_is);
+
+    if (port_is & AHCI_PxIS_TFES) {
+        // A failed queued command aborts the whole queue; fail it and restart
+        int completed = ahci_complete_slots(port, port->issued, BLK_STATUS_ERROR);
+        ahci_port_stop(port);
+        ahci_write(port->regs, AHCI_PxSERR, 0xFFFFFFFF);
+        ahci_port_start(port);
+        return completed;
+    }
+
+    uint32_t still_active = ahci_read(port->regs, AHCI_PxCI);
+    if (port->ncq) {
+        still_active |= ahci_read(port->regs, AHCI_PxSACT);
+    }
+
+    return ahci_complete_slots(port, port->issued & ~still_active, BLK_STATUS_OK);
+}
+
+static int ahci_poll(blkdev_t* blk) {
+    ahci_port_t* port = (ahci_port_t*)blk->driver_data;
+    uint32_t flags = ahci_irq_save();
+    int completed = ahci_port_reap(port);
+    ahci_irq_restore(flags);
+    return completed;
+}
+
+static const blkdev_ops_t ahci_ops = {
+    ahci_submit,
+    ahci_unplug,
+    ahci_poll
+};
+
+// One interrupt may cover many completions on many ports
+static void ahci_irq(pci_device_t* dev) {
+    ahci_hba_t* hba = (ahci_hba_t*)dev->driver_data;
+    uint32_t pending = ahci_read(hba->abar, AHCI_IS);
+    if (!pending) {
+        return; // Shared line
+    }
+
+    // A coalesced interrupt stands for completions on every CCC port
+    uint32_t bits = pending;
+    if (hba->coalescing && (pending & (1u << hba->ccc_int))) {
+        bits &= ~(1u << hba->ccc_int);
+        for (uint32_t i = 0; i < AHCI_MAX_PORTS; i++) {
+            if (hba->ports[i]) {
+                bits |= 1u << i;
+            }
+        }
+    }
+
+    for (; bits; bits &= bits - 1) {
+        uint32_t port_num;
+        __asm__ ("bsf %1, %0" : "=r"(port_num) : "r"(bits));
+
+        ahci_port_t* port = hba->ports[port_num];
+        if (port) {
+            port->blk.interrupts++;
+            ahci_port_reap(port);
+        }
+    }
+
+    ahci_write(hba->abar, AHCI_IS, pending);
+}
+
+// Run IDENTIFY DEVICE synchronously in slot 0
+static int ahci_identify(ahci_port_t* port, dma_addr_t identify) {
+    ahci_cmd_table_t* table = &port->cmd_tables[0];
+    memset(table, 0, sizeof(ahci_cmd_table_t));
+
+    table->cfis[0] = FIS_TYPE_REG_H2D;
+    table->cfis[1] = 0x80;
+    table->cfis[2] = ATA_CMD_IDENTIFY_DEVICE;
+    table->prdt[0].dba = identify;
+    table->prdt[0].dbc = 512 - 1;
+
+    port->cmd_list[0].flags = 5;
+    port->cmd_list[0].prdtl = 1;
+    port->cmd_list[0].prdbc = 0;
+
+    ahci_write(port->regs, AHCI_PxIS, 0xFFFFFFFF);
+    ahci_write(port->regs, AHCI_PxCI, 1);
+
+    for (uint32_t timeout = 0; timeout < 10000000; timeout++) {
+        if (ahci_read(port->regs, AHCI_PxIS) & AHCI_PxIS_TFES) {
+            return -1;
+        }
+        if (!(ahci_read(port->regs, AHCI_PxCI) & 1)) {
+            ahci_write(port->regs, AHCI_PxIS, 0xFFFFFFFF);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Stop a half-initialized port and free its command list, FIS area and tables.
+// If the engines never stop the HBA may still write there, so the block stays.
+static void ahci_port_release(ahci_port_t* port) {
+    if (ahci_port_stop(port) != 0) {
+        return;
+    }
+    ahci_write(port->regs, AHCI_PxCLB, 0);
+    ahci_write(port->regs, AHCI_PxFB, 0);
+
+    dma_free_coherent(port->dma_mem, port->dma_size);
+    kfree(port->slot_sg);
+    port->dma_mem = NULL;
+    port->slot_sg = NULL;
+}
+
+// Allocate port memory, start the engines and register the disk
+static int ahci_port_init(ahci_hba_t* hba, uint8_t port_num) {
+    volatile uint8_t* regs = hba->abar + AHCI_PORT_BASE + port_num * AHCI_PORT_SIZE;
+
+    uint32_t ssts = ahci_read(regs, AHCI_PxSSTS);
+    if ((ssts & 0x0F) != AHCI_SSTS_DET_PRESENT || ahci_read(regs, AHCI_PxSIG) != AHCI_SIG_ATA) {
+        return -1; // No disk (or ATAPI / port multiplier)
+    }
+    if (ahci_num_disks >= AHCI_MAX_DISKS) {
+        return -1;
+    }
+
+    ahci_port_t* port = &ahci_ports[ahci_num_disks];
+    memset(port, 0, sizeof(ahci_port_t));
+    port->hba = hba;
+    port->regs = regs;
+    port->port_num = port_num;
+    port->num_slots = ((hba->cap >> AHCI_CAP_NCS_SHIFT) & 0x1F) + 1;
+
+    if (ahci_port_stop(port) != 0) {
+        return -1;
+    }
+
+    // 1KB command list, 256-byte FIS area, then the 128-byte aligned tables
+    port->dma_size = 1024 + 1024 + sizeof(ahci_cmd_table_t) * port->num_slots;
+    port->dma_mem = dma_alloc_coherent(port->dma_size, &port->dma_handle);
+    port->slot_sg = (dma_sg_list_t*)kcalloc(port->num_slots, sizeof(dma_sg_list_t));
+    dma_addr_t identify_dma;
+    uint16_t* identify = (uint16_t*)dma_alloc_coherent(512, &identify_dma);
+    if (!port->dma_mem || !port->slot_sg || !identify) {
+        dma_free_coherent(port->dma_mem, port->dma_size);
+        kfree(port->slot_sg);
+        dma_free_coherent(identify, 512);
+        return -1;
+    }
+    port->cmd_list = (ahci_cmd_header_t*)port->dma_mem;
+    port->fis_area = (uint8_t*)port->dma_mem + 1024;
+    port->cmd_tables = (ahci_cmd_table_t*)((uint8_t*)port->dma_mem + 2048);
+
+    for (uint32_t i = 0; i < port->num_slots; i++) {
+        port->cmd_list[i].ctba = ahci_port_dma(port, &port->cmd_tables[i]);
+        port->cmd_list[i].ctbau = 0;
+    }
+
+    ahci_write(regs, AHCI_PxCLB, ahci_port_dma(port, port->cmd_list));
+    ahci_write(regs, AHCI_PxCLBU, 0);
+    ahci_write(regs, AHCI_PxFB, ahci_port_dma(port, port->fis_area));
+    ahci_write(regs, AHCI_PxFBU, 0);
+    ahci_write(regs, AHCI_PxSERR, 0xFFFFFFFF);
+    ahci_write(regs, AHCI_PxIS, 0xFFFFFFFF);
+    ahci_write(regs, AHCI_PxIE, 0);
+    ahci_port_start(port);
+
+    if (ahci_identify(port, identify_dma) != 0) {
+        ahci_port_release(port);
+        dma_free_coherent(identify, 512);
+        return -1;
+    }
+
+    // LBA48 capacity in words 100-103 (block layer addresses 32 bits)
+    uint32_t sectors = identify[100] | ((uint32_t)identify[101] << 16);
+    if (identify[102] || identify[103] || sectors == 0) {
+        sectors = sectors ? 0xFFFFFFFF : (identify[60] | ((uint32_t)identify[61] << 16));
+    }
+
+    // NCQ needs HBA and drive support; the drive may accept fewer tags
+    if ((hba->cap & AHCI_CAP_SNCQ) && (identify[76] & (1 << 8))) {
+        uint32_t drive_depth = (identify[75] & 0x1F) + 1;
+        port->ncq = 1;
+        if (drive_depth < port->num_slots) {
+            port->num_slots = drive_depth;
+        }
+    }
+    dma_free_coherent(identify, 512);
+
+    port->blk.name[0] = 's';
+    port->blk.name[1] = 'd';
+    port->blk.name[2] = 'a' + ahci_num_disks;
+    port->blk.name[3] = '\0';
+    port->blk.driver = port->ncq ? "ahci-ncq" : "ahci";
+    port->blk.sector_count = sectors;
+    port->blk.queue_depth = port->num_slots;
+    port->blk.ops = &ahci_ops;
+    port->blk.driver_data = port;
+
+    if (blkdev_register(&port->blk) != 0) {
+        ahci_port_release(port);
+        return -1;
+    }
+    hba->ports[port_num] = port;
+    ahci_num_disks++;
+
+    terminal_writestring(port->blk.name);
+    terminal_writestring(": AHCI port ");
+    terminal_write_dec(port_num);
+    terminal_writestring(", ");
+    terminal_write_dec(sectors / 2048);
+    terminal_writestring(" MB, ");
+    terminal_write_dec(port->num_slots);
+    terminal_writestring(port->ncq ? " NCQ slots\n" : " slots\n");
+    return 0;
+}
+
+static int ahci_probe(pci_device_t* dev, const pci_device_id_t* id) {
+    (void)id;
+
+    if (dev->prog_if != AHCI_PROG_IF || ahci_hba.pci) {
+        return -1; // IDE-mode SATA, or a second HBA
+    }
+
+    pci_enable_device(dev);
+    pci_enable_bus_master(dev);
+
+    ahci_hba_t* hba = &ahci_hba;
+    hba->abar = (volatile uint8_t*)pci_map_bar(dev, AHCI_ABAR);
+    if (!hba->abar) {
+        return -1;
+    }
+    hba->pci = dev;
+    dev->driver_data = hba;
+
+    ahci_write(hba->abar, AHCI_GHC, ahci_read(hba->abar, AHCI_GHC) | AHCI_GHC_AE);
+    hba->cap = ahci_read(hba->abar, AHCI_CAP);
+
+    uint32_t implemented = ahci_read(hba->abar, AHCI_PI);
+    uint32_t disk_ports = 0;
+    for (uint8_t i = 0; i < AHCI_MAX_PORTS; i++) {
+        if ((implemented & (1u << i)) && ahci_port_init(hba, i) == 0) {
+            disk_ports |= 1u << i;
+        }
+    }
+
+    if (!disk_ports) {
+        hba->pci = NULL;
+        return -1;
+    }
+
+    // Interrupts: per-port completion events, coalesced by the HBA when supported
+    if (pci_register_irq(dev, ahci_irq) == 0) {
+        if (hba->cap & AHCI_CAP_CCCS) {
+            ahci_write(hba->abar, AHCI_CCC_CTL, 0);
+            ahci_write(hba->abar, AHCI_CCC_PORTS, disk_ports);
+            ahci_write(hba->abar, AHCI_CCC_CTL,
+                       (AHCI_CCC_TIMEOUT_MS << AHCI_CCC_TV_SHIFT) |
+                       (AHCI_CCC_COMPLETIONS << AHCI_CCC_CC_SHIFT) | AHCI_CCC_EN);
+            hba->ccc_int = (ahci_read(hba->abar, AHCI_CCC_CTL) >> 3) & 0x1F;
+            hba->coalescing = 1;
+        }
+
+        for (uint8_t i = 0; i < AHCI_MAX_PORTS; i++) {
+            if (hba->ports[i]) {
+                ahci_write(hba->ports[i]->regs, AHCI_PxIE,
+                           AHCI_PxIS_DHRS | AHCI_PxIS_SDBS | AHCI_PxIS_TFES);
+            }
+        }
+        ahci_write(hba->abar, AHCI_IS, 0xFFFFFFFF);
+        ahci_write(hba->abar, AHCI_GHC, ahci_read(hba->abar, AHCI_GHC) | AHCI_GHC_IE);
+    }
+
+    if (hba->coalescing) {
+        terminal_writestring("ahci: command completion coalescing enabled\n");
+    }
+    return 0;
+}
+
+void ahci_init(void) {
+    pci_register_driver(&ahci_driver);
+}
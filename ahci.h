@@ -0,0 +1,111 @@
+#ifndef AHCI_H
+#define AHCI_H
+
+#include <stdint.h>
+
+// Limits
+#define AHCI_MAX_PORTS   32
+#define AHCI_MAX_DISKS   4
+#define AHCI_MAX_SLOTS   32
+#define AHCI_MAX_PRDS    32     // Per command table
+
+// PCI identification
+#define AHCI_CLASS_ID    0x0106 // Mass storage / SATA
+#define AHCI_PROG_IF     0x01
+#define AHCI_ABAR        5
+
+// HBA (generic host control) registers
+#define AHCI_CAP         0x00
+#define AHCI_GHC         0x04
+#define AHCI_IS          0x08
+#define AHCI_PI          0x0C
+#define AHCI_VS          0x10
+#define AHCI_CCC_CTL     0x14
+#define AHCI_CCC_PORTS   0x18
+
+#define AHCI_CAP_NCS_SHIFT 8
+#define AHCI_CAP_CCCS    (1u << 7)
+#define AHCI_CAP_SNCQ    (1u << 30)
+#define AHCI_GHC_IE      (1u << 1)
+#define AHCI_GHC_AE      (1u << 31)
+
+// Command completion coalescing (CCC_CTL fields)
+#define AHCI_CCC_EN            0x01
+#define AHCI_CCC_CC_SHIFT      8
+#define AHCI_CCC_TV_SHIFT      16
+#define AHCI_CCC_COMPLETIONS   8    // Interrupt after this many completions...
+#define AHCI_CCC_TIMEOUT_MS    1    // ...or this long after the first one
+
+// Port registers (offset from 0x100 + port * 0x80)
+#define AHCI_PORT_BASE   0x100
+#define AHCI_PORT_SIZE   0x80
+#define AHCI_PxCLB       0x00
+#define AHCI_PxCLBU      0x04
+#define AHCI_PxFB        0x08
+#define AHCI_PxFBU       0x0C
+#define AHCI_PxIS        0x10
+#define AHCI_PxIE        0x14
+#define AHCI_PxCMD       0x18
+#define AHCI_PxTFD       0x20
+#define AHCI_PxSIG       0x24
+#define AHCI_PxSSTS      0x28
+#define AHCI_PxSERR      0x30
+#define AHCI_PxSACT      0x34
+#define AHCI_PxCI        0x38
+
+#define AHCI_PxCMD_ST    (1u << 0)
+#define AHCI_PxCMD_FRE   (1u << 4)
+#define AHCI_PxCMD_FR    (1u << 14)
+#define AHCI_PxCMD_CR    (1u << 15)
+
+#define AHCI_PxIS_DHRS   (1u << 0)  // D2H register FIS (non-queued completion)
+#define AHCI_PxIS_SDBS   (1u << 3)  // Set device bits FIS (NCQ completion)
+#define AHCI_PxIS_TFES   (1u << 30) // Task file error
+
+#define AHCI_TFD_BSY     0x80
+#define AHCI_TFD_DRQ     0x08
+#define AHCI_TFD_ERR     0x01
+
+#define AHCI_SIG_ATA     0x00000101
+#define AHCI_SSTS_DET_PRESENT 3
+
+// FIS types and ATA commands
+#define FIS_TYPE_REG_H2D          0x27
+#define ATA_CMD_READ_DMA_EXT      0x25
+#define ATA_CMD_WRITE_DMA_EXT     0x35
+#define ATA_CMD_READ_FPDMA_QUEUED 0x60
+#define ATA_CMD_WRITE_FPDMA_QUEUED 0x61
+#define ATA_CMD_IDENTIFY_DEVICE   0xEC
+
+// Command header (one of 32 in the command list)
+typedef struct ahci_cmd_header {
+    uint16_t flags;         // CFL[4:0], A, W, P, R, B, C, PMP[15:12]
+    uint16_t prdtl;         // Number of PRD entries
+    volatile uint32_t prdbc;// Bytes transferred
+    uint32_t ctba;          // Command table base (128-byte aligned)
+    uint32_t ctbau;
+    uint32_t reserved[4];
+} __attribute__((packed)) ahci_cmd_header_t;
+
+#define AHCI_CMD_WRITE   (1u << 6)
+
+// Physical region descriptor
+typedef struct ahci_prd {
+    uint32_t dba;
+    uint32_t dbau;
+    uint32_t reserved;
+    uint32_t dbc;           // Byte count - 1, bit 31 = interrupt on completion
+} __attribute__((packed)) ahci_prd_t;
+
+// Command table
+typedef struct ahci_cmd_table {
+    uint8_t cfis[64];
+    uint8_t acmd[16];
+    uint8_t reserved[48];
+    ahci_prd_t prdt[AHCI_MAX_PRDS];
+} __attribute__((packed)) ahci_cmd_table_t;
+
+// Register the driver with the PCI layer
+void ahci_init(void);
+
+#endif // AHCI_H
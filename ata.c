@@ -0,0 +1,252 @@
+#include <stddef.h>
+#include "ata.h"
+#include "blkdev.h"
+#include "pci.h"
+#include "mm.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+
+// I/O port functions
+static inline void outb(uint16_t port, uint8_t val) {
+    __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t ret;
+    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void insw(uint16_t port, void* buffer, uint32_t count) {
+    __asm__ volatile ("rep insw" : "+D"(buffer), "+c"(count) : "d"(port) : "memory");
+}
+
+static inline void outsw(uint16_t port, const void* buffer, uint32_t count) {
+    __asm__ volatile ("rep outsw" : "+S"(buffer), "+c"(count) : "d"(port));
+}
+
+// One drive on a channel
+typedef struct ata_drive {
+    blkdev_t blk;
+    uint16_t io_base;
+    uint16_t ctrl_base;
+    uint8_t slave;
+} ata_drive_t;
+
+static ata_drive_t ata_drives[ATA_MAX_DRIVES];
+static int ata_num_drives = 0;
+
+static int ata_probe(pci_device_t* dev, const pci_device_id_t* id);
+
+static const pci_device_id_t ata_ids[] = {
+    {PCI_ANY_ID, PCI_ANY_ID, 0x0101}, // Any IDE controller
+    {0, 0, 0}
+};
+
+static pci_driver_t ata_driver = {
+    "ata-pio",
+    ata_ids,
+    ata_probe
+};
+
+// 400ns delay by reading the alternate status register
+static void ata_delay(ata_drive_t* drive) {
+    for (int i = 0; i < 4; i++) {
+        inb(drive->ctrl_base);
+    }
+}
+
+// Wait for BSY to clear, then for DRQ (or an error)
+static int ata_wait_drq(ata_drive_t* drive) {
+    for (uint32_t timeout = 0; timeout < 1000000; timeout++) {
+        uint8_t status = inb(drive->io_base + ATA_REG_STATUS);
+        if (status & ATA_SR_BSY) {
+            continue;
+        }
+        if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+            return -1;
+        }
+        if (status & ATA_SR_DRQ) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int ata_wait_idle(ata_drive_t* drive) {
+    for (uint32_t timeout = 0; timeout < 1000000; timeout++) {
+        uint8_t status = inb(drive->io_base + ATA_REG_STATUS);
+        if (!(status & ATA_SR_BSY)) {
+            return (status & (ATA_SR_ERR | ATA_SR_DF)) ? -1 : 0;
+        }
+    }
+    return -1;
+}
+
+// Issue an LBA28 command for up to 256 sectors
+static void ata_issue(ata_drive_t* drive, uint8_t command, uint32_t lba, uint32_t count) {
+    outb(drive->io_base + ATA_REG_DRIVE, 0xE0 | (drive->slave << 4) | ((lba >> 24) & 0x0F));
+    ata_delay(drive);
+    outb(drive->io_base + ATA_REG_SECCOUNT, count & 0xFF); // 0 means 256
+    outb(drive->io_base + ATA_REG_LBA_LOW, lba & 0xFF);
+    outb(drive->io_base + ATA_REG_LBA_MID, (lba >> 8) & 0xFF);
+    outb(drive->io_base + ATA_REG_LBA_HIGH, (lba >> 16) & 0xFF);
+    outb(drive->io_base + ATA_REG_COMMAND, command);
+    drive->blk.notifications++;
+}
+
+// PIO transfers run to completion inside submit
+static int ata_submit(blkdev_t* blk, blk_request_t* req) {
+    ata_drive_t* drive = (ata_drive_t*)blk->driver_data;
+    uint8_t* buffer = (uint8_t*)req->buffer;
+    uint32_t lba = req->sector;
+    uint32_t remaining = req->count;
+    int status = BLK_STATUS_OK;
+
+    while (remaining > 0 && status == BLK_STATUS_OK) {
+        uint32_t chunk = remaining > 256 ? 256 : remaining;
+
+        if (ata_wait_idle(drive) != 0) {
+            status = BLK_STATUS_ERROR;
+            break;
+        }
+        ata_issue(drive, req->op == BLK_OP_WRITE ? ATA_CMD_WRITE_PIO : ATA_CMD_READ_PIO, lba, chunk);
+
+        for (uint32_t i = 0; i < chunk; i++) {
+            if (ata_wait_drq(drive) != 0) {
+                status = BLK_STATUS_ERROR;
+                break;
+            }
+            if (req->op == BLK_OP_WRITE) {
+                outsw(drive->io_base + ATA_REG_DATA, buffer, BLKDEV_SECTOR_SIZE / 2);
+            } else {
+                insw(drive->io_base + ATA_REG_DATA, buffer, BLKDEV_SECTOR_SIZE / 2);
+            }
+            buffer += BLKDEV_SECTOR_SIZE;
+        }
+
+        lba += chunk;
+        remaining -= chunk;
+    }
+
+    if (req->op == BLK_OP_WRITE && status == BLK_STATUS_OK) {
+        outb(drive->io_base + ATA_REG_COMMAND, ATA_CMD_CACHE_FLUSH);
+        if (ata_wait_idle(drive) != 0) {
+            status = BLK_STATUS_ERROR;
+        }
+    }
+
+    req->status = status;
+    if (req->complete) {
+        req->complete(req);
+    }
+    return 0;
+}
+
+static int ata_poll(blkdev_t* blk) {
+    (void)blk;
+    return 0; // Everything completes synchronously
+}
+
+static const blkdev_ops_t ata_ops = {
+    ata_submit,
+    NULL,
+    ata_poll
+};
+
+// IDENTIFY a drive; returns its LBA28 sector count or 0 if absent/ATAPI
+static uint32_t ata_identify(ata_drive_t* drive) {
+    uint16_t identify[256];
+
+    outb(drive->io_base + ATA_REG_DRIVE, 0xA0 | (drive->slave << 4));
+    ata_delay(drive);
+    outb(drive->io_base + ATA_REG_SECCOUNT, 0);
+    outb(drive->io_base + ATA_REG_LBA_LOW, 0);
+    outb(drive->io_base + ATA_REG_LBA_MID, 0);
+    outb(drive->io_base + ATA_REG_LBA_HIGH, 0);
+    outb(drive->io_base + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+
+    uint8_t status = inb(drive->io_base + ATA_REG_STATUS);
+    if (status == 0 || status == 0xFF) {
+        return 0; // No drive
+    }
+
+    for (uint32_t timeout = 0; (status & ATA_SR_BSY) && timeout < 1000000; timeout++) {
+        status = inb(drive->io_base + ATA_REG_STATUS);
+    }
+
+    // ATAPI and SATA devices report a signature instead of data
+    if (inb(drive->io_base + ATA_REG_LBA_MID) || inb(drive->io_base + ATA_REG_LBA_HIGH)) {
+        return 0;
+    }
+
+    if (ata_wait_drq(drive) != 0) {
+        return 0;
+    }
+    insw(drive->io_base + ATA_REG_DATA, identify, 256);
+
+    return identify[60] | ((uint32_t)identify[61] << 16);
+}
+
+static void ata_probe_channel(uint16_t io_base, uint16_t ctrl_base) {
+    for (uint8_t slave = 0; slave < 2 && ata_num_drives < ATA_MAX_DRIVES; slave++) {
+        ata_drive_t* drive = &ata_drives[ata_num_drives];
+        memset(drive, 0, sizeof(ata_drive_t));
+        drive->io_base = io_base;
+        drive->ctrl_base = ctrl_base;
+        drive->slave = slave;
+
+        // Polled operation: keep nIEN set
+        outb(ctrl_base, 0x02);
+
+        uint32_t sectors = ata_identify(drive);
+        if (sectors == 0) {
+            continue;
+        }
+
+        drive->blk.name[0] = 'h';
+        drive->blk.name[1] = 'd';
+        drive->blk.name[2] = 'a' + ((io_base == ATA_PRIMARY_IO ? 0 : 2) + slave);
+        drive->blk.name[3] = '\0';
+        drive->blk.driver = "ata-pio";
+        drive->blk.sector_count = sectors;
+        drive->blk.queue_depth = 1;
+        drive->blk.ops = &ata_ops;
+        drive->blk.driver_data = drive;
+
+        if (blkdev_register(&drive->blk) == 0) {
+            ata_num_drives++;
+            terminal_writestring(drive->blk.name);
+            terminal_writestring(": ATA PIO, ");
+            terminal_write_dec(sectors / 2048);
+            terminal_writestring(" MB\n");
+        }
+    }
+}
+
+static int ata_probe(pci_device_t* dev, const pci_device_id_t* id) {
+    (void)id;
+
+    pci_enable_device(dev);
+
+    // prog_if bits 0 and 2 select native mode for each channel
+    if ((dev->prog_if & 0x01) && dev->bars[0].is_io && dev->bars[1].is_io) {
+        ata_probe_channel(dev->bars[0].base, dev->bars[1].base + 2);
+    } else {
+        ata_probe_channel(ATA_PRIMARY_IO, ATA_PRIMARY_CTRL);
+    }
+
+    if ((dev->prog_if & 0x04) && dev->bars[2].is_io && dev->bars[3].is_io) {
+        ata_probe_channel(dev->bars[2].base, dev->bars[3].base + 2);
+    } else {
+        ata_probe_channel(ATA_SECONDARY_IO, ATA_SECONDARY_CTRL);
+    }
+
+    return ata_num_drives > 0 ? 0 : -1;
+}
+
+void ata_init(void) {
+    pci_register_driver(&ata_driver);
+}
@@ -0,0 +1,40 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include <stdint.h>
+
+// Legacy (compatibility mode) channel ports
+#define ATA_PRIMARY_IO      0x1F0
+#define ATA_PRIMARY_CTRL    0x3F6
+#define ATA_SECONDARY_IO    0x170
+#define ATA_SECONDARY_CTRL  0x376
+
+// Task file register offsets
+#define ATA_REG_DATA        0x00
+#define ATA_REG_ERROR       0x01
+#define ATA_REG_SECCOUNT    0x02
+#define ATA_REG_LBA_LOW     0x03
+#define ATA_REG_LBA_MID     0x04
+#define ATA_REG_LBA_HIGH    0x05
+#define ATA_REG_DRIVE       0x06
+#define ATA_REG_STATUS      0x07
+#define ATA_REG_COMMAND     0x07
+
+// Status bits
+#define ATA_SR_ERR          0x01
+#define ATA_SR_DRQ          0x08
+#define ATA_SR_DF           0x20
+#define ATA_SR_BSY          0x80
+
+// Commands
+#define ATA_CMD_READ_PIO    0x20
+#define ATA_CMD_WRITE_PIO   0x30
+#define ATA_CMD_CACHE_FLUSH 0xE7
+#define ATA_CMD_IDENTIFY    0xEC
+
+#define ATA_MAX_DRIVES 4
+
+// Register the driver with the PCI layer
+void ata_init(void);
+
+#endif // ATA_H
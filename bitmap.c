@@ -0,0 +1,316 @@
+#include "bitmap.h"
+#include "mm.h"
+#include "ktime.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+
+#define BITMAP_FULL     0xFFFFFFFFu
+
+int bitmap_init(bitmap_t* bm, uint32_t* storage, uint32_t nbits) {
+    if (!storage || nbits == 0) {
+        return -1;
+    }
+
+    // Lay the levels out back to back until one word covers the level below
+    uint32_t bits = nbits;
+    uint32_t levels = 0;
+    while (1) {
+        if (levels == BITMAP_MAX_LEVELS) {
+            return -1;
+        }
+        uint32_t words = (bits + 31) / 32;
+        bm->level[levels] = storage;
+        bm->level_bits[levels] = bits;
+        levels++;
+
+        // Padding past the last bit reads as allocated so it is never found
+        // and a word with only padding left counts as full
+        for (uint32_t w = 0; w < words; w++) {
+            storage[w] = 0;
+        }
+        if (bits % 32) {
+            storage[words - 1] = BITMAP_FULL << (bits % 32);
+        }
+        storage += words;
+        if (words == 1) {
+            break;
+        }
+        bits = words;
+    }
+    bm->levels = levels;
+    bm->nbits = nbits;
+    bm->free = nbits;
+    bm->hint = 0;
+    return 0;
+}
+
+// Set a bit and mark its word full in the level above if that filled it
+static void bitmap_mark(bitmap_t* bm, uint32_t level, uint32_t bit) {
+    while (1) {
+        uint32_t* word = &bm->level[level][bit / 32];
+        *word |= 1u << (bit % 32);
+        if (*word != BITMAP_FULL || level + 1 == bm->levels) {
+            return;
+        }
+        level++;
+        bit /= 32;
+    }
+}
+
+static void bitmap_unmark(bitmap_t* bm, uint32_t level, uint32_t bit) {
+    while (1) {
+        uint32_t* word = &bm->level[level][bit / 32];
+        int was_full = *word == BITMAP_FULL;
+        *word &= ~(1u << (bit % 32));
+        if (!was_full || level + 1 == bm->levels) {
+            return;
+        }
+        level++;
+        bit /= 32;
+    }
+}
+
+// First clear bit at or after pos in a level: bsf within the word, and if
+// the rest of it is full, ask the level above for the next word with room
+static int32_t bitmap_find_zero(const bitmap_t* bm, uint32_t level, uint32_t pos) {
+    if (pos >= bm->level_bits[level]) {
+        return -1;
+    }
+    uint32_t w = pos / 32;
+    uint32_t word = ~bm->level[level][w] & (BITMAP_FULL << (pos % 32));
+    if (word) {
+        return (int32_t)(w * 32 + bitmap_bsf(word));
+    }
+    if (level + 1 == bm->levels) {
+        return -1;
+    }
+    int32_t next = bitmap_find_zero(bm, level + 1, w + 1);
+    if (next < 0) {
+        return -1;
+    }
+    return next * 32 + (int32_t)bitmap_bsf(~bm->level[level][next]);
+}
+
+// First set bit in [start, end), or end. There is no summary of empty
+// words, so this walks words; callers bound it by the run they need.
+static uint32_t bitmap_find_one(const bitmap_t* bm, uint32_t start, uint32_t end) {
+    uint32_t w = start / 32;
+    uint32_t word = bm->level[0][w] & (BITMAP_FULL << (start % 32));
+    while (!word) {
+        w++;
+        if (w * 32 >= end) {
+            return end;
+        }
+        word = bm->level[0][w];
+    }
+    uint32_t bit = w * 32 + bitmap_bsf(word);
+    return bit < end ? bit : end;
+}
+
+int32_t bitmap_find_free(const bitmap_t* bm, uint32_t start) {
+    return bitmap_find_zero(bm, 0, start);
+}
+
+int32_t bitmap_find_set(const bitmap_t* bm, uint32_t start) {
+    if (start >= bm->nbits) {
+        return -1;
+    }
+    uint32_t bit = bitmap_find_one(bm, start, bm->nbits);
+    return bit < bm->nbits ? (int32_t)bit : -1;
+}
+
+int32_t bitmap_last_set(const bitmap_t* bm) {
+    uint32_t w = (bm->nbits + 31) / 32;
+    uint32_t word = bm->level[0][w - 1];
+    if (bm->nbits % 32) {
+        word &= ~(BITMAP_FULL << (bm->nbits % 32));
+    }
+    while (1) {
+        if (word) {
+            return (int32_t)((w - 1) * 32 + bitmap_bsr(word));
+        }
+        w--;
+        if (w == 0) {
+            return -1;
+        }
+        word = bm->level[0][w - 1];
+    }
+}
+
+void bitmap_set(bitmap_t* bm, uint32_t bit) {
+    if (bit < bm->nbits && !bitmap_test(bm, bit)) {
+        bitmap_mark(bm, 0, bit);
+        bm->free--;
+    }
+}
+
+void bitmap_clear(bitmap_t* bm, uint32_t bit) {
+    if (bit < bm->nbits && bitmap_test(bm, bit)) {
+        bitmap_unmark(bm, 0, bit);
+        bm->free++;
+    }
+}
+
+void bitmap_free_range(bitmap_t* bm, uint32_t first, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        bitmap_clear(bm, first + i);
+    }
+}
+
+int32_t bitmap_alloc(bitmap_t* bm) {
+    int32_t bit = bitmap_find_zero(bm, 0, bm->hint);
+    if (bit < 0) {
+        bit = bitmap_find_zero(bm, 0, 0);
+        if (bit < 0) {
+            return -1;
+        }
+    }
+    bitmap_set(bm, (uint32_t)bit);
+    bm->hint = (uint32_t)bit + 1 < bm->nbits ? (uint32_t)bit + 1 : 0;
+    return bit;
+}
+
+int32_t bitmap_alloc_from(bitmap_t* bm, uint32_t start) {
+    int32_t bit = bitmap_find_zero(bm, 0, start);
+    if (bit >= 0) {
+        bitmap_set(bm, (uint32_t)bit);
+    }
+    return bit;
+}
+
+// First aligned run of count clear bits at or after start: jump to the next
+// clear bit, round up, and restart past the set bit that cut the run short
+static int32_t bitmap_find_run(const bitmap_t* bm, uint32_t start, uint32_t count,
+                               uint32_t align) {
+    uint32_t pos = start;
+    while (1) {
+        int32_t zero = bitmap_find_zero(bm, 0, pos);
+        if (zero < 0) {
+            return -1;
+        }
+        uint32_t first = ((uint32_t)zero + align - 1) & ~(align - 1);
+        if (first >= bm->nbits || bm->nbits - first < count) {
+            return -1;
+        }
+        uint32_t end = bitmap_find_one(bm, first, first + count);
+        if (end == first + count) {
+            return (int32_t)first;
+        }
+        pos = end + 1;
+    }
+}
+
+int32_t bitmap_alloc_range(bitmap_t* bm, uint32_t count, uint32_t align) {
+    if (count == 0 || count > bm->free || align == 0 || (align & (align - 1))) {
+        return -1;
+    }
+
+    // From the hint first; the retry from 0 also finds runs across the hint
+    int32_t first = bitmap_find_run(bm, bm->hint, count, align);
+    if (first < 0 && bm->hint) {
+        first = bitmap_find_run(bm, 0, count, align);
+    }
+    if (first < 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        bitmap_mark(bm, 0, (uint32_t)first + i);
+    }
+    bm->free -= count;
+    bm->hint = (uint32_t)first + count < bm->nbits ? (uint32_t)first + count : 0;
+    return first;
+}
+
+// Benchmark
+
+void bitmap_benchmark(uint32_t nbits) {
+    uint32_t holes = nbits / 256 ? nbits / 256 : 1;
+    uint32_t* storage = (uint32_t*)kcalloc(BITMAP_STORAGE_WORDS(nbits), sizeof(uint32_t));
+    uint32_t* found = (uint32_t*)kcalloc(holes, sizeof(uint32_t));
+    bitmap_t bm;
+    if (!storage || !found || bitmap_init(&bm, storage, nbits) != 0) {
+        terminal_writestring("Out of memory\n");
+        kfree(storage);
+        kfree(found);
+        return;
+    }
+
+    // A nearly full map: every bit taken but a few scattered ones
+    for (uint32_t i = 0; i < nbits; i++) {
+        bitmap_set(&bm, i);
+    }
+    uint32_t seed = 12345;
+    for (uint32_t i = 0; i < holes; i++) {
+        seed = seed * 1103515245u + 12345u;
+        bitmap_clear(&bm, seed % nbits);
+    }
+    uint32_t free = bm.free;
+
+    // Refill the holes lowest first, three ways, from the same state
+    uint32_t start = (uint32_t)ktime_get_us();
+    for (uint32_t i = 0; i < free; i++) {
+        uint32_t bit = 0;
+        while (bitmap_test(&bm, bit)) {
+            bit++;
+        }
+        bitmap_set(&bm, bit);
+        found[i] = bit;
+    }
+    uint32_t linear_us = (uint32_t)ktime_get_us() - start;
+    int ok = bm.free == 0;
+
+    for (uint32_t i = 0; i < free; i++) {
+        bitmap_clear(&bm, found[i]);
+    }
+    start = (uint32_t)ktime_get_us();
+    for (uint32_t i = 0; i < free; i++) {
+        uint32_t w = 0;
+        while (bm.level[0][w] == BITMAP_FULL) {
+            w++;
+        }
+        uint32_t bit = w * 32 + bitmap_bsf(~bm.level[0][w]);
+        bitmap_set(&bm, bit);
+        ok &= bit == found[i];
+    }
+    uint32_t word_us = (uint32_t)ktime_get_us() - start;
+
+    for (uint32_t i = 0; i < free; i++) {
+        bitmap_clear(&bm, found[i]);
+    }
+    start = (uint32_t)ktime_get_us();
+    for (uint32_t i = 0; i < free; i++) {
+        ok &= bitmap_alloc_from(&bm, 0) == (int32_t)found[i];
+    }
+    uint32_t tree_us = (uint32_t)ktime_get_us() - start;
+    ok &= bm.free == 0 && bitmap_alloc(&bm) == -1;
+
+    // Aligned runs: free an unaligned stretch and take the aligned part
+    uint32_t run = nbits >= 256 ? 64 : 8;
+    bitmap_free_range(&bm, nbits / 2 + 3, run * 2);
+    int32_t first = bitmap_alloc_range(&bm, run, run);
+    ok &= first >= 0 && (uint32_t)first % run == 0 &&
+          (uint32_t)first >= nbits / 2 + 3 && bitmap_last_set(&bm) == (int32_t)nbits - 1;
+
+    terminal_writestring("Refilled ");
+    terminal_write_dec(free);
+    terminal_writestring(" holes in ");
+    terminal_write_dec(nbits);
+    terminal_writestring(" bits\n");
+    terminal_writestring("  bit by bit:      ");
+    terminal_write_dec(linear_us);
+    terminal_writestring(" us\n");
+    terminal_writestring("  word and bsf:    ");
+    terminal_write_dec(word_us);
+    terminal_writestring(" us\n");
+    terminal_writestring("  summary levels:  ");
+    terminal_write_dec(tree_us);
+    terminal_writestring(" us (");
+    terminal_write_dec(bm.levels);
+    terminal_writestring(" levels)\n");
+    terminal_writestring(ok ? "Result: OK\n" : "Result: FAILED\n");
+
+    kfree(storage);
+    kfree(found);
+}
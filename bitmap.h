@@ -0,0 +1,67 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdint.h>
+
+// Bitmap allocator for IDs and slots (1 = allocated). Above the bit level
+// each summary level has one bit per word of the level below, set when
+// that word is full, so a free bit is found by descending from a single
+// top word with bsf at every level instead of scanning the whole map.
+#define BITMAP_MAX_LEVELS   4       // 32^4 = 1M bits
+
+// Words of storage for an n-bit map and all of its summary levels
+#define BITMAP_STORAGE_WORDS(n) \
+    (((n) + 31) / 32 + ((n) + 1023) / 1024 + ((n) + 32767) / 32768 + 1)
+
+typedef struct bitmap {
+    uint32_t* level[BITMAP_MAX_LEVELS];    // level[0] holds the bits themselves
+    uint32_t level_bits[BITMAP_MAX_LEVELS];
+    uint32_t levels;
+    uint32_t nbits;
+    uint32_t free;
+    uint32_t hint;                         // Next-fit position
+} bitmap_t;
+
+// Lowest and highest set bit of a nonzero word
+static inline uint32_t bitmap_bsf(uint32_t word) {
+    uint32_t bit;
+    __asm__ ("bsfl %1, %0" : "=r"(bit) : "rm"(word) : "cc");
+    return bit;
+}
+
+static inline uint32_t bitmap_bsr(uint32_t word) {
+    uint32_t bit;
+    __asm__ ("bsrl %1, %0" : "=r"(bit) : "rm"(word) : "cc");
+    return bit;
+}
+
+// storage must hold BITMAP_STORAGE_WORDS(nbits) words; every bit starts free
+int bitmap_init(bitmap_t* bm, uint32_t* storage, uint32_t nbits);
+
+// Next-fit from the hint, wrapping once; -1 when full
+int32_t bitmap_alloc(bitmap_t* bm);
+
+// Lowest free bit at or after start (no wrap); -1 if none
+int32_t bitmap_alloc_from(bitmap_t* bm, uint32_t start);
+
+// count consecutive free bits starting at a multiple of align (a power of
+// two), next-fit from the hint; -1 if no such run
+int32_t bitmap_alloc_range(bitmap_t* bm, uint32_t count, uint32_t align);
+
+void bitmap_set(bitmap_t* bm, uint32_t bit);
+void bitmap_clear(bitmap_t* bm, uint32_t bit);
+void bitmap_free_range(bitmap_t* bm, uint32_t first, uint32_t count);
+
+static inline int bitmap_test(const bitmap_t* bm, uint32_t bit) {
+    return (bm->level[0][bit / 32] >> (bit % 32)) & 1;
+}
+
+// Searches without allocating; -1 if none
+int32_t bitmap_find_free(const bitmap_t* bm, uint32_t start);
+int32_t bitmap_find_set(const bitmap_t* bm, uint32_t start);
+int32_t bitmap_last_set(const bitmap_t* bm);
+
+// Allocate from a nearly full map, against a bit-by-bit scan
+void bitmap_benchmark(uint32_t nbits);
+
+#endif // BITMAP_H
@@ -0,0 +1,256 @@
+#include "blkdev.h"
+#include "mm.h"
+#include "ktime.h"
+#include "klib.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_putchar(char c);
+extern void terminal_write_dec(uint32_t value);
+extern void terminal_setcolor(uint8_t color);
+extern uint8_t vga_entry_color(int fg, int bg);
+
+// VGA colors
+#define VGA_COLOR_BLACK 0
+#define VGA_COLOR_WHITE 15
+#define VGA_COLOR_LIGHT_CYAN 11
+#define VGA_COLOR_LIGHT_RED 12
+
+// Benchmark limits
+#define BLKDEV_BENCH_MAX_DEPTH 16
+#define BLKDEV_BENCH_SECTORS 8      // 4KB per request
+
+// Registered devices
+static blkdev_t* blkdevs[BLKDEV_MAX_DEVICES];
+static int blkdev_num_devices = 0;
+
+// Register a device with the block layer
+int blkdev_register(blkdev_t* dev) {
+    if (!dev || !dev->ops || blkdev_num_devices >= BLKDEV_MAX_DEVICES) {
+        return -1;
+    }
+
+    if (dev->queue_depth == 0) {
+        dev->queue_depth = 1;
+    }
+    dev->requests = 0;
+    dev->notifications = 0;
+    dev->interrupts = 0;
+
+    blkdevs[blkdev_num_devices++] = dev;
+    return 0;
+}
+
+int blkdev_count(void) {
+    return blkdev_num_devices;
+}
+
+blkdev_t* blkdev_get(int index) {
+    if (index < 0 || index >= blkdev_num_devices) {
+        return NULL;
+    }
+    return blkdevs[index];
+}
+
+blkdev_t* blkdev_find(const char* name) {
+    for (int i = 0; i < blkdev_num_devices; i++) {
+        if (strcmp(blkdevs[i]->name, name) == 0) {
+            return blkdevs[i];
+        }
+    }
+    return NULL;
+}
+
+// Queue a request, reaping completions while the driver queue is full
+int blkdev_submit(blkdev_t* dev, blk_request_t* req) {
+    // Written so that a range ending past 2^32 sectors cannot wrap around
+    if (!dev || !req || req->count == 0 || req->count > dev->sector_count ||
+        req->sector > dev->sector_count - req->count) {
+        return -1;
+    }
+
+    req->status = BLK_STATUS_PENDING;
+    req->next = NULL;
+
+    while (dev->ops->submit(dev, req) != 0) {
+        // Make sure the device sees what is queued, then make room
+        blkdev_unplug(dev);
+        dev->ops->poll(dev);
+    }
+
+    dev->requests++;
+    return 0;
+}
+
+// Kick the device once for the whole batch queued so far
+void blkdev_unplug(blkdev_t* dev) {
+    if (dev->ops->unplug) {
+        dev->ops->unplug(dev);
+    }
+}
+
+int blkdev_poll(blkdev_t* dev) {
+    return dev->ops->poll(dev);
+}
+
+// Wait for a single request to finish
+int blkdev_wait(blkdev_t* dev, blk_request_t* req) {
+    blkdev_unplug(dev);
+    while (req->status == BLK_STATUS_PENDING) {
+        dev->ops->poll(dev);
+    }
+    return req->status;
+}
+
+int blkdev_read(blkdev_t* dev, uint32_t sector, uint32_t count, void* buffer) {
+    blk_request_t req;
+    memset(&req, 0, sizeof(req));
+    req.op = BLK_OP_READ;
+    req.sector = sector;
+    req.count = count;
+    req.buffer = buffer;
+
+    if (blkdev_submit(dev, &req) != 0) {
+        return -1;
+    }
+    return blkdev_wait(dev, &req);
+}
+
+int blkdev_write(blkdev_t* dev, uint32_t sector, uint32_t count, const void* buffer) {
+    blk_request_t req;
+    memset(&req, 0, sizeof(req));
+    req.op = BLK_OP_WRITE;
+    req.sector = sector;
+    req.count = count;
+    req.buffer = (void*)buffer;
+
+    if (blkdev_submit(dev, &req) != 0) {
+        return -1;
+    }
+    return blkdev_wait(dev, &req);
+}
+
+// Print registered devices
+void blkdev_print_devices(void) {
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Block Devices ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+
+    if (blkdev_num_devices == 0) {
+        terminal_writestring("No block devices found.\n");
+        return;
+    }
+
+    for (int i = 0; i < blkdev_num_devices; i++) {
+        blkdev_t* dev = blkdevs[i];
+        terminal_writestring(dev->name);
+        terminal_writestring(": ");
+        terminal_writestring(dev->driver);
+        terminal_writestring(", ");
+        terminal_write_dec(dev->sector_count / 2048);
+        terminal_writestring(" MB, queue depth ");
+        terminal_write_dec(dev->queue_depth);
+        terminal_writestring(", ");
+        terminal_write_dec(dev->requests);
+        terminal_writestring(" requests, ");
+        terminal_write_dec(dev->notifications);
+        terminal_writestring(" notifications\n");
+    }
+}
+
+static void blkdev_bench_report(const char* label, uint32_t requests, uint64_t elapsed_ns,
+                                uint32_t notifications, int errors) {
+    if (elapsed_ns == 0) {
+        elapsed_ns = 1;
+    }
+    terminal_writestring(label);
+    terminal_write_dec((uint32_t)(elapsed_ns / requests / NSEC_PER_USEC));
+    terminal_writestring(" us/req, ");
+    terminal_write_dec((uint32_t)(requests * NSEC_PER_SEC / elapsed_ns));
+    terminal_writestring(" IOPS, ");
+    terminal_write_dec(notifications);
+    terminal_writestring(" notifications");
+    if (errors) {
+        terminal_writestring(", ");
+        terminal_write_dec(errors);
+        terminal_writestring(" errors");
+    }
+    terminal_putchar('\n');
+}
+
+// Compare one-at-a-time reads with batched, deep-queue reads
+void blkdev_benchmark(blkdev_t* dev, uint32_t num_requests) {
+    uint32_t span = dev->sector_count / BLKDEV_BENCH_SECTORS;
+    if (span == 0 || num_requests == 0) {
+        return;
+    }
+
+    uint32_t depth = dev->queue_depth;
+    if (depth > BLKDEV_BENCH_MAX_DEPTH) {
+        depth = BLKDEV_BENCH_MAX_DEPTH;
+    }
+
+    blk_request_t* reqs = (blk_request_t*)kcalloc(depth, sizeof(blk_request_t));
+    uint8_t* buffers = (uint8_t*)kmalloc_aligned(depth * BLKDEV_BENCH_SECTORS * BLKDEV_SECTOR_SIZE, PAGE_SIZE);
+    if (!reqs || !buffers) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("diskbench: out of memory\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+        kfree(reqs);
+        kfree_aligned(buffers);
+        return;
+    }
+
+    terminal_writestring(dev->name);
+    terminal_writestring(" (");
+    terminal_writestring(dev->driver);
+    terminal_writestring("): ");
+    terminal_write_dec(num_requests);
+    terminal_writestring(" x 4KB reads\n");
+
+    // Synchronous: one request in flight, one notification each
+    int errors = 0;
+    uint32_t kicks = dev->notifications;
+    uint64_t start = ktime_get_ns();
+    for (uint32_t i = 0; i < num_requests; i++) {
+        uint32_t sector = (i % span) * BLKDEV_BENCH_SECTORS;
+        if (blkdev_read(dev, sector, BLKDEV_BENCH_SECTORS, buffers) != BLK_STATUS_OK) {
+            errors++;
+        }
+    }
+    blkdev_bench_report("  sync:    ", num_requests, ktime_get_ns() - start,
+                        dev->notifications - kicks, errors);
+
+    // Batched: fill the queue, notify once, then reap the batch
+    errors = 0;
+    kicks = dev->notifications;
+    start = ktime_get_ns();
+    for (uint32_t done = 0; done < num_requests; ) {
+        uint32_t batch = num_requests - done < depth ? num_requests - done : depth;
+
+        for (uint32_t j = 0; j < batch; j++) {
+            blk_request_t* req = &reqs[j];
+            memset(req, 0, sizeof(blk_request_t));
+            req->op = BLK_OP_READ;
+            req->sector = ((done + j) % span) * BLKDEV_BENCH_SECTORS;
+            req->count = BLKDEV_BENCH_SECTORS;
+            req->buffer = buffers + j * BLKDEV_BENCH_SECTORS * BLKDEV_SECTOR_SIZE;
+            if (blkdev_submit(dev, req) != 0) {
+                req->status = BLK_STATUS_ERROR;     // Never queued; counted below
+            }
+        }
+        blkdev_unplug(dev);
+
+        for (uint32_t j = 0; j < batch; j++) {
+            if (blkdev_wait(dev, &reqs[j]) != BLK_STATUS_OK) {
+                errors++;
+            }
+        }
+        done += batch;
+    }
+    blkdev_bench_report("  batched: ", num_requests, ktime_get_ns() - start,
+                        dev->notifications - kicks, errors);
+
+    kfree(reqs);
+    kfree_aligned(buffers);
+}
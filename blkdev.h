@@ -0,0 +1,83 @@
+#ifndef BLKDEV_H
+#define BLKDEV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Block layer constants
+#define BLKDEV_MAX_DEVICES 8
+#define BLKDEV_NAME_LEN 8
+#define BLKDEV_SECTOR_SIZE 512
+
+// Request status values
+#define BLK_STATUS_OK       0
+#define BLK_STATUS_ERROR   -1
+#define BLK_STATUS_PENDING  1
+
+// Request direction
+typedef enum {
+    BLK_OP_READ = 0,
+    BLK_OP_WRITE = 1
+} blk_op_t;
+
+struct blkdev;
+
+// One transfer of contiguous sectors. The caller owns the memory and must
+// keep it alive until status leaves BLK_STATUS_PENDING.
+typedef struct blk_request {
+    blk_op_t op;
+    uint32_t sector;
+    uint32_t count;                 // Number of sectors
+    void* buffer;
+    volatile int status;
+    void (*complete)(struct blk_request* req); // Optional completion callback
+    void* private_data;             // For the submitter
+    struct blk_request* next;       // For driver queues
+} blk_request_t;
+
+// Driver operations
+typedef struct blkdev_ops {
+    // Queue a request; may start it immediately. Returns -1 if the queue is full.
+    int (*submit)(struct blkdev* dev, blk_request_t* req);
+    // Notify the device of everything queued since the last call
+    void (*unplug)(struct blkdev* dev);
+    // Reap finished requests; returns how many completed
+    int (*poll)(struct blkdev* dev);
+} blkdev_ops_t;
+
+// Registered block device
+typedef struct blkdev {
+    char name[BLKDEV_NAME_LEN];
+    const char* driver;
+    uint32_t sector_count;
+    uint32_t queue_depth;           // Requests the driver accepts in flight
+    const blkdev_ops_t* ops;
+    void* driver_data;
+
+    // Statistics
+    uint32_t requests;
+    uint32_t notifications;         // Device kicks or command register writes
+    uint32_t interrupts;
+} blkdev_t;
+
+// Registry
+int blkdev_register(blkdev_t* dev);
+int blkdev_count(void);
+blkdev_t* blkdev_get(int index);
+blkdev_t* blkdev_find(const char* name);
+void blkdev_print_devices(void);
+
+// Asynchronous interface
+int blkdev_submit(blkdev_t* dev, blk_request_t* req);
+void blkdev_unplug(blkdev_t* dev);
+int blkdev_poll(blkdev_t* dev);
+int blkdev_wait(blkdev_t* dev, blk_request_t* req);
+
+// Synchronous helpers
+int blkdev_read(blkdev_t* dev, uint32_t sector, uint32_t count, void* buffer);
+int blkdev_write(blkdev_t* dev, uint32_t sector, uint32_t count, const void* buffer);
+
+// Benchmark
+void blkdev_benchmark(blkdev_t* dev, uint32_t num_requests);
+
+#endif // BLKDEV_H
@@ -34,6 +34,7 @@ stack_top:
 section .text
 global _start:function (_start.end - _start)
 extern kernel_main
+extern boot_entry_tsc
 _start:
     ; The bootloader has loaded us into 32-bit protected mode on a x86
     ; machine. Interrupts are disabled. Paging is disabled. The processor
@@ -50,6 +51,14 @@ _start:
     ; in assembly as languages such as C cannot function without a stack.
     mov esp, stack_top
 
+    ; Note the time of entry for 'boottime' (boottime.c). rdtsc overwrites
+    ; eax, which holds the multiboot magic until kernel_main takes it.
+    mov ecx, eax
+    rdtsc
+    mov [boot_entry_tsc], eax
+    mov [boot_entry_tsc + 4], edx
+    mov eax, ecx
+
     ; This is a good place to initialize crucial processor state before the
     ; high-level kernel is entered. It's best to minimize the early
     ; environment where crucial features are offline. Note that the
@@ -62,9 +71,13 @@ _start:
     ; Enter the high-level kernel. The ABI requires the stack is 16-byte
     ; aligned at the time of the call instruction (which afterwards pushes
     ; the return pointer of size 4 bytes). The stack was originally 16-byte
-    ; aligned above and we've pushed a multiple of 16 bytes to the stack
-    ; since (pushed 0 bytes so far), so the alignment has thus been preserved
-    ; and the call is well defined.
+    ; aligned above; we pad by 8 bytes and push the two 4-byte arguments,
+    ; kernel_main(magic, multiboot info) from eax and ebx as the bootloader
+    ; left them, so the alignment has thus been preserved and the call is
+    ; well defined.
+    sub esp, 8
+    push ebx
+    push eax
     call kernel_main
 
     ; If the system has nothing more to do, put the computer into an
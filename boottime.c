@@ -0,0 +1,84 @@
+#include "boottime.h"
+#include "ktime.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_setcolor(uint8_t color);
+extern void terminal_write_dec(uint32_t value);
+
+// VGA colors
+#define VGA_COLOR_BLACK         0
+#define VGA_COLOR_LIGHT_CYAN    11
+#define VGA_COLOR_WHITE         15
+
+static inline uint8_t vga_entry_color(uint8_t fg, uint8_t bg) {
+    return fg | bg << 4;
+}
+
+// Both written before kernel_main, with BSS already clear
+boot_image_info_t boot_image;
+uint64_t boot_entry_tsc;
+
+static uint64_t boot_ready_tsc;
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+void boottime_ready(void) {
+    boot_ready_tsc = rdtsc();
+}
+
+static void boottime_line(const char* label, uint64_t cycles, const char* note) {
+    terminal_writestring(label);
+    uint64_t us = ktime_tsc_to_ns(cycles) / NSEC_PER_USEC;
+    if (us >= 10000) {
+        terminal_write_dec((uint32_t)(us / 1000));
+        terminal_writestring(" ms");
+    } else {
+        terminal_write_dec((uint32_t)us);
+        terminal_writestring(" us");
+    }
+    terminal_writestring(note);
+}
+
+void boottime_print(void) {
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Boot Time ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+
+    if (!ktime_tsc_to_ns(boot_entry_tsc)) {
+        terminal_writestring("TSC not calibrated\n");
+        return;
+    }
+
+    if (!boot_image.compressed) {
+        terminal_writestring("Image: uncompressed kernel.bin\n");
+        boottime_line("Reset to kernel entry: ", boot_entry_tsc,
+                      " (firmware, bootloader, image load)\n");
+    } else {
+        terminal_writestring("Image: LZ4, ");
+        terminal_write_dec(boot_image.compressed_size / 1024);
+        terminal_writestring(" KB compressed from ");
+        terminal_write_dec(boot_image.image_size / 1024);
+        terminal_writestring(" KB (");
+        terminal_write_dec((uint32_t)((uint64_t)boot_image.compressed_size * 100 / boot_image.image_size));
+        terminal_writestring("%)\n");
+        boottime_line("Reset to stub entry:   ", boot_image.stub_entry_tsc,
+                      " (firmware, bootloader, image load)\n");
+        boottime_line("Decompression:         ", boot_image.decompress_cycles, "");
+        uint64_t ns = ktime_tsc_to_ns(boot_image.decompress_cycles);
+        if (ns) {
+            terminal_writestring(" (");
+            terminal_write_dec((uint32_t)((uint64_t)boot_image.image_size * 1000 / ns));
+            terminal_writestring(" MB/s)");
+        }
+        terminal_writestring("\n");
+        boottime_line("Stub total:            ", boot_entry_tsc - boot_image.stub_entry_tsc,
+                      " (decompression, clearing BSS)\n");
+    }
+    boottime_line("Kernel init:           ", boot_ready_tsc - boot_entry_tsc,
+                  " (entry to shell)\n");
+}
@@ -0,0 +1,43 @@
+#ifndef BOOTTIME_H
+#define BOOTTIME_H
+
+#include <stdint.h>
+
+// Boot timing, from TSC readings taken before kernel_main. _start notes
+// when the kernel was entered; in a compressed build (CONFIG_KERNEL_LZ4)
+// the stub that unpacked it also fills in boot_image. The TSC counts from
+// reset, so the first reading covers firmware, bootloader and image load.
+
+// What lz4pack.py puts in front of the compressed kernel
+#define BOOT_LZ4_MAGIC      0x4B345A4C  // "LZ4K"
+
+typedef struct boot_lz4_header {
+    uint32_t magic;
+    uint32_t load_addr;         // Where the image starts (its lowest segment)
+    uint32_t image_size;        // Bytes of text, rodata and data to unpack
+    uint32_t bss_end;           // Zeroed from load_addr + image_size up to here
+    uint32_t entry;             // _start
+    uint32_t info_addr;         // &boot_image in the unpacked kernel
+    uint32_t compressed_size;   // LZ4 block that follows the header
+    uint32_t reserved;
+} boot_lz4_header_t;
+
+typedef struct boot_image_info {
+    uint32_t compressed;        // Set by the stub; 0 for a plain kernel.bin
+    uint32_t compressed_size;
+    uint32_t image_size;
+    uint32_t reserved;
+    uint64_t stub_entry_tsc;    // When the bootloader handed over to the stub
+    uint64_t decompress_cycles;
+} boot_image_info_t;
+
+extern boot_image_info_t boot_image;
+extern uint64_t boot_entry_tsc;     // Set by _start (boot.asm)
+
+// Note the end of kernel init (before the shell starts)
+void boottime_ready(void);
+
+// 'boottime': load, decompression and init times
+void boottime_print(void);
+
+#endif // BOOTTIME_H
@@ -0,0 +1,22 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+
+// Cache geometry and layout helpers. Structures that are scanned or
+// written on hot paths keep those fields in their first cache line and
+// check it with STATIC_ASSERT, so a field added in the wrong place fails
+// the build instead of quietly costing a miss per access.
+#define CACHE_LINE_SIZE     64
+
+// Start on a line boundary and pad to whole lines (per-CPU style data
+// that should never share a line with a neighbour)
+#define __cacheline_aligned __attribute__((aligned(CACHE_LINE_SIZE)))
+
+#define STATIC_ASSERT(cond, msg) _Static_assert(cond, msg)
+
+// The field ends within the structure's first cache line
+#define IN_FIRST_CACHE_LINE(type, field) \
+    (offsetof(type, field) + sizeof(((type*)0)->field) <= CACHE_LINE_SIZE)
+
+#endif // CACHE_H
@@ -0,0 +1,319 @@
+#include "dma.h"
+#include "mm.h"
+#include "pmm.h"
+#include "reclaim.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+extern void terminal_write_hex(uint32_t value);
+
+// Reserved pool and its page bitmap (1 = in use)
+static uint8_t dma_pool[DMA_POOL_SIZE] __attribute__((aligned(PAGE_SIZE)));
+static uint32_t dma_pool_bitmap[DMA_POOL_PAGES / 32];
+static dma_stats_t dma_stats;
+
+static int dma_page_used(uint32_t page) {
+    return (dma_pool_bitmap[page / 32] >> (page % 32)) & 1;
+}
+
+static void dma_mark_pages(uint32_t first, uint32_t count, int used) {
+    for (uint32_t page = first; page < first + count; page++) {
+        if (used) {
+            dma_pool_bitmap[page / 32] |= 1u << (page % 32);
+        } else {
+            dma_pool_bitmap[page / 32] &= ~(1u << (page % 32));
+        }
+    }
+}
+
+// First-fit search for a run of free pages; returns the first page or -1
+static int dma_find_pages(uint32_t count) {
+    uint32_t run = 0;
+    for (uint32_t page = 0; page < DMA_POOL_PAGES; page++) {
+        if (dma_page_used(page)) {
+            run = 0;
+            continue;
+        }
+        if (++run == count) {
+            return page + 1 - count;
+        }
+    }
+    return -1;
+}
+
+static void* dma_pool_alloc(size_t size) {
+    uint32_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    int first = dma_find_pages(pages);
+    if (first < 0) {
+        return NULL;
+    }
+
+    dma_mark_pages(first, pages, 1);
+    dma_stats.pool_pages_used += pages;
+    return &dma_pool[first * PAGE_SIZE];
+}
+
+static void dma_pool_free(void* ptr, size_t size) {
+    uint8_t* p = (uint8_t*)ptr;
+    if (p < dma_pool || p >= dma_pool + DMA_POOL_SIZE) {
+        return;
+    }
+
+    uint32_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    dma_mark_pages((p - dma_pool) / PAGE_SIZE, pages, 0);
+    dma_stats.pool_pages_used -= pages;
+}
+
+void dma_init(void) {
+    memset(dma_pool_bitmap, 0, sizeof(dma_pool_bitmap));
+    memset(&dma_stats, 0, sizeof(dma_stats));
+    dma_stats.pool_pages = DMA_POOL_PAGES;
+}
+
+// Frames from the physical allocator are used by their physical address
+dma_addr_t dma_virt_to_phys(const void* addr) {
+    if ((uint32_t)addr >= PMM_REGION_START) {
+        return (dma_addr_t)addr;
+    }
+    return paging_get_physical_addr(paging_get_kernel_directory(), (uint32_t)addr);
+}
+
+// Page-granular, physically contiguous and zeroed
+void* dma_alloc_coherent(size_t size, dma_addr_t* handle) {
+    if (size == 0) {
+        return NULL;
+    }
+
+    void* ptr = dma_pool_alloc(size);
+    if (!ptr) {
+        return NULL;
+    }
+
+    memset(ptr, 0, (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+    dma_stats.coherent_allocations++;
+    if (handle) {
+        *handle = dma_virt_to_phys(ptr);
+    }
+    return ptr;
+}
+
+void dma_free_coherent(void* ptr, size_t size) {
+    if (ptr) {
+        dma_pool_free(ptr, size);
+    }
+}
+
+// Add one segment, merging with the previous one when physically adjacent
+static int dma_sg_append(dma_sg_list_t* sgl, dma_addr_t phys, void* virt, uint32_t len) {
+    if (sgl->count > 0) {
+        dma_sg_entry_t* prev = &sgl->entries[sgl->count - 1];
+        if (!prev->bounce && prev->addr + prev->len == phys &&
+            (uint8_t*)prev->virt + prev->len == (uint8_t*)virt) {
+            prev->len += len;
+            return 0;
+        }
+    }
+
+    if (sgl->count == DMA_SG_MAX_ENTRIES) {
+        return -1;
+    }
+
+    dma_sg_entry_t* entry = &sgl->entries[sgl->count++];
+    entry->addr = phys;
+    entry->len = len;
+    entry->virt = virt;
+    entry->bounce = NULL;
+    return 0;
+}
+
+// Replace out-of-reach segments with pool copies
+static int dma_sg_bounce(dma_sg_list_t* sgl, uint32_t dma_mask) {
+    for (uint32_t i = 0; i < sgl->count; i++) {
+        dma_sg_entry_t* entry = &sgl->entries[i];
+        if ((uint64_t)entry->addr + entry->len - 1 <= dma_mask) {
+            continue;
+        }
+
+        void* bounce = dma_pool_alloc(entry->len);
+        if (!bounce) {
+            return -1;
+        }
+        if (sgl->direction & DMA_TO_DEVICE) {
+            memcpy(bounce, entry->virt, entry->len);
+        }
+
+        entry->bounce = bounce;
+        entry->addr = dma_virt_to_phys(bounce);
+        dma_stats.bounced_segments++;
+        dma_stats.bounced_bytes += entry->len;
+    }
+    return 0;
+}
+
+// Free the pool copies, first copying device writes back if copy_back
+static void dma_sg_release(dma_sg_list_t* sgl, int copy_back) {
+    for (uint32_t i = 0; i < sgl->count; i++) {
+        dma_sg_entry_t* entry = &sgl->entries[i];
+        if (!entry->bounce) {
+            continue;
+        }
+        if (copy_back && (sgl->direction & DMA_FROM_DEVICE)) {
+            memcpy(entry->virt, entry->bounce, entry->len);
+        }
+        dma_pool_free(entry->bounce, entry->len);
+        entry->bounce = NULL;
+    }
+    sgl->count = 0;
+}
+
+// Describe a kernel buffer as physically contiguous segments the device
+// can reach. Returns the number of segments or -1.
+int dma_map_sg(dma_sg_list_t* sgl, void* buffer, size_t length, dma_direction_t direction,
+               uint32_t dma_mask) {
+    sgl->count = 0;
+    sgl->direction = direction;
+
+    uint32_t addr = (uint32_t)buffer;
+    while (length > 0) {
+        uint32_t chunk = PAGE_SIZE - (addr & (PAGE_SIZE - 1));
+        if (chunk > length) {
+            chunk = length;
+        }
+
+        dma_addr_t phys = dma_virt_to_phys((void*)addr);
+        if (phys == 0 || dma_sg_append(sgl, phys, (void*)addr, chunk) != 0) {
+            sgl->count = 0;
+            return -1;
+        }
+
+        addr += chunk;
+        length -= chunk;
+    }
+
+    // The device never ran, so there is nothing to copy back
+    if (dma_sg_bounce(sgl, dma_mask) != 0) {
+        dma_sg_release(sgl, 0);
+        return -1;
+    }
+
+    dma_stats.sg_mappings++;
+    return sgl->count;
+}
+
+// Finish a mapping: copy bounced device writes back and release the copies
+void dma_unmap_sg(dma_sg_list_t* sgl) {
+    dma_sg_release(sgl, 1);
+}
+
+dma_stats_t dma_get_stats(void) {
+    return dma_stats;
+}
+
+void dma_print_stats(void) {
+    terminal_writestring("=== DMA Statistics ===\n");
+    terminal_writestring("Pool: 0x");
+    terminal_write_hex(dma_virt_to_phys(dma_pool));
+    terminal_writestring(", ");
+    terminal_write_dec(dma_stats.pool_pages_used);
+    terminal_writestring(" / ");
+    terminal_write_dec(dma_stats.pool_pages);
+    terminal_writestring(" pages used\n");
+
+    terminal_writestring("Coherent allocations: ");
+    terminal_write_dec(dma_stats.coherent_allocations);
+    terminal_writestring("\n");
+
+    terminal_writestring("SG mappings: ");
+    terminal_write_dec(dma_stats.sg_mappings);
+    terminal_writestring("\n");
+
+    terminal_writestring("Bounced segments: ");
+    terminal_write_dec(dma_stats.bounced_segments);
+    terminal_writestring(" (");
+    terminal_write_dec(dma_stats.bounced_bytes);
+    terminal_writestring(" bytes)\n");
+}
+
+// Take a frame above 16MB from the physical allocator, or 0 if there is
+// none to spare. The frames passed over on the way are given back.
+static uint32_t dma_alloc_high_frame(void) {
+    uint32_t skipped = 0;
+    uint32_t frame = 0;
+    while (pmm_free_frames() > reclaim_get_watermarks(RECLAIM_FRAMES).high) {
+        frame = pmm_alloc_frame();
+        if (!frame || frame > DMA_MASK_24BIT) {
+            break;
+        }
+        *(uint32_t*)frame = skipped;    // Chain the low frames through themselves
+        skipped = frame;
+        frame = 0;
+    }
+    while (skipped) {
+        uint32_t next = *(uint32_t*)skipped;
+        pmm_free_frame(skipped);
+        skipped = next;
+    }
+    return frame > DMA_MASK_24BIT ? frame : 0;
+}
+
+static void dma_test_fill(uint8_t* buffer, uint32_t len, uint8_t seed) {
+    for (uint32_t i = 0; i < len; i++) {
+        buffer[i] = (uint8_t)(seed + i * 7);
+    }
+}
+
+static int dma_test_check(const uint8_t* buffer, uint32_t len, uint8_t seed) {
+    for (uint32_t i = 0; i < len; i++) {
+        if (buffer[i] != (uint8_t)(seed + i * 7)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Bounce a buffer above 16MB for a 24-bit device both ways, then check
+// that a mapping the pool cannot hold fails without touching the buffer
+void dma_self_test(void) {
+    terminal_writestring("=== DMA Bounce Test ===\n");
+    uint32_t frame = dma_alloc_high_frame();
+    if (!frame) {
+        terminal_writestring("Skipped: no free frame above 16MB\n");
+        return;
+    }
+    uint8_t* buffer = (uint8_t*)frame;
+    dma_sg_list_t sgl;
+
+    // To the device: the bounce copy is in reach and holds the data
+    dma_test_fill(buffer, PAGE_SIZE, 1);
+    int ok = dma_map_sg(&sgl, buffer, PAGE_SIZE, DMA_TO_DEVICE, DMA_MASK_24BIT) == 1 &&
+             sgl.entries[0].bounce && sgl.entries[0].addr + PAGE_SIZE - 1 <= DMA_MASK_24BIT &&
+             dma_test_check(sgl.entries[0].bounce, PAGE_SIZE, 1) == 0;
+    dma_unmap_sg(&sgl);
+    terminal_writestring(ok ? "To device: OK\n" : "To device: FAILED\n");
+
+    // From the device: what it wrote to the bounce copy reaches the buffer
+    int from_ok = dma_map_sg(&sgl, buffer, PAGE_SIZE, DMA_FROM_DEVICE, DMA_MASK_24BIT) == 1 &&
+                  sgl.entries[0].bounce;
+    if (from_ok) {
+        dma_test_fill(sgl.entries[0].bounce, PAGE_SIZE, 2);
+    }
+    dma_unmap_sg(&sgl);
+    from_ok = from_ok && dma_test_check(buffer, PAGE_SIZE, 2) == 0;
+    terminal_writestring(from_ok ? "From device: OK\n" : "From device: FAILED\n");
+
+    // Pool exhausted: the mapping fails and the buffer keeps its contents
+    void* held[DMA_POOL_PAGES];
+    uint32_t count = 0;
+    while (count < DMA_POOL_PAGES && (held[count] = dma_pool_alloc(PAGE_SIZE)) != NULL) {
+        count++;
+    }
+    int fail_ok = dma_map_sg(&sgl, buffer, PAGE_SIZE, DMA_FROM_DEVICE, DMA_MASK_24BIT) < 0 &&
+                  dma_test_check(buffer, PAGE_SIZE, 2) == 0;
+    while (count > 0) {
+        dma_pool_free(held[--count], PAGE_SIZE);
+    }
+    terminal_writestring(fail_ok ? "Pool full: OK\n" : "Pool full: FAILED\n");
+
+    pmm_free_frame(frame);
+}
@@ -0,0 +1,74 @@
+#ifndef DMA_H
+#define DMA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Reserved pool for coherent allocations and bounce buffers. It lives in
+// the kernel image's BSS, which is loaded below 16MB.
+#define DMA_POOL_SIZE       0x00080000  // 512KB
+#define DMA_POOL_PAGES      (DMA_POOL_SIZE / 4096)
+
+// Maximum segments in one scatter-gather list
+#define DMA_SG_MAX_ENTRIES  32
+
+// Addressing limits of devices
+#define DMA_MASK_32BIT      0xFFFFFFFF
+#define DMA_MASK_24BIT      0x00FFFFFF  // ISA-style devices (below 16MB)
+
+typedef uint32_t dma_addr_t;
+
+// Transfer direction, used to decide when bounce buffers are copied
+typedef enum {
+    DMA_TO_DEVICE = 1,
+    DMA_FROM_DEVICE = 2,
+    DMA_BIDIRECTIONAL = 3
+} dma_direction_t;
+
+// One physically contiguous segment
+typedef struct dma_sg_entry {
+    dma_addr_t addr;        // Bus address handed to the device
+    uint32_t len;
+    void* virt;             // Original kernel address of the segment
+    void* bounce;           // Pool copy when the segment is out of reach (or NULL)
+} dma_sg_entry_t;
+
+typedef struct dma_sg_list {
+    uint32_t count;
+    dma_direction_t direction;
+    dma_sg_entry_t entries[DMA_SG_MAX_ENTRIES];
+} dma_sg_list_t;
+
+// DMA statistics
+typedef struct dma_stats {
+    uint32_t pool_pages;
+    uint32_t pool_pages_used;
+    uint32_t coherent_allocations;
+    uint32_t sg_mappings;
+    uint32_t bounced_segments;
+    uint32_t bounced_bytes;
+} dma_stats_t;
+
+// Initialization
+void dma_init(void);
+
+// Coherent, physically contiguous memory from the reserved pool (zeroed)
+void* dma_alloc_coherent(size_t size, dma_addr_t* handle);
+void dma_free_coherent(void* ptr, size_t size);
+
+// Scatter-gather mapping of arbitrary kernel buffers
+int dma_map_sg(dma_sg_list_t* sgl, void* buffer, size_t length, dma_direction_t direction,
+               uint32_t dma_mask);
+void dma_unmap_sg(dma_sg_list_t* sgl);
+
+// Translation helper
+dma_addr_t dma_virt_to_phys(const void* addr);
+
+// Statistics
+dma_stats_t dma_get_stats(void);
+void dma_print_stats(void);
+
+// Bounce a buffer above 16MB through the pool for a 24-bit device
+void dma_self_test(void);
+
+#endif // DMA_H
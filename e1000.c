@@ -0,0 +1,381 @@
+#include <stddef.h>
+#include "e1000.h"
+#include "pci.h"
+#include "dma.h"
+#include "net.h"
+#include "ether.h"
+#include "mm.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+
+// The device only observes memory, so a compiler barrier is enough on x86
+#define e1000_barrier() __asm__ volatile ("" : : : "memory")
+
+typedef struct e1000 {
+    netif_t netif;
+    pci_device_t* pci;
+    volatile uint8_t* regs;
+    int link_up;
+
+    // Receive ring: every descriptor owns a netbuf the device DMAs into
+    e1000_rx_desc_t* rx_ring;
+    dma_addr_t rx_ring_dma;
+    netbuf_t* rx_bufs[E1000_NUM_RX_DESC];
+    uint32_t rx_next;               // Next descriptor the device completes
+
+    // Transmit ring: frames are queued by xmit_frame and handed to the
+    // device in one tail write by flush
+    e1000_tx_desc_t* tx_ring;
+    dma_addr_t tx_ring_dma;
+    netbuf_t* tx_bufs[E1000_NUM_TX_DESC];
+    uint32_t tx_tail;               // Next free descriptor
+    uint32_t tx_clean;              // Oldest descriptor not yet reclaimed
+    uint32_t tx_doorbell;           // TDT as last written
+
+    uint32_t interrupts;
+    uint32_t tx_doorbells;
+    uint32_t tx_ring_full;
+    uint32_t rx_recycled;
+    uint32_t rx_csum_offloaded;
+} e1000_t;
+
+static e1000_t e1000_nics[E1000_MAX_NICS];
+static int e1000_num_nics = 0;
+
+static int e1000_probe(pci_device_t* dev, const pci_device_id_t* id);
+
+static const pci_device_id_t e1000_ids[] = {
+    {E1000_VENDOR_ID, E1000_DEV_82540EM, PCI_ANY_ID},
+    {E1000_VENDOR_ID, E1000_DEV_82545EM, PCI_ANY_ID},
+    {0, 0, 0}
+};
+
+static pci_driver_t e1000_driver = {
+    "e1000",
+    e1000_ids,
+    e1000_probe
+};
+
+// MMIO accessors
+static inline uint32_t e1000_read(e1000_t* nic, uint32_t reg) {
+    return *(volatile uint32_t*)(nic->regs + reg);
+}
+
+static inline void e1000_write(e1000_t* nic, uint32_t reg, uint32_t value) {
+    *(volatile uint32_t*)(nic->regs + reg) = value;
+}
+
+// Transmit
+
+// Free the buffers of every descriptor the device has written back
+static void e1000_tx_reclaim(e1000_t* nic) {
+    while (nic->tx_clean != nic->tx_tail &&
+           (nic->tx_ring[nic->tx_clean].status & E1000_TXD_STAT_DD)) {
+        netbuf_free(nic->tx_bufs[nic->tx_clean]);
+        nic->tx_bufs[nic->tx_clean] = NULL;
+        nic->tx_clean = (nic->tx_clean + 1) % E1000_NUM_TX_DESC;
+    }
+}
+
+static void e1000_flush(netif_t* netif) {
+    e1000_t* nic = (e1000_t*)netif->driver_data;
+    if (nic->tx_doorbell == nic->tx_tail) {
+        return;
+    }
+    e1000_barrier();
+    e1000_write(nic, E1000_TDT, nic->tx_tail);
+    nic->tx_doorbell = nic->tx_tail;
+    nic->tx_doorbells++;
+}
+
+static int e1000_xmit_frame(netif_t* netif, netbuf_t* nb) {
+    e1000_t* nic = (e1000_t*)netif->driver_data;
+    uint32_t next = (nic->tx_tail + 1) % E1000_NUM_TX_DESC;
+
+    if (next == nic->tx_clean) {
+        // Ring full: start what is queued and take back what has finished
+        e1000_flush(netif);
+        e1000_tx_reclaim(nic);
+        if (next == nic->tx_clean) {
+            nic->tx_ring_full++;
+            netbuf_free(nb);
+            return -1;
+        }
+    }
+
+    e1000_tx_desc_t* desc = &nic->tx_ring[nic->tx_tail];
+    desc->addr = dma_virt_to_phys(nb->data);
+    desc->length = (uint16_t)nb->len;
+    desc->cso = 0;
+    desc->cmd = E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS;
+    desc->status = 0;
+    desc->css = 0;
+    desc->special = 0;
+
+    nic->tx_bufs[nic->tx_tail] = nb;
+    nic->tx_tail = next;
+    return 0;
+}
+
+// Receive
+
+static void e1000_rx_refill(e1000_t* nic, uint32_t index, netbuf_t* nb) {
+    nic->rx_bufs[index] = nb;
+    nic->rx_ring[index].addr = dma_virt_to_phys(nb->data);
+    nic->rx_ring[index].status = 0;
+}
+
+// Pass completed frames up the stack and return their descriptors to the
+// device with a single tail write
+static void e1000_poll(netif_t* netif) {
+    e1000_t* nic = (e1000_t*)netif->driver_data;
+    uint32_t done = 0;
+
+    e1000_tx_reclaim(nic);
+
+    while (done < E1000_NUM_RX_DESC) {
+        e1000_rx_desc_t* desc = &nic->rx_ring[nic->rx_next];
+        uint8_t status = desc->status;
+        if (!(status & E1000_RXD_STAT_DD)) {
+            break;
+        }
+        e1000_barrier();
+
+        netbuf_t* nb = nic->rx_bufs[nic->rx_next];
+        netbuf_t* replacement = NULL;
+        if ((status & E1000_RXD_STAT_EOP) && !(desc->errors & ~(E1000_RXD_ERR_TCPE | E1000_RXD_ERR_IPE))) {
+            replacement = netbuf_alloc();
+        }
+
+        if (!replacement) {
+            // Bad frame or no spare buffer: drop it and recycle the buffer in place
+            nic->rx_recycled++;
+            netif->drops++;
+            desc->status = 0;
+        } else {
+            netbuf_put(nb, desc->length);
+            if ((status & (E1000_RXD_STAT_IXSM | E1000_RXD_STAT_IPCS | E1000_RXD_STAT_TCPCS)) ==
+                    (E1000_RXD_STAT_IPCS | E1000_RXD_STAT_TCPCS) &&
+                !(desc->errors & (E1000_RXD_ERR_TCPE | E1000_RXD_ERR_IPE))) {
+                nb->csum_verified = 1;
+                nic->rx_csum_offloaded++;
+            }
+            e1000_rx_refill(nic, nic->rx_next, replacement);
+            ether_rx(netif, nb);
+        }
+
+        nic->rx_next = (nic->rx_next + 1) % E1000_NUM_RX_DESC;
+        done++;
+    }
+
+    if (done) {
+        // RDT points at the last descriptor the device may fill
+        e1000_barrier();
+        e1000_write(nic, E1000_RDT, (nic->rx_next + E1000_NUM_RX_DESC - 1) % E1000_NUM_RX_DESC);
+    }
+}
+
+// The interrupt only acknowledges the cause; net_poll does the ring work.
+// ITR keeps the rate bounded under load.
+static void e1000_irq(pci_device_t* dev) {
+    e1000_t* nic = (e1000_t*)dev->driver_data;
+    uint32_t cause = e1000_read(nic, E1000_ICR);
+    if (!cause) {
+        return; // Shared line
+    }
+
+    nic->interrupts++;
+    if (cause & E1000_ICR_LSC) {
+        nic->link_up = (e1000_read(nic, E1000_STATUS) & E1000_STATUS_LU) != 0;
+    }
+}
+
+// Setup
+
+static uint16_t e1000_eeprom_read(e1000_t* nic, uint8_t addr) {
+    e1000_write(nic, E1000_EERD, E1000_EERD_START | ((uint32_t)addr << E1000_EERD_ADDR_SHIFT));
+    for (uint32_t timeout = 0; timeout < 100000; timeout++) {
+        uint32_t value = e1000_read(nic, E1000_EERD);
+        if (value & E1000_EERD_DONE) {
+            return (uint16_t)(value >> E1000_EERD_DATA_SHIFT);
+        }
+    }
+    return 0;
+}
+
+static void e1000_read_mac(e1000_t* nic) {
+    uint32_t ral = e1000_read(nic, E1000_RAL0);
+    uint32_t rah = e1000_read(nic, E1000_RAH0);
+
+    if (!(rah & E1000_RAH_AV)) {
+        // Receive address not loaded yet: take it from the EEPROM
+        uint16_t words[3];
+        for (uint8_t i = 0; i < 3; i++) {
+            words[i] = e1000_eeprom_read(nic, i);
+        }
+        ral = words[0] | ((uint32_t)words[1] << 16);
+        rah = words[2] | E1000_RAH_AV;
+        e1000_write(nic, E1000_RAL0, ral);
+        e1000_write(nic, E1000_RAH0, rah);
+    }
+
+    for (int i = 0; i < 4; i++) {
+        nic->netif.mac[i] = (uint8_t)(ral >> (i * 8));
+    }
+    nic->netif.mac[4] = (uint8_t)rah;
+    nic->netif.mac[5] = (uint8_t)(rah >> 8);
+}
+
+static int e1000_setup_rings(e1000_t* nic) {
+    nic->rx_ring = (e1000_rx_desc_t*)dma_alloc_coherent(sizeof(e1000_rx_desc_t) * E1000_NUM_RX_DESC,
+                                                        &nic->rx_ring_dma);
+    nic->tx_ring = (e1000_tx_desc_t*)dma_alloc_coherent(sizeof(e1000_tx_desc_t) * E1000_NUM_TX_DESC,
+                                                        &nic->tx_ring_dma);
+    if (!nic->rx_ring || !nic->tx_ring) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < E1000_NUM_RX_DESC; i++) {
+        netbuf_t* nb = netbuf_alloc();
+        if (!nb) {
+            return -1;
+        }
+        e1000_rx_refill(nic, i, nb);
+    }
+
+    e1000_write(nic, E1000_RDBAL, nic->rx_ring_dma);
+    e1000_write(nic, E1000_RDBAH, 0);
+    e1000_write(nic, E1000_RDLEN, sizeof(e1000_rx_desc_t) * E1000_NUM_RX_DESC);
+    e1000_write(nic, E1000_RDH, 0);
+    e1000_write(nic, E1000_RDT, E1000_NUM_RX_DESC - 1);
+    e1000_write(nic, E1000_RXCSUM, E1000_RXCSUM_IPOFL | E1000_RXCSUM_TUOFL);
+    e1000_write(nic, E1000_RCTL, E1000_RCTL_EN | E1000_RCTL_BAM | E1000_RCTL_SECRC);
+
+    e1000_write(nic, E1000_TDBAL, nic->tx_ring_dma);
+    e1000_write(nic, E1000_TDBAH, 0);
+    e1000_write(nic, E1000_TDLEN, sizeof(e1000_tx_desc_t) * E1000_NUM_TX_DESC);
+    e1000_write(nic, E1000_TDH, 0);
+    e1000_write(nic, E1000_TDT, 0);
+    e1000_write(nic, E1000_TIPG, E1000_TIPG_DEFAULT);
+    e1000_write(nic, E1000_TCTL, E1000_TCTL_EN | E1000_TCTL_PSP |
+                (0x0F << E1000_TCTL_CT_SHIFT) | (0x40 << E1000_TCTL_COLD_SHIFT));
+    return 0;
+}
+
+static void e1000_free_rings(e1000_t* nic) {
+    for (uint32_t i = 0; i < E1000_NUM_RX_DESC; i++) {
+        netbuf_free(nic->rx_bufs[i]);
+        nic->rx_bufs[i] = NULL;
+    }
+    dma_free_coherent(nic->rx_ring, sizeof(e1000_rx_desc_t) * E1000_NUM_RX_DESC);
+    dma_free_coherent(nic->tx_ring, sizeof(e1000_tx_desc_t) * E1000_NUM_TX_DESC);
+}
+
+static int e1000_probe(pci_device_t* dev, const pci_device_id_t* id) {
+    (void)id;
+
+    if (e1000_num_nics >= E1000_MAX_NICS) {
+        return -1;
+    }
+
+    pci_enable_device(dev);
+    pci_enable_bus_master(dev);
+
+    e1000_t* nic = &e1000_nics[e1000_num_nics];
+    memset(nic, 0, sizeof(e1000_t));
+    nic->pci = dev;
+    nic->regs = (volatile uint8_t*)pci_map_bar(dev, E1000_MMIO_BAR);
+    if (!nic->regs) {
+        return -1;
+    }
+
+    // Reset, keep interrupts masked until the rings are in place
+    e1000_write(nic, E1000_IMC, 0xFFFFFFFF);
+    e1000_write(nic, E1000_CTRL, e1000_read(nic, E1000_CTRL) | E1000_CTRL_RST);
+    for (uint32_t timeout = 0; timeout < 1000000; timeout++) {
+        if (!(e1000_read(nic, E1000_CTRL) & E1000_CTRL_RST)) {
+            break;
+        }
+    }
+    e1000_write(nic, E1000_IMC, 0xFFFFFFFF);
+    e1000_read(nic, E1000_ICR);
+
+    uint32_t ctrl = e1000_read(nic, E1000_CTRL);
+    ctrl &= ~(E1000_CTRL_LRST | E1000_CTRL_ILOS | E1000_CTRL_VME | E1000_CTRL_PHY_RST);
+    e1000_write(nic, E1000_CTRL, ctrl | E1000_CTRL_SLU | E1000_CTRL_ASDE);
+
+    e1000_read_mac(nic);
+    for (uint32_t i = 0; i < 128; i++) {
+        e1000_write(nic, E1000_MTA + i * 4, 0);
+    }
+
+    if (e1000_setup_rings(nic) != 0) {
+        e1000_free_rings(nic);
+        return -1;
+    }
+
+    // Default address 10.0.0.<last MAC byte>/24, changeable with ifconfig
+    netif_t* netif = &nic->netif;
+    netif->name[0] = 'e';
+    netif->name[1] = 't';
+    netif->name[2] = 'h';
+    netif->name[3] = '0' + e1000_num_nics;
+    netif->name[4] = '\0';
+    netif->ip = IP_ADDR(10, 0, 0, netif->mac[5]);
+    netif->netmask = IP_ADDR(255, 255, 255, 0);
+    netif->poll = e1000_poll;
+    netif->xmit_frame = e1000_xmit_frame;
+    netif->flush = e1000_flush;
+    netif->driver_data = nic;
+    ether_setup(netif);
+
+    if (netif_register(netif) != 0) {
+        e1000_write(nic, E1000_RCTL, 0);
+        e1000_write(nic, E1000_TCTL, 0);
+        e1000_free_rings(nic);
+        return -1;
+    }
+    dev->driver_data = nic;
+    e1000_num_nics++;
+
+    // Interrupt moderation bounds the rate; transmit completions are
+    // reclaimed lazily and do not interrupt at all
+    if (pci_register_irq(dev, e1000_irq) == 0) {
+        e1000_write(nic, E1000_ITR, E1000_ITR_VALUE);
+        e1000_write(nic, E1000_IMS, E1000_ICR_RXT0 | E1000_ICR_RXO | E1000_ICR_RXDMT0 | E1000_ICR_LSC);
+    }
+
+    nic->link_up = (e1000_read(nic, E1000_STATUS) & E1000_STATUS_LU) != 0;
+
+    terminal_writestring(netif->name);
+    terminal_writestring(": e1000 ");
+    ether_print_mac(netif->mac);
+    terminal_writestring(", ");
+    net_print_ip(netif->ip);
+    terminal_writestring(nic->link_up ? ", link up\n" : ", link down\n");
+    return 0;
+}
+
+void e1000_init(void) {
+    pci_register_driver(&e1000_driver);
+}
+
+void e1000_print_stats(void) {
+    for (int i = 0; i < e1000_num_nics; i++) {
+        e1000_t* nic = &e1000_nics[i];
+        terminal_writestring(nic->netif.name);
+        terminal_writestring(": ");
+        terminal_write_dec(nic->interrupts);
+        terminal_writestring(" interrupts, ");
+        terminal_write_dec(nic->tx_doorbells);
+        terminal_writestring(" tx doorbells, ");
+        terminal_write_dec(nic->tx_ring_full);
+        terminal_writestring(" tx ring full, ");
+        terminal_write_dec(nic->rx_recycled);
+        terminal_writestring(" rx recycled, ");
+        terminal_write_dec(nic->rx_csum_offloaded);
+        terminal_writestring(" rx csum offloaded\n");
+    }
+}
@@ -0,0 +1,130 @@
+#ifndef E1000_H
+#define E1000_H
+
+#include <stdint.h>
+
+// Limits
+#define E1000_MAX_NICS      2
+#define E1000_NUM_RX_DESC   64      // Multiples of 8 (128-byte ring granularity)
+#define E1000_NUM_TX_DESC   64
+
+// PCI identification (82540EM is QEMU's default model)
+#define E1000_VENDOR_ID     0x8086
+#define E1000_DEV_82540EM   0x100E
+#define E1000_DEV_82545EM   0x100F
+#define E1000_MMIO_BAR      0
+
+// Registers
+#define E1000_CTRL          0x0000
+#define E1000_STATUS        0x0008
+#define E1000_EERD          0x0014
+#define E1000_ICR           0x00C0
+#define E1000_ITR           0x00C4
+#define E1000_IMS           0x00D0
+#define E1000_IMC           0x00D8
+#define E1000_RCTL          0x0100
+#define E1000_TCTL          0x0400
+#define E1000_TIPG          0x0410
+#define E1000_RDBAL         0x2800
+#define E1000_RDBAH         0x2804
+#define E1000_RDLEN         0x2808
+#define E1000_RDH           0x2810
+#define E1000_RDT           0x2818
+#define E1000_TDBAL         0x3800
+#define E1000_TDBAH         0x3804
+#define E1000_TDLEN         0x3808
+#define E1000_TDH           0x3810
+#define E1000_TDT           0x3818
+#define E1000_RXCSUM        0x5000
+#define E1000_MTA           0x5200  // 128 entries
+#define E1000_RAL0          0x5400
+#define E1000_RAH0          0x5404
+
+// CTRL bits
+#define E1000_CTRL_LRST     (1u << 3)
+#define E1000_CTRL_ASDE     (1u << 5)
+#define E1000_CTRL_SLU      (1u << 6)
+#define E1000_CTRL_ILOS     (1u << 7)
+#define E1000_CTRL_RST      (1u << 26)
+#define E1000_CTRL_VME      (1u << 30)
+#define E1000_CTRL_PHY_RST  (1u << 31)
+
+// STATUS bits
+#define E1000_STATUS_LU     (1u << 1)
+#define E1000_STATUS_SPEED_SHIFT 6
+
+// EEPROM read register
+#define E1000_EERD_START    (1u << 0)
+#define E1000_EERD_DONE     (1u << 4)
+#define E1000_EERD_ADDR_SHIFT 8
+#define E1000_EERD_DATA_SHIFT 16
+
+// Interrupt cause bits (ICR/IMS/IMC)
+#define E1000_ICR_TXDW      (1u << 0)
+#define E1000_ICR_LSC       (1u << 2)
+#define E1000_ICR_RXDMT0    (1u << 4)
+#define E1000_ICR_RXO       (1u << 6)
+#define E1000_ICR_RXT0      (1u << 7)
+
+// Interrupt moderation: ITR counts in 256ns units between interrupts
+#define E1000_ITR_MAX_RATE  8000    // Interrupts per second
+#define E1000_ITR_VALUE     (1000000000 / (E1000_ITR_MAX_RATE * 256))
+
+// RCTL bits (BSIZE 00 with BSEX clear selects 2048-byte buffers)
+#define E1000_RCTL_EN       (1u << 1)
+#define E1000_RCTL_BAM      (1u << 15)
+#define E1000_RCTL_SECRC    (1u << 26)
+
+// RXCSUM bits
+#define E1000_RXCSUM_IPOFL  (1u << 8)
+#define E1000_RXCSUM_TUOFL  (1u << 9)
+
+// TCTL bits
+#define E1000_TCTL_EN       (1u << 1)
+#define E1000_TCTL_PSP      (1u << 3)
+#define E1000_TCTL_CT_SHIFT 4
+#define E1000_TCTL_COLD_SHIFT 12
+#define E1000_TIPG_DEFAULT  (10 | (8 << 10) | (6 << 20))
+
+// RAH bits
+#define E1000_RAH_AV        (1u << 31)
+
+// Legacy transmit descriptor
+#define E1000_TXD_CMD_EOP   0x01
+#define E1000_TXD_CMD_IFCS  0x02
+#define E1000_TXD_CMD_RS    0x08
+#define E1000_TXD_STAT_DD   0x01
+
+typedef struct e1000_tx_desc {
+    uint64_t addr;
+    uint16_t length;
+    uint8_t cso;
+    uint8_t cmd;
+    uint8_t status;
+    uint8_t css;
+    uint16_t special;
+} __attribute__((packed)) e1000_tx_desc_t;
+
+// Legacy receive descriptor
+#define E1000_RXD_STAT_DD    0x01
+#define E1000_RXD_STAT_EOP   0x02
+#define E1000_RXD_STAT_IXSM  0x04   // Checksum indications are not valid
+#define E1000_RXD_STAT_TCPCS 0x20   // TCP/UDP checksum was checked
+#define E1000_RXD_STAT_IPCS  0x40   // IPv4 header checksum was checked
+#define E1000_RXD_ERR_TCPE   0x20
+#define E1000_RXD_ERR_IPE    0x40
+
+typedef struct e1000_rx_desc {
+    uint64_t addr;
+    uint16_t length;
+    uint16_t csum;
+    uint8_t status;
+    uint8_t errors;
+    uint16_t special;
+} __attribute__((packed)) e1000_rx_desc_t;
+
+// Driver registration
+void e1000_init(void);
+void e1000_print_stats(void);
+
+#endif // E1000_H
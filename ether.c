@@ -0,0 +1,258 @@
+#include <stddef.h>
+#include "ether.h"
+#include "net.h"
+#include "ktime.h"
+#include "mm.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_putchar(char c);
+
+#define ARP_HTYPE_ETHER 1
+#define ARP_OP_REQUEST  1
+#define ARP_OP_REPLY    2
+
+typedef struct arp_packet {
+    uint16_t htype;
+    uint16_t ptype;
+    uint8_t hlen;
+    uint8_t plen;
+    uint16_t oper;
+    uint8_t sha[ETH_ALEN];
+    uint32_t spa;
+    uint8_t tha[ETH_ALEN];
+    uint32_t tpa;
+} __attribute__((packed)) arp_packet_t;
+
+typedef enum {
+    ARP_FREE,
+    ARP_PENDING,
+    ARP_RESOLVED
+} arp_state_t;
+
+typedef struct arp_entry {
+    arp_state_t state;
+    netif_t* netif;
+    uint32_t ip;
+    uint8_t mac[ETH_ALEN];
+    netbuf_queue_t pending;     // Packets waiting for the reply
+    uint64_t requested_ms;
+    uint64_t used_ms;
+} arp_entry_t;
+
+static arp_entry_t arp_cache[ARP_CACHE_SIZE];
+
+static const uint8_t ether_broadcast[ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static const uint8_t ether_unknown[ETH_ALEN] = {0, 0, 0, 0, 0, 0};
+
+// Prepend the Ethernet header and queue the frame on the device
+static int ether_output(netif_t* netif, netbuf_t* nb, const uint8_t* dst, uint16_t type) {
+    ether_header_t* eth = (ether_header_t*)netbuf_push(nb, ETH_HLEN);
+    if (!eth) {
+        netbuf_free(nb);
+        return -1;
+    }
+    memcpy(eth->dst, dst, ETH_ALEN);
+    memcpy(eth->src, netif->mac, ETH_ALEN);
+    eth->type = htons(type);
+
+    netif->tx_packets++;
+    netif->tx_bytes += nb->len;
+    return netif->xmit_frame(netif, nb);
+}
+
+static void arp_send(netif_t* netif, uint16_t oper, const uint8_t* dst_mac, uint32_t target_ip) {
+    netbuf_t* nb = netbuf_alloc();
+    if (!nb) {
+        return;
+    }
+
+    arp_packet_t* arp = (arp_packet_t*)netbuf_put(nb, sizeof(arp_packet_t));
+    arp->htype = htons(ARP_HTYPE_ETHER);
+    arp->ptype = htons(ETH_TYPE_IPV4);
+    arp->hlen = ETH_ALEN;
+    arp->plen = 4;
+    arp->oper = htons(oper);
+    memcpy(arp->sha, netif->mac, ETH_ALEN);
+    arp->spa = htonl(netif->ip);
+    memcpy(arp->tha, oper == ARP_OP_REPLY ? dst_mac : ether_unknown, ETH_ALEN);
+    arp->tpa = htonl(target_ip);
+
+    ether_output(netif, nb, dst_mac, ETH_TYPE_ARP);
+}
+
+static arp_entry_t* arp_lookup(netif_t* netif, uint32_t ip) {
+    for (int i = 0; i < ARP_CACHE_SIZE; i++) {
+        if (arp_cache[i].state != ARP_FREE && arp_cache[i].netif == netif && arp_cache[i].ip == ip) {
+            return &arp_cache[i];
+        }
+    }
+    return NULL;
+}
+
+// A free entry, or else the least recently used one
+static arp_entry_t* arp_alloc(netif_t* netif, uint32_t ip) {
+    arp_entry_t* victim = &arp_cache[0];
+    for (int i = 0; i < ARP_CACHE_SIZE; i++) {
+        if (arp_cache[i].state == ARP_FREE) {
+            victim = &arp_cache[i];
+            break;
+        }
+        if (arp_cache[i].used_ms < victim->used_ms) {
+            victim = &arp_cache[i];
+        }
+    }
+
+    netbuf_queue_purge(&victim->pending);
+    memset(victim, 0, sizeof(arp_entry_t));
+    victim->netif = netif;
+    victim->ip = ip;
+    victim->state = ARP_PENDING;
+    victim->used_ms = ktime_get_ms();
+    return victim;
+}
+
+// Record a mapping and release anything that was waiting for it
+static void arp_update(netif_t* netif, uint32_t ip, const uint8_t* mac, int create) {
+    arp_entry_t* entry = arp_lookup(netif, ip);
+    if (!entry) {
+        if (!create) {
+            return;
+        }
+        entry = arp_alloc(netif, ip);
+    }
+
+    memcpy(entry->mac, mac, ETH_ALEN);
+    entry->state = ARP_RESOLVED;
+
+    netbuf_t* nb;
+    while ((nb = netbuf_queue_pop(&entry->pending)) != NULL) {
+        ether_output(netif, nb, entry->mac, ETH_TYPE_IPV4);
+    }
+}
+
+static void arp_rx(netif_t* netif, netbuf_t* nb) {
+    arp_packet_t* arp = (arp_packet_t*)nb->data;
+    if (nb->len < sizeof(arp_packet_t) || ntohs(arp->htype) != ARP_HTYPE_ETHER ||
+        ntohs(arp->ptype) != ETH_TYPE_IPV4 || arp->hlen != ETH_ALEN || arp->plen != 4) {
+        netbuf_free(nb);
+        return;
+    }
+
+    uint32_t sender_ip = ntohl(arp->spa);
+    uint32_t target_ip = ntohl(arp->tpa);
+    uint16_t oper = ntohs(arp->oper);
+    int for_us = netif->ip && target_ip == netif->ip;
+
+    // Learn the sender when it talks to us; otherwise only refresh what we know
+    arp_update(netif, sender_ip, arp->sha, for_us);
+
+    if (for_us && oper == ARP_OP_REQUEST) {
+        uint8_t requester[ETH_ALEN];
+        memcpy(requester, arp->sha, ETH_ALEN);
+        netbuf_free(nb);
+        arp_send(netif, ARP_OP_REPLY, requester, sender_ip);
+        return;
+    }
+    netbuf_free(nb);
+}
+
+// netif transmit hook: resolve the next hop, holding the packet if needed
+static int ether_transmit(netif_t* netif, netbuf_t* nb, uint32_t next_hop) {
+    if (next_hop == IP_BROADCAST || next_hop == (netif->ip | ~netif->netmask)) {
+        return ether_output(netif, nb, ether_broadcast, ETH_TYPE_IPV4);
+    }
+
+    uint64_t now = ktime_get_ms();
+    arp_entry_t* entry = arp_lookup(netif, next_hop);
+    if (!entry) {
+        entry = arp_alloc(netif, next_hop);
+    }
+    entry->used_ms = now;
+
+    if (entry->state == ARP_RESOLVED) {
+        return ether_output(netif, nb, entry->mac, ETH_TYPE_IPV4);
+    }
+
+    if (entry->pending.count >= ARP_MAX_PENDING) {
+        netbuf_free(netbuf_queue_pop(&entry->pending));
+        netif->drops++;
+    }
+    netbuf_queue_push(&entry->pending, nb);
+
+    if (entry->requested_ms == 0 || now - entry->requested_ms >= ARP_RETRY_MS) {
+        entry->requested_ms = now;
+        arp_send(netif, ARP_OP_REQUEST, ether_broadcast, next_hop);
+    }
+    return 0;
+}
+
+void ether_setup(netif_t* netif) {
+    netif->flags |= NETIF_F_ETHER;
+    netif->transmit = ether_transmit;
+    if (netif->mtu == 0 || netif->mtu > ETH_MTU) {
+        netif->mtu = ETH_MTU;
+    }
+}
+
+void ether_rx(netif_t* netif, netbuf_t* nb) {
+    ether_header_t* eth = (ether_header_t*)nb->data;
+    if (nb->len < ETH_HLEN) {
+        netbuf_free(nb);
+        return;
+    }
+
+    uint16_t type = ntohs(eth->type);
+    netbuf_pull(nb, ETH_HLEN);
+
+    switch (type) {
+    case ETH_TYPE_IPV4:
+        net_rx(netif, nb);
+        break;
+    case ETH_TYPE_ARP:
+        arp_rx(netif, nb);
+        break;
+    default:
+        netbuf_free(nb);
+        break;
+    }
+}
+
+// Diagnostics
+
+void ether_print_mac(const uint8_t* mac) {
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < ETH_ALEN; i++) {
+        terminal_putchar(hex[mac[i] >> 4]);
+        terminal_putchar(hex[mac[i] & 0x0F]);
+        if (i < ETH_ALEN - 1) {
+            terminal_putchar(':');
+        }
+    }
+}
+
+void arp_print_cache(void) {
+    int count = 0;
+    for (int i = 0; i < ARP_CACHE_SIZE; i++) {
+        arp_entry_t* entry = &arp_cache[i];
+        if (entry->state == ARP_FREE) {
+            continue;
+        }
+        count++;
+
+        net_print_ip(entry->ip);
+        terminal_writestring(" at ");
+        if (entry->state == ARP_RESOLVED) {
+            ether_print_mac(entry->mac);
+        } else {
+            terminal_writestring("(incomplete)");
+        }
+        terminal_writestring(" on ");
+        terminal_writestring(entry->netif->name);
+        terminal_putchar('\n');
+    }
+
+    if (count == 0) {
+        terminal_writestring("ARP cache is empty.\n");
+    }
+}
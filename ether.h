@@ -0,0 +1,36 @@
+#ifndef ETHER_H
+#define ETHER_H
+
+#include <stdint.h>
+#include "net.h"
+
+// Ethernet framing
+#define ETH_ALEN        6
+#define ETH_HLEN        14
+#define ETH_ZLEN        60      // Minimum frame without FCS (devices pad)
+#define ETH_MTU         1500
+#define ETH_TYPE_IPV4   0x0800
+#define ETH_TYPE_ARP    0x0806
+
+// ARP cache; entries never age out, a reply simply overwrites them
+#define ARP_CACHE_SIZE  16
+#define ARP_MAX_PENDING 4       // Packets held per unresolved address
+#define ARP_RETRY_MS    1000
+
+typedef struct ether_header {
+    uint8_t dst[ETH_ALEN];
+    uint8_t src[ETH_ALEN];
+    uint16_t type;
+} __attribute__((packed)) ether_header_t;
+
+// Attach the Ethernet/ARP transmit path to a device's netif
+void ether_setup(netif_t* netif);
+
+// Called by drivers from poll context with a complete frame
+void ether_rx(netif_t* netif, netbuf_t* nb);
+
+// Diagnostics
+void ether_print_mac(const uint8_t* mac);
+void arp_print_cache(void);
+
+#endif // ETHER_H
@@ -1,4 +1,6 @@
 #include "fs.h"
+#include "klib.h"
+#include "tunable.h"
 
 // External terminal functions from kernel.c
 extern void terminal_writestring(const char* data);
@@ -10,6 +12,9 @@ extern void terminal_write_dec(uint32_t value);
 // External memory functions
 extern void* kmalloc(size_t size);
 extern void kfree(void* ptr);
+extern void* kmalloc_aligned(size_t size, size_t alignment);
+extern void kfree_aligned(void* ptr);
+extern void* memset(void* dest, int value, size_t count);
 
 // VGA colors
 #define VGA_COLOR_BLACK 0
@@ -23,40 +28,57 @@ extern void kfree(void* ptr);
 static fs_t filesystem;
 static int fs_initialized = 0;
 
-// String utility functions
-static size_t fs_strlen(const char* str) {
-    size_t len = 0;
-    while (str[len]) len++;
-    return len;
-}
+// Name lookup
+static hash_table_t fs_names;
 
-static int fs_strcmp(const char* str1, const char* str2) {
-    while (*str1 && (*str1 == *str2)) {
-        str1++;
-        str2++;
-    }
-    return *(unsigned char*)str1 - *(unsigned char*)str2;
+TUNABLE_VAR(fs_max_files, FS_MAX_FILES);
+#if CONFIG_TUNABLES
+static tunable_t fs_max_files_tunable = {
+    .name = "fs.max_files",
+    .description = "File table entries",
+    .type = TUNABLE_U32,
+    .flags = TUNABLE_BOOT,
+    .value = &fs_max_files,
+    .min = 1,
+    .max = FS_MAX_FILES_LIMIT,
+};
+#endif
+
+static uint32_t fs_name_hash(const void* key) {
+    return hash_fnv1a_str((const char*)key);
 }
 
-static void fs_strcpy(char* dest, const char* src) {
-    while (*src) {
-        *dest++ = *src++;
-    }
-    *dest = '\0';
+static int fs_name_match(const hash_node_t* node, const void* key) {
+    return strcmp(hash_entry(node, fs_file_t, node)->name, (const char*)key) == 0;
 }
 
+static const hash_table_ops_t fs_name_ops = {
+    .hash = fs_name_hash,
+    .match = fs_name_match,
+};
+
 // Initialize the file system
 void fs_init(void) {
     if (fs_initialized) {
         return;
     }
     
+    tunable_register(&fs_max_files_tunable);
+    
     // Initialize file system structure
     filesystem.magic = FS_MAGIC;
     filesystem.file_count = 0;
+    filesystem.max_files = fs_max_files;
+    filesystem.files = kmalloc_aligned(fs_max_files * sizeof(fs_file_t), CACHE_LINE_SIZE);
+    filesystem.file_data = kmalloc(fs_max_files * FS_MAX_FILESIZE);
+    if (!filesystem.files || !filesystem.file_data) {
+        kfree_aligned(filesystem.files);
+        kfree(filesystem.file_data);
+        return; // No heap for the file table
+    }
     
     // Clear all file entries
-    for (int i = 0; i < FS_MAX_FILES; i++) {
+    for (uint32_t i = 0; i < filesystem.max_files; i++) {
         filesystem.files[i].name[0] = '\0';
         filesystem.files[i].size = 0;
         filesystem.files[i].type = FS_FILE_TYPE_TEXT;
@@ -65,8 +87,14 @@ void fs_init(void) {
     }
     
     // Clear file data storage
-    for (int i = 0; i < FS_MAX_FILES * FS_MAX_FILESIZE; i++) {
-        filesystem.file_data[i] = 0;
+    memset(filesystem.file_data, 0, filesystem.max_files * FS_MAX_FILESIZE);
+    
+    if (hash_table_init(&fs_names, &fs_name_ops, filesystem.max_files) != 0) {
+        kfree_aligned(filesystem.files);
+        kfree(filesystem.file_data);
+        filesystem.files = NULL;
+        filesystem.file_data = NULL;
+        return; // No heap for the name table
     }
     
     fs_initialized = 1;
@@ -77,12 +105,12 @@ void fs_init(void) {
 
 // Add a file to the file system
 int fs_add_file(const char* name, const char* content, fs_file_type_t type) {
-    if (!fs_initialized || filesystem.file_count >= FS_MAX_FILES) {
+    if (!fs_initialized || filesystem.file_count >= filesystem.max_files) {
         return -1; // File system not initialized or full
     }
     
-    size_t name_len = fs_strlen(name);
-    size_t content_len = fs_strlen(content);
+    size_t name_len = strlen(name);
+    size_t content_len = strlen(content);
     
     if (name_len >= FS_MAX_FILENAME || content_len >= FS_MAX_FILESIZE) {
         return -2; // Name or content too long
@@ -98,7 +126,7 @@ int fs_add_file(const char* name, const char* content, fs_file_type_t type) {
     fs_file_t* file = &filesystem.files[file_index];
     
     // Set up file metadata
-    fs_strcpy(file->name, name);
+    strlcpy(file->name, name, sizeof(file->name));
     file->size = content_len;
     file->type = type;
     file->permissions = 0; // Read-only
@@ -111,6 +139,7 @@ int fs_add_file(const char* name, const char* content, fs_file_type_t type) {
         file->data[i] = content[i];
     }
     
+    hash_table_insert(&fs_names, &file->node, file->name);
     filesystem.file_count++;
     return 0; // Success
 }
@@ -121,13 +150,8 @@ fs_file_t* fs_find_file(const char* filename) {
         return NULL;
     }
     
-    for (uint32_t i = 0; i < filesystem.file_count; i++) {
-        if (fs_strcmp(filesystem.files[i].name, filename) == 0) {
-            return &filesystem.files[i];
-        }
-    }
-    
-    return NULL; // File not found
+    hash_node_t* node = hash_table_lookup(&fs_names, filename);
+    return node ? hash_entry(node, fs_file_t, node) : NULL;
 }
 
 // Check if a file exists
@@ -161,7 +185,7 @@ int fs_list(void) {
         
         // Print filename (padded to 24 chars)
         terminal_writestring(file->name);
-        int name_len = fs_strlen(file->name);
+        int name_len = strlen(file->name);
         for (int j = name_len; j < 24; j++) {
             terminal_putchar(' ');
         }
@@ -195,7 +219,7 @@ int fs_list(void) {
     terminal_writestring("\nTotal files: ");
     terminal_write_dec(filesystem.file_count);
     terminal_writestring(" / ");
-    terminal_write_dec(FS_MAX_FILES);
+    terminal_write_dec(filesystem.max_files);
     terminal_putchar('\n');
     
     return 0;
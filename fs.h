@@ -3,9 +3,13 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "hashtable.h"
+#include "cache.h"
+#include "config.h"
 
 // File system constants
-#define FS_MAX_FILES 16
+#define FS_MAX_FILES CONFIG_FS_MAX_FILES   // Default for fs.max_files
+#define FS_MAX_FILES_LIMIT 256
 #define FS_MAX_FILENAME 32
 #define FS_MAX_FILESIZE 4096
 #define FS_MAGIC 0x4D494E49  // "MINI" magic number
@@ -16,21 +20,26 @@ typedef enum {
     FS_FILE_TYPE_BINARY = 1
 } fs_file_type_t;
 
-// File entry structure
+// File entry structure: one cache line. A lookup reads the hash node and
+// compares the name, so those come first; reading the file needs the rest.
 typedef struct {
+    hash_node_t node;      // Name lookup table
     char name[FS_MAX_FILENAME];
     uint32_t size;
-    fs_file_type_t type;
     uint8_t* data;
-    uint32_t permissions;  // Simple read-only flag
-} fs_file_t;
+    uint8_t type;          // fs_file_type_t
+    uint8_t permissions;   // Simple read-only flag
+} __cacheline_aligned fs_file_t;
 
-// File system structure
+STATIC_ASSERT(sizeof(fs_file_t) == CACHE_LINE_SIZE, "fs_file_t: entries are one cache line");
+
+// File system structure; file data lives apart from the metadata
 typedef struct {
     uint32_t magic;
     uint32_t file_count;
-    fs_file_t files[FS_MAX_FILES];
-    uint8_t file_data[FS_MAX_FILES * FS_MAX_FILESIZE];  // Static storage
+    uint32_t max_files;    // fs.max_files, fixed at init
+    fs_file_t* files;
+    uint8_t* file_data;    // FS_MAX_FILESIZE bytes per file, from the heap
 } fs_t;
 
 // File system functions
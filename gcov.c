@@ -0,0 +1,212 @@
+#include <stddef.h>
+#include "gcov.h"
+
+// This file itself is never instrumented (see the Makefile)
+
+static inline void outb(uint16_t port, uint8_t data) {
+    __asm__ __volatile__("outb %1, %0" : : "dN"(port), "a"(data));
+}
+
+// Counter layout emitted by GCC 7 and later (struct gcov_info in libgcov).
+// The number of counter kinds and the object checksum vary by version.
+#if __GNUC__ >= 14
+#define GCOV_COUNTERS       9
+#elif __GNUC__ >= 10
+#define GCOV_COUNTERS       8
+#else
+#define GCOV_COUNTERS       9
+#endif
+
+// GCC 12 changed record lengths from words to bytes
+#if __GNUC__ >= 12
+#define GCOV_UNIT_SIZE      4
+#else
+#define GCOV_UNIT_SIZE      1
+#endif
+
+#define GCOV_DATA_MAGIC             0x67636461  // "gcda"
+#define GCOV_TAG_FUNCTION           0x01000000
+#define GCOV_TAG_FUNCTION_LENGTH    (3 * GCOV_UNIT_SIZE)
+#define GCOV_TAG_COUNTER_BASE       0x01a10000
+#define GCOV_TAG_OBJECT_SUMMARY     0xa1000000
+#define GCOV_TAG_SUMMARY_LENGTH     (2 * GCOV_UNIT_SIZE)
+#define GCOV_TAG_FOR_COUNTER(n)     (GCOV_TAG_COUNTER_BASE + ((uint32_t)(n) << 17))
+
+typedef int64_t gcov_type;
+struct gcov_info;
+
+typedef struct gcov_ctr_info {
+    uint32_t num;
+    gcov_type* values;
+} gcov_ctr_info_t;
+
+typedef struct gcov_fn_info {
+    const struct gcov_info* key;    // Object that owns the function (COMDAT)
+    uint32_t ident;
+    uint32_t lineno_checksum;
+    uint32_t cfg_checksum;
+    gcov_ctr_info_t ctrs[];         // One per counter kind with a merge function
+} gcov_fn_info_t;
+
+typedef struct gcov_info {
+    uint32_t version;
+    struct gcov_info* next;
+    uint32_t stamp;
+#if __GNUC__ >= 12
+    uint32_t checksum;
+#endif
+    const char* filename;
+    void (*merge[GCOV_COUNTERS])(gcov_type*, uint32_t);
+    uint32_t n_functions;
+    const gcov_fn_info_t* const* functions;
+} gcov_info_t;
+
+static gcov_info_t* gcov_objects;
+static uint32_t gcov_nobjects;
+
+// Called by every instrumented object's constructor
+void __gcov_init(gcov_info_t* info) {
+    info->next = gcov_objects;
+    gcov_objects = info;
+    gcov_nobjects++;
+}
+
+// Referenced by the counter tables; profiles are merged on the host
+void __gcov_merge_add(gcov_type* counters, uint32_t n) {
+    (void)counters;
+    (void)n;
+}
+
+// Called from destructors, which the kernel never runs
+void __gcov_exit(void) {
+}
+
+typedef void (*gcov_ctor_t)(void);
+extern gcov_ctor_t __init_array_start[];
+extern gcov_ctor_t __init_array_end[];
+
+void gcov_init(void) {
+    for (gcov_ctor_t* ctor = __init_array_start; ctor < __init_array_end; ctor++) {
+        (*ctor)();
+    }
+}
+
+// Output: one pass counts the bytes of an image, a second sends them
+
+static uint32_t gcov_bytes;
+static int gcov_sending;
+
+static void gcov_put_u32(uint32_t value) {
+    gcov_bytes += 4;
+    if (gcov_sending) {
+        for (int i = 0; i < 4; i++) {
+            outb(GCOV_DEBUG_PORT, (uint8_t)(value >> (i * 8)));
+        }
+    }
+}
+
+static void gcov_put_u64(gcov_type value) {
+    gcov_put_u32((uint32_t)value);
+    gcov_put_u32((uint32_t)((uint64_t)value >> 32));
+}
+
+// Arc counts are kind 0; -fprofile-arcs only activates that one, but any
+// kind the compiler gave a merge function has counters in each function
+static int gcov_counter_active(const gcov_info_t* info, uint32_t kind) {
+    return info->merge[kind] != NULL;
+}
+
+// Largest arc count of the program, for the object summaries
+static gcov_type gcov_sum_max(void) {
+    gcov_type max = 0;
+    for (gcov_info_t* info = gcov_objects; info; info = info->next) {
+        if (!gcov_counter_active(info, 0)) {
+            continue;
+        }
+        for (uint32_t f = 0; f < info->n_functions; f++) {
+            const gcov_fn_info_t* fn = info->functions[f];
+            if (!fn || fn->key != info) {
+                continue;
+            }
+            for (uint32_t i = 0; i < fn->ctrs[0].num; i++) {
+                if (fn->ctrs[0].values[i] > max) {
+                    max = fn->ctrs[0].values[i];
+                }
+            }
+        }
+    }
+    return max;
+}
+
+// The .gcda image, record for record as libgcov writes it after one run
+static void gcov_write_info(const gcov_info_t* info, gcov_type sum_max) {
+    gcov_put_u32(GCOV_DATA_MAGIC);
+    gcov_put_u32(info->version);
+    gcov_put_u32(info->stamp);
+#if __GNUC__ >= 12
+    gcov_put_u32(info->checksum);
+#endif
+    gcov_put_u32(GCOV_TAG_OBJECT_SUMMARY);
+    gcov_put_u32(GCOV_TAG_SUMMARY_LENGTH);
+    gcov_put_u32(1);                    // Runs
+    gcov_put_u32((uint32_t)sum_max);
+
+    for (uint32_t f = 0; f < info->n_functions; f++) {
+        const gcov_fn_info_t* fn = info->functions[f];
+
+        // Functions another object owns get an empty record
+        gcov_put_u32(GCOV_TAG_FUNCTION);
+        if (!fn || fn->key != info) {
+            gcov_put_u32(0);
+            continue;
+        }
+        gcov_put_u32(GCOV_TAG_FUNCTION_LENGTH);
+        gcov_put_u32(fn->ident);
+        gcov_put_u32(fn->lineno_checksum);
+        gcov_put_u32(fn->cfg_checksum);
+
+        const gcov_ctr_info_t* ctr = fn->ctrs;
+        for (uint32_t kind = 0; kind < GCOV_COUNTERS; kind++) {
+            if (!gcov_counter_active(info, kind)) {
+                continue;
+            }
+            gcov_put_u32(GCOV_TAG_FOR_COUNTER(kind));
+            gcov_put_u32(ctr->num * 2 * GCOV_UNIT_SIZE);
+            for (uint32_t i = 0; i < ctr->num; i++) {
+                gcov_put_u64(ctr->values[i]);
+            }
+            ctr++;
+        }
+    }
+}
+
+uint32_t gcov_dump(void) {
+    if (!gcov_objects) {
+        return 0;
+    }
+
+    gcov_type sum_max = gcov_sum_max();
+    for (gcov_info_t* info = gcov_objects; info; info = info->next) {
+        uint32_t name_len = 0;
+        while (info->filename[name_len]) {
+            name_len++;
+        }
+
+        gcov_sending = 0;
+        gcov_bytes = 0;
+        gcov_write_info(info, sum_max);
+        uint32_t image_bytes = gcov_bytes;
+
+        gcov_sending = 1;
+        gcov_put_u32(GCOV_STREAM_MAGIC);
+        gcov_put_u32(name_len);
+        for (uint32_t i = 0; i < name_len; i++) {
+            outb(GCOV_DEBUG_PORT, (uint8_t)info->filename[i]);
+        }
+        gcov_put_u32(image_bytes);
+        gcov_write_info(info, sum_max);
+    }
+    gcov_put_u32(GCOV_STREAM_END);
+    gcov_sending = 0;
+    return gcov_nobjects;
+}
@@ -0,0 +1,23 @@
+#ifndef GCOV_H
+#define GCOV_H
+
+#include <stdint.h>
+
+// Minimal gcov runtime for profile-guided builds (make pgo). Objects built
+// with -fprofile-arcs register their arc counters from a constructor;
+// gcov_dump writes each one out as the .gcda image libgcov would have
+// written, over the QEMU debug console port. Without instrumented objects
+// both calls do nothing.
+#define GCOV_DEBUG_PORT     0xE9        // QEMU -debugcon
+#define GCOV_STREAM_MAGIC   0x56434752  // "RGCV": a .gcda image follows
+#define GCOV_STREAM_END     0x444E4552  // "REND": no more images
+
+// Run the compiler-emitted constructors (linker script: __init_array_*)
+void gcov_init(void);
+
+// Stream format, all little endian: per object GCOV_STREAM_MAGIC, the
+// .gcda path length and path, the image length and image; then
+// GCOV_STREAM_END. Returns the number of objects written.
+uint32_t gcov_dump(void);
+
+#endif // GCOV_H
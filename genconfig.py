@@ -0,0 +1,418 @@
+#!/usr/bin/env python3
+"""Build configuration for MiniCore-OS.
+
+defconfig <profile> <.config>   Resolve a profile (configs/*.config) against
+                                Kconfig and write the complete .config
+generate <.config> [dir]        Write config.h and the gen_tables.[ch] lookup
+                                tables; a file whose contents would not
+                                change is left alone, so only the objects
+                                that see a changed value are rebuilt
+"""
+
+import os
+import re
+import sys
+
+KCONFIG = os.path.join(os.path.dirname(os.path.abspath(__file__)), "Kconfig")
+
+TYPES = ("bool", "int", "hex", "string")
+
+
+class Symbol:
+    def __init__(self, name, menu, choice):
+        self.name = name
+        self.menu = menu
+        self.choice = choice
+        self.type = None
+        self.prompt = ""
+        self.default = None
+        self.range = None
+
+
+class Choice:
+    def __init__(self, menu):
+        self.menu = menu
+        self.prompt = ""
+        self.default = None
+        self.members = []
+
+
+def fail(path, line_no, message):
+    sys.exit("%s:%d: %s" % (path, line_no, message))
+
+
+def parse_kconfig(path=KCONFIG):
+    symbols = []
+    choices = []
+    menu = None
+    choice = None
+    current = None
+    help_indent = None
+
+    with open(path) as f:
+        lines = f.read().expandtabs(8).splitlines()
+
+    for line_no, line in enumerate(lines, 1):
+        indent = len(line) - len(line.lstrip())
+        text = line.strip()
+        if help_indent is not None:
+            if not text or indent > help_indent:
+                continue
+            help_indent = None
+        if not text or text.startswith("#"):
+            continue
+
+        keyword, _, rest = text.partition(" ")
+        rest = rest.strip()
+        if keyword == "menu":
+            menu = rest.strip('"')
+        elif keyword == "endmenu":
+            menu = None
+        elif keyword == "choice":
+            choice = Choice(menu)
+            choices.append(choice)
+            current = choice
+        elif keyword == "endchoice":
+            if not choice or not choice.members:
+                fail(path, line_no, "empty or unopened choice")
+            choice = None
+            current = None
+        elif keyword == "config":
+            if not re.match(r"^[A-Z0-9_]+$", rest):
+                fail(path, line_no, "bad symbol name '%s'" % rest)
+            current = Symbol(rest, menu, choice)
+            symbols.append(current)
+            if choice:
+                choice.members.append(current)
+        elif current is None:
+            fail(path, line_no, "'%s' outside a config or choice" % keyword)
+        elif keyword == "prompt":
+            current.prompt = rest.strip('"')
+        elif keyword in TYPES:
+            current.type = keyword
+            current.prompt = rest.strip('"')
+        elif keyword == "default":
+            current.default = rest
+        elif keyword == "range":
+            bounds = rest.split()
+            if len(bounds) != 2:
+                fail(path, line_no, "range takes two values")
+            current.range = (int(bounds[0], 0), int(bounds[1], 0))
+        elif keyword == "help":
+            help_indent = indent
+        else:
+            fail(path, line_no, "unknown keyword '%s'" % keyword)
+
+    by_name = {}
+    for sym in symbols:
+        if sym.type is None:
+            sys.exit("%s: %s has no type" % (path, sym.name))
+        if sym.choice and sym.type != "bool":
+            sys.exit("%s: choice member %s is not a bool" % (path, sym.name))
+        by_name[sym.name] = sym
+    for choice in choices:
+        if choice.default not in [m.name for m in choice.members]:
+            sys.exit("%s: choice '%s' needs a default among its members" % (path, choice.prompt))
+    return symbols, choices, by_name
+
+
+def parse_value(sym, text, where):
+    if sym.type == "bool":
+        if text not in ("y", "n"):
+            sys.exit("%s: %s must be y or n, not '%s'" % (where, sym.name, text))
+        return text == "y"
+    if sym.type == "string":
+        if len(text) < 2 or text[0] != '"' or text[-1] != '"':
+            sys.exit("%s: %s must be a quoted string" % (where, sym.name))
+        return text[1:-1]
+    try:
+        value = int(text, 16 if sym.type == "hex" else 10)
+    except ValueError:
+        sys.exit("%s: %s is not a valid %s: '%s'" % (where, sym.name, sym.type, text))
+    if sym.range and not sym.range[0] <= value <= sym.range[1]:
+        sys.exit("%s: %s=%s is outside %s..%s" % (where, sym.name, text,
+                                                  format_value(sym, sym.range[0]),
+                                                  format_value(sym, sym.range[1])))
+    return value
+
+
+def format_value(sym, value):
+    if sym.type == "bool":
+        return "y" if value else "n"
+    if sym.type == "hex":
+        return "0x%x" % value
+    if sym.type == "string":
+        return '"%s"' % value
+    return str(value)
+
+
+CONFIG_LINE = re.compile(r"^CONFIG_([A-Z0-9_]+)=(.*)$")
+NOT_SET_LINE = re.compile(r"^# CONFIG_([A-Z0-9_]+) is not set$")
+
+
+def read_config(path, by_name):
+    """Assignments in a profile or .config, by symbol name"""
+    assigned = {}
+    with open(path) as f:
+        for line_no, line in enumerate(f, 1):
+            line = line.strip()
+            match = CONFIG_LINE.match(line)
+            if match:
+                name, text = match.groups()
+            else:
+                match = NOT_SET_LINE.match(line)
+                if not match:
+                    if line and not line.startswith("#"):
+                        fail(path, line_no, "not a CONFIG_ line")
+                    continue
+                name, text = match.group(1), "n"
+            if name not in by_name:
+                fail(path, line_no, "unknown symbol CONFIG_%s" % name)
+            assigned[name] = parse_value(by_name[name], text, "%s:%d" % (path, line_no))
+    return assigned
+
+
+def resolve(path, symbols, choices, by_name):
+    """Kconfig defaults overridden by the file's assignments"""
+    assigned = read_config(path, by_name)
+    values = {}
+    for sym in symbols:
+        if sym.choice:
+            continue
+        if sym.name in assigned:
+            values[sym.name] = assigned[sym.name]
+        else:
+            values[sym.name] = parse_value(sym, sym.default or "n", KCONFIG)
+
+    # One member of each choice is y: the one the file selects, else the default
+    for choice in choices:
+        selected = [m.name for m in choice.members if assigned.get(m.name)]
+        if len(selected) > 1:
+            sys.exit("%s: only one of %s can be selected for '%s'" % (path, ", ".join(selected), choice.prompt))
+        chosen = selected[0] if selected else choice.default
+        for member in choice.members:
+            values[member.name] = member.name == chosen
+    return values
+
+
+def profile_name(path):
+    return os.path.basename(path).rsplit(".config", 1)[0]
+
+
+def write_if_changed(path, text):
+    try:
+        with open(path) as f:
+            if f.read() == text:
+                return False
+    except FileNotFoundError:
+        pass
+    with open(path, "w") as f:
+        f.write(text)
+    return True
+
+
+def defconfig(profile_path, out_path):
+    symbols, choices, by_name = parse_kconfig()
+    values = resolve(profile_path, symbols, choices, by_name)
+
+    lines = ["# Generated by genconfig.py from %s; do not edit" % profile_path,
+             "# profile: %s" % profile_name(profile_path)]
+    menu = None
+    for sym in symbols:
+        if sym.menu != menu:
+            menu = sym.menu
+            lines += ["", "# %s" % menu]
+        if sym.type == "bool" and not values[sym.name]:
+            lines.append("# CONFIG_%s is not set" % sym.name)
+        else:
+            lines.append("CONFIG_%s=%s" % (sym.name, format_value(sym, values[sym.name])))
+    # Always rewritten, so the build regenerates from it
+    with open(out_path, "w") as f:
+        f.write("\n".join(lines) + "\n")
+    print("genconfig: wrote %s (profile %s)" % (out_path, profile_name(profile_path)))
+
+
+# Lookup tables
+
+# Scan code set 1 rows: the number row starts at 0x02, the top letter row at
+# 0x10, the home row at 0x1E and the bottom row (from the key left of Z) at
+# 0x2B. '\0' marks keys with no ASCII character.
+KEYMAP_SIZE = 0x3A
+KEYMAP_ROWS = (0x02, 0x10, 0x1E, 0x2B)
+KEYMAP_FIXED = {0x37: "*", 0x39: " "}      # Keypad *, space
+
+KEYBOARD_LAYOUTS = {
+    "KEYBOARD_US": (
+        ("1234567890-=", "qwertyuiop[]", "asdfghjkl;'`", "\\zxcvbnm,./"),
+        ("!@#$%^&*()_+", "QWERTYUIOP{}", 'ASDFGHJKL:"~', "|ZXCVBNM<>?"),
+    ),
+    "KEYBOARD_UK": (
+        ("1234567890-=", "qwertyuiop[]", "asdfghjkl;'`", "#zxcvbnm,./"),
+        ('!"\0$%^&*()_+', "QWERTYUIOP{}", "ASDFGHJKL:@\0", "~ZXCVBNM<>?"),
+    ),
+    "KEYBOARD_DE": (
+        ("1234567890\0\0", "qwertzuiop\0+", "asdfghjkl\0\0^", "#yxcvbnm,.-"),
+        ('!"\0$%&/()=?`', "QWERTZUIOP\0*", "ASDFGHJKL\0\0\0", "'YXCVBNM;:_"),
+    ),
+    "KEYBOARD_DVORAK": (
+        ("1234567890[]", "',.pyfgcrl/=", "aoeuidhtns-`", "\\;qjkxbmwvz"),
+        ("!@#$%^&*(){}", '"<>PYFGCRL?+', "AOEUIDHTNS_~", "|:QJKXBMWVZ"),
+    ),
+}
+
+EXCEPTION_NAMES = (
+    "Division By Zero",
+    "Debug",
+    "Non Maskable Interrupt",
+    "Breakpoint",
+    "Into Detected Overflow",
+    "Out of Bounds",
+    "Invalid Opcode",
+    "No Coprocessor",
+    "Double Fault",
+    "Coprocessor Segment Overrun",
+    "Bad TSS",
+    "Segment Not Present",
+    "Stack Fault",
+    "General Protection Fault",
+    "Page Fault",
+    "Unknown Interrupt",
+    "Coprocessor Fault",
+    "Alignment Check",
+    "Machine Check",
+) + ("Reserved",) * 13
+
+# Interrupt gates: the exception stubs, then IRQ0-15 remapped to 32-47
+IDT_GATE_FLAGS = 0x8E       # Present, ring 0, 32-bit interrupt gate
+IDT_GATES = [(n, "isr%d" % n) for n in range(32)] + [(32 + n, "irq%d" % n) for n in range(16)]
+
+
+def c_char(c):
+    if c == "\0":
+        return "0"
+    if c in "\\'":
+        return "'\\%s'" % c
+    return "'%s'" % c
+
+
+def build_keymap(layout, shifted):
+    rows = KEYBOARD_LAYOUTS[layout][1 if shifted else 0]
+    keymap = ["\0"] * KEYMAP_SIZE
+    for start, row in zip(KEYMAP_ROWS, rows):
+        for i, c in enumerate(row):
+            keymap[start + i] = c
+    for code, c in KEYMAP_FIXED.items():
+        keymap[code] = c
+    return keymap
+
+
+def keymap_source(name, keymap):
+    out = ["const char %s[KEYMAP_SIZE] = {" % name]
+    for base in range(0, KEYMAP_SIZE, 8):
+        chars = ", ".join(c_char(c) for c in keymap[base:base + 8])
+        out.append("    %s,%s// 0x%02X" % (chars, " " * max(1, 50 - len(chars)), base))
+    out.append("};")
+    return out
+
+
+def generate(config_path, out_dir):
+    symbols, choices, by_name = parse_kconfig()
+    values = resolve(config_path, symbols, choices, by_name)
+
+    profile = None
+    with open(config_path) as f:
+        for line in f:
+            if line.startswith("# profile: "):
+                profile = line[len("# profile: "):].strip()
+    origin = "%s (profile %s)" % (config_path, profile) if profile else config_path
+    banner = "// Generated by genconfig.py from %s; do not edit" % origin
+
+    layouts = [name for name in KEYBOARD_LAYOUTS if values.get(name)]
+    unknown = [m.name for c in choices for m in c.members
+               if m.name.startswith("KEYBOARD_") and m.name not in KEYBOARD_LAYOUTS]
+    if unknown or len(layouts) != 1:
+        sys.exit("genconfig: no keyboard table for %s" % ", ".join(unknown or ["the selection"]))
+    for rows in KEYBOARD_LAYOUTS[layouts[0]]:
+        for start, row, end in zip(KEYMAP_ROWS, rows, KEYMAP_ROWS[1:] + (KEYMAP_SIZE,)):
+            if start + len(row) > end:
+                sys.exit("genconfig: %s row at 0x%02X is too long" % (layouts[0], start))
+    layout_prompt = by_name[layouts[0]].prompt
+
+    # config.h: every symbol, bools as 1/0 so they work in #if and in C
+    header = [banner, "#ifndef CONFIG_H", "#define CONFIG_H", ""]
+    header += ['#define CONFIG_PROFILE "%s"' % (profile or "custom"), ""]
+    menu = None
+    for sym in symbols:
+        if sym.menu != menu:
+            if menu is not None:
+                header.append("")
+            menu = sym.menu
+            header.append("// %s" % menu)
+        value = values[sym.name]
+        if sym.type == "bool":
+            text = "1" if value else "0"
+        elif sym.type == "string":
+            text = '"%s"' % value
+        else:
+            text = format_value(sym, value)
+        header.append("#define CONFIG_%s %s" % (sym.name, text))
+    header += ["", "#endif // CONFIG_H"]
+
+    tables_h = [
+        banner,
+        "#ifndef GEN_TABLES_H",
+        "#define GEN_TABLES_H",
+        "",
+        "#include <stdint.h>",
+        "",
+        "// Scan code set 1 to ASCII, %s; 0 for keys without a character" % layout_prompt,
+        "#define KEYMAP_SIZE 0x%02X" % KEYMAP_SIZE,
+        "extern const char keymap_normal[KEYMAP_SIZE];",
+        "extern const char keymap_shift[KEYMAP_SIZE];",
+        "",
+        "// CPU exception names, by vector",
+        "#define EXCEPTION_COUNT %d" % len(EXCEPTION_NAMES),
+        "extern const char* const exception_names[EXCEPTION_COUNT];",
+        "",
+        "// The gates idt_init installs (stubs in interrupt.asm)",
+        "typedef struct {",
+        "    uint8_t vector;",
+        "    uint8_t flags;",
+        "    void (*handler)(void);",
+        "} idt_gate_t;",
+        "",
+        "#define IDT_GATE_COUNT %d" % len(IDT_GATES),
+        "extern const idt_gate_t idt_gates[IDT_GATE_COUNT];",
+        "",
+        "#endif // GEN_TABLES_H",
+    ]
+
+    tables_c = [banner, '#include "gen_tables.h"', '#include "idt.h"', ""]
+    tables_c += ["// %s" % layout_prompt]
+    tables_c += keymap_source("keymap_normal", build_keymap(layouts[0], False))
+    tables_c += [""]
+    tables_c += keymap_source("keymap_shift", build_keymap(layouts[0], True))
+    tables_c += ["", "const char* const exception_names[EXCEPTION_COUNT] = {"]
+    tables_c += ['    "%s",' % name for name in EXCEPTION_NAMES]
+    tables_c += ["};", "", "const idt_gate_t idt_gates[IDT_GATE_COUNT] = {"]
+    tables_c += ["    { %d, 0x%02X, %s }," % (vector, IDT_GATE_FLAGS, stub) for vector, stub in IDT_GATES]
+    tables_c += ["};"]
+
+    changed = []
+    for name, lines in (("config.h", header), ("gen_tables.h", tables_h), ("gen_tables.c", tables_c)):
+        if write_if_changed(os.path.join(out_dir, name), "\n".join(lines) + "\n"):
+            changed.append(name)
+    print("genconfig: %s" % (", ".join(changed) + " updated" if changed else "up to date"))
+
+
+def main():
+    if len(sys.argv) == 4 and sys.argv[1] == "defconfig":
+        defconfig(sys.argv[2], sys.argv[3])
+    elif len(sys.argv) in (3, 4) and sys.argv[1] == "generate":
+        generate(sys.argv[2], sys.argv[3] if len(sys.argv) == 4 else ".")
+    else:
+        sys.exit(__doc__)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,406 @@
+#include "hashtable.h"
+#include "mm.h"
+#include "ktime.h"
+#include "klib.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+
+// Keep stores in program order for lockless readers
+static inline void hash_barrier(void) {
+    __asm__ volatile ("" : : : "memory");
+}
+
+// Hash functions
+
+#define FNV_OFFSET_BASIS    2166136261u
+#define FNV_PRIME           16777619u
+
+uint32_t hash_fnv1a(const void* data, size_t len) {
+    const uint8_t* p = (const uint8_t*)data;
+    uint32_t hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+uint32_t hash_fnv1a_str(const char* str) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+    while (*str) {
+        hash ^= (uint8_t)*str++;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+#define XXH_PRIME1  2654435761u
+#define XXH_PRIME2  2246822519u
+#define XXH_PRIME3  3266489917u
+#define XXH_PRIME4  668265263u
+#define XXH_PRIME5  374761393u
+
+static inline uint32_t xxh_rotl(uint32_t x, int r) {
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline uint32_t xxh_read32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t xxh_round(uint32_t acc, uint32_t input) {
+    acc += input * XXH_PRIME2;
+    return xxh_rotl(acc, 13) * XXH_PRIME1;
+}
+
+uint32_t hash_xxh32(const void* data, size_t len, uint32_t seed) {
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + len;
+    uint32_t hash;
+
+    if (len >= 16) {
+        uint32_t v1 = seed + XXH_PRIME1 + XXH_PRIME2;
+        uint32_t v2 = seed + XXH_PRIME2;
+        uint32_t v3 = seed;
+        uint32_t v4 = seed - XXH_PRIME1;
+        while (end - p >= 16) {
+            v1 = xxh_round(v1, xxh_read32(p));
+            v2 = xxh_round(v2, xxh_read32(p + 4));
+            v3 = xxh_round(v3, xxh_read32(p + 8));
+            v4 = xxh_round(v4, xxh_read32(p + 12));
+            p += 16;
+        }
+        hash = xxh_rotl(v1, 1) + xxh_rotl(v2, 7) + xxh_rotl(v3, 12) + xxh_rotl(v4, 18);
+    } else {
+        hash = seed + XXH_PRIME5;
+    }
+    hash += (uint32_t)len;
+
+    while (end - p >= 4) {
+        hash += xxh_read32(p) * XXH_PRIME3;
+        hash = xxh_rotl(hash, 17) * XXH_PRIME4;
+        p += 4;
+    }
+    while (p < end) {
+        hash += *p++ * XXH_PRIME5;
+        hash = xxh_rotl(hash, 11) * XXH_PRIME1;
+    }
+
+    hash ^= hash >> 15;
+    hash *= XXH_PRIME2;
+    hash ^= hash >> 13;
+    hash *= XXH_PRIME3;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+uint32_t hash_xxh32_str(const char* str) {
+    return hash_xxh32(str, strlen(str), 0);
+}
+
+// Table
+
+// Fold the high bits in so multiplicative hashes spread over small tables
+static inline uint32_t hash_bucket(uint32_t hash, uint32_t size) {
+    return (hash ^ (hash >> 16)) & (size - 1);
+}
+
+static hash_node_t** hash_alloc_buckets(uint32_t size) {
+    return (hash_node_t**)kcalloc(size, sizeof(hash_node_t*));
+}
+
+int hash_table_init(hash_table_t* table, const hash_table_ops_t* ops, uint32_t min_size) {
+    uint32_t size = HASH_MIN_SIZE;
+    while (size < min_size) {
+        size <<= 1;
+    }
+
+    memset(table, 0, sizeof(hash_table_t));
+    table->ops = ops;
+    table->min_size = size;
+    table->size = size;
+    table->buckets = hash_alloc_buckets(size);
+    return table->buckets ? 0 : -1;
+}
+
+void hash_table_destroy(hash_table_t* table) {
+    kfree(table->old_buckets);
+    kfree(table->buckets);
+    table->old_buckets = NULL;
+    table->buckets = NULL;
+    table->size = 0;
+    table->count = 0;
+}
+
+// Move up to nr old chains into the current array (empty buckets are
+// cheap and count a sixteenth, so sparse tables drain quickly after a
+// shrink). Each chain is moved from its tail, so the node being moved is
+// the only one whose next pointer changes and it is reachable from both
+// arrays meanwhile.
+static void hash_migrate(hash_table_t* table, uint32_t nr) {
+    uint32_t budget = nr * 16;
+    while (table->old_buckets && budget > 0) {
+        hash_node_t** old_head = &table->old_buckets[table->migrate_pos];
+        budget -= (*old_head && budget >= 16) ? 16 : 1;
+        while (*old_head) {
+            hash_node_t** link = old_head;
+            while ((*link)->next) {
+                link = &(*link)->next;
+            }
+            hash_node_t* node = *link;
+            uint32_t bucket = hash_bucket(node->hash, table->size);
+            node->next = table->buckets[bucket];
+            hash_barrier();
+            table->buckets[bucket] = node;
+            hash_barrier();
+            *link = NULL;
+        }
+
+        if (++table->migrate_pos == table->old_size) {
+            kfree(table->old_buckets);
+            table->old_buckets = NULL;
+            table->old_size = 0;
+        }
+    }
+}
+
+// Switch to a new bucket array; entries follow over the next writes
+static void hash_resize(hash_table_t* table, uint32_t size) {
+    hash_node_t** buckets = hash_alloc_buckets(size);
+    if (!buckets) {
+        return; // Longer chains until a later write manages it
+    }
+    table->old_buckets = table->buckets;
+    table->old_size = table->size;
+    table->migrate_pos = 0;
+    hash_barrier();
+    table->buckets = buckets;
+    table->size = size;
+    table->resizes++;
+}
+
+static hash_node_t* hash_search(hash_table_t* table, hash_node_t** buckets, uint32_t size,
+                                uint32_t hash, const void* key) {
+    for (hash_node_t* node = buckets[hash_bucket(hash, size)]; node; node = node->next) {
+        table->probes++;
+        if (node->hash == hash && table->ops->match(node, key)) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+static hash_node_t* hash_find(hash_table_t* table, uint32_t hash, const void* key) {
+    // Old array first: a moved entry reaches the new one before leaving it
+    hash_node_t** old_buckets = table->old_buckets;
+    uint32_t old_size = table->old_size;
+    hash_node_t* node = NULL;
+    if (old_buckets) {
+        node = hash_search(table, old_buckets, old_size, hash, key);
+    }
+    if (!node) {
+        node = hash_search(table, table->buckets, table->size, hash, key);
+    }
+    return node;
+}
+
+hash_node_t* hash_table_lookup(hash_table_t* table, const void* key) {
+    table->lookups++;
+    return hash_find(table, table->ops->hash(key), key);
+}
+
+int hash_table_insert(hash_table_t* table, hash_node_t* node, const void* key) {
+    uint32_t hash = table->ops->hash(key);
+    if (hash_find(table, hash, key)) {
+        return -1;
+    }
+    hash_migrate(table, HASH_MIGRATE_BATCH);
+
+    uint32_t bucket = hash_bucket(hash, table->size);
+    node->hash = hash;
+    node->next = table->buckets[bucket];
+    hash_barrier();
+    table->buckets[bucket] = node;
+    table->count++;
+
+    if (!table->old_buckets && table->count * HASH_GROW_DEN > table->size * HASH_GROW_NUM) {
+        hash_resize(table, table->size * 2);
+    }
+    return 0;
+}
+
+// Unlink the entry from one array; it keeps its next pointer for readers
+static hash_node_t* hash_unlink(hash_table_t* table, hash_node_t** buckets, uint32_t size,
+                                uint32_t hash, const void* key) {
+    hash_node_t** link = &buckets[hash_bucket(hash, size)];
+    for (; *link; link = &(*link)->next) {
+        hash_node_t* node = *link;
+        if (node->hash == hash && table->ops->match(node, key)) {
+            *link = node->next;
+            return node;
+        }
+    }
+    return NULL;
+}
+
+hash_node_t* hash_table_remove(hash_table_t* table, const void* key) {
+    uint32_t hash = table->ops->hash(key);
+    hash_node_t* node = NULL;
+    if (table->old_buckets) {
+        node = hash_unlink(table, table->old_buckets, table->old_size, hash, key);
+    }
+    if (!node) {
+        node = hash_unlink(table, table->buckets, table->size, hash, key);
+    }
+    if (!node) {
+        return NULL;
+    }
+    table->count--;
+    hash_migrate(table, HASH_MIGRATE_BATCH);
+
+    if (!table->old_buckets && table->size > table->min_size &&
+        table->count * HASH_SHRINK_DEN < table->size) {
+        hash_resize(table, table->size / 2);
+    }
+    return node;
+}
+
+void hash_table_print_stats(const hash_table_t* table, const char* name) {
+    terminal_writestring(name);
+    terminal_writestring(": ");
+    terminal_write_dec(table->count);
+    terminal_writestring(" entries in ");
+    terminal_write_dec(table->size);
+    terminal_writestring(" buckets");
+    if (table->old_buckets) {
+        terminal_writestring(" (resizing from ");
+        terminal_write_dec(table->old_size);
+        terminal_writestring(")");
+    }
+    terminal_writestring(", ");
+    terminal_write_dec(table->resizes);
+    terminal_writestring(" resizes, ");
+    terminal_write_dec(table->lookups);
+    terminal_writestring(" lookups, ");
+    terminal_write_dec(table->probes);
+    terminal_writestring(" probes\n");
+}
+
+// Benchmark
+
+typedef struct hash_bench_entry {
+    hash_node_t node;
+    char key[12];
+} hash_bench_entry_t;
+
+static void hash_bench_key(char* key, uint32_t value) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    int pos = 0;
+    key[pos++] = 'k';
+    key[pos++] = '-';
+    while (n > 0) {
+        key[pos++] = digits[--n];
+    }
+    key[pos] = '\0';
+}
+
+static int hash_bench_equal(const char* a, const char* b) {
+    return strcmp(a, b) == 0;
+}
+
+static uint32_t hash_bench_hash(const void* key) {
+    return hash_fnv1a_str((const char*)key);
+}
+
+static int hash_bench_match(const hash_node_t* node, const void* key) {
+    return hash_bench_equal(hash_entry(node, hash_bench_entry_t, node)->key, (const char*)key);
+}
+
+static const hash_table_ops_t hash_bench_ops = {
+    .hash = hash_bench_hash,
+    .match = hash_bench_match,
+};
+
+void hash_table_benchmark(uint32_t n) {
+    hash_bench_entry_t* entries = (hash_bench_entry_t*)kcalloc(n, sizeof(hash_bench_entry_t));
+    hash_table_t table;
+    if (!entries || hash_table_init(&table, &hash_bench_ops, 0) != 0) {
+        terminal_writestring("Out of memory\n");
+        kfree(entries);
+        return;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        hash_bench_key(entries[i].key, i * 7919);
+    }
+
+    // Inserts: the slowest one shows whether any resize stalled
+    uint32_t worst_us = 0;
+    uint32_t start = (uint32_t)ktime_get_us();
+    int ok = 1;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t t0 = (uint32_t)ktime_get_us();
+        ok &= hash_table_insert(&table, &entries[i].node, entries[i].key) == 0;
+        uint32_t t = (uint32_t)ktime_get_us() - t0;
+        if (t > worst_us) {
+            worst_us = t;
+        }
+    }
+    uint32_t insert_us = (uint32_t)ktime_get_us() - start;
+
+    // Every key once, through the table and by linear scan
+    start = (uint32_t)ktime_get_us();
+    for (uint32_t i = 0; i < n; i++) {
+        hash_node_t* node = hash_table_lookup(&table, entries[i].key);
+        ok &= node == &entries[i].node;
+    }
+    uint32_t lookup_us = (uint32_t)ktime_get_us() - start;
+
+    start = (uint32_t)ktime_get_us();
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t j = 0;
+        while (j < n && !hash_bench_equal(entries[j].key, entries[i].key)) {
+            j++;
+        }
+        ok &= j == i;
+    }
+    uint32_t linear_us = (uint32_t)ktime_get_us() - start;
+
+    hash_table_print_stats(&table, "table");
+    uint32_t resizes = table.resizes;
+    for (uint32_t i = 0; i < n; i++) {
+        ok &= hash_table_remove(&table, entries[i].key) == &entries[i].node;
+    }
+    ok &= table.count == 0 && hash_table_lookup(&table, entries[0].key) == NULL;
+
+    terminal_writestring("Inserted ");
+    terminal_write_dec(n);
+    terminal_writestring(" keys in ");
+    terminal_write_dec(insert_us);
+    terminal_writestring(" us (slowest ");
+    terminal_write_dec(worst_us);
+    terminal_writestring(" us, ");
+    terminal_write_dec(resizes);
+    terminal_writestring(" resizes)\n");
+    terminal_writestring("Lookups: ");
+    terminal_write_dec(lookup_us);
+    terminal_writestring(" us hashed, ");
+    terminal_write_dec(linear_us);
+    terminal_writestring(" us by linear scan\n");
+    terminal_writestring("After removing all: ");
+    terminal_write_dec(table.size);
+    terminal_writestring(" buckets, ");
+    terminal_write_dec(table.resizes - resizes);
+    terminal_writestring(" shrinks\n");
+    terminal_writestring(ok ? "Result: OK\n" : "Result: FAILED\n");
+
+    hash_table_destroy(&table);
+    kfree(entries);
+}
@@ -0,0 +1,79 @@
+#ifndef HASHTABLE_H
+#define HASHTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Intrusive chained hash table. Objects embed a hash_node_t; the table
+// never allocates per entry, only its bucket arrays.
+//
+// Growing and shrinking are incremental: a new bucket array is allocated
+// and every later insert or removal moves a few buckets over, so no single
+// operation rehashes the whole table. Lookups take no locks: nodes are
+// published fully initialised, unlinked nodes keep their next pointer, and
+// a bucket move relinks the tail of the old chain first, so an entry is
+// always reachable from the old array, the new one, or both. Lookups try
+// the old array first. Writers must be serialised by the caller.
+#define HASH_MIN_SIZE           8       // Buckets; sizes are powers of two
+#define HASH_MIGRATE_BATCH      4       // Chains moved per write while resizing
+
+// Grow above 3/4 entries per bucket, shrink below 1/8
+#define HASH_GROW_NUM           3
+#define HASH_GROW_DEN           4
+#define HASH_SHRINK_DEN         8
+
+typedef struct hash_node {
+    struct hash_node* next;
+    uint32_t hash;              // Cached so moves and chain walks skip rehashing
+} hash_node_t;
+
+// How a table hashes keys and matches them against entries
+typedef struct hash_table_ops {
+    uint32_t (*hash)(const void* key);
+    int (*match)(const hash_node_t* node, const void* key);    // Nonzero if equal
+} hash_table_ops_t;
+
+typedef struct hash_table {
+    const hash_table_ops_t* ops;
+    hash_node_t** buckets;
+    uint32_t size;
+    hash_node_t** old_buckets;  // Being drained while resizing, else NULL
+    uint32_t old_size;
+    uint32_t migrate_pos;       // Next old bucket to move
+    uint32_t min_size;
+    uint32_t count;
+
+    // Statistics
+    uint32_t resizes;
+    uint32_t lookups;
+    uint32_t probes;            // Entries compared by lookups
+} hash_table_t;
+
+// Entry that embeds a node
+#define hash_entry(node, type, member) \
+    ((type*)((char*)(node) - offsetof(type, member)))
+
+// Hash functions
+uint32_t hash_fnv1a(const void* data, size_t len);
+uint32_t hash_fnv1a_str(const char* str);
+uint32_t hash_xxh32(const void* data, size_t len, uint32_t seed);
+uint32_t hash_xxh32_str(const char* str);
+static inline uint32_t hash_u32(uint32_t value) {
+    return value * 0x9E3779B1u;     // Fibonacci hashing (buckets fold in the high bits)
+}
+
+// min_size is rounded up to a power of two; returns -1 without memory
+int hash_table_init(hash_table_t* table, const hash_table_ops_t* ops, uint32_t min_size);
+void hash_table_destroy(hash_table_t* table);
+
+// Returns -1 if the key is already present
+int hash_table_insert(hash_table_t* table, hash_node_t* node, const void* key);
+hash_node_t* hash_table_lookup(hash_table_t* table, const void* key);
+hash_node_t* hash_table_remove(hash_table_t* table, const void* key);
+
+void hash_table_print_stats(const hash_table_t* table, const char* name);
+
+// Insert, look up and remove n string keys; compares against a linear scan
+void hash_table_benchmark(uint32_t n);
+
+#endif // HASHTABLE_H
@@ -0,0 +1,87 @@
+#include <stddef.h>
+#include "hpet.h"
+#include "acpi.h"
+#include "ktime.h"
+#include "mm.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+extern void terminal_write_hex(uint32_t value);
+
+static volatile uint8_t* hpet_base = NULL;
+
+static inline uint32_t hpet_read32(uint32_t reg) {
+    return *(volatile uint32_t*)(hpet_base + reg);
+}
+
+static inline void hpet_write32(uint32_t reg, uint32_t value) {
+    *(volatile uint32_t*)(hpet_base + reg) = value;
+}
+
+// The 64-bit counter is read in halves; retry if the low half wrapped in between
+static uint64_t hpet_read_counter64(void) {
+    uint32_t high, low;
+    do {
+        high = hpet_read32(HPET_COUNTER + 4);
+        low = hpet_read32(HPET_COUNTER);
+    } while (high != hpet_read32(HPET_COUNTER + 4));
+    return ((uint64_t)high << 32) | low;
+}
+
+static uint64_t hpet_read_counter32(void) {
+    return hpet_read32(HPET_COUNTER);
+}
+
+static clocksource_t hpet_clocksource = {
+    "hpet",
+    CLOCKSOURCE_RATING_HPET,
+    hpet_read_counter64,
+    0xFFFFFFFFFFFFFFFFULL,
+    0,
+    0, 0
+};
+
+int hpet_init(void) {
+    acpi_hpet_t* table = (acpi_hpet_t*)acpi_find_table("HPET");
+    if (!table || table->base_address.address_space != 0 ||
+        (table->base_address.address >> 32) != 0) {
+        return -1;
+    }
+
+    uint32_t base = (uint32_t)table->base_address.address;
+    if (paging_map_page(paging_get_kernel_directory(), base, base,
+                        PAGE_PRESENT | PAGE_WRITABLE | PAGE_CACHE_DISABLE) != 0) {
+        return -1;
+    }
+    hpet_base = (volatile uint8_t*)base;
+
+    // Tick period in femtoseconds is the upper half of the capabilities
+    uint32_t period_fs = hpet_read32(HPET_CAP + 4);
+    if (period_fs == 0 || period_fs > HPET_MAX_PERIOD_FS) {
+        hpet_base = NULL;
+        return -1;
+    }
+
+    if (!(hpet_read32(HPET_CAP) & HPET_CAP_COUNT_64)) {
+        hpet_clocksource.read = hpet_read_counter32;
+        hpet_clocksource.mask = 0xFFFFFFFF;
+    }
+    hpet_clocksource.frequency = 1000000000000000ULL / period_fs;
+
+    // Reset and start the main counter (legacy replacement routing stays off)
+    hpet_write32(HPET_CONFIG, hpet_read32(HPET_CONFIG) & ~HPET_CONFIG_ENABLE);
+    hpet_write32(HPET_COUNTER, 0);
+    hpet_write32(HPET_COUNTER + 4, 0);
+    hpet_write32(HPET_CONFIG, hpet_read32(HPET_CONFIG) | HPET_CONFIG_ENABLE);
+
+    clocksource_register(&hpet_clocksource);
+
+    terminal_writestring("HPET: 0x");
+    terminal_write_hex(base);
+    terminal_writestring(", ");
+    terminal_write_dec((uint32_t)(hpet_clocksource.frequency / 1000));
+    terminal_writestring(" kHz, ");
+    terminal_writestring(hpet_clocksource.mask == 0xFFFFFFFF ? "32-bit\n" : "64-bit\n");
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef HPET_H
+#define HPET_H
+
+#include <stdint.h>
+
+// Register offsets from the ACPI-provided base
+#define HPET_CAP            0x000   // General capabilities and ID (64-bit)
+#define HPET_CONFIG         0x010
+#define HPET_COUNTER        0x0F0   // Main counter (64-bit)
+
+#define HPET_CAP_COUNT_64   (1u << 13)
+#define HPET_CONFIG_ENABLE  0x01
+#define HPET_MAX_PERIOD_FS  100000000   // Spec limit: 100ns per tick
+
+// Find the HPET through ACPI, start its counter and register it as a
+// clock source; returns 0 on success
+int hpet_init(void);
+
+#endif // HPET_H
@@ -1,5 +1,6 @@
 #include "isr.h"
 #include "idt.h"
+#include "gen_tables.h"
 
 // I/O functions
 static inline void outb(uint16_t port, uint8_t val) {
@@ -15,42 +16,6 @@ static inline uint8_t inb(uint16_t port) {
 // ISR handler table
 static isr_t interrupt_handlers[256];
 
-// Exception messages
-static const char* exception_messages[] = {
-    "Division By Zero",
-    "Debug",
-    "Non Maskable Interrupt",
-    "Breakpoint",
-    "Into Detected Overflow",
-    "Out of Bounds",
-    "Invalid Opcode",
-    "No Coprocessor",
-    "Double Fault",
-    "Coprocessor Segment Overrun",
-    "Bad TSS",
-    "Segment Not Present",
-    "Stack Fault",
-    "General Protection Fault",
-    "Page Fault",
-    "Unknown Interrupt",
-    "Coprocessor Fault",
-    "Alignment Check",
-    "Machine Check",
-    "Reserved",
-    "Reserved",
-    "Reserved",
-    "Reserved",
-    "Reserved",
-    "Reserved",
-    "Reserved",
-    "Reserved",
-    "Reserved",
-    "Reserved",
-    "Reserved",
-    "Reserved",
-    "Reserved"
-};
-
 // External functions from kernel
 extern void terminal_writestring(const char* data);
 extern void terminal_setcolor(uint8_t color);
@@ -84,8 +49,8 @@ void isr_handler(struct registers* r) {
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
     terminal_writestring("Exception: ");
     
-    if (r->int_no < 32) {
-        terminal_writestring(exception_messages[r->int_no]);
+    if (r->int_no < EXCEPTION_COUNT) {
+        terminal_writestring(exception_names[r->int_no]);
     } else {
         terminal_writestring("Unknown Exception");
     }
@@ -6,6 +6,28 @@
 #include "isr.h"
 #include "scheduler.h"
 #include "fs.h"
+#include "pci.h"
+#include "ata.h"
+#include "virtio_blk.h"
+#include "ahci.h"
+#include "dma.h"
+#include "acpi.h"
+#include "rtc.h"
+#include "hpet.h"
+#include "ktime.h"
+#include "net.h"
+#include "e1000.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "ksm.h"
+#include "reclaim.h"
+#include "memcg.h"
+#include "kmem.h"
+#include "klib.h"
+#include "gcov.h"
+#include "multiboot.h"
+#include "tunable.h"
+#include "boottime.h"
 
 /* Hardware text mode color constants. */
 enum vga_color {
@@ -38,12 +60,30 @@ static inline uint16_t vga_entry(unsigned char uc, uint8_t color) {
 // Forward declarations
 void terminal_scroll_up(void);
 
-size_t strlen(const char* str) {
-    size_t len = 0;
-    while (str[len])
-        len++;
-    return len;
+#ifdef BENCH_AUTORUN
+// Headless benchmark runs (make pgo): the console is copied to COM1 for the
+// host, and QEMU's isa-debug-exit device ends the run
+#define BENCH_SERIAL_PORT   0x3F8
+#define BENCH_SERIAL_LSR    (BENCH_SERIAL_PORT + 5)
+#define BENCH_SERIAL_THRE   0x20        // Transmit holding register empty
+#define BENCH_EXIT_PORT     0xF4
+
+static inline void outb(uint16_t port, uint8_t data) {
+    __asm__ __volatile__("outb %1, %0" : : "dN"(port), "a"(data));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t result;
+    __asm__ __volatile__("inb %1, %0" : "=a"(result) : "dN"(port));
+    return result;
+}
+
+static void bench_serial_putchar(char c) {
+    while (!(inb(BENCH_SERIAL_LSR) & BENCH_SERIAL_THRE)) {
+    }
+    outb(BENCH_SERIAL_PORT, (uint8_t)c);
 }
+#endif
 
 static const size_t VGA_WIDTH = 80;
 static const size_t VGA_HEIGHT = 25;
@@ -76,6 +116,9 @@ void terminal_putentryat(char c, uint8_t color, size_t x, size_t y) {
 }
 
 void terminal_putchar(char c) {
+#ifdef BENCH_AUTORUN
+    bench_serial_putchar(c);
+#endif
     if (c == '\n') {
         terminal_column = 0;
         if (++terminal_row == VGA_HEIGHT) {
@@ -132,15 +175,6 @@ void terminal_scroll_up(void) {
     }
 }
 
-// Simple string comparison function
-int strcmp(const char* str1, const char* str2) {
-    while (*str1 && (*str1 == *str2)) {
-        str1++;
-        str2++;
-    }
-    return *(unsigned char*)str1 - *(unsigned char*)str2;
-}
-
 // Helper function to write hexadecimal numbers
 void terminal_write_hex(uint32_t value) {
     char hex_digits[] = "0123456789ABCDEF";
@@ -227,9 +261,22 @@ void process_command(const char* command) {
     }
 }
 
-void kernel_main(void) {
+void kernel_main(uint32_t magic, multiboot_info_t* mbi) {
+    /* Register profile counters (instrumented PGO builds only) */
+    gcov_init();
+    
+    /* Keep the command line; subsystems read their tunables from it */
+    const char* cmdline = NULL;
+    if (magic == MULTIBOOT_BOOTLOADER_MAGIC && (mbi->flags & MULTIBOOT_INFO_CMDLINE)) {
+        cmdline = (const char*)mbi->cmdline;
+    }
+    tunable_init(cmdline);
+    
     /* Initialize terminal interface */
     terminal_initialize();
+    
+    /* Pick the string routines for this CPU */
+    klib_init();
 
     /* Display welcome message */
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
@@ -242,6 +289,11 @@ void kernel_main(void) {
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_BROWN, VGA_COLOR_BLACK));
     terminal_writestring("Initializing memory management...\n");
     mm_init(NULL, 0); // Initialize with default heap
+    dma_init();
+    pmm_init();
+    reclaim_init();
+    memcg_init();
+    kmem_init();
     terminal_writestring("Memory management initialized!\n");
     
     /* Initialize interrupt system */
@@ -249,6 +301,8 @@ void kernel_main(void) {
     terminal_writestring("Initializing interrupt system...\n");
     idt_init();
     isr_init();
+    vmm_init();
+    ksm_init();
     terminal_writestring("IDT and ISR initialized!\n");
     
     /* Initialize scheduler and multitasking */
@@ -256,6 +310,30 @@ void kernel_main(void) {
     terminal_writestring("Initializing scheduler...\n");
     scheduler_init();
     
+    /* Initialize clock sources */
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK));
+    terminal_writestring("Initializing clock sources...\n");
+    acpi_init();
+    rtc_init();
+    hpet_init();
+    ktime_init();
+    
+    /* Enumerate PCI devices */
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("Scanning PCI bus...\n");
+    pci_init();
+    
+    /* Probe block devices */
+    terminal_writestring("Probing block devices...\n");
+    ata_init();
+    virtio_blk_init();
+    ahci_init();
+    
+    /* Bring up the network stack */
+    terminal_writestring("Initializing network stack...\n");
+    net_init();
+    e1000_init();
+    
     /* Initialize file system */
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_BROWN, VGA_COLOR_BLACK));
     terminal_writestring("Initializing file system...\n");
@@ -272,7 +350,9 @@ void kernel_main(void) {
     terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
     terminal_writestring("\nSystem Information:\n");
     terminal_writestring("- Architecture: x86 (32-bit) | Mode: Protected Mode\n");
-    terminal_writestring("- Memory: 1MB Heap | Display: VGA 80x25 | File System: Active\n");
+    terminal_writestring("- Memory: ");
+    terminal_write_dec(mm_get_stats().total_memory / 1024);
+    terminal_writestring("KB Heap | Display: VGA 80x25 | File System: Active\n");
     terminal_writestring("- Interrupts: Ready (use 'enableints' to activate)\n");
     
     /* Demonstrate memory management */
@@ -288,12 +368,21 @@ void kernel_main(void) {
     terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
     
     shell_init();
+    boottime_ready();
     
     /* Enter shell main loop - now with multitasking! */
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_BROWN, VGA_COLOR_BLACK));
     terminal_writestring("Multitasking demo running in background...\n");
     terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
     
+#ifdef BENCH_AUTORUN
+    /* Headless run: the benchmark suite, the profile if this build
+       collects one, then power off */
+    shell_run_line("bench");
+    gcov_dump();
+    outb(BENCH_EXIT_PORT, 0);
+#endif
+    
     shell_run();
     
     /* Should never reach here */
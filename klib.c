@@ -0,0 +1,429 @@
+#include "klib.h"
+#include "mm.h"
+#include "ktime.h"
+#include "tunable.h"
+#include "config.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+
+static inline uint32_t klib_irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void klib_irq_restore(uint32_t flags) {
+    __asm__ volatile ("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+// Word loads from char data
+typedef uint32_t __attribute__((may_alias)) klib_word_t;
+
+#define KLIB_ONES       0x01010101u
+#define KLIB_HIGHS      0x80808080u
+
+// Nonzero if some byte of the word is zero
+static inline uint32_t klib_has_zero(uint32_t word) {
+    return (word - KLIB_ONES) & ~word & KLIB_HIGHS;
+}
+
+// Byte at a time: the versions the subsystems used to carry, kept for the
+// benchmark
+
+static size_t klib_strlen_byte(const char* str) {
+    size_t len = 0;
+    while (str[len]) len++;
+    return len;
+}
+
+static char* klib_strchr_byte(const char* str, int c) {
+    while (*str) {
+        if (*str == (char)c) return (char*)str;
+        str++;
+    }
+    return c ? NULL : (char*)str;
+}
+
+static int klib_strcmp_byte(const char* str1, const char* str2) {
+    while (*str1 && (*str1 == *str2)) {
+        str1++;
+        str2++;
+    }
+    return *(unsigned char*)str1 - *(unsigned char*)str2;
+}
+
+// Word at a time. Loads are aligned, so a word that holds the terminator
+// never reaches into the next page.
+
+static size_t klib_strlen_word(const char* str) {
+    const char* p = str;
+    while ((uintptr_t)p & 3) {
+        if (!*p) return (size_t)(p - str);
+        p++;
+    }
+    const klib_word_t* word = (const klib_word_t*)p;
+    while (!klib_has_zero(*word)) {
+        word++;
+    }
+    p = (const char*)word;
+    while (*p) p++;
+    return (size_t)(p - str);
+}
+
+static char* klib_strchr_word(const char* str, int c) {
+    char ch = (char)c;
+    while ((uintptr_t)str & 3) {
+        if (*str == ch) return (char*)str;
+        if (!*str) return NULL;
+        str++;
+    }
+
+    // Stop at the first word holding the terminator or the character
+    uint32_t pattern = (uint8_t)ch * KLIB_ONES;
+    const klib_word_t* word = (const klib_word_t*)str;
+    while (!klib_has_zero(*word) && !klib_has_zero(*word ^ pattern)) {
+        word++;
+    }
+    str = (const char*)word;
+    while (*str != ch) {
+        if (!*str) return NULL;
+        str++;
+    }
+    return (char*)str;
+}
+
+static int klib_strcmp_word(const char* str1, const char* str2) {
+    // Whole words only when both strings reach a word boundary together
+    if ((((uintptr_t)str1 ^ (uintptr_t)str2) & 3) == 0) {
+        while (((uintptr_t)str1 & 3) && *str1 && *str1 == *str2) {
+            str1++;
+            str2++;
+        }
+        if (((uintptr_t)str1 & 3) == 0) {
+            const klib_word_t* w1 = (const klib_word_t*)str1;
+            const klib_word_t* w2 = (const klib_word_t*)str2;
+            while (*w1 == *w2 && !klib_has_zero(*w1)) {
+                w1++;
+                w2++;
+            }
+            str1 = (const char*)w1;
+            str2 = (const char*)w2;
+        }
+    }
+    while (*str1 && (*str1 == *str2)) {
+        str1++;
+        str2++;
+    }
+    return *(unsigned char*)str1 - *(unsigned char*)str2;
+}
+
+#if CONFIG_KLIB_SSE2
+
+// SSE2, 16 bytes at a time. XMM registers are not saved on interrupts or
+// task switches, so every use runs with interrupts off and nothing is kept
+// in them between calls. The kernel is built without SSE, so these
+// functions alone are compiled for it.
+#define KLIB_SSE2 __attribute__((target("sse2")))
+
+// Bit i set if byte i of the aligned block is zero
+KLIB_SSE2 static inline uint32_t klib_sse2_zero_mask(const char* block) {
+    uint32_t mask;
+    __asm__ volatile ("pxor %%xmm0, %%xmm0\n\t"
+                      "pcmpeqb (%1), %%xmm0\n\t"
+                      "pmovmskb %%xmm0, %0"
+                      : "=r"(mask) : "r"(block) : "xmm0", "memory");
+    return mask;
+}
+
+// ... zero or equal to the byte repeated in pattern
+KLIB_SSE2 static inline uint32_t klib_sse2_char_mask(const char* block, uint32_t pattern) {
+    uint32_t mask;
+    __asm__ volatile ("movd %2, %%xmm1\n\t"
+                      "pshufd $0, %%xmm1, %%xmm1\n\t"
+                      "pxor %%xmm0, %%xmm0\n\t"
+                      "pcmpeqb (%1), %%xmm0\n\t"
+                      "pcmpeqb (%1), %%xmm1\n\t"
+                      "por %%xmm1, %%xmm0\n\t"
+                      "pmovmskb %%xmm0, %0"
+                      : "=r"(mask) : "r"(block), "r"(pattern) : "xmm0", "xmm1", "memory");
+    return mask;
+}
+
+// Bit i set where the unaligned blocks differ or the first one ends
+KLIB_SSE2 static inline uint32_t klib_sse2_cmp_mask(const char* str1, const char* str2) {
+    uint32_t equal, zero;
+    __asm__ volatile ("movdqu (%2), %%xmm0\n\t"
+                      "movdqu (%3), %%xmm1\n\t"
+                      "pxor %%xmm2, %%xmm2\n\t"
+                      "pcmpeqb %%xmm0, %%xmm2\n\t"
+                      "pcmpeqb %%xmm1, %%xmm0\n\t"
+                      "pmovmskb %%xmm0, %0\n\t"
+                      "pmovmskb %%xmm2, %1"
+                      : "=r"(equal), "=r"(zero) : "r"(str1), "r"(str2)
+                      : "xmm0", "xmm1", "xmm2", "memory");
+    return (~equal | zero) & 0xFFFF;
+}
+
+KLIB_SSE2 static size_t klib_strlen_sse2(const char* str) {
+    uint32_t flags = klib_irq_save();
+    const char* block = (const char*)((uintptr_t)str & ~(uintptr_t)15);
+    uint32_t mask = klib_sse2_zero_mask(block) & (0xFFFFu << (str - block));
+    while (!mask) {
+        block += 16;
+        mask = klib_sse2_zero_mask(block);
+    }
+    klib_irq_restore(flags);
+    return (size_t)(block + __builtin_ctz(mask) - str);
+}
+
+KLIB_SSE2 static char* klib_strchr_sse2(const char* str, int c) {
+    uint32_t pattern = (uint8_t)c * KLIB_ONES;
+    uint32_t flags = klib_irq_save();
+    const char* block = (const char*)((uintptr_t)str & ~(uintptr_t)15);
+    uint32_t mask = klib_sse2_char_mask(block, pattern) & (0xFFFFu << (str - block));
+    while (!mask) {
+        block += 16;
+        mask = klib_sse2_char_mask(block, pattern);
+    }
+    klib_irq_restore(flags);
+    const char* p = block + __builtin_ctz(mask);
+    return *p == (char)c ? (char*)p : NULL;
+}
+
+// The strings are rarely aligned alike, so blocks are loaded unaligned and
+// only while neither load can cross into a page that may not be mapped;
+// near a page end it steps a byte at a time until both are clear of it
+KLIB_SSE2 static int klib_strcmp_sse2(const char* str1, const char* str2) {
+    uint32_t flags = klib_irq_save();
+    while (1) {
+        if (((uintptr_t)str1 & (PAGE_SIZE - 1)) <= PAGE_SIZE - 16 &&
+            ((uintptr_t)str2 & (PAGE_SIZE - 1)) <= PAGE_SIZE - 16) {
+            uint32_t mask = klib_sse2_cmp_mask(str1, str2);
+            if (mask) {
+                str1 += __builtin_ctz(mask);
+                str2 += __builtin_ctz(mask);
+                break;
+            }
+            str1 += 16;
+            str2 += 16;
+        } else {
+            if (!*str1 || *str1 != *str2) {
+                break;
+            }
+            str1++;
+            str2++;
+        }
+    }
+    klib_irq_restore(flags);
+    return *(unsigned char*)str1 - *(unsigned char*)str2;
+}
+
+#else
+
+// Built without them, klib_init never selects these and the calls below
+// go straight to the word versions
+#define klib_strlen_sse2    klib_strlen_word
+#define klib_strchr_sse2    klib_strchr_word
+#define klib_strcmp_sse2    klib_strcmp_word
+
+#endif // CONFIG_KLIB_SSE2
+
+// Dispatch
+
+static int klib_sse2;
+static size_t (*klib_strlen_impl)(const char*) = klib_strlen_word;
+static char* (*klib_strchr_impl)(const char*, int) = klib_strchr_word;
+static int (*klib_strcmp_impl)(const char*, const char*) = klib_strcmp_word;
+
+size_t strlen(const char* str) {
+    return CONFIG_KLIB_SSE2 ? klib_strlen_impl(str) : klib_strlen_word(str);
+}
+
+char* strchr(const char* str, int c) {
+    return CONFIG_KLIB_SSE2 ? klib_strchr_impl(str, c) : klib_strchr_word(str, c);
+}
+
+int strcmp(const char* str1, const char* str2) {
+    return CONFIG_KLIB_SSE2 ? klib_strcmp_impl(str1, str2) : klib_strcmp_word(str1, str2);
+}
+
+size_t strnlen(const char* str, size_t max) {
+    size_t len = 0;
+    while (len < max && ((uintptr_t)(str + len) & 3)) {
+        if (!str[len]) return len;
+        len++;
+    }
+    while (max - len >= 4 && !klib_has_zero(*(const klib_word_t*)(str + len))) {
+        len += 4;
+    }
+    while (len < max && str[len]) {
+        len++;
+    }
+    return len;
+}
+
+size_t strlcpy(char* dest, const char* src, size_t size) {
+    size_t len = strlen(src);
+    if (size) {
+        size_t n = len < size - 1 ? len : size - 1;
+        memcpy(dest, src, n);
+        dest[n] = '\0';
+    }
+    return len;
+}
+
+// CPU features
+
+#define EFLAGS_ID           0x00200000  // Writable only if CPUID exists
+#define CPUID_EDX_SSE2      (1u << 26)
+#define CR0_MP              0x00000002
+#define CR0_EM              0x00000004
+#define CR0_TS              0x00000008
+#define CR4_OSFXSR          0x00000200
+#define CR4_OSXMMEXCPT      0x00000400
+
+static int klib_cpu_has_sse2(void) {
+    uint32_t before, after;
+    __asm__ volatile ("pushf; pop %0\n\t"
+                      "mov %0, %1\n\t"
+                      "xor %2, %1\n\t"
+                      "push %1; popf\n\t"
+                      "pushf; pop %1\n\t"
+                      "push %0; popf"
+                      : "=&r"(before), "=&r"(after) : "i"(EFLAGS_ID) : "cc");
+    if (!((before ^ after) & EFLAGS_ID)) {
+        return 0;
+    }
+
+    uint32_t eax = 1, ebx, ecx, edx;
+    __asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return (edx & CPUID_EDX_SSE2) != 0;
+}
+
+// klib.sse2=0 keeps the word-at-a-time routines even where SSE2 exists
+TUNABLE_VAR(klib_use_sse2, CONFIG_KLIB_SSE2);
+#if CONFIG_TUNABLES
+static tunable_t klib_sse2_tunable = {
+    .name = "klib.sse2",
+    .description = "Use SSE2 string routines if the CPU has them",
+    .type = TUNABLE_BOOL,
+    .flags = TUNABLE_BOOT,
+    .value = &klib_use_sse2,
+    .max = 1,
+};
+#endif
+
+void klib_init(void) {
+    tunable_register(&klib_sse2_tunable);
+    if (!CONFIG_KLIB_SSE2 || !klib_use_sse2 || !klib_cpu_has_sse2()) {
+        return;
+    }
+
+    // SSE instructions fault until the OS declares it handles their state
+    uint32_t cr0, cr4;
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    cr0 = (cr0 & ~(CR0_EM | CR0_TS)) | CR0_MP;
+    __asm__ volatile ("mov %0, %%cr0" : : "r"(cr0));
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4));
+
+    klib_sse2 = 1;
+    klib_strlen_impl = klib_strlen_sse2;
+    klib_strchr_impl = klib_strchr_sse2;
+    klib_strcmp_impl = klib_strcmp_sse2;
+}
+
+int klib_has_sse2(void) {
+    return klib_sse2;
+}
+
+// Benchmark
+
+#define KLIB_BENCH_ROUNDS   200
+
+static void klib_bench_line(const char* name, uint32_t us[3], int sse2) {
+    terminal_writestring(name);
+    terminal_write_dec(us[0]);
+    terminal_writestring(" us byte, ");
+    terminal_write_dec(us[1]);
+    terminal_writestring(" us word");
+    if (sse2) {
+        terminal_writestring(", ");
+        terminal_write_dec(us[2]);
+        terminal_writestring(" us SSE2");
+    }
+    terminal_writestring("\n");
+}
+
+void klib_benchmark(uint32_t len) {
+    // Two copies one byte apart, so strcmp sees differently aligned strings
+    char* a = (char*)kmalloc(len + 1);
+    char* buf = (char*)kmalloc(len + 2);
+    if (!a || !buf) {
+        terminal_writestring("Out of memory\n");
+        kfree(a);
+        kfree(buf);
+        return;
+    }
+    char* b = buf + 1;
+    for (uint32_t i = 0; i < len; i++) {
+        a[i] = b[i] = (char)('a' + i % 26);
+    }
+    a[len] = b[len] = '\0';
+
+    size_t (*strlens[3])(const char*) = { klib_strlen_byte, klib_strlen_word, klib_strlen_sse2 };
+    char* (*strchrs[3])(const char*, int) = { klib_strchr_byte, klib_strchr_word, klib_strchr_sse2 };
+    int (*strcmps[3])(const char*, const char*) = { klib_strcmp_byte, klib_strcmp_word, klib_strcmp_sse2 };
+    int versions = klib_sse2 ? 3 : 2;
+    uint32_t len_us[3] = { 0, 0, 0 };
+    uint32_t chr_us[3] = { 0, 0, 0 };
+    uint32_t cmp_us[3] = { 0, 0, 0 };
+    int ok = 1;
+
+    for (int v = 0; v < versions; v++) {
+        uint32_t start = (uint32_t)ktime_get_us();
+        for (uint32_t r = 0; r < KLIB_BENCH_ROUNDS; r++) {
+            uint32_t offset = r % 8 <= len ? r % 8 : 0;     // Vary the alignment
+            ok &= strlens[v](a + offset) == len - offset;
+        }
+        len_us[v] = (uint32_t)ktime_get_us() - start;
+
+        // A character that is not there, so the whole string is searched
+        start = (uint32_t)ktime_get_us();
+        for (uint32_t r = 0; r < KLIB_BENCH_ROUNDS; r++) {
+            ok &= strchrs[v](a, '#') == NULL;
+        }
+        chr_us[v] = (uint32_t)ktime_get_us() - start;
+
+        start = (uint32_t)ktime_get_us();
+        for (uint32_t r = 0; r < KLIB_BENCH_ROUNDS; r++) {
+            ok &= strcmps[v](a, b) == 0;
+        }
+        cmp_us[v] = (uint32_t)ktime_get_us() - start;
+
+        // Spot checks against the byte-wise results
+        if (len > 0) {
+            b[len - 1] = 'A';
+            ok &= (strcmps[v](a, b) > 0) == (klib_strcmp_byte(a, b) > 0);
+            ok &= strchrs[v](a, a[len - 1]) == klib_strchr_byte(a, a[len - 1]);
+            b[len - 1] = a[len - 1];
+        }
+        ok &= strchrs[v](a, 0) == a + len;
+    }
+    ok &= strnlen(a, len / 2) == len / 2 && strnlen(a, len + 5) == len;
+
+    terminal_write_dec(KLIB_BENCH_ROUNDS);
+    terminal_writestring(" calls on ");
+    terminal_write_dec(len);
+    terminal_writestring("-byte strings:\n");
+    klib_bench_line("  strlen: ", len_us, klib_sse2);
+    klib_bench_line("  strchr: ", chr_us, klib_sse2);
+    klib_bench_line("  strcmp: ", cmp_us, klib_sse2);
+    terminal_writestring(ok ? "Result: OK\n" : "Result: FAILED\n");
+
+    kfree(a);
+    kfree(buf);
+}
@@ -0,0 +1,28 @@
+#ifndef KLIB_H
+#define KLIB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Kernel string library. The generic versions work a word at a time; once
+// klib_init has found SSE2 through CPUID, strlen, strchr and strcmp switch to
+// 16-byte versions. Loads stay inside aligned words (or check for a page
+// boundary), so reading past the terminator never faults. Without
+// CONFIG_KLIB_SSE2 only the generic versions are built.
+size_t strlen(const char* str);
+size_t strnlen(const char* str, size_t max);
+int strcmp(const char* str1, const char* str2);
+char* strchr(const char* str, int c);
+
+// Copies at most size - 1 bytes and always terminates (if size > 0);
+// returns strlen(src), so a result >= size means the copy was cut short
+size_t strlcpy(char* dest, const char* src, size_t size);
+
+// Detect SSE2, enable it in CR0/CR4 and select the SSE2 routines
+void klib_init(void);
+int klib_has_sse2(void);
+
+// Time the byte-wise, word-at-a-time and SSE2 versions on len-byte strings
+void klib_benchmark(uint32_t len);
+
+#endif // KLIB_H
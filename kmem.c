@@ -0,0 +1,367 @@
+#include "kmem.h"
+#include "mm.h"
+#include "reclaim.h"
+#include "ktime.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+
+static kmem_cpu_t kmem_cpus[KMEM_MAX_CPUS];
+static kmem_depot_t kmem_depot[KMEM_NR_CLASSES];
+static volatile uint32_t kmem_depot_locked;
+static int kmem_ready = 0;
+
+static uint32_t kmem_shrink_count(void);
+static uint32_t kmem_shrink_scan(uint32_t nr_to_scan);
+
+static shrinker_t kmem_shrinker = {
+    .name = "kmem-depot",
+    .pool = RECLAIM_HEAP,
+    .count = kmem_shrink_count,
+    .scan = kmem_shrink_scan,
+};
+
+static inline uint32_t kmem_irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void kmem_irq_restore(uint32_t flags) {
+    __asm__ volatile ("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+// Slot of the running CPU. An SMP bring-up would look this up by local
+// APIC ID; until then only the boot CPU runs.
+static inline uint32_t kmem_cpu_id(void) {
+    return 0;
+}
+
+// Depot lock: interrupts off for this CPU, the spinlock for the others
+static inline uint32_t kmem_depot_lock(void) {
+    uint32_t flags = kmem_irq_save();
+    uint32_t busy;
+    do {
+        busy = 1;
+        __asm__ volatile ("xchg %0, %1" : "+r"(busy), "+m"(kmem_depot_locked) : : "memory");
+        if (busy) {
+            __asm__ volatile ("pause");
+        }
+    } while (busy);
+    return flags;
+}
+
+static inline void kmem_depot_unlock(uint32_t flags) {
+    __asm__ volatile ("" : : : "memory");
+    kmem_depot_locked = 0;
+    kmem_irq_restore(flags);
+}
+
+// A full or an empty magazine from the depot, or NULL if it has none
+static kmem_magazine_t* kmem_depot_take(kmem_depot_t* depot, int full) {
+    uint32_t flags = kmem_depot_lock();
+    kmem_magazine_t* mag = full ? depot->full : depot->empty;
+    if (mag) {
+        if (full) {
+            depot->full = mag->next;
+            depot->nr_full--;
+        } else {
+            depot->empty = mag->next;
+            depot->nr_empty--;
+        }
+        depot->taken++;
+    }
+    kmem_depot_unlock(flags);
+    return mag;
+}
+
+static void kmem_depot_give(kmem_depot_t* depot, kmem_magazine_t* mag) {
+    uint32_t flags = kmem_depot_lock();
+    if (mag->rounds) {
+        mag->next = depot->full;
+        depot->full = mag;
+        depot->nr_full++;
+    } else {
+        mag->next = depot->empty;
+        depot->empty = mag;
+        depot->nr_empty++;
+    }
+    kmem_depot_unlock(flags);
+}
+
+// Heap bytes a magazine and its rounds hold, headers included
+static uint32_t kmem_magazine_bytes(int cls, uint32_t rounds) {
+    return (sizeof(kmem_magazine_t) + sizeof(mem_block_t)) +
+           rounds * (kmem_class_size(cls) + sizeof(mem_block_t));
+}
+
+// Free a magazine and its rounds to the heap
+static uint32_t kmem_magazine_release(int cls, kmem_magazine_t* mag) {
+    uint32_t bytes = kmem_magazine_bytes(cls, mag->rounds);
+    while (mag->rounds) {
+        kfree_heap(mag->objs[--mag->rounds]);
+    }
+    kfree_heap(mag);
+    return bytes;
+}
+
+void kmem_init(void) {
+    register_shrinker(&kmem_shrinker);
+    kmem_ready = 1;
+}
+
+void* kmem_alloc(int cls) {
+    if (!kmem_ready) {
+        return NULL;
+    }
+
+    uint32_t flags = kmem_irq_save();
+    kmem_cpu_t* cpu = &kmem_cpus[kmem_cpu_id()];
+    kmem_cpu_cache_t* cc = &cpu->caches[cls];
+    void* obj = NULL;
+
+    for (;;) {
+        kmem_magazine_t* mag = cc->loaded;
+        if (mag && mag->rounds) {
+            obj = mag->objs[--mag->rounds];
+            cpu->alloc_hits++;
+            break;
+        }
+
+        // A full previous magazine: swap it in
+        if (cc->previous && cc->previous->rounds) {
+            cc->loaded = cc->previous;
+            cc->previous = mag;
+            continue;
+        }
+
+        // Both empty: trade previous for a full one from the depot
+        kmem_magazine_t* full = kmem_depot_take(&kmem_depot[cls], 1);
+        if (!full) {
+            cpu->alloc_misses++;
+            break;
+        }
+        if (cc->previous) {
+            kmem_depot_give(&kmem_depot[cls], cc->previous);
+        }
+        cc->previous = mag;
+        cc->loaded = full;
+    }
+
+    kmem_irq_restore(flags);
+    return obj;
+}
+
+int kmem_free(int cls, void* obj) {
+    if (!kmem_ready) {
+        return -1;
+    }
+
+    uint32_t flags = kmem_irq_save();
+    int result = 0;
+
+    for (;;) {
+        kmem_cpu_t* cpu = &kmem_cpus[kmem_cpu_id()];
+        kmem_cpu_cache_t* cc = &cpu->caches[cls];
+        kmem_magazine_t* mag = cc->loaded;
+        if (mag && mag->rounds < KMEM_MAG_ROUNDS) {
+            mag->objs[mag->rounds++] = obj;
+            cpu->free_hits++;
+            break;
+        }
+
+        // An empty previous magazine: swap it in
+        if (cc->previous && cc->previous->rounds == 0) {
+            cc->loaded = cc->previous;
+            cc->previous = mag;
+            continue;
+        }
+
+        // Both full: trade previous for an empty one from the depot
+        kmem_magazine_t* empty = kmem_depot_take(&kmem_depot[cls], 0);
+        if (empty) {
+            if (cc->previous) {
+                kmem_depot_give(&kmem_depot[cls], cc->previous);
+            }
+            cc->previous = mag;
+            cc->loaded = empty;
+            continue;
+        }
+
+        // The depot has none either: make one. The heap may reclaim, so
+        // interrupts go back on, and this CPU's magazines are looked at
+        // again afterwards.
+        kmem_irq_restore(flags);
+        empty = (kmem_magazine_t*)kmalloc_heap(sizeof(kmem_magazine_t));
+        flags = kmem_irq_save();
+        if (!empty) {
+            cpu->free_misses++;
+            result = -1;
+            break;
+        }
+        empty->rounds = 0;
+        kmem_depot_give(&kmem_depot[cls], empty);
+    }
+
+    kmem_irq_restore(flags);
+    return result;
+}
+
+void kmem_drain(void) {
+    // This CPU's magazines go to the depot first
+    uint32_t flags = kmem_irq_save();
+    kmem_cpu_t* cpu = &kmem_cpus[kmem_cpu_id()];
+    for (int cls = 0; cls < KMEM_NR_CLASSES; cls++) {
+        kmem_cpu_cache_t* cc = &cpu->caches[cls];
+        if (cc->loaded) {
+            kmem_depot_give(&kmem_depot[cls], cc->loaded);
+        }
+        if (cc->previous) {
+            kmem_depot_give(&kmem_depot[cls], cc->previous);
+        }
+        cc->loaded = NULL;
+        cc->previous = NULL;
+    }
+    kmem_irq_restore(flags);
+
+    kmem_shrink_scan(UINT32_MAX);
+}
+
+// Shrinker: the depot's magazines, full ones first, largest class first.
+// The CPUs' own magazines stay; they are what makes the fast path.
+
+static uint32_t kmem_shrink_count(void) {
+    uint32_t bytes = 0;
+    for (int cls = 0; cls < KMEM_NR_CLASSES; cls++) {
+        bytes += kmem_depot[cls].nr_full * kmem_magazine_bytes(cls, KMEM_MAG_ROUNDS);
+        bytes += kmem_depot[cls].nr_empty * kmem_magazine_bytes(cls, 0);
+    }
+    return bytes;
+}
+
+static uint32_t kmem_shrink_scan(uint32_t nr_to_scan) {
+    uint32_t freed = 0;
+    for (int full = 1; full >= 0; full--) {
+        for (int cls = KMEM_NR_CLASSES - 1; cls >= 0; cls--) {
+            kmem_magazine_t* mag;
+            while (freed < nr_to_scan && (mag = kmem_depot_take(&kmem_depot[cls], full))) {
+                freed += kmem_magazine_release(cls, mag);
+            }
+        }
+    }
+    return freed;
+}
+
+// Statistics
+
+void kmem_print_stats(void) {
+    terminal_writestring("=== Magazine Caches ===\n");
+    for (int cls = 0; cls < KMEM_NR_CLASSES; cls++) {
+        kmem_depot_t* depot = &kmem_depot[cls];
+        uint32_t cached = depot->nr_full * KMEM_MAG_ROUNDS;
+        for (int c = 0; c < KMEM_MAX_CPUS; c++) {
+            kmem_cpu_cache_t* cc = &kmem_cpus[c].caches[cls];
+            cached += (cc->loaded ? cc->loaded->rounds : 0) + (cc->previous ? cc->previous->rounds : 0);
+        }
+        terminal_writestring("  ");
+        terminal_write_dec(kmem_class_size(cls));
+        terminal_writestring(" bytes: ");
+        terminal_write_dec(cached);
+        terminal_writestring(" cached, depot ");
+        terminal_write_dec(depot->nr_full);
+        terminal_writestring(" full / ");
+        terminal_write_dec(depot->nr_empty);
+        terminal_writestring(" empty, ");
+        terminal_write_dec(depot->taken);
+        terminal_writestring(" taken\n");
+    }
+
+    for (int c = 0; c < KMEM_MAX_CPUS; c++) {
+        kmem_cpu_t* cpu = &kmem_cpus[c];
+        if (!cpu->alloc_hits && !cpu->alloc_misses && !cpu->free_hits && !cpu->free_misses) {
+            continue;
+        }
+        terminal_writestring("CPU ");
+        terminal_write_dec(c);
+        terminal_writestring(": alloc ");
+        terminal_write_dec(cpu->alloc_hits);
+        terminal_writestring(" hits, ");
+        terminal_write_dec(cpu->alloc_misses);
+        terminal_writestring(" misses; free ");
+        terminal_write_dec(cpu->free_hits);
+        terminal_writestring(" hits, ");
+        terminal_write_dec(cpu->free_misses);
+        terminal_writestring(" misses\n");
+    }
+}
+
+// Benchmark: the same allocations through kmalloc and straight from the heap
+
+#define KMEM_BENCH_ROUNDS   64
+
+static const uint16_t kmem_bench_sizes[] = { 16, 24, 40, 64, 100, 128, 200, 256 };
+#define KMEM_BENCH_NR_SIZES (sizeof(kmem_bench_sizes) / sizeof(kmem_bench_sizes[0]))
+
+// One round: allocate them all, free them newest first. Returns 0 if an
+// allocation failed.
+static int kmem_bench_round(void** objs, uint32_t count, uint32_t round, int heap) {
+    int ok = 1;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t size = kmem_bench_sizes[(i + round) % KMEM_BENCH_NR_SIZES];
+        objs[i] = heap ? kmalloc_heap(kmem_class_size(kmem_class(size))) : kmalloc(size);
+        ok &= objs[i] != NULL;
+    }
+    for (uint32_t i = count; i-- > 0;) {
+        if (heap) {
+            kfree_heap(objs[i]);
+        } else {
+            kfree(objs[i]);
+        }
+    }
+    return ok;
+}
+
+void kmem_benchmark(uint32_t count) {
+    void** objs = (void**)kmalloc(count * sizeof(void*));
+    if (!objs) {
+        terminal_writestring("Out of memory\n");
+        return;
+    }
+
+    kmem_cpu_t* cpu = &kmem_cpus[kmem_cpu_id()];
+    int ok = 1;
+
+    uint32_t start = (uint32_t)ktime_get_us();
+    for (uint32_t r = 0; r < KMEM_BENCH_ROUNDS; r++) {
+        ok &= kmem_bench_round(objs, count, r, 1);
+    }
+    uint32_t heap_us = (uint32_t)ktime_get_us() - start;
+
+    // An untimed round fills the magazines first
+    ok &= kmem_bench_round(objs, count, 0, 0);
+    uint32_t hits = cpu->alloc_hits;
+    uint32_t misses = cpu->alloc_misses;
+    start = (uint32_t)ktime_get_us();
+    for (uint32_t r = 0; r < KMEM_BENCH_ROUNDS; r++) {
+        ok &= kmem_bench_round(objs, count, r, 0);
+    }
+    uint32_t mag_us = (uint32_t)ktime_get_us() - start;
+    hits = cpu->alloc_hits - hits;
+    misses = cpu->alloc_misses - misses;
+
+    terminal_write_dec(KMEM_BENCH_ROUNDS);
+    terminal_writestring(" rounds of ");
+    terminal_write_dec(count);
+    terminal_writestring(" objects, 16-256 bytes:\n  heap: ");
+    terminal_write_dec(heap_us);
+    terminal_writestring(" us, magazines: ");
+    terminal_write_dec(mag_us);
+    terminal_writestring(" us (");
+    terminal_write_dec(hits + misses ? (uint32_t)((uint64_t)hits * 100 / (hits + misses)) : 0);
+    terminal_writestring("% hits)\n");
+    terminal_writestring(ok ? "Result: OK\n" : "Result: FAILED\n");
+
+    kfree(objs);
+    kmem_drain();
+}
@@ -0,0 +1,93 @@
+#ifndef KMEM_H
+#define KMEM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "cache.h"
+
+// Magazine layer in front of the heap (Bonwick, "Magazines and Vmem").
+// kmalloc sizes up to KMEM_MAX_SIZE are rounded to a power-of-two class;
+// kfree parks blocks of a class size in the running CPU's magazines, and
+// kmalloc takes them back from there, neither touching the heap's free
+// list. Each CPU holds a loaded and a previous magazine per class, used
+// with interrupts off and no lock. Only when both are empty (allocating)
+// or both full (freeing) does it trade one with the depot, which is
+// shared and locked. Reclaim takes the depot's magazines back to the heap.
+#define KMEM_MIN_SIZE       16      // MEM_BLOCK_ALIGN
+#define KMEM_MAX_SIZE       256
+#define KMEM_NR_CLASSES     5       // 16, 32, 64, 128 and 256 bytes
+
+// Rounds per magazine; with its header a magazine is 64 bytes
+#define KMEM_MAG_ROUNDS     14
+
+// Per-CPU slots. Only the boot CPU runs until there is an SMP bring-up.
+#define KMEM_MAX_CPUS       8
+
+typedef struct kmem_magazine {
+    struct kmem_magazine* next;     // Depot list
+    uint32_t rounds;                // Objects held
+    void* objs[KMEM_MAG_ROUNDS];
+} kmem_magazine_t;
+
+STATIC_ASSERT(sizeof(kmem_magazine_t) == CACHE_LINE_SIZE, "kmem_magazine_t: one cache line");
+
+// One CPU's magazines. Always full, empty or absent, never in between
+// (Bonwick's invariant for 'previous'), so a trade moves a whole magazine.
+typedef struct kmem_cpu_cache {
+    kmem_magazine_t* loaded;
+    kmem_magazine_t* previous;
+} kmem_cpu_cache_t;
+
+typedef struct kmem_cpu {
+    kmem_cpu_cache_t caches[KMEM_NR_CLASSES];
+    uint32_t alloc_hits;            // Served from a magazine
+    uint32_t alloc_misses;          // Went to the heap
+    uint32_t free_hits;
+    uint32_t free_misses;
+} __cacheline_aligned kmem_cpu_t;
+
+STATIC_ASSERT(sizeof(kmem_cpu_t) == CACHE_LINE_SIZE, "kmem_cpu_t: one cache line per CPU");
+
+// Shared magazines of one class
+typedef struct kmem_depot {
+    kmem_magazine_t* full;
+    kmem_magazine_t* empty;
+    uint32_t nr_full;
+    uint32_t nr_empty;
+    uint32_t taken;                 // Magazines taken out, by CPUs or reclaim
+} kmem_depot_t;
+
+// Class of a kmalloc size (1..KMEM_MAX_SIZE), and its block size
+static inline int kmem_class(size_t size) {
+    if (size <= KMEM_MIN_SIZE) {
+        return 0;
+    }
+    return 32 - __builtin_clz((uint32_t)size - 1) - 4;
+}
+
+static inline size_t kmem_class_size(int cls) {
+    return (size_t)KMEM_MIN_SIZE << cls;
+}
+
+// A block of exactly a class size, which a magazine can hold
+static inline int kmem_cacheable(size_t size) {
+    return size >= KMEM_MIN_SIZE && size <= KMEM_MAX_SIZE && (size & (size - 1)) == 0;
+}
+
+// Call after reclaim_init; until then every call misses
+void kmem_init(void);
+
+// Object from this CPU's magazines, or NULL to take one from the heap
+void* kmem_alloc(int cls);
+
+// Park an object in this CPU's magazines. Returns 0, or -1 if it has to go
+// back to the heap (no magazine could be had).
+int kmem_free(int cls, void* obj);
+
+// Give every cached object back to the heap
+void kmem_drain(void);
+
+void kmem_print_stats(void);
+void kmem_benchmark(uint32_t count);
+
+#endif // KMEM_H
@@ -0,0 +1,584 @@
+#include <stddef.h>
+#include "ksm.h"
+#include "pmm.h"
+#include "swap.h"
+#include "hashtable.h"
+#include "ktime.h"
+#include "tunable.h"
+#include "reclaim.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+
+#define KSM_TABLE_MIN       64      // Initial buckets of each table
+#define KSM_TEST_MAX_SPACES 8
+#define KSM_TEST_SLACK      16      // Frames left free beyond what merging saved
+
+// Merged frame. The table keeps a reference of its own, so the frame
+// outlives its last mapping until the end of the round drops it.
+typedef struct ksm_stable_node {
+    hash_node_t node;
+    uint32_t phys;
+    struct ksm_stable_node* next;   // All merged frames
+} ksm_stable_node_t;
+
+// Candidate page, seen unchanged over two rounds. It holds no reference:
+// it is checked again before use, as the page may be gone by then.
+typedef struct ksm_item {
+    hash_node_t node;
+    address_space_t* as;
+    uint32_t vaddr;
+    uint32_t phys;
+    struct ksm_item* next;          // This round's candidates
+} ksm_item_t;
+
+// Lookup key: a page's contents and their checksum
+typedef struct ksm_key {
+    const void* page;
+    uint32_t checksum;
+} ksm_key_t;
+
+// Tunables
+TUNABLE_VAR(ksm_run, 1);
+TUNABLE_VAR(ksm_pages_to_scan, KSM_PAGES_TO_SCAN);
+TUNABLE_VAR(ksm_sleep_ms, KSM_SLEEP_MS);
+
+#if CONFIG_TUNABLES
+static tunable_t ksm_tunables[] = {
+    {
+        .name = "ksm.run",
+        .description = "Merge identical user pages in the background",
+        .type = TUNABLE_BOOL,
+        .value = &ksm_run,
+        .min = 0,
+        .max = 1,
+    },
+    {
+        .name = "ksm.pages_to_scan",
+        .description = "Pages checked per scanner call",
+        .type = TUNABLE_U32,
+        .value = &ksm_pages_to_scan,
+        .min = 1,
+        .max = 4096,
+    },
+    {
+        .name = "ksm.sleep_ms",
+        .description = "Milliseconds between scanner calls",
+        .type = TUNABLE_U32,
+        .value = &ksm_sleep_ms,
+        .min = 1,
+        .max = 10000,
+    },
+};
+#endif
+
+static hash_table_t ksm_stable;
+static hash_table_t ksm_unstable;
+static ksm_stable_node_t* ksm_stable_list = NULL;
+static ksm_item_t* ksm_items = NULL;
+static int ksm_ready = 0;
+static int ksm_unstable_ready = 0;
+static ksm_stats_t ksm_stats;
+
+// Checksum of each frame's contents when the scanner last saw it
+static uint32_t ksm_checksums[PMM_MAX_FRAMES];
+
+// Where the scanner resumes. NULL between rounds: at VMM_USER_END once the
+// last space is done, so the next call ends the round first.
+static address_space_t* ksm_cursor = NULL;
+static uint32_t ksm_cursor_vaddr = VMM_USER_START;
+static uint64_t ksm_last_ms = 0;
+
+// Set while the tables change, so reclaim leaves them alone
+static int ksm_busy = 0;
+
+static uint32_t ksm_shrink_count(void);
+static uint32_t ksm_shrink_scan(uint32_t nr_to_scan);
+
+static shrinker_t ksm_shrinker = {
+    .name = "ksm",
+    .pool = RECLAIM_FRAMES,
+    .count = ksm_shrink_count,
+    .scan = ksm_shrink_scan,
+};
+
+static uint32_t ksm_key_hash(const void* key) {
+    return ((const ksm_key_t*)key)->checksum;
+}
+
+static int ksm_stable_match(const hash_node_t* node, const void* key) {
+    const ksm_stable_node_t* stable = hash_entry(node, ksm_stable_node_t, node);
+    return memcmp((const void*)stable->phys, ((const ksm_key_t*)key)->page, PAGE_SIZE) == 0;
+}
+
+static int ksm_item_match(const hash_node_t* node, const void* key) {
+    const ksm_item_t* item = hash_entry(node, ksm_item_t, node);
+    return memcmp((const void*)item->phys, ((const ksm_key_t*)key)->page, PAGE_SIZE) == 0;
+}
+
+static const hash_table_ops_t ksm_stable_ops = {
+    .hash = ksm_key_hash,
+    .match = ksm_stable_match,
+};
+
+static const hash_table_ops_t ksm_item_ops = {
+    .hash = ksm_key_hash,
+    .match = ksm_item_match,
+};
+
+void ksm_init(void) {
+#if CONFIG_TUNABLES
+    for (size_t i = 0; i < sizeof(ksm_tunables) / sizeof(ksm_tunables[0]); i++) {
+        tunable_register(&ksm_tunables[i]);
+    }
+#endif
+
+    memset(&ksm_stats, 0, sizeof(ksm_stats));
+    if (hash_table_init(&ksm_stable, &ksm_stable_ops, KSM_TABLE_MIN) != 0) {
+        return;
+    }
+    ksm_unstable_ready = hash_table_init(&ksm_unstable, &ksm_item_ops, KSM_TABLE_MIN) == 0;
+    register_shrinker(&ksm_shrinker);
+    ksm_ready = 1;
+}
+
+// Read-only from now on; a write faults and gets a private copy
+static void ksm_write_protect(address_space_t* as, uint32_t vaddr, page_entry_t* pte) {
+    if (pte->writable) {
+        pte->writable = 0;
+        pte->available |= VMM_PTE_COW;
+    }
+    vmm_flush_page(as, vaddr);
+}
+
+// Map vaddr to a merged frame and free the page's own frame, which
+// nothing else maps (the scanner only takes pages with a refcount of 1)
+static void ksm_replace(address_space_t* as, uint32_t vaddr, page_entry_t* pte, uint32_t phys) {
+    uint32_t old = pte->frame << 12;
+    pmm_get_frame(phys);
+    pte->frame = phys >> 12;
+    ksm_write_protect(as, vaddr, pte);
+    swap_lru_del(old);
+    pmm_free_frame(old);
+    ksm_stats.merges++;
+}
+
+// Turn a candidate's frame into a merged frame; NULL if the candidate is
+// stale (unmapped, swapped out, forked or written since it was recorded)
+static ksm_stable_node_t* ksm_promote(ksm_item_t* item, const ksm_key_t* key) {
+    page_frame_t* frame = pmm_frame(item->phys);
+    if (!frame || !(frame->flags & PMM_FRAME_LRU) || (frame->flags & (PMM_FRAME_CACHE | PMM_FRAME_KSM)) ||
+        frame->refcount != 1 || frame->mapping != item->as || frame->vaddr != item->vaddr) {
+        return NULL;
+    }
+    page_entry_t* pte = vmm_get_pte(item->as, item->vaddr, 0);
+    if (!pte || !pte->present || ((uint32_t)pte->frame << 12) != item->phys) {
+        return NULL;
+    }
+
+    ksm_stable_node_t* stable = kmalloc(sizeof(ksm_stable_node_t));
+    if (!stable) {
+        return NULL;
+    }
+    stable->phys = item->phys;
+    if (hash_table_insert(&ksm_stable, &stable->node, key) != 0) {
+        kfree(stable);
+        return NULL;
+    }
+    stable->next = ksm_stable_list;
+    ksm_stable_list = stable;
+
+    // Off the aging lists: merged frames are never swapped out
+    ksm_write_protect(item->as, item->vaddr, pte);
+    swap_lru_del(item->phys);
+    frame->mapping = NULL;
+    frame->flags |= PMM_FRAME_KSM;
+    pmm_get_frame(item->phys);
+    ksm_stats.merges++;
+    return stable;
+}
+
+static void ksm_scan_page(address_space_t* as, uint32_t vaddr, page_entry_t* pte) {
+    uint32_t phys = pte->frame << 12;
+    page_frame_t* frame = pmm_frame(phys);
+    // Merged already, shared after fork, or not an anonymous page
+    if (!frame || (frame->flags & (PMM_FRAME_KSM | PMM_FRAME_CACHE)) || frame->refcount != 1) {
+        return;
+    }
+    ksm_stats.pages_scanned++;
+
+    ksm_key_t key = { (const void*)phys, hash_xxh32((const void*)phys, PAGE_SIZE, 0) };
+    hash_node_t* node = hash_table_lookup(&ksm_stable, &key);
+    if (node) {
+        ksm_replace(as, vaddr, pte, hash_entry(node, ksm_stable_node_t, node)->phys);
+        return;
+    }
+
+    // Changed since the last round: likely to change again
+    uint32_t* checksum = &ksm_checksums[(phys - PMM_REGION_START) / PAGE_SIZE];
+    if (*checksum != key.checksum) {
+        *checksum = key.checksum;
+        ksm_stats.pages_volatile++;
+        return;
+    }
+    if (!ksm_unstable_ready) {
+        return;
+    }
+
+    node = hash_table_lookup(&ksm_unstable, &key);
+    if (node) {
+        ksm_item_t* item = hash_entry(node, ksm_item_t, node);
+        if (item->phys == phys) {
+            return;
+        }
+        // Merged or stale, it stops being a candidate either way
+        hash_table_remove(&ksm_unstable, &key);
+        ksm_stable_node_t* stable = ksm_promote(item, &key);
+        if (stable) {
+            ksm_replace(as, vaddr, pte, stable->phys);
+            return;
+        }
+    }
+
+    ksm_item_t* item = kmalloc(sizeof(ksm_item_t));
+    if (!item) {
+        return;
+    }
+    item->as = as;
+    item->vaddr = vaddr;
+    item->phys = phys;
+    item->next = ksm_items;
+    ksm_items = item;
+    hash_table_insert(&ksm_unstable, &item->node, &key);
+}
+
+// Free up to max merged frames that nothing maps any more (only the
+// table's reference is left)
+static uint32_t ksm_prune(uint32_t max) {
+    uint32_t freed = 0;
+    ksm_stable_node_t** link = &ksm_stable_list;
+    while (*link && freed < max) {
+        ksm_stable_node_t* stable = *link;
+        if (pmm_frame_refcount(stable->phys) > 1) {
+            link = &stable->next;
+            continue;
+        }
+        ksm_key_t key = { (const void*)stable->phys, stable->node.hash };
+        hash_table_remove(&ksm_stable, &key);
+        pmm_frame(stable->phys)->flags &= ~PMM_FRAME_KSM;
+        pmm_free_frame(stable->phys);
+        *link = stable->next;
+        kfree(stable);
+        freed++;
+    }
+    return freed;
+}
+
+// Unmerging takes a copy per page, so under memory pressure the frames the
+// copies leave unmapped are given back at once rather than at round end
+static uint32_t ksm_shrink_count(void) {
+    uint32_t count = 0;
+    if (ksm_busy) {
+        return 0;
+    }
+    for (ksm_stable_node_t* stable = ksm_stable_list; stable; stable = stable->next) {
+        count += pmm_frame_refcount(stable->phys) == 1;
+    }
+    return count;
+}
+
+static uint32_t ksm_shrink_scan(uint32_t nr_to_scan) {
+    return ksm_busy ? 0 : ksm_prune(nr_to_scan);
+}
+
+// End of a round: forget the candidates, free merged frames nothing maps
+// any more, and start again from the first address space
+static void ksm_round_done(void) {
+    while (ksm_items) {
+        ksm_item_t* next = ksm_items->next;
+        kfree(ksm_items);
+        ksm_items = next;
+    }
+    if (ksm_unstable_ready) {
+        hash_table_destroy(&ksm_unstable);
+    }
+    ksm_unstable_ready = hash_table_init(&ksm_unstable, &ksm_item_ops, KSM_TABLE_MIN) == 0;
+    ksm_prune(UINT32_MAX);
+
+    ksm_cursor = NULL;
+    ksm_cursor_vaddr = VMM_USER_START;
+}
+
+void ksm_space_destroyed(address_space_t* as) {
+    if (ksm_cursor == as) {
+        ksm_cursor = as->next;
+        ksm_cursor_vaddr = as->next ? VMM_USER_START : VMM_USER_END;
+    }
+}
+
+// Check up to 'pages' present user pages from the cursor on
+static void ksm_scan(uint32_t pages) {
+    if (!vmm_first_space()) {
+        return;
+    }
+
+    ksm_busy = 1;
+    uint32_t tables = 0;
+    while (pages > 0 && tables < KSM_TABLES_PER_CALL) {
+        if (!ksm_cursor) {
+            if (ksm_cursor_vaddr == VMM_USER_END) {
+                ksm_round_done();
+                ksm_stats.full_scans++;
+            }
+            ksm_cursor = vmm_first_space();
+            ksm_cursor_vaddr = VMM_USER_START;
+        }
+        address_space_t* as = ksm_cursor;
+
+        page_entry_t* pte = vmm_get_pte(as, ksm_cursor_vaddr, 0);
+        if (!pte) {
+            // No page table (or a 4MB page): skip the whole slot
+            ksm_cursor_vaddr = (ksm_cursor_vaddr & ~(PMM_HUGE_SIZE - 1)) + PMM_HUGE_SIZE;
+            tables++;
+        } else {
+            if (pte->present) {
+                ksm_scan_page(as, ksm_cursor_vaddr, pte);
+                pages--;
+            }
+            ksm_cursor_vaddr += PAGE_SIZE;
+            if ((ksm_cursor_vaddr & (PMM_HUGE_SIZE - 1)) == 0) {
+                tables++;
+            }
+        }
+
+        if (ksm_cursor_vaddr >= VMM_USER_END) {
+            ksm_cursor = as->next;
+            ksm_cursor_vaddr = ksm_cursor ? VMM_USER_START : VMM_USER_END;
+        }
+    }
+    ksm_busy = 0;
+}
+
+void ksm_poll(void) {
+    if (!ksm_ready || !ksm_run) {
+        return;
+    }
+    uint64_t now = ktime_get_ms();
+    if (now - ksm_last_ms < ksm_sleep_ms) {
+        return;
+    }
+    ksm_last_ms = now;
+    ksm_scan(ksm_pages_to_scan);
+}
+
+void ksm_run_rounds(uint32_t count) {
+    if (!ksm_ready) {
+        return;
+    }
+    uint32_t target = ksm_stats.full_scans + count;
+    while (ksm_stats.full_scans != target && vmm_first_space()) {
+        ksm_scan(4096);
+    }
+}
+
+ksm_stats_t ksm_get_stats(void) {
+    ksm_stats_t stats = ksm_stats;
+    stats.pages_shared = 0;
+    stats.pages_sharing = 0;
+    for (ksm_stable_node_t* stable = ksm_stable_list; stable; stable = stable->next) {
+        uint32_t mappings = pmm_frame_refcount(stable->phys) - 1;
+        stats.pages_shared++;
+        stats.pages_sharing += mappings > 1 ? mappings - 1 : 0;
+    }
+    stats.pages_unshared = ksm_unstable_ready ? ksm_unstable.count : 0;
+    return stats;
+}
+
+void ksm_print_stats(void) {
+    ksm_stats_t stats = ksm_get_stats();
+    terminal_writestring("=== Same-Page Merging ===\n");
+    terminal_writestring("Scanner: ");
+    if (!ksm_ready) {
+        terminal_writestring("unavailable (no memory for its table)\n");
+    } else if (!ksm_run) {
+        terminal_writestring("off (ksm.run)\n");
+    } else {
+        terminal_write_dec(ksm_pages_to_scan);
+        terminal_writestring(" pages every ");
+        terminal_write_dec(ksm_sleep_ms);
+        terminal_writestring(" ms\n");
+    }
+
+    terminal_writestring("Merged: ");
+    terminal_write_dec(stats.pages_shared);
+    terminal_writestring(" frames for ");
+    terminal_write_dec(stats.pages_shared + stats.pages_sharing);
+    terminal_writestring(" pages, ");
+    terminal_write_dec(stats.pages_sharing * (PAGE_SIZE / 1024));
+    terminal_writestring(" KB saved\n");
+
+    terminal_writestring("Candidates: ");
+    terminal_write_dec(stats.pages_unshared);
+    terminal_writestring(", ");
+    terminal_write_dec(stats.pages_volatile);
+    terminal_writestring(" pages seen changing\n");
+
+    terminal_writestring("Scanned: ");
+    terminal_write_dec(stats.pages_scanned);
+    terminal_writestring(" pages in ");
+    terminal_write_dec(stats.full_scans);
+    terminal_writestring(" rounds, ");
+    terminal_write_dec(stats.merges);
+    terminal_writestring(" merges\n");
+}
+
+// Take frames until only 'left' are free, chaining them through their
+// first word; returns the chain
+static uint32_t ksm_test_hold(uint32_t left) {
+    uint32_t held = 0;
+    while (pmm_free_frames() > left) {
+        uint32_t frame = pmm_alloc_frame();
+        if (!frame) {
+            break;
+        }
+        *(uint32_t*)frame = held;
+        held = frame;
+    }
+    return held;
+}
+
+static void ksm_test_release(uint32_t held) {
+    while (held) {
+        uint32_t next = *(uint32_t*)held;
+        pmm_free_frame(held);
+        held = next;
+    }
+}
+
+// Test page contents: every fourth page differs between spaces
+static void ksm_test_page(uint32_t* words, uint32_t space, uint32_t page) {
+    words[0] = page * 2654435761u;
+    words[1] = (page % 4 == 3) ? space + 1 : 0;
+}
+
+void ksm_test(uint32_t spaces, uint32_t pages) {
+    if (!ksm_ready) {
+        terminal_writestring("Same-page merging is unavailable\n");
+        return;
+    }
+    if (spaces < 2 || spaces > KSM_TEST_MAX_SPACES || pages == 0) {
+        terminal_writestring("Need 2-8 spaces and at least one page\n");
+        return;
+    }
+    // The pages and a page table per 4MB of each
+    uint32_t needed = spaces * (pages + (pages + 1023) / 1024);
+    if (needed > pmm_free_frames()) {
+        terminal_writestring("Not enough free frames (");
+        terminal_write_dec(pmm_free_frames());
+        terminal_writestring(" available)\n");
+        return;
+    }
+
+    address_space_t* as[KSM_TEST_MAX_SPACES] = { NULL };
+    int ok = 1;
+    for (uint32_t s = 0; s < spaces && ok; s++) {
+        as[s] = vmm_create();
+        ok = as[s] && vmm_map_anon(as[s], VMM_USER_START, pages, PAGE_WRITABLE | PAGE_USER) == 0;
+        for (uint32_t p = 0; p < pages && ok; p++) {
+            uint32_t words[2];
+            ksm_test_page(words, s, p);
+            ok = vmm_copy_to(as[s], VMM_USER_START + p * PAGE_SIZE, words, sizeof(words)) == 0;
+        }
+    }
+    if (!ok) {
+        terminal_writestring("Failed to set up the address spaces\n");
+        for (uint32_t s = 0; s < spaces; s++) {
+            vmm_destroy(as[s]);
+        }
+        return;
+    }
+
+    // A round to record checksums, then one to merge
+    ksm_round_done();
+    ksm_stats_t before = ksm_get_stats();
+    uint32_t free_before = pmm_free_frames();
+    uint32_t start = (uint32_t)ktime_get_us();
+    ksm_run_rounds(2);
+    uint32_t merge_us = (uint32_t)ktime_get_us() - start;
+    uint32_t freed = pmm_free_frames() - free_before;
+    ksm_stats_t after = ksm_get_stats();
+
+    uint32_t expected = (pages - pages / 4) * (spaces - 1);
+    terminal_writestring("Spaces: ");
+    terminal_write_dec(spaces);
+    terminal_writestring(" x ");
+    terminal_write_dec(pages);
+    terminal_writestring(" pages, ");
+    terminal_write_dec(expected);
+    terminal_writestring(" duplicates\n");
+    terminal_writestring("Merged: ");
+    terminal_write_dec(after.merges - before.merges);
+    terminal_writestring(" pages into ");
+    terminal_write_dec(after.pages_shared - before.pages_shared);
+    terminal_writestring(" frames in ");
+    terminal_write_dec(merge_us);
+    terminal_writestring(" us, ");
+    terminal_write_dec(freed);
+    terminal_writestring(" frames (");
+    terminal_write_dec(freed * (PAGE_SIZE / 1024));
+    terminal_writestring(" KB) freed\n");
+
+    for (uint32_t s = 0; s < spaces; s++) {
+        for (uint32_t p = 0; p < pages; p++) {
+            uint32_t words[2];
+            uint32_t expect[2];
+            ksm_test_page(expect, s, p);
+            if (vmm_copy_from(as[s], words, VMM_USER_START + p * PAGE_SIZE, sizeof(words)) != 0 ||
+                words[0] != expect[0] || words[1] != expect[1]) {
+                ok = 0;
+            }
+        }
+    }
+    terminal_writestring(ok && freed >= expected ? "Data check: OK\n" : "Data check: FAILED\n");
+
+    // A write to a merged page gets its own copy; the other spaces keep theirs
+    uint32_t value = 0xDEADBEEF;
+    uint32_t seen = 0;
+    uint32_t copies = as[0]->cow_copies;
+    ok = vmm_copy_to(as[0], VMM_USER_START, &value, sizeof(value)) == 0 &&
+         vmm_copy_from(as[0], &seen, VMM_USER_START, sizeof(seen)) == 0 && seen == value &&
+         vmm_copy_from(as[1], &seen, VMM_USER_START, sizeof(seen)) == 0 && seen == 0 &&
+         as[0]->cow_copies == copies + 1;
+    terminal_writestring(ok ? "Copy on write: OK\n" : "Copy on write: FAILED\n");
+
+    // Unmerge everything with only what merging saved left free: the last
+    // copy of each page needs the frame it leaves behind to be reclaimed
+    uint32_t held = ksm_test_hold(freed + KSM_TEST_SLACK);
+    uint32_t scarce = pmm_free_frames();
+    uint32_t reclaimed = ksm_shrinker.freed;
+    ok = 1;
+    for (uint32_t s = 0; s < spaces; s++) {
+        for (uint32_t p = 0; p < pages; p += (p % 4 == 2) ? 2 : 1) {
+            uint32_t addr = VMM_USER_START + p * PAGE_SIZE + 8;
+            value = (s << 16) | p | 0x80000000;
+            if (vmm_copy_to(as[s], addr, &value, sizeof(value)) != 0 ||
+                vmm_copy_from(as[s], &seen, addr, sizeof(seen)) != 0 || seen != value) {
+                ok = 0;
+            }
+        }
+    }
+    reclaimed = ksm_shrinker.freed - reclaimed;
+    ksm_test_release(held);
+    terminal_writestring("Unmerge with ");
+    terminal_write_dec(scarce);
+    terminal_writestring(" frames free: ");
+    terminal_writestring(ok ? "OK, " : "FAILED, ");
+    terminal_write_dec(reclaimed);
+    terminal_writestring(" merged frames reclaimed\n");
+
+    for (uint32_t s = 0; s < spaces; s++) {
+        vmm_destroy(as[s]);
+    }
+    ksm_round_done();
+}
@@ -0,0 +1,51 @@
+#ifndef KSM_H
+#define KSM_H
+
+#include <stdint.h>
+#include "vmm.h"
+
+// Same-page merging. A scanner run from the idle loop walks the present
+// 4KB user pages of every address space in turn, a few per call, and
+// merges pages with identical contents into one frame that all of them
+// map read-only and copy-on-write, as after fork.
+//
+// Merged frames sit in the stable table, keyed by contents. A candidate
+// that matches none goes into the unstable table, but only once its
+// checksum is the same as on the previous round: pages that keep changing
+// would only be copied again. When a second page matches an unstable
+// entry, that entry's frame becomes a merged frame. The unstable table is
+// thrown away after every full round, as its pages may have changed since.
+#define KSM_PAGES_TO_SCAN   128     // Pages per scanner call (ksm.pages_to_scan)
+#define KSM_SLEEP_MS        100     // Between scanner calls (ksm.sleep_ms)
+#define KSM_TABLES_PER_CALL 64      // Page tables (or empty 4MB slots) a call may walk
+
+typedef struct ksm_stats {
+    uint32_t pages_shared;      // Merged frames
+    uint32_t pages_sharing;     // Mappings of them beyond the first: pages saved
+    uint32_t pages_unshared;    // Candidates in the unstable table
+    uint32_t pages_volatile;    // Changed since the last round, so not candidates
+    uint32_t pages_scanned;
+    uint32_t merges;            // Pages mapped to a merged frame
+    uint32_t full_scans;        // Rounds over every address space
+} ksm_stats_t;
+
+// Registers the tunables and sets up the tables
+void ksm_init(void);
+
+// Scanner step, at most every ksm.sleep_ms; call from the idle loop
+void ksm_poll(void);
+
+// Scan until count more full rounds have completed
+void ksm_run_rounds(uint32_t count);
+
+// Called by vmm_destroy so the scanner moves past a space going away
+void ksm_space_destroyed(address_space_t* as);
+
+ksm_stats_t ksm_get_stats(void);
+void ksm_print_stats(void);
+
+// Several address spaces with the same data in most of their pages: merge
+// them, then check the data and copy-on-write after merging
+void ksm_test(uint32_t spaces, uint32_t pages);
+
+#endif // KSM_H
@@ -0,0 +1,303 @@
+#include <stddef.h>
+#include "ktime.h"
+#include "rtc.h"
+#include "klib.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+
+// I/O port functions
+static inline void outb(uint16_t port, uint8_t val) {
+    __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t ret;
+    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline uint32_t ktime_irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void ktime_irq_restore(uint32_t flags) {
+    __asm__ volatile ("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+// PIT channel 2, used to calibrate the TSC when there is no HPET
+#define PIT_FREQUENCY     1193182
+#define PIT_CH2_DATA      0x42
+#define PIT_COMMAND       0x43
+#define PIT_CH2_GATE      0x61     // Bit 0 gate, bit 1 speaker, bit 5 output
+#define PIT_CH2_ONESHOT   0xB0     // Channel 2, lo/hi byte, mode 0
+
+// TSC calibration
+#define TSC_CALIBRATE_MS  10
+#define TSC_MAX_DRIFT_PPM 1000     // Two calibration windows must agree this closely
+
+static clocksource_t* clocksources[KTIME_MAX_CLOCKSOURCES];
+static int num_clocksources = 0;
+
+// Monotonic time is ktime_base_ns plus the current source's cycles since cycle_last
+static clocksource_t* ktime_source = NULL;
+static uint64_t ktime_cycle_last = 0;
+static uint64_t ktime_base_ns = 0;
+static uint32_t ktime_boot_real = 0;   // RTC time at ktime_init
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static clocksource_t tsc_clocksource = {
+    "tsc",
+    0,
+    rdtsc,
+    0xFFFFFFFFFFFFFFFFULL,
+    0,
+    0, 0
+};
+
+// Split the multiply so a 64-bit delta never overflows the intermediate
+static inline uint64_t clocksource_cyc2ns(clocksource_t* cs, uint64_t cycles) {
+    uint64_t high = ((cycles >> 32) * cs->mult) << (32 - cs->shift);
+    uint64_t low = ((cycles & 0xFFFFFFFF) * cs->mult) >> cs->shift;
+    return high + low;
+}
+
+// Largest shift that keeps mult within 32 bits gives the best precision
+static void clocksource_compute_mult(clocksource_t* cs) {
+    for (uint32_t shift = 32; ; shift--) {
+        uint64_t mult = (NSEC_PER_SEC << shift) / cs->frequency;
+        if (mult <= 0xFFFFFFFF || shift == 0) {
+            cs->mult = (uint32_t)mult;
+            cs->shift = shift;
+            return;
+        }
+    }
+}
+
+// Fold the elapsed time into the base so the counter can be replaced or wrap
+static void ktime_accumulate(uint64_t now) {
+    uint64_t delta = (now - ktime_cycle_last) & ktime_source->mask;
+    ktime_base_ns += clocksource_cyc2ns(ktime_source, delta);
+    ktime_cycle_last = now;
+}
+
+// Switch ktime to the highest-rated source
+static void clocksource_select(void) {
+    clocksource_t* best = NULL;
+    for (int i = 0; i < num_clocksources; i++) {
+        if (!best || clocksources[i]->rating > best->rating) {
+            best = clocksources[i];
+        }
+    }
+
+    if (best == ktime_source) {
+        return;
+    }
+
+    uint32_t flags = ktime_irq_save();
+    if (ktime_source) {
+        ktime_accumulate(ktime_source->read());
+    }
+    ktime_source = best;
+    ktime_cycle_last = best->read();
+    ktime_irq_restore(flags);
+}
+
+int clocksource_register(clocksource_t* cs) {
+    if (!cs || !cs->read || cs->frequency == 0 || num_clocksources >= KTIME_MAX_CLOCKSOURCES) {
+        return -1;
+    }
+
+    clocksource_compute_mult(cs);
+    clocksources[num_clocksources++] = cs;
+
+    // Before ktime_init the choice waits until the TSC has been rated
+    if (ktime_source) {
+        clocksource_select();
+    }
+    return 0;
+}
+
+clocksource_t* clocksource_current(void) {
+    return ktime_source;
+}
+
+// TSC ticks per second measured over one window of the reference source
+static uint64_t tsc_measure_against(clocksource_t* ref) {
+    uint64_t window = ref->frequency * TSC_CALIBRATE_MS / 1000;
+
+    // Start on a tick edge of the reference
+    uint64_t ref_start = ref->read();
+    uint64_t ref_now;
+    while ((ref_now = ref->read()) == ref_start);
+    ref_start = ref_now;
+    uint64_t tsc_start = rdtsc();
+
+    while ((((ref_now = ref->read()) - ref_start) & ref->mask) < window);
+    uint64_t tsc_end = rdtsc();
+
+    uint64_t ref_ticks = (ref_now - ref_start) & ref->mask;
+    return (tsc_end - tsc_start) * ref->frequency / ref_ticks;
+}
+
+// TSC ticks per second over a PIT channel 2 one-shot
+static uint64_t tsc_measure_against_pit(void) {
+    uint32_t count = PIT_FREQUENCY * TSC_CALIBRATE_MS / 1000;
+
+    // Gate on, speaker off
+    outb(PIT_CH2_GATE, (inb(PIT_CH2_GATE) & ~0x02) | 0x01);
+    outb(PIT_COMMAND, PIT_CH2_ONESHOT);
+    outb(PIT_CH2_DATA, count & 0xFF);
+    outb(PIT_CH2_DATA, (count >> 8) & 0xFF);
+
+    uint64_t tsc_start = rdtsc();
+    while (!(inb(PIT_CH2_GATE) & 0x20));
+    uint64_t tsc_end = rdtsc();
+
+    return (tsc_end - tsc_start) * 1000 / TSC_CALIBRATE_MS;
+}
+
+// Calibrate the TSC twice and rate it by how well the windows agree
+static void tsc_calibrate(void) {
+    clocksource_t* ref = NULL;
+    for (int i = 0; i < num_clocksources; i++) {
+        // Only a fine-grained reference can time a short window
+        if (clocksources[i]->frequency >= 1000000 &&
+            (!ref || clocksources[i]->rating > ref->rating)) {
+            ref = clocksources[i];
+        }
+    }
+
+    uint32_t flags = ktime_irq_save();
+    uint64_t first = ref ? tsc_measure_against(ref) : tsc_measure_against_pit();
+    uint64_t second = ref ? tsc_measure_against(ref) : tsc_measure_against_pit();
+    ktime_irq_restore(flags);
+
+    uint64_t diff = first > second ? first - second : second - first;
+    if (second == 0) {
+        return;
+    }
+
+    tsc_clocksource.frequency = second;
+    if (diff * 1000000 / second > TSC_MAX_DRIFT_PPM) {
+        tsc_clocksource.rating = CLOCKSOURCE_RATING_TSC_UNSTABLE;
+    } else {
+        tsc_clocksource.rating = ref ? CLOCKSOURCE_RATING_TSC : CLOCKSOURCE_RATING_TSC_PIT;
+    }
+
+    terminal_writestring("TSC: ");
+    terminal_write_dec((uint32_t)(second / 1000000));
+    terminal_writestring(" MHz (calibrated against ");
+    terminal_writestring(ref ? ref->name : "pit");
+    terminal_writestring(tsc_clocksource.rating == CLOCKSOURCE_RATING_TSC_UNSTABLE ?
+                         ", unstable)\n" : ")\n");
+}
+
+void ktime_init(void) {
+    tsc_calibrate();
+    clocksource_register(&tsc_clocksource);
+    clocksource_select();
+
+    ktime_boot_real = rtc_get_unix_time();
+    ktime_base_ns = 0;
+    ktime_cycle_last = ktime_source ? ktime_source->read() : 0;
+
+    if (ktime_source) {
+        terminal_writestring("Clock source: ");
+        terminal_writestring(ktime_source->name);
+        terminal_writestring("\n");
+    }
+}
+
+uint64_t ktime_get_ns(void) {
+    if (!ktime_source) {
+        return 0;
+    }
+
+    uint32_t flags = ktime_irq_save();
+    uint64_t now = ktime_source->read();
+    uint64_t delta = (now - ktime_cycle_last) & ktime_source->mask;
+
+    // Narrow counters are folded before they can wrap past cycle_last
+    if (delta > (ktime_source->mask >> 1)) {
+        ktime_accumulate(now);
+        delta = 0;
+    }
+
+    uint64_t ns = ktime_base_ns + clocksource_cyc2ns(ktime_source, delta);
+    ktime_irq_restore(flags);
+    return ns;
+}
+
+// Timer interrupt hook: a 32-bit HPET wraps within tens of seconds at higher
+// rates, so fold narrow counters even when nothing reads ktime for a while
+void ktime_tick(void) {
+    if (!ktime_source || ktime_source->mask == 0xFFFFFFFFFFFFFFFFULL) {
+        return;
+    }
+
+    uint32_t flags = ktime_irq_save();
+    ktime_accumulate(ktime_source->read());
+    ktime_irq_restore(flags);
+}
+
+uint64_t ktime_tsc_to_ns(uint64_t cycles) {
+    if (!tsc_clocksource.frequency) {
+        return 0;
+    }
+    return clocksource_cyc2ns(&tsc_clocksource, cycles);
+}
+
+uint64_t ktime_get_us(void) {
+    return ktime_get_ns() / NSEC_PER_USEC;
+}
+
+uint64_t ktime_get_ms(void) {
+    return ktime_get_ns() / NSEC_PER_MSEC;
+}
+
+uint32_t ktime_get_real_seconds(void) {
+    return ktime_boot_real + (uint32_t)(ktime_get_ns() / NSEC_PER_SEC);
+}
+
+void ktime_delay_us(uint32_t us) {
+    uint64_t end = ktime_get_ns() + (uint64_t)us * NSEC_PER_USEC;
+    while (ktime_get_ns() < end) {
+        __asm__ volatile ("pause");
+    }
+}
+
+static void clocksource_print_padded(const char* text, int width) {
+    int len = (int)strlen(text);
+    terminal_writestring(text);
+    for (; len < width; len++) {
+        terminal_writestring(" ");
+    }
+}
+
+void clocksource_print(void) {
+    terminal_writestring("  Name    Rating  Frequency\n");
+    terminal_writestring("  ------  ------  ---------\n");
+    for (int i = 0; i < num_clocksources; i++) {
+        clocksource_t* cs = clocksources[i];
+        terminal_writestring(cs == ktime_source ? "* " : "  ");
+        clocksource_print_padded(cs->name, 8);
+        terminal_write_dec(cs->rating);
+        terminal_writestring(cs->rating < 10 ? "       " : cs->rating < 100 ? "      " : "     ");
+        if (cs->frequency >= 1000000) {
+            terminal_write_dec((uint32_t)(cs->frequency / 1000000));
+            terminal_writestring(" MHz\n");
+        } else {
+            terminal_write_dec((uint32_t)cs->frequency);
+            terminal_writestring(" Hz\n");
+        }
+    }
+}
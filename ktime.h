@@ -0,0 +1,57 @@
+#ifndef KTIME_H
+#define KTIME_H
+
+#include <stdint.h>
+
+#define KTIME_MAX_CLOCKSOURCES 4
+#define NSEC_PER_SEC  1000000000ULL
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_USEC 1000ULL
+
+// Clock source ratings: the highest-rated registered source drives ktime
+#define CLOCKSOURCE_RATING_RTC        10   // 1 Hz, last resort
+#define CLOCKSOURCE_RATING_TSC_UNSTABLE 50 // Rate disagreed with the reference
+#define CLOCKSOURCE_RATING_TSC_PIT    200  // Calibrated against the PIT only
+#define CLOCKSOURCE_RATING_HPET       250
+#define CLOCKSOURCE_RATING_TSC        300  // Validated against the HPET
+
+// A free-running counter
+typedef struct clocksource {
+    const char* name;
+    uint32_t rating;
+    uint64_t (*read)(void);
+    uint64_t mask;              // Counter width
+    uint64_t frequency;         // Hz
+
+    // Filled in at registration: ns = (cycles * mult) >> shift
+    uint32_t mult;
+    uint32_t shift;
+} clocksource_t;
+
+// Registration and selection
+int clocksource_register(clocksource_t* cs);
+clocksource_t* clocksource_current(void);
+void clocksource_print(void);
+
+// Calibrate the TSC, pick the best source and seed the wall clock
+void ktime_init(void);
+
+// Monotonic time since ktime_init
+uint64_t ktime_get_ns(void);
+uint64_t ktime_get_us(void);
+uint64_t ktime_get_ms(void);
+
+// Wall-clock time (seconds since 1970, seeded from the RTC)
+uint32_t ktime_get_real_seconds(void);
+
+// TSC cycles (as read before ktime_init, say) in ns; 0 if the TSC was
+// not calibrated
+uint64_t ktime_tsc_to_ns(uint64_t cycles);
+
+// Called from the timer interrupt so a narrow source cannot wrap unseen
+void ktime_tick(void);
+
+// Busy-wait using the current source
+void ktime_delay_us(uint32_t us);
+
+#endif // KTIME_H
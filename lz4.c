@@ -0,0 +1,106 @@
+#include "lz4.h"
+
+// Built for the boot stub with -fno-tree-loop-distribute-patterns: there is
+// no memcpy to turn these loops into
+
+#define LZ4_MIN_MATCH       4
+#define LZ4_SHORT_COPY      16      // Copied in one go when both buffers have room
+
+// Unaligned word access; fine on x86
+typedef uint32_t __attribute__((may_alias, aligned(1))) lz4_word_t;
+
+static inline void lz4_copy(uint8_t* dst, const uint8_t* src, size_t len) {
+    while (len >= 4) {
+        *(lz4_word_t*)dst = *(const lz4_word_t*)src;
+        dst += 4;
+        src += 4;
+        len -= 4;
+    }
+    while (len--) {
+        *dst++ = *src++;
+    }
+}
+
+// Short literal runs and matches are the common case: copy a fixed 16
+// bytes, overshooting into output that the next sequence overwrites
+static inline void lz4_copy_short(uint8_t* dst, const uint8_t* src) {
+    ((lz4_word_t*)dst)[0] = ((const lz4_word_t*)src)[0];
+    ((lz4_word_t*)dst)[1] = ((const lz4_word_t*)src)[1];
+    ((lz4_word_t*)dst)[2] = ((const lz4_word_t*)src)[2];
+    ((lz4_word_t*)dst)[3] = ((const lz4_word_t*)src)[3];
+}
+
+// Lengths of 15 continue in bytes that add up until one is below 255
+static inline int lz4_read_length(const uint8_t** ip, const uint8_t* end, size_t* len) {
+    uint8_t byte;
+    do {
+        if (*ip >= end) {
+            return -1;
+        }
+        byte = *(*ip)++;
+        *len += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+int lz4_decompress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_len) {
+    const uint8_t* ip = src;
+    const uint8_t* ip_end = src + src_len;
+    uint8_t* op = dst;
+    uint8_t* op_end = dst + dst_len;
+
+    while (ip < ip_end) {
+        uint8_t token = *ip++;
+
+        // Literals
+        size_t len = token >> 4;
+        if (len == 15 && lz4_read_length(&ip, ip_end, &len) != 0) {
+            return -1;
+        }
+        if (len > (size_t)(ip_end - ip) || len > (size_t)(op_end - op)) {
+            return -1;
+        }
+        if (len <= LZ4_SHORT_COPY && ip_end - ip >= LZ4_SHORT_COPY && op_end - op >= LZ4_SHORT_COPY) {
+            lz4_copy_short(op, ip);
+        } else {
+            lz4_copy(op, ip, len);
+        }
+        ip += len;
+        op += len;
+
+        // The last sequence is literals only
+        if (ip == ip_end) {
+            break;
+        }
+
+        // Match: offset back into the output, then its length
+        if (ip_end - ip < 2) {
+            return -1;
+        }
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        len = token & 15;
+        if (len == 15 && lz4_read_length(&ip, ip_end, &len) != 0) {
+            return -1;
+        }
+        len += LZ4_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - dst) || len > (size_t)(op_end - op)) {
+            return -1;
+        }
+
+        const uint8_t* match = op - offset;
+        if (offset >= 4 && len <= LZ4_SHORT_COPY && op_end - op >= LZ4_SHORT_COPY) {
+            lz4_copy_short(op, match);
+            op += len;
+        } else if (offset >= 4) {
+            // Each word read is already written, even where the match overlaps
+            lz4_copy(op, match, len);
+            op += len;
+        } else {
+            while (len--) {
+                *op++ = *match++;
+            }
+        }
+    }
+    return (int)(op - dst);
+}
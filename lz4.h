@@ -0,0 +1,15 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// LZ4 block decoder (the raw block format, no frame). Freestanding and
+// allocation-free, so the boot stub can use it before anything is set up.
+// Literals and matches at least a word apart are copied a word at a time.
+
+// Decode src_len bytes of src into dst. Returns the number of bytes
+// written, or -1 if the input is malformed or would overrun dst_len.
+int lz4_decompress(const uint8_t* src, size_t src_len, uint8_t* dst, size_t dst_len);
+
+#endif // LZ4_H
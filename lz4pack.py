@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""Compress kernel.bin for the LZ4 boot stub (CONFIG_KERNEL_LZ4).
+
+lz4pack.py <kernel.bin> <kernel.lz4>
+
+Lays the kernel's loadable segments out as they sit in memory, compresses
+that image as one LZ4 block and writes it behind a boot_lz4_header_t
+(boottime.h), which lz4stub.asm includes. The block is decoded again here
+before anything is written, so a bad image fails the build, not the boot.
+"""
+
+import struct
+import sys
+
+BOOT_LZ4_MAGIC = 0x4B345A4C
+STUB_BASE = 0x800000            # lz4stub.ld
+
+PT_LOAD = 1
+SHT_SYMTAB = 2
+
+MIN_MATCH = 4
+LAST_LITERALS = 5               # The block ends with at least this many literals
+MATCH_LIMIT = 12                # and no match starts closer than this to the end
+MAX_OFFSET = 0xFFFF
+
+
+def read_elf(path):
+    with open(path, "rb") as f:
+        elf = f.read()
+    if elf[:4] != b"\x7fELF" or elf[4] != 1:
+        sys.exit("lz4pack: %s is not a 32-bit ELF file" % path)
+
+    (entry, phoff, shoff) = struct.unpack_from("<III", elf, 24)
+    (phentsize, phnum, shentsize, shnum) = struct.unpack_from("<HHHH", elf, 42)
+
+    segments = []
+    for i in range(phnum):
+        (p_type, offset, _, paddr, filesz, memsz) = struct.unpack_from("<IIIIII", elf, phoff + i * phentsize)
+        if p_type == PT_LOAD and memsz:
+            segments.append((paddr, elf[offset:offset + filesz], memsz))
+
+    symbols = {}
+    for i in range(shnum):
+        (_, sh_type, _, _, offset, size, link) = struct.unpack_from("<IIIIIII", elf, shoff + i * shentsize)
+        if sh_type != SHT_SYMTAB:
+            continue
+        strtab_offset = struct.unpack_from("<I", elf, shoff + link * shentsize + 16)[0]
+        for sym in range(offset, offset + size, 16):
+            (name, value) = struct.unpack_from("<II", elf, sym)
+            end = elf.index(b"\0", strtab_offset + name)
+            symbols[elf[strtab_offset + name:end].decode()] = value
+    return entry, segments, symbols
+
+
+def write_length(out, length):
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+
+
+def emit(out, literals, offset=0, match_len=0):
+    lit_len = len(literals)
+    extra = match_len - MIN_MATCH if match_len else 0
+    out.append(min(lit_len, 15) << 4 | (min(extra, 15) if match_len else 0))
+    if lit_len >= 15:
+        write_length(out, lit_len - 15)
+    out += literals
+    if match_len:
+        out += struct.pack("<H", offset)
+        if extra >= 15:
+            write_length(out, extra - 15)
+
+
+def compress(data):
+    """Greedy LZ4 block: the most recent earlier occurrence of each 4 bytes"""
+    out = bytearray()
+    last_seen = {}
+    anchor = 0
+    pos = 0
+    match_start_limit = len(data) - MATCH_LIMIT
+    match_end_limit = len(data) - LAST_LITERALS
+    while pos < match_start_limit:
+        key = data[pos:pos + MIN_MATCH]
+        candidate = last_seen.get(key)
+        last_seen[key] = pos
+        if candidate is None or pos - candidate > MAX_OFFSET:
+            pos += 1
+            continue
+        length = MIN_MATCH
+        while pos + length < match_end_limit and data[candidate + length] == data[pos + length]:
+            length += 1
+        emit(out, data[anchor:pos], pos - candidate, length)
+        pos += length
+        anchor = pos
+    emit(out, data[anchor:])
+    return bytes(out)
+
+
+def decompress(block):
+    out = bytearray()
+    pos = 0
+    while pos < len(block):
+        token = block[pos]
+        pos += 1
+        length = token >> 4
+        if length == 15:
+            while True:
+                length += block[pos]
+                pos += 1
+                if block[pos - 1] != 255:
+                    break
+        out += block[pos:pos + length]
+        pos += length
+        if pos == len(block):
+            break
+        offset = block[pos] | block[pos + 1] << 8
+        pos += 2
+        length = token & 15
+        if length == 15:
+            while True:
+                length += block[pos]
+                pos += 1
+                if block[pos - 1] != 255:
+                    break
+        for _ in range(length + MIN_MATCH):
+            out.append(out[-offset])
+    return bytes(out)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit(__doc__)
+    entry, segments, symbols = read_elf(sys.argv[1])
+    if not segments:
+        sys.exit("lz4pack: no loadable segments")
+    if "boot_image" not in symbols:
+        sys.exit("lz4pack: kernel has no boot_image symbol (boottime.c)")
+
+    load_addr = min(paddr for paddr, _, _ in segments)
+    image_end = max(paddr + len(data) for paddr, data, _ in segments)
+    bss_end = max(paddr + memsz for paddr, _, memsz in segments)
+    if bss_end > STUB_BASE:
+        sys.exit("lz4pack: kernel ends at 0x%x, over the stub at 0x%x" % (bss_end, STUB_BASE))
+
+    # Whole words, so the stub clears BSS a word at a time
+    image_end = (image_end + 3) & ~3
+    bss_end = (bss_end + 3) & ~3
+    image = bytearray(image_end - load_addr)
+    for paddr, data, _ in segments:
+        image[paddr - load_addr:paddr - load_addr + len(data)] = data
+    image = bytes(image)
+
+    block = compress(image)
+    if decompress(block) != image:
+        sys.exit("lz4pack: compressed image does not decode to the kernel")
+
+    header = struct.pack("<8I", BOOT_LZ4_MAGIC, load_addr, len(image), bss_end, entry,
+                         symbols["boot_image"], len(block), 0)
+    with open(sys.argv[2], "wb") as f:
+        f.write(header + block)
+    print("lz4pack: %d bytes at 0x%x -> %d (%d%%)" % (len(image), load_addr, len(block),
+                                                       len(block) * 100 // max(len(image), 1)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,59 @@
+; Multiboot stub for the compressed kernel (CONFIG_KERNEL_LZ4). GRUB loads
+; this instead of kernel.bin; unlz4_main unpacks the kernel carried below
+; to its link address, and the stub jumps to the kernel's _start with the
+; multiboot registers as the bootloader left them.
+
+; Multiboot header, as in boot.asm
+MBALIGN  equ  1 << 0
+MEMINFO  equ  1 << 1
+FLAGS    equ  MBALIGN | MEMINFO
+MAGIC    equ  0x1BADB002
+CHECKSUM equ -(MAGIC + FLAGS)
+
+section .multiboot
+align 4
+    dd MAGIC
+    dd FLAGS
+    dd CHECKSUM
+
+section .bss
+align 16
+stub_stack_bottom:
+resb 4096
+stub_stack_top:
+
+; lz4pack.py output: a boot_lz4_header_t and the compressed image
+section .rodata
+align 4
+kernel_lz4:
+incbin "kernel.lz4"
+
+section .text
+global _start
+extern unlz4_main
+_start:
+    ; Read the TSC first: it marks the end of the bootloader's load
+    mov esp, stub_stack_top
+    mov esi, eax                ; Multiboot magic and info pointer, kept in
+    mov edi, ebx                ; registers the C code preserves
+    rdtsc
+
+    ; unlz4_main(header, tsc low, tsc high); 16-byte aligned at the call
+    sub esp, 4
+    push edx
+    push eax
+    push kernel_lz4
+    call unlz4_main
+    add esp, 16
+    test eax, eax
+    jz .hang
+
+    mov ecx, eax
+    mov eax, esi
+    mov ebx, edi
+    jmp ecx
+
+.hang:
+    cli
+    hlt
+    jmp .hang
@@ -0,0 +1,382 @@
+#include <stddef.h>
+#include "memcg.h"
+#include "pmm.h"
+#include "klib.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+
+// Largest oomtest limit: all the frames there can be
+#define MEMCG_TEST_MAX_KB   (PMM_MAX_FRAMES * (PAGE_SIZE / 1024))
+
+static mem_group_t memcg_groups[MEMCG_MAX_GROUPS];
+
+// Heap blocks may be charged before this runs; only the root's identity is set
+void memcg_init(void) {
+    mem_group_t* root = &memcg_groups[MEMCG_ROOT];
+    strlcpy(root->name, "kernel", MEMCG_NAME_LEN);
+    root->id = MEMCG_ROOT;
+    root->in_use = 1;
+}
+
+mem_group_t* memcg_create(const char* name) {
+    if (memcg_find(name)) {
+        return NULL;
+    }
+    for (int i = 1; i < MEMCG_MAX_GROUPS; i++) {
+        mem_group_t* group = &memcg_groups[i];
+        if (!group->in_use) {
+            memset(group, 0, sizeof(mem_group_t));
+            strlcpy(group->name, name, MEMCG_NAME_LEN);
+            group->id = (uint8_t)i;
+            group->in_use = 1;
+            return group;
+        }
+    }
+    return NULL;
+}
+
+mem_group_t* memcg_find(const char* name) {
+    for (int i = 0; i < MEMCG_MAX_GROUPS; i++) {
+        if (memcg_groups[i].in_use && strcmp(memcg_groups[i].name, name) == 0) {
+            return &memcg_groups[i];
+        }
+    }
+    return NULL;
+}
+
+mem_group_t* memcg_current(void) {
+    if (current_task && current_task->memcg) {
+        return current_task->memcg;
+    }
+    return &memcg_groups[MEMCG_ROOT];
+}
+
+static inline mem_group_t* memcg_of(address_space_t* as) {
+    return as->memcg ? as->memcg : &memcg_groups[MEMCG_ROOT];
+}
+
+void memcg_set_limits(mem_group_t* group, uint32_t soft_limit, uint32_t hard_limit) {
+    group->soft_limit = soft_limit;
+    group->hard_limit = hard_limit;
+}
+
+void memcg_attach(task_t* task, mem_group_t* group) {
+    if (task->mm) {
+        memcg_uncharge_pages(task->mm, task->mm->resident_pages);
+        task->mm->memcg = group;
+        memcg_force_charge_pages(task->mm, task->mm->resident_pages);
+    }
+    task->memcg = group;
+}
+
+uint32_t memcg_task_usage(const task_t* task) {
+    uint32_t usage = task->heap_bytes;
+    if (task->mm) {
+        usage += task->mm->resident_pages * PAGE_SIZE;
+    }
+    return usage;
+}
+
+// Usage bookkeeping after a charge
+
+static void memcg_account(mem_group_t* group, uint32_t old_usage) {
+    uint32_t usage = memcg_usage(group);
+    if (usage > group->peak_bytes) {
+        group->peak_bytes = usage;
+    }
+    if (group->soft_limit && old_usage <= group->soft_limit && usage > group->soft_limit) {
+        group->soft_breaches++;
+    }
+}
+
+static void memcg_task_peak(task_t* task) {
+    uint32_t usage = memcg_task_usage(task);
+    if (usage > task->mem_peak) {
+        task->mem_peak = usage;
+    }
+}
+
+// OOM policy
+
+// Largest live task, of one group or (group NULL) of all; tasks in groups
+// over their soft limit win over the rest regardless of size
+static task_t* memcg_select_victim(mem_group_t* group) {
+    task_t* victim = NULL;
+    int victim_over = 0;
+    uint32_t victim_usage = 0;
+
+    for (int i = 0; i < task_table_size(); i++) {
+        task_t* task = task_get(i);
+        if (!task || task->killed || (group && task->memcg != group)) {
+            continue;
+        }
+        mem_group_t* tg = task->memcg ? task->memcg : &memcg_groups[MEMCG_ROOT];
+        int over = tg->soft_limit && memcg_usage(tg) > tg->soft_limit;
+        uint32_t usage = memcg_task_usage(task);
+        if (!victim || over > victim_over || (over == victim_over && usage > victim_usage)) {
+            victim = task;
+            victim_over = over;
+            victim_usage = usage;
+        }
+    }
+    return victim;
+}
+
+// Kill a victim; returns 1 if its memory was released now. The running
+// task and the owner of the space being mapped into only get marked, since
+// their memory is in use by the caller.
+static int memcg_kill(task_t* victim, address_space_t* busy) {
+    mem_group_t* group = victim->memcg ? victim->memcg : &memcg_groups[MEMCG_ROOT];
+    group->oom_kills++;
+
+    terminal_writestring("OOM: killed task ");
+    terminal_write_dec(victim->id);
+    terminal_writestring(" (");
+    terminal_writestring(victim->name);
+    terminal_writestring(", ");
+    terminal_write_dec(memcg_task_usage(victim) / 1024);
+    terminal_writestring(" KB) in group ");
+    terminal_writestring(group->name);
+    terminal_writestring("\n");
+
+    if (victim == current_task || (busy && victim->mm == busy)) {
+        victim->killed = 1;
+        return 0;
+    }
+    task_kill(victim);
+    return 1;
+}
+
+// Make room for bytes under the group's hard limit, killing as needed
+static int memcg_try_charge(mem_group_t* group, uint32_t bytes, address_space_t* busy) {
+    if (!group->hard_limit || memcg_usage(group) + bytes <= group->hard_limit) {
+        return 0;
+    }
+
+    group->limit_hits++;
+    for (int attempt = 0; attempt < task_table_size(); attempt++) {
+        task_t* victim = memcg_select_victim(group);
+        if (!victim || !memcg_kill(victim, busy)) {
+            break;
+        }
+        if (memcg_usage(group) + bytes <= group->hard_limit) {
+            return 0;
+        }
+    }
+    group->failed++;
+    return -1;
+}
+
+int memcg_out_of_memory(address_space_t* busy) {
+    task_t* victim = memcg_select_victim(NULL);
+    return victim && memcg_kill(victim, busy) ? 0 : -1;
+}
+
+// Heap charges
+
+int memcg_charge_heap(uint32_t bytes, uint8_t* group_id, uint16_t* owner) {
+    mem_group_t* group = memcg_current();
+    if (memcg_try_charge(group, bytes, NULL) != 0) {
+        return -1;
+    }
+
+    uint32_t old_usage = memcg_usage(group);
+    group->heap_bytes += bytes;
+    memcg_account(group, old_usage);
+
+    *group_id = group->id;
+    *owner = 0;
+    if (current_task) {
+        current_task->heap_bytes += bytes;
+        memcg_task_peak(current_task);
+        *owner = (uint16_t)current_task->id;
+    }
+    return 0;
+}
+
+void memcg_uncharge_heap(uint8_t group_id, uint16_t owner, uint32_t bytes) {
+    if (group_id >= MEMCG_MAX_GROUPS) {
+        return;
+    }
+    mem_group_t* group = &memcg_groups[group_id];
+    group->heap_bytes = group->heap_bytes > bytes ? group->heap_bytes - bytes : 0;
+
+    // The owner may be gone (its blocks stay with the group) or its id reused
+    task_t* task = owner ? task_find(owner) : NULL;
+    if (task) {
+        task->heap_bytes = task->heap_bytes > bytes ? task->heap_bytes - bytes : 0;
+    }
+}
+
+// Page charges
+
+static task_t* memcg_space_owner(address_space_t* as) {
+    for (int i = 0; i < task_table_size(); i++) {
+        task_t* task = task_get(i);
+        if (task && task->mm == as) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+int memcg_charge_pages(address_space_t* as, uint32_t pages) {
+    if (memcg_try_charge(memcg_of(as), pages * PAGE_SIZE, as) != 0) {
+        return -1;
+    }
+    memcg_force_charge_pages(as, pages);
+    return 0;
+}
+
+int memcg_charge_pages_optional(address_space_t* as, uint32_t pages) {
+    mem_group_t* group = memcg_of(as);
+    if (group->hard_limit && memcg_usage(group) + pages * PAGE_SIZE > group->hard_limit) {
+        return -1;
+    }
+    memcg_force_charge_pages(as, pages);
+    return 0;
+}
+
+void memcg_force_charge_pages(address_space_t* as, uint32_t pages) {
+    mem_group_t* group = memcg_of(as);
+    uint32_t old_usage = memcg_usage(group);
+    group->pages += pages;
+    memcg_account(group, old_usage);
+
+    task_t* task = memcg_space_owner(as);
+    if (task) {
+        memcg_task_peak(task);
+    }
+}
+
+void memcg_uncharge_pages(address_space_t* as, uint32_t pages) {
+    mem_group_t* group = memcg_of(as);
+    group->pages = group->pages > pages ? group->pages - pages : 0;
+}
+
+void memcg_print_stats(void) {
+    terminal_writestring("=== Memory Groups ===\n");
+    for (int i = 0; i < MEMCG_MAX_GROUPS; i++) {
+        mem_group_t* group = &memcg_groups[i];
+        if (!group->in_use) {
+            continue;
+        }
+        terminal_writestring(group->name);
+        terminal_writestring(": heap ");
+        terminal_write_dec(group->heap_bytes / 1024);
+        terminal_writestring(" KB, pages ");
+        terminal_write_dec(group->pages);
+        terminal_writestring(", peak ");
+        terminal_write_dec(group->peak_bytes / 1024);
+        terminal_writestring(" KB, limits ");
+        if (group->soft_limit) {
+            terminal_write_dec(group->soft_limit / 1024);
+        } else {
+            terminal_writestring("-");
+        }
+        terminal_writestring("/");
+        if (group->hard_limit) {
+            terminal_write_dec(group->hard_limit / 1024);
+        } else {
+            terminal_writestring("-");
+        }
+        terminal_writestring(" KB\n");
+        terminal_writestring("  soft breaches ");
+        terminal_write_dec(group->soft_breaches);
+        terminal_writestring(", limit hits ");
+        terminal_write_dec(group->limit_hits);
+        terminal_writestring(" (");
+        terminal_write_dec(group->failed);
+        terminal_writestring(" failed), OOM kills ");
+        terminal_write_dec(group->oom_kills);
+        terminal_writestring("\n");
+    }
+}
+
+// Demo
+
+static void memcg_test_idle(void) {
+    while (1) {
+        __asm__ volatile ("hlt");
+    }
+}
+
+// Give a new task of the group an address space with some pages mapped
+static task_t* memcg_test_task(const char* name, mem_group_t* group, uint32_t pages) {
+    task_t* task = task_find(task_create(name, memcg_test_idle));
+    if (!task) {
+        return NULL;
+    }
+    memcg_attach(task, group);
+    task->mm = vmm_create();
+    if (!task->mm) {
+        task_kill(task);
+        return NULL;
+    }
+    task->mm->memcg = group;
+    vmm_map_anon(task->mm, VMM_USER_START, pages, PAGE_WRITABLE | PAGE_USER);
+    return task;
+}
+
+void memcg_oom_test(uint32_t limit_kb) {
+    mem_group_t* group = memcg_find("oomtest");
+    if (!group) {
+        group = memcg_create("oomtest");
+    }
+    if (!group) {
+        terminal_writestring("No free memory group\n");
+        return;
+    }
+    // No more than all of physical memory, which also keeps the byte
+    // limits below in 32 bits
+    if (limit_kb > MEMCG_TEST_MAX_KB) {
+        terminal_writestring("Limit too large (at most ");
+        terminal_write_dec(MEMCG_TEST_MAX_KB);
+        terminal_writestring(" KB)\n");
+        return;
+    }
+    uint32_t limit_pages = limit_kb * 1024 / PAGE_SIZE;
+    if (limit_pages < 8) {
+        terminal_writestring("Limit too small\n");
+        return;
+    }
+    memcg_set_limits(group, limit_kb * 1024 / 2, limit_kb * 1024);
+
+    // The hog takes three quarters of the limit, the other task an eighth
+    task_t* hog = memcg_test_task("hog", group, limit_pages * 3 / 4);
+    task_t* small = memcg_test_task("small", group, limit_pages / 8);
+    if (!hog || !small) {
+        terminal_writestring("Could not create the test tasks\n");
+        task_kill(hog);
+        task_kill(small);
+        return;
+    }
+    uint32_t hog_id = hog->id;
+
+    terminal_writestring("Group usage ");
+    terminal_write_dec(memcg_usage(group) / 1024);
+    terminal_writestring(" KB of ");
+    terminal_write_dec(limit_kb);
+    terminal_writestring(" KB; growing 'small' by ");
+    terminal_write_dec(limit_pages / 4);
+    terminal_writestring(" pages\n");
+
+    // Crossing the hard limit must kill the hog, not fail small's mappings
+    uint32_t vaddr = VMM_USER_START + (limit_pages / 8) * PAGE_SIZE;
+    int ok = vmm_map_anon(small->mm, vaddr, limit_pages / 4, PAGE_WRITABLE | PAGE_USER) == 0;
+    ok = ok && task_find(hog_id) == NULL && small->mm->resident_pages == limit_pages / 8 + limit_pages / 4;
+
+    terminal_writestring("Group usage ");
+    terminal_write_dec(memcg_usage(group) / 1024);
+    terminal_writestring(" KB, peak ");
+    terminal_write_dec(group->peak_bytes / 1024);
+    terminal_writestring(" KB, small resident ");
+    terminal_write_dec(small->mm->resident_pages);
+    terminal_writestring(" pages\n");
+    terminal_writestring(ok ? "Result: OK\n" : "Result: FAILED\n");
+
+    task_kill(task_find(hog_id));
+    task_kill(small);
+}
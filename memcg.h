@@ -0,0 +1,78 @@
+#ifndef MEMCG_H
+#define MEMCG_H
+
+#include <stdint.h>
+#include "scheduler.h"
+#include "vmm.h"
+
+// Memory groups: heap bytes and resident user pages are charged to the
+// group of the task that allocated or maps them. Group 0 holds the kernel
+// and tasks nobody moved; it has no limits unless one is set.
+#define MEMCG_MAX_GROUPS    8
+#define MEMCG_ROOT          0
+#define MEMCG_NAME_LEN      16
+
+typedef struct mem_group {
+    char name[MEMCG_NAME_LEN];
+    uint8_t id;
+    uint8_t in_use;
+    uint32_t heap_bytes;        // Heap blocks charged (block sizes)
+    uint32_t pages;             // Resident user pages of the group's address spaces
+    uint32_t peak_bytes;        // Highest heap + page usage seen
+
+    // Limits in bytes (0 = none). Over the soft limit a group's tasks are
+    // the first OOM victims; a charge over the hard limit kills the group's
+    // largest task, and fails only if there is nothing left to kill.
+    uint32_t soft_limit;
+    uint32_t hard_limit;
+
+    // Statistics
+    uint32_t soft_breaches;     // Charges that crossed the soft limit
+    uint32_t limit_hits;        // Charges that ran into the hard limit
+    uint32_t failed;            // ... and could not be satisfied
+    uint32_t oom_kills;         // Tasks of this group killed
+} mem_group_t;
+
+void memcg_init(void);
+
+// Groups
+mem_group_t* memcg_create(const char* name);
+mem_group_t* memcg_find(const char* name);
+mem_group_t* memcg_current(void);
+void memcg_set_limits(mem_group_t* group, uint32_t soft_limit, uint32_t hard_limit);
+
+// Move a task (and its resident pages) into a group; heap blocks stay
+// charged to the group that allocated them
+void memcg_attach(task_t* task, mem_group_t* group);
+
+static inline uint32_t memcg_usage(const mem_group_t* group) {
+    return group->heap_bytes + group->pages * PAGE_SIZE;
+}
+
+// Task usage: heap charged while it ran plus its resident pages
+uint32_t memcg_task_usage(const task_t* task);
+
+// Heap hooks (mm.c): charge the current task's group and report the owner
+// to record in the block; -1 if the allocation has to fail
+int memcg_charge_heap(uint32_t bytes, uint8_t* group, uint16_t* owner);
+void memcg_uncharge_heap(uint8_t group, uint16_t owner, uint32_t bytes);
+
+// Page hooks (vmm.c, swap.c). The forced variant never fails: pages coming
+// back from swap or shared by fork are already in use. The optional one
+// only charges what fits under the limit as it is, without killing a task
+// for room; for memory the caller can do without, like 4MB pages.
+int memcg_charge_pages(address_space_t* as, uint32_t pages);
+int memcg_charge_pages_optional(address_space_t* as, uint32_t pages);
+void memcg_force_charge_pages(address_space_t* as, uint32_t pages);
+void memcg_uncharge_pages(address_space_t* as, uint32_t pages);
+
+// Out of frames: kill the largest task (preferring groups over their soft
+// limit) other than the one mapping into busy; 0 if memory was released
+int memcg_out_of_memory(address_space_t* busy);
+
+void memcg_print_stats(void);
+
+// Two tasks in a limited group; growing the small one kills the large one
+void memcg_oom_test(uint32_t limit_kb);
+
+#endif // MEMCG_H
@@ -1,4 +1,8 @@
 #include "mm.h"
+#include "reclaim.h"
+#include "memcg.h"
+#include "tunable.h"
+#include "kmem.h"
 
 // Global memory management state
 static mem_block_t* heap_head = NULL;
@@ -6,9 +10,24 @@ static void* heap_start = NULL;
 static size_t heap_size = 0;
 static mem_stats_t mem_stats = {0};
 
-// Simulated page directory (for demonstration)
-static page_directory_t kernel_page_directory;
-static page_table_t kernel_page_tables[256]; // Support for 1GB of virtual memory
+TUNABLE_VAR(mm_heap_size, KERNEL_HEAP_SIZE);
+#if CONFIG_TUNABLES
+static tunable_t mm_heap_size_tunable = {
+    .name = "mm.heap_size",
+    .description = "Kernel heap size",
+    .type = TUNABLE_SIZE,
+    .flags = TUNABLE_BOOT,
+    .value = &mm_heap_size,
+    .min = KERNEL_HEAP_MIN,
+    .max = KERNEL_HEAP_MAX,
+};
+#endif
+
+// Kernel page directory; page aligned, as its entries and CR3 hold frame numbers
+static page_directory_t kernel_page_directory __attribute__((aligned(PAGE_SIZE)));
+static page_table_t kernel_page_tables[256] __attribute__((aligned(PAGE_SIZE))); // Support for 1GB of virtual memory
+
+#define CR0_PG  0x80000000
 
 // Simple implementations of standard library functions
 void* memset(void* dest, int value, size_t count) {
@@ -43,14 +62,15 @@ int memcmp(const void* ptr1, const void* ptr2, size_t count) {
 
 // Initialize memory management
 void mm_init(void* mmap_addr, uint32_t mmap_length) {
-    // Set up heap
+    // Set up heap, in whole pages
+    tunable_register(&mm_heap_size_tunable);
     heap_start = (void*)KERNEL_HEAP_START;
-    heap_size = KERNEL_HEAP_SIZE;
+    heap_size = mm_heap_size & ~(uint32_t)(PAGE_SIZE - 1);
     
     // Initialize the first block
     heap_head = (mem_block_t*)heap_start;
     heap_head->size = heap_size - sizeof(mem_block_t);
-    heap_head->is_free = 1;
+    heap_head->is_free = MEM_BLOCK_FREE;
     heap_head->next = NULL;
     heap_head->prev = NULL;
     
@@ -77,7 +97,7 @@ static mem_block_t* find_free_block(size_t size) {
     mem_block_t* current = heap_head;
     
     while (current) {
-        if (current->is_free && current->size >= size) {
+        if (current->is_free == MEM_BLOCK_FREE && current->size >= size) {
             return current;
         }
         current = current->next;
@@ -91,7 +111,7 @@ static void split_block(mem_block_t* block, size_t size) {
     if (block->size > size + sizeof(mem_block_t) + 32) { // Minimum split size
         mem_block_t* new_block = (mem_block_t*)((char*)block + sizeof(mem_block_t) + size);
         new_block->size = block->size - size - sizeof(mem_block_t);
-        new_block->is_free = 1;
+        new_block->is_free = MEM_BLOCK_FREE;
         new_block->next = block->next;
         new_block->prev = block;
         
@@ -107,7 +127,7 @@ static void split_block(mem_block_t* block, size_t size) {
 // Merge adjacent free blocks
 static void merge_free_blocks(mem_block_t* block) {
     // Merge with next block
-    while (block->next && block->next->is_free) {
+    while (block->next && block->next->is_free == MEM_BLOCK_FREE) {
         mem_block_t* next = block->next;
         block->size += next->size + sizeof(mem_block_t);
         block->next = next->next;
@@ -117,7 +137,7 @@ static void merge_free_blocks(mem_block_t* block) {
     }
     
     // Merge with previous block
-    while (block->prev && block->prev->is_free) {
+    while (block->prev && block->prev->is_free == MEM_BLOCK_FREE) {
         mem_block_t* prev = block->prev;
         prev->size += block->size + sizeof(mem_block_t);
         prev->next = block->next;
@@ -128,35 +148,79 @@ static void merge_free_blocks(mem_block_t* block) {
     }
 }
 
-// Allocate memory
-void* kmalloc(size_t size) {
+// Allocate from the heap's free list
+void* kmalloc_heap(size_t size) {
     if (size == 0) {
         return NULL;
     }
     
-    // Align size to 8 bytes
-    size = (size + 7) & ~7;
+    // Whole headers, so the next block's header stays aligned
+    size = (size + MEM_BLOCK_ALIGN - 1) & ~(MEM_BLOCK_ALIGN - 1);
     
     mem_block_t* block = find_free_block(size);
     if (!block) {
-        return NULL; // Out of memory
+        // Slow path: let registered caches give memory back, then retry once
+        if (reclaim_direct(RECLAIM_HEAP, size + sizeof(mem_block_t)) == 0) {
+            block = find_free_block(size);
+        }
+        if (!block) {
+            return NULL; // Out of memory
+        }
     }
     
     // Split the block if necessary
     split_block(block, size);
     
     // Mark as used
-    block->is_free = 0;
+    block->is_free = MEM_BLOCK_USED;
+    
+    // Charge the allocating task's group. Over its hard limit a task gets
+    // killed, which may free blocks next to this one, hence after marking.
+    if (memcg_charge_heap(block->size, &block->memcg, &block->owner) != 0) {
+        block->is_free = MEM_BLOCK_FREE;
+        merge_free_blocks(block);
+        return NULL;
+    }
     
     // Update statistics
     mem_stats.used_memory += block->size;
     mem_stats.free_memory -= block->size;
     mem_stats.num_allocations++;
+    reclaim_check(RECLAIM_HEAP);
     
     // Return pointer to data (after the header)
     return (char*)block + sizeof(mem_block_t);
 }
 
+// Allocate memory
+void* kmalloc(size_t size) {
+    if (size == 0) {
+        return NULL;
+    }
+    if (size > KMEM_MAX_SIZE) {
+        return kmalloc_heap(size);
+    }
+    
+    // Small sizes: a block parked in this CPU's magazine, or a class-sized
+    // one from the heap so that it can be parked when freed
+    int cls = kmem_class(size);
+    void* ptr = kmem_alloc(cls);
+    if (!ptr) {
+        return kmalloc_heap(kmem_class_size(cls));
+    }
+    
+    mem_block_t* block = (mem_block_t*)((char*)ptr - sizeof(mem_block_t));
+    block->is_free = MEM_BLOCK_USED;
+    if (memcg_charge_heap(block->size, &block->memcg, &block->owner) != 0) {
+        block->is_free = MEM_BLOCK_CACHED;
+        if (kmem_free(cls, ptr) != 0) {
+            kfree_heap(ptr);
+        }
+        return NULL;
+    }
+    return ptr;
+}
+
 // Allocate aligned memory
 void* kmalloc_aligned(size_t size, size_t alignment) {
     if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
@@ -195,22 +259,21 @@ void* kcalloc(size_t count, size_t size) {
     return ptr;
 }
 
-// Free memory
-void kfree(void* ptr) {
+// Return a block to the heap's free list. Parked blocks were uncharged
+// when they went into their magazine.
+void kfree_heap(void* ptr) {
     if (!ptr) {
         return;
     }
     
-    // Get the block header
     mem_block_t* block = (mem_block_t*)((char*)ptr - sizeof(mem_block_t));
-    
-    // Validate the block
-    if (block->is_free) {
+    if (block->is_free == MEM_BLOCK_FREE) {
         return; // Double free
     }
-    
-    // Mark as free
-    block->is_free = 1;
+    if (block->is_free == MEM_BLOCK_USED) {
+        memcg_uncharge_heap(block->memcg, block->owner, block->size);
+    }
+    block->is_free = MEM_BLOCK_FREE;
     
     // Update statistics
     mem_stats.used_memory -= block->size;
@@ -221,6 +284,41 @@ void kfree(void* ptr) {
     merge_free_blocks(block);
 }
 
+// Free memory
+void kfree(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    
+    // Get the block header
+    mem_block_t* block = (mem_block_t*)((char*)ptr - sizeof(mem_block_t));
+    
+    // Validate the block
+    if (block->is_free != MEM_BLOCK_USED) {
+        return; // Double free
+    }
+    
+    // Class-sized blocks are parked in this CPU's magazine
+    if (kmem_cacheable(block->size)) {
+        memcg_uncharge_heap(block->memcg, block->owner, block->size);
+        block->is_free = MEM_BLOCK_CACHED;
+        if (kmem_free(kmem_class(block->size), ptr) == 0) {
+            return;
+        }
+    }
+    kfree_heap(ptr);
+}
+
+// Free memory returned by kmalloc_aligned
+void kfree_aligned(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    
+    // The original pointer is stored just before the aligned one
+    kfree(*((void**)ptr - 1));
+}
+
 // Reallocate memory
 void* krealloc(void* ptr, size_t new_size) {
     if (!ptr) {
@@ -233,10 +331,13 @@ void* krealloc(void* ptr, size_t new_size) {
     }
     
     mem_block_t* block = (mem_block_t*)((char*)ptr - sizeof(mem_block_t));
+    new_size = (new_size + MEM_BLOCK_ALIGN - 1) & ~(MEM_BLOCK_ALIGN - 1);
     
     if (block->size >= new_size) {
-        // Current block is large enough
+        // Current block is large enough; a split-off tail is no longer charged
+        size_t old_size = block->size;
         split_block(block, new_size);
+        memcg_uncharge_heap(block->memcg, block->owner, old_size - block->size);
         return ptr;
     }
     
@@ -250,6 +351,11 @@ void* krealloc(void* ptr, size_t new_size) {
     return new_ptr;
 }
 
+// Free heap bytes (cheap; used by reclaim watermarks)
+size_t mm_free_memory(void) {
+    return mem_stats.free_memory;
+}
+
 // Get memory statistics
 mem_stats_t mm_get_stats(void) {
     // Update largest free block
@@ -257,7 +363,7 @@ mem_stats_t mm_get_stats(void) {
     mem_block_t* current = heap_head;
     
     while (current) {
-        if (current->is_free && current->size > mem_stats.largest_free_block) {
+        if (current->is_free == MEM_BLOCK_FREE && current->size > mem_stats.largest_free_block) {
             mem_stats.largest_free_block = current->size;
         }
         current = current->next;
@@ -271,22 +377,168 @@ void paging_init(void) {
     // Clear page directory
     memset(&kernel_page_directory, 0, sizeof(page_directory_t));
     
-    // Map first 4MB of memory (identity mapping)
-    for (int i = 0; i < 1024; i++) {
-        uint32_t physical_addr = i * PAGE_SIZE;
+    // Identity map low memory (kernel image and heap)
+    for (int t = 0; t < KERNEL_IDENTITY_TABLES; t++) {
+        for (int i = 0; i < 1024; i++) {
+            uint32_t physical_addr = (t * 1024 + i) * PAGE_SIZE;
+            
+            // Set up page entry
+            kernel_page_tables[t].pages[i].present = 1;
+            kernel_page_tables[t].pages[i].writable = 1;
+            kernel_page_tables[t].pages[i].user = 0;
+            kernel_page_tables[t].pages[i].frame = physical_addr >> 12;
+        }
         
-        // Set up page entry
-        kernel_page_tables[0].pages[i].present = 1;
-        kernel_page_tables[0].pages[i].writable = 1;
-        kernel_page_tables[0].pages[i].user = 0;
-        kernel_page_tables[0].pages[i].frame = physical_addr >> 12;
+        // Install page table in directory
+        kernel_page_directory.tables[t].present = 1;
+        kernel_page_directory.tables[t].writable = 1;
+        kernel_page_directory.tables[t].user = 0;
+        kernel_page_directory.tables[t].frame = (uint32_t)&kernel_page_tables[t] >> 12;
     }
     
-    // Install page table in directory
-    kernel_page_directory.tables[0].present = 1;
-    kernel_page_directory.tables[0].writable = 1;
-    kernel_page_directory.tables[0].user = 0;
-    kernel_page_directory.tables[0].frame = (uint32_t)&kernel_page_tables[0] >> 12;
+    paging_set_recursive(&kernel_page_directory);
+}
+
+// Get the kernel page directory
+page_directory_t* paging_get_kernel_directory(void) {
+    return &kernel_page_directory;
+}
+
+// Create a new page directory sharing the kernel mappings
+page_directory_t* paging_create_directory(void) {
+    page_directory_t* dir = (page_directory_t*)kmalloc_aligned(sizeof(page_directory_t), PAGE_SIZE);
+    if (!dir) {
+        return NULL;
+    }
+
+    memcpy(dir, &kernel_page_directory, sizeof(page_directory_t));
+    paging_set_recursive(dir);
+    return dir;
+}
+
+// Point a directory's last entry at the directory itself. Kernel only, so
+// user code never sees the tables.
+void paging_set_recursive(page_directory_t* dir) {
+    page_entry_t* pde = &dir->tables[PAGING_RECURSIVE_PDE];
+    memset(pde, 0, sizeof(page_entry_t));
+    pde->present = 1;
+    pde->writable = 1;
+    pde->frame = (uint32_t)dir >> 12;
+}
+
+// Paging is on and the CPU walks this directory
+int paging_is_loaded(page_directory_t* dir) {
+    uint32_t cr0, cr3;
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    if (!(cr0 & CR0_PG)) {
+        return 0;
+    }
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(cr3));
+    return (cr3 & ~(uint32_t)(PAGE_SIZE - 1)) == (uint32_t)dir;
+}
+
+static inline void paging_flush(uint32_t virtual_addr) {
+    __asm__ volatile ("invlpg (%0)" : : "r"(virtual_addr) : "memory");
+}
+
+// Get the page table entry for a virtual address, optionally creating its
+// table. In the loaded directory that is the recursive mapping's entry;
+// otherwise the walk goes through the identity-mapped table frames.
+page_entry_t* paging_get_pte(page_directory_t* dir, uint32_t virtual_addr, int create) {
+    uint32_t table_index = virtual_addr >> 22;
+    int loaded = paging_is_loaded(dir);
+    page_entry_t* pde = loaded ? paging_recursive_pde(virtual_addr) : &dir->tables[table_index];
+
+    if (!pde->present) {
+        if (!create) {
+            return NULL;
+        }
+
+        page_table_t* table;
+        if (dir == &kernel_page_directory && table_index < 256) {
+            table = &kernel_page_tables[table_index];
+        } else {
+            // Beyond the static tables (e.g. MMIO near 4GB), take one from the heap
+            table = (page_table_t*)kmalloc_aligned(sizeof(page_table_t), PAGE_SIZE);
+            if (!table) {
+                return NULL;
+            }
+        }
+        memset(table, 0, sizeof(page_table_t));
+
+        pde->present = 1;
+        pde->writable = 1;
+        pde->user = 1; // Access is restricted per page
+        pde->frame = (uint32_t)table >> 12;
+        if (loaded) {
+            paging_flush((uint32_t)paging_recursive_pte(virtual_addr));
+        }
+    }
+
+    if (loaded) {
+        return paging_recursive_pte(virtual_addr);
+    }
+    // Tables are identity mapped, so the frame address is usable directly
+    page_table_t* table = (page_table_t*)(pde->frame << 12);
+    return &table->pages[(virtual_addr >> 12) & 0x3FF];
+}
+
+// Map a virtual page to a physical frame
+int paging_map_page(page_directory_t* dir, uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
+    if (!dir || virtual_addr >= PAGING_PTE_BASE) {
+        return -1; // The top 4MB is the recursive mapping
+    }
+
+    page_entry_t* pte = paging_get_pte(dir, virtual_addr, 1);
+    if (!pte) {
+        return -1; // Out of memory for page tables
+    }
+
+    pte->present = (flags & PAGE_PRESENT) ? 1 : 0;
+    pte->writable = (flags & PAGE_WRITABLE) ? 1 : 0;
+    pte->user = (flags & PAGE_USER) ? 1 : 0;
+    pte->write_through = (flags & PAGE_WRITE_THROUGH) ? 1 : 0;
+    pte->cache_disable = (flags & PAGE_CACHE_DISABLE) ? 1 : 0;
+    pte->accessed = 0;
+    pte->dirty = 0;
+    pte->frame = physical_addr >> 12;
+
+    if (paging_is_loaded(dir)) {
+        paging_flush(virtual_addr);
+    }
+    return 0;
+}
+
+// Remove the mapping for a virtual page
+int paging_unmap_page(page_directory_t* dir, uint32_t virtual_addr) {
+    if (!dir || virtual_addr >= PAGING_PTE_BASE) {
+        return -1;
+    }
+
+    page_entry_t* pte = paging_get_pte(dir, virtual_addr, 0);
+    if (!pte) {
+        return -1; // Not mapped
+    }
+
+    memset(pte, 0, sizeof(page_entry_t));
+    if (paging_is_loaded(dir)) {
+        paging_flush(virtual_addr);
+    }
+    return 0;
+}
+
+// Translate a virtual address to its physical address (0 if unmapped)
+uint32_t paging_get_physical_addr(page_directory_t* dir, uint32_t virtual_addr) {
+    if (!dir) {
+        return 0;
+    }
+
+    page_entry_t* pte = paging_get_pte(dir, virtual_addr, 0);
+    if (!pte || !pte->present) {
+        return 0;
+    }
+
+    return (pte->frame << 12) | (virtual_addr & 0xFFF);
 }
 
 // Validate pointer
@@ -375,11 +627,11 @@ void mm_print_memory_map(void) {
     terminal_writestring("\n");
     
     terminal_writestring("Kernel Heap End: 0x");
-    terminal_write_hex(KERNEL_HEAP_END);
+    terminal_write_hex(KERNEL_HEAP_START + heap_size);
     terminal_writestring("\n");
     
     terminal_writestring("Heap Size: ");
-    terminal_write_hex(KERNEL_HEAP_SIZE);
+    terminal_write_hex(heap_size);
     terminal_writestring(" bytes\n");
 }
 
@@ -402,7 +654,8 @@ void mm_debug_heap(void) {
         terminal_writestring(", Size=");
         terminal_write_dec(current->size);
         terminal_writestring(", ");
-        terminal_writestring(current->is_free ? "FREE" : "USED");
+        terminal_writestring(current->is_free == MEM_BLOCK_FREE ? "FREE" :
+                             current->is_free == MEM_BLOCK_CACHED ? "CACHED" : "USED");
         terminal_writestring("\n");
         
         current = current->next;
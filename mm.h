@@ -3,26 +3,46 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "cache.h"
+#include "config.h"
 
 // Memory constants
 #define PAGE_SIZE 4096
-#define KERNEL_HEAP_START 0x00200000  // 2MB - start of kernel heap
-#define KERNEL_HEAP_SIZE  0x00100000  // 1MB - size of kernel heap
-#define KERNEL_HEAP_END   (KERNEL_HEAP_START + KERNEL_HEAP_SIZE)
+#define KERNEL_HEAP_START 0x00400000  // 4MB - start of kernel heap (above the kernel image's BSS)
+#define KERNEL_HEAP_SIZE  CONFIG_KERNEL_HEAP_SIZE  // Default for mm.heap_size (Kconfig)
+#define KERNEL_HEAP_MIN   0x00040000  // 256KB
+#define KERNEL_HEAP_MAX   0x00400000  // 4MB - up to the frame allocator's region at 8MB
+
+// Low memory identity-mapped at boot; covers the kernel image and the heap
+#define KERNEL_IDENTITY_TABLES 2      // 8MB
 
 // Memory allocation flags
 #define ALLOC_KERNEL  0x01
 #define ALLOC_USER    0x02
 #define ALLOC_ZERO    0x04
 
-// Memory block structure for free list allocator
+// Memory block structure for free list allocator. Block sizes are
+// multiples of the header size, so every header sits on a 16-byte
+// boundary: a first-fit walk reads one cache line per block, never two.
+#define MEM_BLOCK_ALIGN 16
+
+// Block states (is_free)
+#define MEM_BLOCK_USED      0
+#define MEM_BLOCK_FREE      1
+#define MEM_BLOCK_CACHED    2   // Allocated, parked in a kmem magazine (kmem.h)
+
 typedef struct mem_block {
     size_t size;
-    int is_free;
+    uint8_t is_free;
+    uint8_t memcg;      // Group the block is charged to (memcg.c)
+    uint16_t owner;     // Task that allocated it (0 = kernel)
     struct mem_block* next;
     struct mem_block* prev;
 } mem_block_t;
 
+STATIC_ASSERT(sizeof(mem_block_t) == MEM_BLOCK_ALIGN, "mem_block_t: header must stay 16 bytes");
+STATIC_ASSERT(CACHE_LINE_SIZE % MEM_BLOCK_ALIGN == 0, "mem_block_t: headers must not straddle lines");
+
 // Memory statistics structure
 typedef struct mem_stats {
     size_t total_memory;
@@ -38,10 +58,12 @@ typedef struct page_entry {
     uint32_t present    : 1;   // Page present in memory
     uint32_t writable   : 1;   // Page is writable
     uint32_t user       : 1;   // Page is accessible by user
-    uint32_t reserved1  : 2;   // Reserved bits
+    uint32_t write_through : 1; // Write-through caching
+    uint32_t cache_disable : 1; // Caching disabled (MMIO)
     uint32_t accessed   : 1;   // Page has been accessed
     uint32_t dirty      : 1;   // Page has been written to
-    uint32_t reserved2  : 2;   // Reserved bits
+    uint32_t page_size  : 1;   // Directory entry maps a 4MB page (needs CR4.PSE)
+    uint32_t global     : 1;   // Kept in the TLB across CR3 loads (needs CR4.PGE)
     uint32_t available  : 3;   // Available for OS use
     uint32_t frame      : 20;  // Frame address (shifted right 12 bits)
 } __attribute__((packed)) page_entry_t;
@@ -54,6 +76,30 @@ typedef struct page_directory {
     page_entry_t tables[1024];
 } page_directory_t;
 
+// Page mapping flags for paging_map_page
+#define PAGE_PRESENT        0x01
+#define PAGE_WRITABLE       0x02
+#define PAGE_USER           0x04
+#define PAGE_WRITE_THROUGH  0x08
+#define PAGE_CACHE_DISABLE  0x10
+
+// Recursive mapping: the last directory entry points at the directory
+// itself. With paging on, the loaded directory's page tables then appear
+// as one array of PTEs in the top 4MB, the directory in its last page, so
+// any PTE of the current address space is a computed address away, in
+// whichever table it lives. The top 4MB cannot be mapped otherwise.
+#define PAGING_RECURSIVE_PDE    1023
+#define PAGING_PTE_BASE         0xFFC00000
+#define PAGING_PDE_BASE         0xFFFFF000
+
+static inline page_entry_t* paging_recursive_pte(uint32_t virtual_addr) {
+    return (page_entry_t*)PAGING_PTE_BASE + (virtual_addr >> 12);
+}
+
+static inline page_entry_t* paging_recursive_pde(uint32_t virtual_addr) {
+    return (page_entry_t*)PAGING_PDE_BASE + (virtual_addr >> 22);
+}
+
 // Multiboot memory map structures
 typedef struct multiboot_mmap_entry {
     uint32_t size;
@@ -68,10 +114,16 @@ void* kmalloc(size_t size);
 void* kmalloc_aligned(size_t size, size_t alignment);
 void* kcalloc(size_t count, size_t size);
 void kfree(void* ptr);
+void kfree_aligned(void* ptr);
 void* krealloc(void* ptr, size_t new_size);
 
+// The heap under kmalloc and kfree, bypassing the magazines (kmem.c)
+void* kmalloc_heap(size_t size);
+void kfree_heap(void* ptr);
+
 // Memory statistics and debugging
 mem_stats_t mm_get_stats(void);
+size_t mm_free_memory(void);
 void mm_print_stats(void);
 void mm_print_memory_map(void);
 void mm_debug_heap(void);
@@ -79,9 +131,13 @@ void mm_debug_heap(void);
 // Paging functions (simulation)
 void paging_init(void);
 page_directory_t* paging_create_directory(void);
+page_directory_t* paging_get_kernel_directory(void);
 int paging_map_page(page_directory_t* dir, uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags);
 int paging_unmap_page(page_directory_t* dir, uint32_t virtual_addr);
 uint32_t paging_get_physical_addr(page_directory_t* dir, uint32_t virtual_addr);
+void paging_set_recursive(page_directory_t* dir);
+int paging_is_loaded(page_directory_t* dir);
+page_entry_t* paging_get_pte(page_directory_t* dir, uint32_t virtual_addr, int create);
 
 // Utility functions
 void* memset(void* dest, int value, size_t count);
@@ -0,0 +1,28 @@
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include <stdint.h>
+
+// What the bootloader hands kernel_main (boot.asm passes eax and ebx)
+#define MULTIBOOT_BOOTLOADER_MAGIC  0x2BADB002
+
+// multiboot_info_t.flags: which fields are valid
+#define MULTIBOOT_INFO_MEMORY       0x001
+#define MULTIBOOT_INFO_CMDLINE      0x004
+#define MULTIBOOT_INFO_MEM_MAP      0x040
+
+// Boot information (Multiboot 0.6.96), up to the memory map
+typedef struct multiboot_info {
+    uint32_t flags;
+    uint32_t mem_lower;         // KB below 1MB
+    uint32_t mem_upper;         // KB above 1MB
+    uint32_t boot_device;
+    uint32_t cmdline;           // Physical address of a NUL-terminated string
+    uint32_t mods_count;
+    uint32_t mods_addr;
+    uint32_t syms[4];
+    uint32_t mmap_length;
+    uint32_t mmap_addr;
+} __attribute__((packed)) multiboot_info_t;
+
+#endif // MULTIBOOT_H
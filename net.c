@@ -0,0 +1,586 @@
+#include <stddef.h>
+#include "net.h"
+#include "tcp.h"
+#include "ether.h"
+#include "mm.h"
+#include "klib.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+extern void terminal_putchar(char c);
+
+// Upper bound on packets handled per net_poll, so a feedback loop
+// (e.g. ACK storms on loopback) cannot livelock the caller
+#define NET_POLL_BUDGET 256
+
+typedef struct ipv4_header {
+    uint8_t version_ihl;
+    uint8_t tos;
+    uint16_t total_length;
+    uint16_t id;
+    uint16_t frag_offset;
+    uint8_t ttl;
+    uint8_t protocol;
+    uint16_t checksum;
+    uint32_t src;
+    uint32_t dst;
+} __attribute__((packed)) ipv4_header_t;
+
+#define IPV4_FLAG_MF      0x2000
+#define IPV4_FRAG_MASK    0x1FFF
+
+typedef struct udp_header {
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint16_t length;
+    uint16_t checksum;
+} __attribute__((packed)) udp_header_t;
+
+typedef struct udp_binding {
+    uint16_t port;
+    udp_handler_t handler;
+    void* ctx;
+} udp_binding_t;
+
+// Slab of packet buffers
+static netbuf_t netbufs[NETBUF_COUNT];
+static uint8_t netbuf_storage[NETBUF_COUNT][NETBUF_SIZE] __attribute__((aligned(64)));
+static netbuf_t* netbuf_free_list = NULL;
+static netbuf_stats_t netbuf_stats;
+
+static netif_t* netifs[NET_MAX_NETIFS];
+static int net_num_netifs = 0;
+static netif_t loopback_netif;
+
+// Received packets waiting for net_poll
+static netbuf_queue_t net_backlog;
+
+static udp_binding_t udp_bindings[UDP_MAX_BINDINGS];
+static uint16_t ipv4_next_id = 1;
+
+static inline uint32_t net_irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void net_irq_restore(uint32_t flags) {
+    __asm__ volatile ("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+// Packet buffers
+
+netbuf_t* netbuf_alloc(void) {
+    uint32_t flags = net_irq_save();
+    netbuf_t* nb = netbuf_free_list;
+    if (!nb) {
+        netbuf_stats.failures++;
+        net_irq_restore(flags);
+        return NULL;
+    }
+    netbuf_free_list = nb->next;
+    netbuf_stats.free--;
+    netbuf_stats.allocations++;
+    net_irq_restore(flags);
+
+    nb->next = NULL;
+    nb->data = nb->head + NETBUF_HEADROOM;
+    nb->len = 0;
+    nb->refcount = 1;
+    nb->netif = NULL;
+    nb->csum_verified = 0;
+    nb->src_ip = nb->dst_ip = 0;
+    nb->src_port = nb->dst_port = 0;
+    return nb;
+}
+
+void netbuf_get(netbuf_t* nb) {
+    uint32_t flags = net_irq_save();
+    nb->refcount++;
+    net_irq_restore(flags);
+}
+
+// Drop a reference; the buffer returns to the slab with the last one
+void netbuf_free(netbuf_t* nb) {
+    if (!nb) {
+        return;
+    }
+
+    uint32_t flags = net_irq_save();
+    if (--nb->refcount == 0) {
+        nb->next = netbuf_free_list;
+        netbuf_free_list = nb;
+        netbuf_stats.free++;
+    }
+    net_irq_restore(flags);
+}
+
+uint8_t* netbuf_push(netbuf_t* nb, uint32_t len) {
+    if ((uint32_t)(nb->data - nb->head) < len) {
+        return NULL;
+    }
+    nb->data -= len;
+    nb->len += len;
+    return nb->data;
+}
+
+uint8_t* netbuf_pull(netbuf_t* nb, uint32_t len) {
+    if (nb->len < len) {
+        return NULL;
+    }
+    nb->data += len;
+    nb->len -= len;
+    return nb->data;
+}
+
+uint8_t* netbuf_put(netbuf_t* nb, uint32_t len) {
+    if (netbuf_tailroom(nb) < len) {
+        return NULL;
+    }
+    uint8_t* tail = nb->data + nb->len;
+    nb->len += len;
+    return tail;
+}
+
+uint32_t netbuf_tailroom(netbuf_t* nb) {
+    return NETBUF_SIZE - (uint32_t)(nb->data - nb->head) - nb->len;
+}
+
+netbuf_stats_t netbuf_get_stats(void) {
+    return netbuf_stats;
+}
+
+void netbuf_queue_push(netbuf_queue_t* q, netbuf_t* nb) {
+    nb->next = NULL;
+    if (q->tail) {
+        q->tail->next = nb;
+    } else {
+        q->head = nb;
+    }
+    q->tail = nb;
+    q->count++;
+}
+
+netbuf_t* netbuf_queue_pop(netbuf_queue_t* q) {
+    netbuf_t* nb = q->head;
+    if (nb) {
+        q->head = nb->next;
+        if (!q->head) {
+            q->tail = NULL;
+        }
+        q->count--;
+        nb->next = NULL;
+    }
+    return nb;
+}
+
+void netbuf_queue_purge(netbuf_queue_t* q) {
+    netbuf_t* nb;
+    while ((nb = netbuf_queue_pop(q)) != NULL) {
+        netbuf_free(nb);
+    }
+}
+
+// Interfaces
+
+int netif_register(netif_t* netif) {
+    if (!netif || !netif->transmit || net_num_netifs >= NET_MAX_NETIFS) {
+        return -1;
+    }
+    netif->flags |= NETIF_F_UP;
+    netifs[net_num_netifs++] = netif;
+    return 0;
+}
+
+int netif_count(void) {
+    return net_num_netifs;
+}
+
+netif_t* netif_get(int index) {
+    if (index < 0 || index >= net_num_netifs) {
+        return NULL;
+    }
+    return netifs[index];
+}
+
+netif_t* netif_find(const char* name) {
+    for (int i = 0; i < net_num_netifs; i++) {
+        if (strcmp(netifs[i]->name, name) == 0) {
+            return netifs[i];
+        }
+    }
+    return NULL;
+}
+
+int net_is_local_ip(uint32_t ip) {
+    if ((ip >> 24) == 127) {
+        return 1;
+    }
+    for (int i = 0; i < net_num_netifs; i++) {
+        if (netifs[i]->ip && netifs[i]->ip == ip) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Pick the outgoing interface: local addresses loop back, then the
+// directly attached subnet, then the first interface with a gateway
+netif_t* net_route(uint32_t dst_ip, uint32_t* next_hop) {
+    *next_hop = dst_ip;
+    if (net_is_local_ip(dst_ip)) {
+        return &loopback_netif;
+    }
+
+    for (int i = 0; i < net_num_netifs; i++) {
+        netif_t* netif = netifs[i];
+        if ((netif->flags & (NETIF_F_UP | NETIF_F_LOOPBACK)) != NETIF_F_UP || !netif->ip) {
+            continue;
+        }
+        if (dst_ip == IP_BROADCAST || (dst_ip & netif->netmask) == (netif->ip & netif->netmask)) {
+            return netif;
+        }
+    }
+
+    for (int i = 0; i < net_num_netifs; i++) {
+        netif_t* netif = netifs[i];
+        if ((netif->flags & (NETIF_F_UP | NETIF_F_LOOPBACK)) == NETIF_F_UP && netif->gateway) {
+            *next_hop = netif->gateway;
+            return netif;
+        }
+    }
+    return NULL;
+}
+
+void net_rx(netif_t* netif, netbuf_t* nb) {
+    nb->netif = netif;
+    netif->rx_packets++;
+    netif->rx_bytes += nb->len;
+
+    uint32_t flags = net_irq_save();
+    netbuf_queue_push(&net_backlog, nb);
+    net_irq_restore(flags);
+}
+
+// The loopback device hands the very same buffer back to the receive path
+static int loopback_transmit(netif_t* netif, netbuf_t* nb, uint32_t next_hop) {
+    (void)next_hop;
+    netif->tx_packets++;
+    netif->tx_bytes += nb->len;
+    nb->csum_verified = 1;
+    net_rx(netif, nb);
+    return 0;
+}
+
+// Checksums
+
+static uint32_t inet_sum(const void* data, uint32_t len, uint32_t sum) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    while (len > 1) {
+        sum += ((uint32_t)bytes[0] << 8) | bytes[1];
+        bytes += 2;
+        len -= 2;
+    }
+    if (len) {
+        sum += (uint32_t)bytes[0] << 8;
+    }
+    return sum;
+}
+
+// Internet checksum in host order; `initial` carries a pseudo-header sum
+uint16_t inet_checksum(const void* data, uint32_t len, uint32_t initial) {
+    uint32_t sum = inet_sum(data, len, initial);
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+uint32_t inet_pseudo_checksum(uint32_t src, uint32_t dst, uint8_t proto, uint16_t len) {
+    return (src >> 16) + (src & 0xFFFF) + (dst >> 16) + (dst & 0xFFFF) + proto + len;
+}
+
+// IPv4
+
+int ipv4_output(netbuf_t* nb, uint32_t src_ip, uint32_t dst_ip, uint8_t proto) {
+    uint32_t next_hop;
+    netif_t* netif = net_route(dst_ip, &next_hop);
+    if (!netif || nb->len + sizeof(ipv4_header_t) > netif->mtu) {
+        netbuf_free(nb);
+        return -1;
+    }
+
+    ipv4_header_t* ip = (ipv4_header_t*)netbuf_push(nb, sizeof(ipv4_header_t));
+    if (!ip) {
+        netbuf_free(nb);
+        return -1;
+    }
+    ip->version_ihl = 0x45;
+    ip->tos = 0;
+    ip->total_length = htons(nb->len);
+    ip->id = htons(ipv4_next_id++);
+    ip->frag_offset = 0;
+    ip->ttl = IP_DEFAULT_TTL;
+    ip->protocol = proto;
+    ip->checksum = 0;
+    ip->src = htonl(src_ip ? src_ip : netif->ip);
+    ip->dst = htonl(dst_ip);
+    if (!(netif->flags & NETIF_F_NO_CSUM)) {
+        ip->checksum = htons(inet_checksum(ip, sizeof(ipv4_header_t), 0));
+    }
+
+    if (netif->transmit(netif, nb, next_hop) != 0) {
+        netif->drops++;
+        return -1;
+    }
+    return 0;
+}
+
+static void udp_rx(netbuf_t* nb);
+
+static void ipv4_rx(netbuf_t* nb) {
+    if (nb->len < sizeof(ipv4_header_t)) {
+        netbuf_free(nb);
+        return;
+    }
+
+    ipv4_header_t* ip = (ipv4_header_t*)nb->data;
+    uint32_t header_len = (ip->version_ihl & 0x0F) * 4;
+    uint32_t total_len = ntohs(ip->total_length);
+    if ((ip->version_ihl >> 4) != 4 || header_len < sizeof(ipv4_header_t) ||
+        total_len < header_len || total_len > nb->len) {
+        netbuf_free(nb);
+        return;
+    }
+    if (!nb->csum_verified && inet_checksum(ip, header_len, 0) != 0) {
+        netbuf_free(nb);
+        return;
+    }
+
+    // Fragments are not reassembled; senders here never produce them
+    if (ntohs(ip->frag_offset) & (IPV4_FLAG_MF | IPV4_FRAG_MASK)) {
+        netbuf_free(nb);
+        return;
+    }
+
+    nb->src_ip = ntohl(ip->src);
+    nb->dst_ip = ntohl(ip->dst);
+    if (!net_is_local_ip(nb->dst_ip) && nb->dst_ip != IP_BROADCAST) {
+        netbuf_free(nb);
+        return;
+    }
+
+    uint8_t proto = ip->protocol;
+    nb->len = total_len;            // Drop link-layer padding
+    netbuf_pull(nb, header_len);
+
+    switch (proto) {
+    case IP_PROTO_TCP:
+        tcp_rx(nb);
+        break;
+    case IP_PROTO_UDP:
+        udp_rx(nb);
+        break;
+    default:
+        netbuf_free(nb);
+        break;
+    }
+}
+
+// UDP
+
+int udp_bind(uint16_t port, udp_handler_t handler, void* ctx) {
+    int free_slot = -1;
+    for (int i = 0; i < UDP_MAX_BINDINGS; i++) {
+        if (udp_bindings[i].handler && udp_bindings[i].port == port) {
+            return -1;
+        }
+        if (!udp_bindings[i].handler && free_slot < 0) {
+            free_slot = i;
+        }
+    }
+    if (free_slot < 0) {
+        return -1;
+    }
+
+    udp_bindings[free_slot].port = port;
+    udp_bindings[free_slot].handler = handler;
+    udp_bindings[free_slot].ctx = ctx;
+    return 0;
+}
+
+void udp_unbind(uint16_t port) {
+    for (int i = 0; i < UDP_MAX_BINDINGS; i++) {
+        if (udp_bindings[i].handler && udp_bindings[i].port == port) {
+            udp_bindings[i].handler = NULL;
+        }
+    }
+}
+
+int udp_output(netbuf_t* nb, uint32_t src_ip, uint16_t src_port, uint32_t dst_ip, uint16_t dst_port) {
+    udp_header_t* udp = (udp_header_t*)netbuf_push(nb, sizeof(udp_header_t));
+    if (!udp) {
+        netbuf_free(nb);
+        return -1;
+    }
+    udp->src_port = htons(src_port);
+    udp->dst_port = htons(dst_port);
+    udp->length = htons(nb->len);
+    udp->checksum = 0;              // Optional over IPv4
+
+    return ipv4_output(nb, src_ip, dst_ip, IP_PROTO_UDP);
+}
+
+static void udp_rx(netbuf_t* nb) {
+    udp_header_t* udp = (udp_header_t*)nb->data;
+    if (nb->len < sizeof(udp_header_t) || ntohs(udp->length) < sizeof(udp_header_t) ||
+        ntohs(udp->length) > nb->len) {
+        netbuf_free(nb);
+        return;
+    }
+
+    if (!nb->csum_verified && udp->checksum != 0) {
+        uint32_t pseudo = inet_pseudo_checksum(nb->src_ip, nb->dst_ip, IP_PROTO_UDP, ntohs(udp->length));
+        if (inet_checksum(udp, ntohs(udp->length), pseudo) != 0) {
+            netbuf_free(nb);
+            return;
+        }
+    }
+
+    nb->src_port = ntohs(udp->src_port);
+    nb->dst_port = ntohs(udp->dst_port);
+    nb->len = ntohs(udp->length);
+    netbuf_pull(nb, sizeof(udp_header_t));
+
+    for (int i = 0; i < UDP_MAX_BINDINGS; i++) {
+        if (udp_bindings[i].handler && udp_bindings[i].port == nb->dst_port) {
+            udp_bindings[i].handler(udp_bindings[i].ctx, nb);
+            return;
+        }
+    }
+    netbuf_free(nb);
+}
+
+// Main loop hook: drain device rings and the backlog, then run timers
+void net_poll(void) {
+    for (int i = 0; i < net_num_netifs; i++) {
+        if (netifs[i]->poll) {
+            netifs[i]->poll(netifs[i]);
+        }
+    }
+
+    for (int budget = NET_POLL_BUDGET; budget > 0; budget--) {
+        uint32_t flags = net_irq_save();
+        netbuf_t* nb = netbuf_queue_pop(&net_backlog);
+        net_irq_restore(flags);
+        if (!nb) {
+            break;
+        }
+        ipv4_rx(nb);
+    }
+
+    tcp_timer();
+    net_flush();
+}
+
+// Devices batch transmitted frames; this rings each doorbell once
+void net_flush(void) {
+    for (int i = 0; i < net_num_netifs; i++) {
+        if (netifs[i]->flush) {
+            netifs[i]->flush(netifs[i]);
+        }
+    }
+}
+
+void net_init(void) {
+    netbuf_free_list = NULL;
+    for (int i = NETBUF_COUNT - 1; i >= 0; i--) {
+        netbufs[i].head = netbuf_storage[i];
+        netbufs[i].refcount = 0;
+        netbufs[i].next = netbuf_free_list;
+        netbuf_free_list = &netbufs[i];
+    }
+    netbuf_stats.total = NETBUF_COUNT;
+    netbuf_stats.free = NETBUF_COUNT;
+
+    memset(&loopback_netif, 0, sizeof(netif_t));
+    memcpy(loopback_netif.name, "lo", 3);
+    loopback_netif.flags = NETIF_F_LOOPBACK | NETIF_F_NO_CSUM;
+    loopback_netif.ip = IP_LOOPBACK;
+    loopback_netif.netmask = IP_ADDR(255, 0, 0, 0);
+    loopback_netif.mtu = 1500;
+    loopback_netif.transmit = loopback_transmit;
+    netif_register(&loopback_netif);
+}
+
+// Diagnostics
+
+// Dotted quad to host-order address; returns -1 on malformed input
+int net_parse_ip(const char* str, uint32_t* ip) {
+    uint32_t result = 0;
+    for (int part = 0; part < 4; part++) {
+        uint32_t value = 0;
+        int digits = 0;
+        while (*str >= '0' && *str <= '9' && digits < 4) {
+            value = value * 10 + (*str++ - '0');
+            digits++;
+        }
+        if (digits == 0 || value > 255 || *str != (part < 3 ? '.' : '\0')) {
+            return -1;
+        }
+        str++;
+        result = (result << 8) | value;
+    }
+    *ip = result;
+    return 0;
+}
+
+void net_print_ip(uint32_t ip) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        terminal_write_dec((ip >> shift) & 0xFF);
+        if (shift) {
+            terminal_putchar('.');
+        }
+    }
+}
+
+void net_print_interfaces(void) {
+    for (int i = 0; i < net_num_netifs; i++) {
+        netif_t* netif = netifs[i];
+        terminal_writestring(netif->name);
+        terminal_writestring(": ");
+        net_print_ip(netif->ip);
+        terminal_writestring(" netmask ");
+        net_print_ip(netif->netmask);
+        terminal_writestring(" mtu ");
+        terminal_write_dec(netif->mtu);
+        if (netif->flags & NETIF_F_ETHER) {
+            terminal_writestring(" ether ");
+            ether_print_mac(netif->mac);
+        }
+        terminal_writestring(netif->flags & NETIF_F_UP ? " up\n" : " down\n");
+        terminal_writestring("  rx ");
+        terminal_write_dec(netif->rx_packets);
+        terminal_writestring(" pkts / ");
+        terminal_write_dec(netif->rx_bytes);
+        terminal_writestring(" bytes, tx ");
+        terminal_write_dec(netif->tx_packets);
+        terminal_writestring(" pkts / ");
+        terminal_write_dec(netif->tx_bytes);
+        terminal_writestring(" bytes, ");
+        terminal_write_dec(netif->drops);
+        terminal_writestring(" drops\n");
+    }
+
+    netbuf_stats_t stats = netbuf_get_stats();
+    terminal_writestring("netbufs: ");
+    terminal_write_dec(stats.total - stats.free);
+    terminal_writestring(" / ");
+    terminal_write_dec(stats.total);
+    terminal_writestring(" in use, ");
+    terminal_write_dec(stats.allocations);
+    terminal_writestring(" allocations, ");
+    terminal_write_dec(stats.failures);
+    terminal_writestring(" failures\n");
+}
@@ -0,0 +1,156 @@
+#ifndef NET_H
+#define NET_H
+
+#include <stdint.h>
+
+// Packet buffers: a fixed slab of equal-sized buffers. Headers are pushed
+// into the headroom in place, so a payload is never copied between layers.
+#define NETBUF_COUNT     256    // Enough to keep NIC receive rings full
+#define NETBUF_SIZE      2048
+#define NETBUF_HEADROOM  64     // Ethernet + IPv4 + TCP headers fit in front
+
+// Interfaces
+#define NET_MAX_NETIFS   4
+#define NETIF_F_LOOPBACK 0x01
+#define NETIF_F_NO_CSUM  0x02   // Checksums are neither generated nor verified
+#define NETIF_F_UP       0x04
+#define NETIF_F_ETHER    0x08   // Frames go through ether.c (ARP, framing)
+
+// IPv4
+#define IP_PROTO_ICMP    1
+#define IP_PROTO_TCP     6
+#define IP_PROTO_UDP     17
+#define IP_DEFAULT_TTL   64
+#define IP_ADDR(a, b, c, d) (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+#define IP_LOOPBACK      IP_ADDR(127, 0, 0, 1)
+#define IP_BROADCAST     0xFFFFFFFF
+
+// UDP port bindings
+#define UDP_MAX_BINDINGS 16
+
+// Byte order (the wire is big-endian, x86 is little-endian)
+static inline uint16_t htons(uint16_t value) {
+    return (uint16_t)((value << 8) | (value >> 8));
+}
+
+static inline uint32_t htonl(uint32_t value) {
+    return ((value & 0xFF) << 24) | ((value & 0xFF00) << 8) |
+           ((value >> 8) & 0xFF00) | (value >> 24);
+}
+
+#define ntohs(x) htons(x)
+#define ntohl(x) htonl(x)
+
+struct netif;
+
+// One packet; data/len describe the valid bytes inside the slab buffer
+typedef struct netbuf {
+    struct netbuf* next;        // Queue link, owned by whoever holds the buffer
+    uint8_t* head;              // Start of the slab buffer
+    uint8_t* data;
+    uint32_t len;
+    uint32_t refcount;
+    struct netif* netif;        // Receiving interface
+    int csum_verified;          // Set by interfaces that guarantee integrity
+
+    // Receive metadata filled in by the protocol layers
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t src_port;
+    uint16_t dst_port;
+} netbuf_t;
+
+// A queue of buffers linked through netbuf_t.next
+typedef struct netbuf_queue {
+    netbuf_t* head;
+    netbuf_t* tail;
+    uint32_t count;
+} netbuf_queue_t;
+
+// Network interface
+typedef struct netif {
+    char name[8];
+    uint32_t flags;
+    uint32_t ip;
+    uint32_t netmask;
+    uint32_t gateway;
+    uint16_t mtu;
+    uint8_t mac[6];
+
+    // Hand a fully built IPv4 packet to the device; the interface owns the
+    // buffer afterwards. Returns -1 if it was dropped.
+    int (*transmit)(struct netif* netif, netbuf_t* nb, uint32_t next_hop);
+    void (*poll)(struct netif* netif);
+    void* driver_data;
+
+    // Ethernet devices: queue a finished frame (the device owns it from
+    // then on), and ring the doorbell for everything queued so far
+    int (*xmit_frame)(struct netif* netif, netbuf_t* nb);
+    void (*flush)(struct netif* netif);
+
+    uint32_t tx_packets;
+    uint32_t tx_bytes;
+    uint32_t rx_packets;
+    uint32_t rx_bytes;
+    uint32_t drops;
+} netif_t;
+
+// Receive callback for a bound UDP port
+typedef void (*udp_handler_t)(void* ctx, netbuf_t* nb);
+
+// Pool statistics
+typedef struct netbuf_stats {
+    uint32_t total;
+    uint32_t free;
+    uint32_t allocations;
+    uint32_t failures;
+} netbuf_stats_t;
+
+// Initialization (sets up the pool and the loopback interface)
+void net_init(void);
+
+// Packet buffers
+netbuf_t* netbuf_alloc(void);
+void netbuf_get(netbuf_t* nb);
+void netbuf_free(netbuf_t* nb);
+uint8_t* netbuf_push(netbuf_t* nb, uint32_t len);  // Prepend a header
+uint8_t* netbuf_pull(netbuf_t* nb, uint32_t len);  // Strip a header
+uint8_t* netbuf_put(netbuf_t* nb, uint32_t len);   // Append payload
+uint32_t netbuf_tailroom(netbuf_t* nb);
+netbuf_stats_t netbuf_get_stats(void);
+
+void netbuf_queue_push(netbuf_queue_t* q, netbuf_t* nb);
+netbuf_t* netbuf_queue_pop(netbuf_queue_t* q);
+void netbuf_queue_purge(netbuf_queue_t* q);
+
+// Interfaces
+int netif_register(netif_t* netif);
+int netif_count(void);
+netif_t* netif_get(int index);
+netif_t* netif_find(const char* name);
+netif_t* net_route(uint32_t dst_ip, uint32_t* next_hop);
+int net_is_local_ip(uint32_t ip);
+void net_rx(netif_t* netif, netbuf_t* nb);  // Queue a received IPv4 packet
+
+// Process queued packets and protocol timers
+void net_poll(void);
+
+// Push frames queued on devices to the hardware
+void net_flush(void);
+
+// IPv4
+uint16_t inet_checksum(const void* data, uint32_t len, uint32_t initial);
+uint32_t inet_pseudo_checksum(uint32_t src, uint32_t dst, uint8_t proto, uint16_t len);
+int ipv4_output(netbuf_t* nb, uint32_t src_ip, uint32_t dst_ip, uint8_t proto);
+
+// UDP
+int udp_bind(uint16_t port, udp_handler_t handler, void* ctx);
+void udp_unbind(uint16_t port);
+int udp_output(netbuf_t* nb, uint32_t src_ip, uint16_t src_port, uint32_t dst_ip, uint16_t dst_port);
+
+// Diagnostics
+int net_parse_ip(const char* str, uint32_t* ip);
+void net_print_ip(uint32_t ip);
+void net_print_interfaces(void);
+
+#endif // NET_H
@@ -0,0 +1,516 @@
+#include <stddef.h>
+#include "pagecache.h"
+#include "pmm.h"
+#include "mm.h"
+#include "reclaim.h"
+#include "ktime.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+
+static page_cache_t* pcache_list = NULL;
+static uint32_t pcache_total_pages = 0;
+static uint32_t pcache_total_dirty = 0;
+
+// Cached pages of every file, most recently added at the head. Reclaim
+// takes clean pages from the tail, giving pages hit since the last pass
+// another round.
+static page_frame_t* pcache_lru_head = NULL;
+static page_frame_t* pcache_lru_tail = NULL;
+
+static uint32_t pcache_shrink_count(void);
+static uint32_t pcache_shrink_scan(uint32_t nr_to_scan);
+
+static shrinker_t pcache_shrinker = {
+    .name = "page-cache",
+    .pool = RECLAIM_FRAMES,
+    .count = pcache_shrink_count,
+    .scan = pcache_shrink_scan,
+};
+static int pcache_shrinker_registered = 0;
+
+// LRU list
+
+static void pcache_lru_push(page_frame_t* frame) {
+    frame->lru_prev = NULL;
+    frame->lru_next = pcache_lru_head;
+    if (pcache_lru_head) {
+        pcache_lru_head->lru_prev = frame;
+    } else {
+        pcache_lru_tail = frame;
+    }
+    pcache_lru_head = frame;
+}
+
+static void pcache_lru_unlink(page_frame_t* frame) {
+    if (frame->lru_prev) {
+        frame->lru_prev->lru_next = frame->lru_next;
+    } else {
+        pcache_lru_head = frame->lru_next;
+    }
+    if (frame->lru_next) {
+        frame->lru_next->lru_prev = frame->lru_prev;
+    } else {
+        pcache_lru_tail = frame->lru_prev;
+    }
+    frame->lru_prev = NULL;
+    frame->lru_next = NULL;
+}
+
+// Cache management
+
+void pcache_init(page_cache_t* pc, const char* name, const page_cache_ops_t* ops,
+                 void* private_data, uint32_t size_pages) {
+    memset(pc, 0, sizeof(page_cache_t));
+    pc->name = name;
+    pc->ops = ops;
+    pc->private_data = private_data;
+    pc->size_pages = size_pages;
+    radix_init(&pc->pages);
+
+    pc->next = pcache_list;
+    pcache_list = pc;
+
+    if (!pcache_shrinker_registered) {
+        register_shrinker(&pcache_shrinker);
+        pcache_shrinker_registered = 1;
+    }
+}
+
+static inline page_frame_t* pcache_lookup(page_cache_t* pc, uint32_t index) {
+    return (page_frame_t*)radix_lookup(&pc->pages, index);
+}
+
+// Remove a page from its cache and free the frame
+static void pcache_remove(page_cache_t* pc, page_frame_t* frame) {
+    if (radix_tag_get(&pc->pages, frame->index, PCACHE_TAG_DIRTY)) {
+        pc->nrdirty--;
+        pcache_total_dirty--;
+    }
+    radix_delete(&pc->pages, frame->index);
+    pcache_lru_unlink(frame);
+    pc->nrpages--;
+    pcache_total_pages--;
+    pmm_free_frame(pmm_frame_phys(frame));
+}
+
+// Read a missing page into a new frame and insert it; NULL on failure
+static page_frame_t* pcache_add(page_cache_t* pc, uint32_t index) {
+    uint32_t phys = pmm_alloc_frame();
+    if (!phys) {
+        return NULL;
+    }
+
+    // Pages past the end of the backing store start out zeroed
+    int result = 0;
+    if (index < pc->size_pages && pc->ops && pc->ops->readpage) {
+        result = pc->ops->readpage(pc, index, (void*)phys);
+    } else {
+        memset((void*)phys, 0, PAGE_SIZE);
+    }
+    if (result != 0 || radix_insert(&pc->pages, index, pmm_frame(phys)) != 0) {
+        if (result != 0) {
+            pc->errors++;
+        }
+        pmm_free_frame(phys);
+        return NULL;
+    }
+
+    page_frame_t* frame = pmm_frame(phys);
+    frame->flags |= PMM_FRAME_CACHE;
+    frame->cache = pc;
+    frame->index = index;
+    pcache_lru_push(frame);
+    pc->nrpages++;
+    pcache_total_pages++;
+    return frame;
+}
+
+// Read the pages after a miss that are not cached yet
+static void pcache_readahead(page_cache_t* pc, uint32_t index) {
+    for (uint32_t i = 1; i <= PCACHE_READAHEAD; i++) {
+        uint32_t next = index + i;
+        if (next >= pc->size_pages || next < index) {
+            break;
+        }
+        if (pcache_lookup(pc, next)) {
+            continue;
+        }
+        if (!pcache_add(pc, next)) {
+            break;
+        }
+        pc->readahead++;
+    }
+}
+
+uint32_t pcache_get_page(page_cache_t* pc, uint32_t index) {
+    page_frame_t* frame = pcache_lookup(pc, index);
+    if (frame) {
+        frame->flags |= PMM_FRAME_REFERENCED;
+        pc->hits++;
+        return pmm_frame_phys(frame);
+    }
+
+    pc->misses++;
+    frame = pcache_add(pc, index);
+    return frame ? pmm_frame_phys(frame) : 0;
+}
+
+void pcache_set_dirty(page_cache_t* pc, uint32_t index) {
+    if (pcache_lookup(pc, index) && !radix_tag_get(&pc->pages, index, PCACHE_TAG_DIRTY)) {
+        radix_tag_set(&pc->pages, index, PCACHE_TAG_DIRTY);
+        pc->nrdirty++;
+        pcache_total_dirty++;
+    }
+}
+
+int pcache_read(page_cache_t* pc, uint32_t offset, void* buffer, uint32_t len) {
+    uint8_t* dst = (uint8_t*)buffer;
+    while (len > 0) {
+        uint32_t index = offset / PAGE_SIZE;
+        uint32_t in_page = offset % PAGE_SIZE;
+        uint32_t chunk = PAGE_SIZE - in_page;
+        if (chunk > len) {
+            chunk = len;
+        }
+
+        int missed = pcache_lookup(pc, index) == NULL;
+        uint32_t phys = pcache_get_page(pc, index);
+        if (!phys) {
+            return -1;
+        }
+        memcpy(dst, (uint8_t*)phys + in_page, chunk);
+
+        // After the copy: reading ahead may reclaim the page just used
+        if (missed) {
+            pcache_readahead(pc, index);
+        }
+
+        dst += chunk;
+        offset += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+int pcache_write(page_cache_t* pc, uint32_t offset, const void* buffer, uint32_t len) {
+    const uint8_t* src = (const uint8_t*)buffer;
+    while (len > 0) {
+        uint32_t index = offset / PAGE_SIZE;
+        uint32_t in_page = offset % PAGE_SIZE;
+        uint32_t chunk = PAGE_SIZE - in_page;
+        if (chunk > len) {
+            chunk = len;
+        }
+
+        uint32_t phys = pcache_get_page(pc, index);
+        if (!phys) {
+            return -1;
+        }
+        memcpy((uint8_t*)phys + in_page, src, chunk);
+        pcache_set_dirty(pc, index);
+        if (index >= pc->size_pages) {
+            pc->size_pages = index + 1;
+        }
+
+        src += chunk;
+        offset += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+uint32_t pcache_find_dirty(page_cache_t* pc, uint32_t first, uint32_t* indices, uint32_t max) {
+    void* pages[PCACHE_BATCH];
+    uint32_t found = 0;
+    while (found < max) {
+        uint32_t want = max - found < PCACHE_BATCH ? max - found : PCACHE_BATCH;
+        uint32_t n = radix_gang_lookup_tag(&pc->pages, pages, indices + found, first, want,
+                                           PCACHE_TAG_DIRTY);
+        found += n;
+        if (n < want || indices[found - 1] == 0xFFFFFFFF) {
+            break;
+        }
+        first = indices[found - 1] + 1;
+    }
+    return found;
+}
+
+// Writeback
+
+// Write one page: dirty moves to writeback before the I/O, so a write that
+// lands meanwhile dirties the page again instead of being lost
+static int pcache_writepage(page_cache_t* pc, page_frame_t* frame) {
+    radix_tag_set(&pc->pages, frame->index, PCACHE_TAG_WRITEBACK);
+    radix_tag_clear(&pc->pages, frame->index, PCACHE_TAG_DIRTY);
+    pc->nrdirty--;
+    pcache_total_dirty--;
+
+    int result = pc->ops->writepage(pc, frame->index, (const void*)pmm_frame_phys(frame));
+    radix_tag_clear(&pc->pages, frame->index, PCACHE_TAG_WRITEBACK);
+    if (result != 0) {
+        pc->errors++;
+        pcache_set_dirty(pc, frame->index);
+        return -1;
+    }
+    pc->written++;
+    return 0;
+}
+
+int pcache_writeback_range(page_cache_t* pc, uint32_t first, uint32_t last) {
+    if (!pc->ops || !pc->ops->writepage) {
+        return -1;
+    }
+
+    // Only dirty-tagged subtrees are visited, so the cost follows the
+    // number of dirty pages rather than the size of the range
+    void* pages[PCACHE_BATCH];
+    uint32_t indices[PCACHE_BATCH];
+    int written = 0;
+    int failed = 0;
+    while (first <= last) {
+        uint32_t n = radix_gang_lookup_tag(&pc->pages, pages, indices, first, PCACHE_BATCH,
+                                           PCACHE_TAG_DIRTY);
+        if (n == 0) {
+            break;
+        }
+        for (uint32_t i = 0; i < n && indices[i] <= last; i++) {
+            if (pcache_writepage(pc, (page_frame_t*)pages[i]) == 0) {
+                written++;
+            } else {
+                failed = 1;
+            }
+        }
+        if (n < PCACHE_BATCH || indices[n - 1] >= last) {
+            break;
+        }
+        first = indices[n - 1] + 1;
+    }
+    return failed ? -1 : written;
+}
+
+uint32_t pcache_truncate(page_cache_t* pc, uint32_t first) {
+    void* pages[PCACHE_BATCH];
+    uint32_t dropped = 0;
+    uint32_t n;
+    while ((n = radix_gang_lookup(&pc->pages, pages, NULL, first, PCACHE_BATCH)) > 0) {
+        for (uint32_t i = 0; i < n; i++) {
+            pcache_remove(pc, (page_frame_t*)pages[i]);
+        }
+        dropped += n;
+    }
+    if (pc->size_pages > first) {
+        pc->size_pages = first;
+    }
+    return dropped;
+}
+
+void pcache_destroy(page_cache_t* pc) {
+    if (pc->nrdirty > 0) {
+        pcache_writeback_range(pc, 0, 0xFFFFFFFF);
+    }
+
+    // Dirty pages that failed to write are lost with the cache
+    uint32_t size = pc->size_pages;
+    pcache_truncate(pc, 0);
+    pc->size_pages = size;
+
+    page_cache_t** link = &pcache_list;
+    while (*link && *link != pc) {
+        link = &(*link)->next;
+    }
+    if (*link) {
+        *link = pc->next;
+    }
+    pc->next = NULL;
+}
+
+// Reclaim
+
+static uint32_t pcache_shrink_count(void) {
+    return pcache_total_pages - pcache_total_dirty;
+}
+
+static uint32_t pcache_shrink_scan(uint32_t nr_to_scan) {
+    uint32_t freed = 0;
+    uint32_t budget = pcache_total_pages;
+
+    while (freed < nr_to_scan && budget-- > 0 && pcache_lru_tail) {
+        page_frame_t* frame = pcache_lru_tail;
+        page_cache_t* pc = frame->cache;
+
+        // Recently hit pages and pages with writeback in flight go around again
+        if ((frame->flags & PMM_FRAME_REFERENCED) ||
+            radix_tag_get(&pc->pages, frame->index, PCACHE_TAG_WRITEBACK)) {
+            frame->flags &= ~PMM_FRAME_REFERENCED;
+            pcache_lru_unlink(frame);
+            pcache_lru_push(frame);
+            continue;
+        }
+
+        // Dirty pages that reach the tail are written back first
+        if (radix_tag_get(&pc->pages, frame->index, PCACHE_TAG_DIRTY) &&
+            (!pc->ops || !pc->ops->writepage || pcache_writepage(pc, frame) != 0)) {
+            pcache_lru_unlink(frame);
+            pcache_lru_push(frame);
+            continue;
+        }
+
+        pcache_remove(pc, frame);
+        pc->evicted++;
+        freed++;
+    }
+    return freed;
+}
+
+// Block device backing store
+
+static int pcache_bdev_readpage(page_cache_t* pc, uint32_t index, void* buffer) {
+    return blkdev_read((blkdev_t*)pc->private_data, index * (PAGE_SIZE / BLKDEV_SECTOR_SIZE),
+                       PAGE_SIZE / BLKDEV_SECTOR_SIZE, buffer);
+}
+
+static int pcache_bdev_writepage(page_cache_t* pc, uint32_t index, const void* buffer) {
+    return blkdev_write((blkdev_t*)pc->private_data, index * (PAGE_SIZE / BLKDEV_SECTOR_SIZE),
+                        PAGE_SIZE / BLKDEV_SECTOR_SIZE, buffer);
+}
+
+static const page_cache_ops_t pcache_bdev_ops = {
+    .readpage = pcache_bdev_readpage,
+    .writepage = pcache_bdev_writepage,
+};
+
+void pcache_bdev_init(page_cache_t* pc, blkdev_t* dev) {
+    pcache_init(pc, dev->name, &pcache_bdev_ops, dev,
+                dev->sector_count / (PAGE_SIZE / BLKDEV_SECTOR_SIZE));
+}
+
+void pcache_print_stats(void) {
+    terminal_writestring("=== Page Cache ===\n");
+    terminal_writestring("Pages: ");
+    terminal_write_dec(pcache_total_pages);
+    terminal_writestring(" (");
+    terminal_write_dec(pcache_total_dirty);
+    terminal_writestring(" dirty)\n");
+
+    if (!pcache_list) {
+        terminal_writestring("No files cached\n");
+        return;
+    }
+    for (page_cache_t* pc = pcache_list; pc; pc = pc->next) {
+        terminal_writestring(pc->name);
+        terminal_writestring(": ");
+        terminal_write_dec(pc->nrpages);
+        terminal_writestring(" pages, ");
+        terminal_write_dec(pc->nrdirty);
+        terminal_writestring(" dirty, ");
+        terminal_write_dec(pc->pages.nodes);
+        terminal_writestring(" nodes; ");
+        terminal_write_dec(pc->hits);
+        terminal_writestring(" hits, ");
+        terminal_write_dec(pc->misses);
+        terminal_writestring(" misses, ");
+        terminal_write_dec(pc->readahead);
+        terminal_writestring(" read ahead, ");
+        terminal_write_dec(pc->written);
+        terminal_writestring(" written, ");
+        terminal_write_dec(pc->evicted);
+        terminal_writestring(" evicted, errors: ");
+        terminal_write_dec(pc->errors);
+        terminal_writestring("\n");
+    }
+}
+
+// Benchmark
+
+static uint8_t pcache_bench_buf[PAGE_SIZE];
+
+void pcache_benchmark(blkdev_t* dev, uint32_t pages) {
+    page_cache_t pc;
+    pcache_bdev_init(&pc, dev);
+
+    if (pages > pc.size_pages) {
+        pages = pc.size_pages;
+    }
+    if (pages > pmm_free_frames() / 2) {
+        pages = pmm_free_frames() / 2;
+    }
+    if (pages < 8) {
+        terminal_writestring("Device or free memory too small\n");
+        pcache_destroy(&pc);
+        return;
+    }
+
+    // Sequential reads: cold ones miss and read ahead, warm ones all hit
+    uint32_t start = (uint32_t)ktime_get_us();
+    int ok = 1;
+    for (uint32_t p = 0; ok && p < pages; p++) {
+        ok = pcache_read(&pc, p * PAGE_SIZE, pcache_bench_buf, PAGE_SIZE) == 0;
+    }
+    uint32_t cold_us = (uint32_t)ktime_get_us() - start;
+    uint32_t cold_misses = pc.misses;
+
+    start = (uint32_t)ktime_get_us();
+    for (uint32_t p = 0; ok && p < pages; p++) {
+        ok = pcache_read(&pc, p * PAGE_SIZE, pcache_bench_buf, PAGE_SIZE) == 0;
+    }
+    uint32_t warm_us = (uint32_t)ktime_get_us() - start;
+
+    // Dirty every eighth page by rewriting its first bytes unchanged, so
+    // the device contents stay as they were
+    uint32_t dirtied = 0;
+    for (uint32_t p = 0; ok && p < pages; p += 8) {
+        ok = pcache_read(&pc, p * PAGE_SIZE, pcache_bench_buf, 64) == 0 &&
+             pcache_write(&pc, p * PAGE_SIZE, pcache_bench_buf, 64) == 0;
+        dirtied++;
+    }
+
+    // Flush the middle half, then the rest
+    uint32_t first = pages / 4;
+    uint32_t last = first + pages / 2 - 1;
+    start = (uint32_t)ktime_get_us();
+    int range_written = pcache_writeback_range(&pc, first, last);
+    uint32_t range_us = (uint32_t)ktime_get_us() - start;
+    uint32_t left = pc.nrdirty;
+    int rest_written = pcache_writeback_range(&pc, 0, 0xFFFFFFFF);
+
+    uint32_t nodes = pc.pages.nodes;
+    uint32_t cached = pc.nrpages;
+    uint32_t dropped = pcache_truncate(&pc, pages / 2);
+
+    terminal_writestring("Cold read of ");
+    terminal_write_dec(pages);
+    terminal_writestring(" pages: ");
+    terminal_write_dec(cold_us / 1000);
+    terminal_writestring(" ms (");
+    terminal_write_dec(cold_misses);
+    terminal_writestring(" misses, ");
+    terminal_write_dec(pc.readahead);
+    terminal_writestring(" read ahead)\n");
+    terminal_writestring("Warm read: ");
+    terminal_write_dec(warm_us);
+    terminal_writestring(" us, ");
+    terminal_write_dec(cached);
+    terminal_writestring(" pages in ");
+    terminal_write_dec(nodes);
+    terminal_writestring(" radix nodes\n");
+    terminal_writestring("Dirtied ");
+    terminal_write_dec(dirtied);
+    terminal_writestring(" pages; range writeback wrote ");
+    terminal_write_dec(range_written < 0 ? 0 : (uint32_t)range_written);
+    terminal_writestring(" in ");
+    terminal_write_dec(range_us);
+    terminal_writestring(" us, left ");
+    terminal_write_dec(left);
+    terminal_writestring(" dirty, full flush wrote ");
+    terminal_write_dec(rest_written < 0 ? 0 : (uint32_t)rest_written);
+    terminal_writestring("\n");
+    terminal_writestring("Truncate to half dropped ");
+    terminal_write_dec(dropped);
+    terminal_writestring(" pages\n");
+
+    ok = ok && range_written >= 0 && rest_written >= 0 && pc.nrdirty == 0;
+    terminal_writestring(ok ? "Result: OK\n" : "Result: FAILED\n");
+    pcache_destroy(&pc);
+}
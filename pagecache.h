@@ -0,0 +1,76 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <stdint.h>
+#include "radix.h"
+#include "blkdev.h"
+
+// Radix tree tags on cached pages
+#define PCACHE_TAG_DIRTY        0   // Modified since it was last written
+#define PCACHE_TAG_WRITEBACK    1   // Being written to the backing store
+
+// Pages fetched per gang lookup, and read ahead after a miss
+#define PCACHE_BATCH            16
+#define PCACHE_READAHEAD        8
+
+struct page_cache;
+
+// Backing store of one file: synchronous page-sized transfers
+typedef struct page_cache_ops {
+    int (*readpage)(struct page_cache* pc, uint32_t index, void* buffer);
+    int (*writepage)(struct page_cache* pc, uint32_t index, const void* buffer);
+} page_cache_ops_t;
+
+// The cached pages of one file, indexed by page offset
+typedef struct page_cache {
+    const char* name;
+    radix_root_t pages;         // page_frame_t* per cached page
+    const page_cache_ops_t* ops;
+    void* private_data;
+    uint32_t size_pages;        // Length of the backing store
+    uint32_t nrpages;
+    uint32_t nrdirty;
+
+    // Statistics
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t readahead;         // Pages read without a miss of their own
+    uint32_t written;           // Pages written back
+    uint32_t evicted;           // Clean pages dropped by reclaim
+    uint32_t errors;
+
+    struct page_cache* next;    // All caches
+} page_cache_t;
+
+void pcache_init(page_cache_t* pc, const char* name, const page_cache_ops_t* ops,
+                 void* private_data, uint32_t size_pages);
+
+// Write back every dirty page, then drop them all
+void pcache_destroy(page_cache_t* pc);
+
+// Cached page at index, read in on a miss; returns its frame address or 0
+uint32_t pcache_get_page(page_cache_t* pc, uint32_t index);
+
+// Byte-granular access through the cache; writes leave pages dirty
+int pcache_read(page_cache_t* pc, uint32_t offset, void* buffer, uint32_t len);
+int pcache_write(page_cache_t* pc, uint32_t offset, const void* buffer, uint32_t len);
+void pcache_set_dirty(page_cache_t* pc, uint32_t index);
+
+// Indices of up to max dirty pages at or after first
+uint32_t pcache_find_dirty(page_cache_t* pc, uint32_t first, uint32_t* indices, uint32_t max);
+
+// Write dirty pages in [first, last]; returns pages written or -1 on an error
+int pcache_writeback_range(page_cache_t* pc, uint32_t first, uint32_t last);
+
+// Drop cached pages from first onwards, dirty ones included; returns pages dropped
+uint32_t pcache_truncate(page_cache_t* pc, uint32_t first);
+
+// Cache the contents of a whole block device (page n = sectors 8n..8n+7)
+void pcache_bdev_init(page_cache_t* pc, blkdev_t* dev);
+
+void pcache_print_stats(void);
+
+// Cold and warm reads, then sparse dirtying and range writeback, on a device
+void pcache_benchmark(blkdev_t* dev, uint32_t pages);
+
+#endif // PAGECACHE_H
@@ -0,0 +1,462 @@
+#include <stddef.h>
+#include "pci.h"
+#include "isr.h"
+#include "idt.h"
+#include "mm.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_putchar(char c);
+extern void terminal_write_hex(uint32_t value);
+extern void terminal_write_dec(uint32_t value);
+extern void terminal_setcolor(uint8_t color);
+extern uint8_t vga_entry_color(int fg, int bg);
+
+// VGA colors
+#define VGA_COLOR_BLACK 0
+#define VGA_COLOR_WHITE 15
+#define VGA_COLOR_LIGHT_CYAN 11
+
+// I/O port functions
+static inline void outl(uint16_t port, uint32_t val) {
+    __asm__ volatile ("outl %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t ret;
+    __asm__ volatile ("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// Interrupt routing entry (several devices may share one PIC line)
+typedef struct pci_irq_route {
+    pci_device_t* dev;
+    pci_irq_handler_t handler;
+} pci_irq_route_t;
+
+// Discovered devices and registered drivers
+static pci_device_t pci_devices[PCI_MAX_DEVICES];
+static int pci_num_devices = 0;
+static pci_driver_t* pci_drivers[PCI_MAX_DRIVERS];
+static int pci_num_drivers = 0;
+static pci_irq_route_t pci_irq_routes[PCI_MAX_IRQ_HANDLERS];
+static int pci_num_irq_routes = 0;
+
+static void pci_scan_bus(uint8_t bus);
+
+// Raw configuration space access by bus/slot/function
+static uint32_t pci_read_raw(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset) {
+    uint32_t address = 0x80000000 | ((uint32_t)bus << 16) | ((uint32_t)slot << 11) |
+                       ((uint32_t)func << 8) | (offset & 0xFC);
+    outl(PCI_CONFIG_ADDRESS, address);
+    return inl(PCI_CONFIG_DATA);
+}
+
+static void pci_write_raw(uint8_t bus, uint8_t slot, uint8_t func, uint8_t offset, uint32_t value) {
+    uint32_t address = 0x80000000 | ((uint32_t)bus << 16) | ((uint32_t)slot << 11) |
+                       ((uint32_t)func << 8) | (offset & 0xFC);
+    outl(PCI_CONFIG_ADDRESS, address);
+    outl(PCI_CONFIG_DATA, value);
+}
+
+uint32_t pci_config_read32(pci_device_t* dev, uint8_t offset) {
+    return pci_read_raw(dev->bus, dev->slot, dev->func, offset);
+}
+
+uint16_t pci_config_read16(pci_device_t* dev, uint8_t offset) {
+    return (pci_config_read32(dev, offset) >> ((offset & 2) * 8)) & 0xFFFF;
+}
+
+uint8_t pci_config_read8(pci_device_t* dev, uint8_t offset) {
+    return (pci_config_read32(dev, offset) >> ((offset & 3) * 8)) & 0xFF;
+}
+
+void pci_config_write32(pci_device_t* dev, uint8_t offset, uint32_t value) {
+    pci_write_raw(dev->bus, dev->slot, dev->func, offset, value);
+}
+
+void pci_config_write16(pci_device_t* dev, uint8_t offset, uint16_t value) {
+    uint32_t shift = (offset & 2) * 8;
+    uint32_t old = pci_config_read32(dev, offset);
+    old &= ~(0xFFFFu << shift);
+    pci_config_write32(dev, offset, old | ((uint32_t)value << shift));
+}
+
+void pci_config_write8(pci_device_t* dev, uint8_t offset, uint8_t value) {
+    uint32_t shift = (offset & 3) * 8;
+    uint32_t old = pci_config_read32(dev, offset);
+    old &= ~(0xFFu << shift);
+    pci_config_write32(dev, offset, old | ((uint32_t)value << shift));
+}
+
+// Walk the capability list; returns the offset or 0 if absent
+uint8_t pci_find_capability(pci_device_t* dev, uint8_t cap_id) {
+    if (!(pci_config_read16(dev, PCI_STATUS) & 0x10)) {
+        return 0; // No capability list
+    }
+
+    uint8_t offset = pci_config_read8(dev, PCI_CAPABILITY_LIST) & 0xFC;
+    for (int guard = 0; offset && guard < 48; guard++) {
+        if (pci_config_read8(dev, offset) == cap_id) {
+            return offset;
+        }
+        offset = pci_config_read8(dev, offset + 1) & 0xFC;
+    }
+
+    return 0;
+}
+
+// Decode the size of every BAR by writing all ones and reading back
+static void pci_probe_bars(pci_device_t* dev) {
+    int num_bars = (dev->header_type & 0x7F) == 0 ? PCI_NUM_BARS : 2;
+    uint16_t command = pci_config_read16(dev, PCI_COMMAND);
+
+    // Stop decoding while the BARs hold the sizing pattern
+    pci_config_write16(dev, PCI_COMMAND, command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+
+    for (int i = 0; i < num_bars; i++) {
+        uint8_t offset = PCI_BAR0 + i * 4;
+        uint32_t value = pci_config_read32(dev, offset);
+
+        pci_config_write32(dev, offset, 0xFFFFFFFF);
+        uint32_t mask = pci_config_read32(dev, offset);
+        pci_config_write32(dev, offset, value);
+
+        pci_bar_t* bar = &dev->bars[i];
+        if (value & PCI_BAR_IO) {
+            bar->is_io = 1;
+            bar->base = value & 0xFFFFFFFC;
+            mask &= 0xFFFFFFFC;
+            bar->size = mask ? (~(mask | 0xFFFF0000) + 1) & 0xFFFF : 0;
+        } else {
+            bar->is_io = 0;
+            bar->prefetchable = (value & PCI_BAR_PREFETCH) ? 1 : 0;
+            bar->base = value & 0xFFFFFFF0;
+            mask &= 0xFFFFFFF0;
+            bar->size = mask ? ~mask + 1 : 0;
+
+            // The upper half of a 64-bit BAR is not a BAR of its own
+            if (value & PCI_BAR_TYPE_64) {
+                i++;
+            }
+        }
+    }
+
+    pci_config_write16(dev, PCI_COMMAND, command);
+}
+
+// Record one function and descend into bridges
+static void pci_scan_function(uint8_t bus, uint8_t slot, uint8_t func) {
+    uint32_t id = pci_read_raw(bus, slot, func, PCI_VENDOR_ID);
+    if ((id & 0xFFFF) == 0xFFFF) {
+        return;
+    }
+
+    uint32_t class_reg = pci_read_raw(bus, slot, func, PCI_REVISION_ID);
+    uint8_t class_code = class_reg >> 24;
+    uint8_t subclass = (class_reg >> 16) & 0xFF;
+
+    if (pci_num_devices < PCI_MAX_DEVICES) {
+        pci_device_t* dev = &pci_devices[pci_num_devices++];
+        memset(dev, 0, sizeof(pci_device_t));
+
+        dev->bus = bus;
+        dev->slot = slot;
+        dev->func = func;
+        dev->vendor_id = id & 0xFFFF;
+        dev->device_id = id >> 16;
+        dev->class_code = class_code;
+        dev->subclass = subclass;
+        dev->prog_if = (class_reg >> 8) & 0xFF;
+        dev->revision = class_reg & 0xFF;
+        dev->header_type = pci_config_read8(dev, PCI_HEADER_TYPE);
+        dev->irq_line = pci_config_read8(dev, PCI_INTERRUPT_LINE);
+        dev->irq_pin = pci_config_read8(dev, PCI_INTERRUPT_PIN);
+
+        pci_probe_bars(dev);
+    }
+
+    if (class_code == PCI_CLASS_BRIDGE && subclass == PCI_SUBCLASS_PCI_BRIDGE) {
+        uint8_t secondary = (pci_read_raw(bus, slot, func, PCI_SECONDARY_BUS) >> 8) & 0xFF;
+        if (secondary != 0 && secondary != bus) {
+            pci_scan_bus(secondary);
+        }
+    }
+}
+
+// Scan every slot of a bus
+static void pci_scan_bus(uint8_t bus) {
+    for (uint8_t slot = 0; slot < 32; slot++) {
+        uint32_t id = pci_read_raw(bus, slot, 0, PCI_VENDOR_ID);
+        if ((id & 0xFFFF) == 0xFFFF) {
+            continue;
+        }
+
+        pci_scan_function(bus, slot, 0);
+
+        uint8_t header_type = (pci_read_raw(bus, slot, 0, 0x0C) >> 16) & 0xFF;
+        if (header_type & 0x80) {
+            for (uint8_t func = 1; func < 8; func++) {
+                pci_scan_function(bus, slot, func);
+            }
+        }
+    }
+}
+
+// Check a device against one ID table entry
+static int pci_id_matches(const pci_device_t* dev, const pci_device_id_t* id) {
+    if (id->vendor_id != PCI_ANY_ID && id->vendor_id != dev->vendor_id) {
+        return 0;
+    }
+    if (id->device_id != PCI_ANY_ID && id->device_id != dev->device_id) {
+        return 0;
+    }
+    if (id->class_id != PCI_ANY_ID &&
+        id->class_id != (((uint16_t)dev->class_code << 8) | dev->subclass)) {
+        return 0;
+    }
+    return 1;
+}
+
+// Offer an unbound device to a driver
+static int pci_try_bind(pci_device_t* dev, pci_driver_t* driver) {
+    if (dev->driver) {
+        return 0;
+    }
+
+    for (const pci_device_id_t* id = driver->id_table; id->vendor_id != 0; id++) {
+        if (pci_id_matches(dev, id)) {
+            dev->driver = driver;
+            if (driver->probe(dev, id) == 0) {
+                return 1;
+            }
+            dev->driver = NULL;
+            dev->driver_data = NULL;
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+// Enumerate all PCI functions reachable from the host bridge
+void pci_init(void) {
+    pci_num_devices = 0;
+
+    uint32_t id = pci_read_raw(0, 0, 0, PCI_VENDOR_ID);
+    if ((id & 0xFFFF) == 0xFFFF) {
+        terminal_writestring("PCI: no host bridge found\n");
+        return;
+    }
+
+    // A multi-function host bridge means one host controller per function
+    uint8_t header_type = (pci_read_raw(0, 0, 0, 0x0C) >> 16) & 0xFF;
+    if (header_type & 0x80) {
+        for (uint8_t func = 0; func < 8; func++) {
+            if ((pci_read_raw(0, 0, func, PCI_VENDOR_ID) & 0xFFFF) != 0xFFFF) {
+                pci_scan_bus(func);
+            }
+        }
+    } else {
+        pci_scan_bus(0);
+    }
+
+    terminal_writestring("PCI: ");
+    terminal_write_dec(pci_num_devices);
+    terminal_writestring(" devices found\n");
+}
+
+// Register a driver and probe it against all unbound devices
+int pci_register_driver(pci_driver_t* driver) {
+    if (!driver || !driver->id_table || !driver->probe || pci_num_drivers >= PCI_MAX_DRIVERS) {
+        return -1;
+    }
+
+    pci_drivers[pci_num_drivers++] = driver;
+
+    int bound = 0;
+    for (int i = 0; i < pci_num_devices; i++) {
+        bound += pci_try_bind(&pci_devices[i], driver);
+    }
+
+    return bound;
+}
+
+int pci_device_count(void) {
+    return pci_num_devices;
+}
+
+pci_device_t* pci_get_device(int index) {
+    if (index < 0 || index >= pci_num_devices) {
+        return NULL;
+    }
+    return &pci_devices[index];
+}
+
+pci_device_t* pci_find_device(uint16_t vendor_id, uint16_t device_id) {
+    for (int i = 0; i < pci_num_devices; i++) {
+        if (pci_devices[i].vendor_id == vendor_id && pci_devices[i].device_id == device_id) {
+            return &pci_devices[i];
+        }
+    }
+    return NULL;
+}
+
+// Turn on I/O and memory decoding
+void pci_enable_device(pci_device_t* dev) {
+    uint16_t command = pci_config_read16(dev, PCI_COMMAND);
+    command |= PCI_COMMAND_IO | PCI_COMMAND_MEMORY;
+    pci_config_write16(dev, PCI_COMMAND, command);
+}
+
+// Allow the device to initiate DMA
+void pci_enable_bus_master(pci_device_t* dev) {
+    uint16_t command = pci_config_read16(dev, PCI_COMMAND);
+    pci_config_write16(dev, PCI_COMMAND, command | PCI_COMMAND_MASTER);
+}
+
+// Identity-map a memory BAR as uncached and return its address
+void* pci_map_bar(pci_device_t* dev, int bar) {
+    if (bar < 0 || bar >= PCI_NUM_BARS) {
+        return NULL;
+    }
+
+    pci_bar_t* b = &dev->bars[bar];
+    if (b->is_io || b->size == 0) {
+        return NULL;
+    }
+
+    if (!b->mapped) {
+        page_directory_t* dir = paging_get_kernel_directory();
+        uint32_t start = b->base & ~(PAGE_SIZE - 1);
+        uint32_t end = b->base + b->size;
+        if (end <= b->base) {
+            return NULL;    // Runs past 4GB
+        }
+
+        for (uint32_t addr = start; addr < end && addr >= start; addr += PAGE_SIZE) {
+            if (paging_map_page(dir, addr, addr,
+                                PAGE_PRESENT | PAGE_WRITABLE | PAGE_CACHE_DISABLE) != 0) {
+                return NULL;
+            }
+        }
+        b->mapped = 1;
+    }
+
+    return (void*)b->base;
+}
+
+// Dispatch a PIC line to every device routed onto it
+static void pci_irq_dispatch(struct registers* r) {
+    uint8_t line = r->int_no - IRQ0;
+
+    for (int i = 0; i < pci_num_irq_routes; i++) {
+        if (pci_irq_routes[i].dev->irq_line == line) {
+            pci_irq_routes[i].handler(pci_irq_routes[i].dev);
+        }
+    }
+}
+
+// Route the device's legacy interrupt line to a handler
+int pci_register_irq(pci_device_t* dev, pci_irq_handler_t handler) {
+    if (dev->irq_pin == 0 || dev->irq_line >= 16 || pci_num_irq_routes >= PCI_MAX_IRQ_HANDLERS) {
+        return -1;
+    }
+
+    pci_irq_routes[pci_num_irq_routes].dev = dev;
+    pci_irq_routes[pci_num_irq_routes].handler = handler;
+    pci_num_irq_routes++;
+
+    register_interrupt_handler(IRQ0 + dev->irq_line, pci_irq_dispatch);
+
+    // Make sure INTx is not masked at the device
+    uint16_t command = pci_config_read16(dev, PCI_COMMAND);
+    pci_config_write16(dev, PCI_COMMAND, command & ~PCI_COMMAND_INTX_DISABLE);
+
+    if (dev->irq_line >= 8) {
+        irq_enable(2); // Cascade to the slave PIC
+    }
+    irq_enable(dev->irq_line);
+
+    return 0;
+}
+
+// Drop the device's routes; the PIC line stays unmasked for any sharers
+void pci_unregister_irq(pci_device_t* dev) {
+    int kept = 0;
+    for (int i = 0; i < pci_num_irq_routes; i++) {
+        if (pci_irq_routes[i].dev != dev) {
+            pci_irq_routes[kept++] = pci_irq_routes[i];
+        }
+    }
+    pci_num_irq_routes = kept;
+
+    uint16_t command = pci_config_read16(dev, PCI_COMMAND);
+    pci_config_write16(dev, PCI_COMMAND, command | PCI_COMMAND_INTX_DISABLE);
+}
+
+// Short human-readable class name
+static const char* pci_class_name(uint8_t class_code, uint8_t subclass) {
+    switch (class_code) {
+        case 0x01:
+            if (subclass == 0x01) return "IDE controller";
+            if (subclass == 0x06) return "SATA controller";
+            return "Storage controller";
+        case 0x02: return "Network controller";
+        case 0x03: return "Display controller";
+        case 0x04: return "Multimedia device";
+        case 0x06:
+            if (subclass == 0x00) return "Host bridge";
+            if (subclass == 0x01) return "ISA bridge";
+            if (subclass == 0x04) return "PCI bridge";
+            return "Bridge";
+        case 0x0C: return "Serial bus controller";
+        default: return "Device";
+    }
+}
+
+static void pci_write_hex_digits(uint32_t value, int digits) {
+    const char hex_digits[] = "0123456789ABCDEF";
+    for (int i = digits - 1; i >= 0; i--) {
+        terminal_putchar(hex_digits[(value >> (i * 4)) & 0xF]);
+    }
+}
+
+// Print all discovered devices
+void pci_print_devices(void) {
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== PCI Devices ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+
+    if (pci_num_devices == 0) {
+        terminal_writestring("No PCI devices found.\n");
+        return;
+    }
+
+    for (int i = 0; i < pci_num_devices; i++) {
+        pci_device_t* dev = &pci_devices[i];
+
+        pci_write_hex_digits(dev->bus, 2);
+        terminal_putchar(':');
+        pci_write_hex_digits(dev->slot, 2);
+        terminal_putchar('.');
+        pci_write_hex_digits(dev->func, 1);
+        terminal_putchar(' ');
+        pci_write_hex_digits(dev->vendor_id, 4);
+        terminal_putchar(':');
+        pci_write_hex_digits(dev->device_id, 4);
+        terminal_putchar(' ');
+        terminal_writestring(pci_class_name(dev->class_code, dev->subclass));
+
+        if (dev->irq_pin) {
+            terminal_writestring(" irq ");
+            terminal_write_dec(dev->irq_line);
+        }
+        if (dev->driver) {
+            terminal_writestring(" [");
+            terminal_writestring(dev->driver->name);
+            terminal_putchar(']');
+        }
+        terminal_putchar('\n');
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+// PCI configuration space access (mechanism #1)
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+// Limits
+#define PCI_MAX_DEVICES 32
+#define PCI_MAX_DRIVERS 16
+#define PCI_MAX_IRQ_HANDLERS 16
+#define PCI_NUM_BARS 6
+
+// Wildcard for device ID tables
+#define PCI_ANY_ID 0xFFFF
+
+// Configuration space register offsets
+#define PCI_VENDOR_ID       0x00
+#define PCI_DEVICE_ID       0x02
+#define PCI_COMMAND         0x04
+#define PCI_STATUS          0x06
+#define PCI_REVISION_ID     0x08
+#define PCI_PROG_IF         0x09
+#define PCI_SUBCLASS        0x0A
+#define PCI_CLASS           0x0B
+#define PCI_HEADER_TYPE     0x0E
+#define PCI_BAR0            0x10
+#define PCI_SECONDARY_BUS   0x19
+#define PCI_CAPABILITY_LIST 0x34
+#define PCI_INTERRUPT_LINE  0x3C
+#define PCI_INTERRUPT_PIN   0x3D
+
+// Command register bits
+#define PCI_COMMAND_IO           0x0001
+#define PCI_COMMAND_MEMORY       0x0002
+#define PCI_COMMAND_MASTER       0x0004
+#define PCI_COMMAND_INTX_DISABLE 0x0400
+
+// BAR bits
+#define PCI_BAR_IO          0x01
+#define PCI_BAR_TYPE_64     0x04
+#define PCI_BAR_PREFETCH    0x08
+
+// Class codes used during enumeration
+#define PCI_CLASS_BRIDGE        0x06
+#define PCI_SUBCLASS_PCI_BRIDGE 0x04
+
+// BAR description
+typedef struct pci_bar {
+    uint32_t base;          // Physical address or I/O port base
+    uint32_t size;          // Decoded size in bytes (0 if unused)
+    uint8_t is_io;          // 1 for I/O space, 0 for memory space
+    uint8_t prefetchable;
+    uint8_t mapped;         // Memory BAR mapped through the paging layer
+} pci_bar_t;
+
+struct pci_driver;
+
+// Discovered PCI function
+typedef struct pci_device {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t func;
+    uint8_t header_type;
+
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t revision;
+
+    uint8_t irq_line;       // Legacy PIC line (0xFF if not routed)
+    uint8_t irq_pin;        // INTA#..INTD# (0 if none)
+
+    pci_bar_t bars[PCI_NUM_BARS];
+
+    struct pci_driver* driver;
+    void* driver_data;
+} pci_device_t;
+
+// Driver match entry; tables end with a zero vendor_id.
+// class_id is (class << 8) | subclass.
+typedef struct pci_device_id {
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint16_t class_id;
+} pci_device_id_t;
+
+// Driver descriptor
+typedef struct pci_driver {
+    const char* name;
+    const pci_device_id_t* id_table;
+    int (*probe)(pci_device_t* dev, const pci_device_id_t* id); // 0 = bound
+} pci_driver_t;
+
+// Per-device interrupt handler
+typedef void (*pci_irq_handler_t)(pci_device_t* dev);
+
+// Enumeration and driver registry
+void pci_init(void);
+int pci_register_driver(pci_driver_t* driver);
+int pci_device_count(void);
+pci_device_t* pci_get_device(int index);
+pci_device_t* pci_find_device(uint16_t vendor_id, uint16_t device_id);
+void pci_print_devices(void);
+
+// Configuration space access
+uint32_t pci_config_read32(pci_device_t* dev, uint8_t offset);
+uint16_t pci_config_read16(pci_device_t* dev, uint8_t offset);
+uint8_t pci_config_read8(pci_device_t* dev, uint8_t offset);
+void pci_config_write32(pci_device_t* dev, uint8_t offset, uint32_t value);
+void pci_config_write16(pci_device_t* dev, uint8_t offset, uint16_t value);
+void pci_config_write8(pci_device_t* dev, uint8_t offset, uint8_t value);
+uint8_t pci_find_capability(pci_device_t* dev, uint8_t cap_id);
+
+// Device setup helpers
+void pci_enable_device(pci_device_t* dev);
+void pci_enable_bus_master(pci_device_t* dev);
+void* pci_map_bar(pci_device_t* dev, int bar);
+int pci_register_irq(pci_device_t* dev, pci_irq_handler_t handler);
+void pci_unregister_irq(pci_device_t* dev);
+
+#endif // PCI_H
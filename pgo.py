@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Host side of 'make pgo'.
+
+extract <stream> <dir>      Split the profile stream the kernel wrote to the
+                            QEMU debug console (gcov.c) into .gcda files
+compare <baseline> <pgo>    Compare the 'bench:' lines of two serial logs
+"""
+
+import os
+import re
+import struct
+import sys
+
+STREAM_MAGIC = 0x56434752
+STREAM_END = 0x444E4552
+
+
+def extract(stream_path, out_dir):
+    with open(stream_path, "rb") as f:
+        data = f.read()
+
+    pos = 0
+    written = 0
+    while True:
+        if pos + 4 > len(data):
+            sys.exit("profile stream truncated after %d objects" % written)
+        (tag,) = struct.unpack_from("<I", data, pos)
+        pos += 4
+        if tag == STREAM_END:
+            break
+        if tag != STREAM_MAGIC:
+            sys.exit("bad profile stream tag 0x%08x at offset %d" % (tag, pos - 4))
+
+        (name_len,) = struct.unpack_from("<I", data, pos)
+        pos += 4
+        name = data[pos:pos + name_len].decode()
+        pos += name_len
+        (image_len,) = struct.unpack_from("<I", data, pos)
+        pos += 4
+        image = data[pos:pos + image_len]
+        pos += image_len
+        if len(image) != image_len:
+            sys.exit("profile stream truncated in %s" % name)
+
+        # The kernel reports the path the object was compiled for; the
+        # rebuild looks for the file next to the object
+        path = os.path.join(out_dir, os.path.basename(name))
+        with open(path, "wb") as f:
+            f.write(image)
+        written += 1
+
+    print("pgo: wrote %d profiles to %s" % (written, out_dir))
+
+
+BENCH_LINE = re.compile(r"^bench: (.+?)\s+(\d+) us\s*$")
+
+
+def read_bench(log_path):
+    results = {}
+    order = []
+    with open(log_path, errors="replace") as f:
+        for line in f:
+            match = BENCH_LINE.match(line)
+            if match:
+                name = match.group(1)
+                if name not in results:
+                    order.append(name)
+                results[name] = int(match.group(2))
+    if not results:
+        sys.exit("no benchmark results in %s" % log_path)
+    return order, results
+
+
+def compare(baseline_path, pgo_path):
+    order, baseline = read_bench(baseline_path)
+    _, pgo = read_bench(pgo_path)
+
+    print("%-24s %12s %12s %9s" % ("benchmark", "-O2 (us)", "PGO+LTO (us)", "speedup"))
+    for name in order:
+        if name not in pgo:
+            continue
+        before = baseline[name]
+        after = pgo[name]
+        speedup = "%.2fx" % (before / after) if after else "-"
+        print("%-24s %12d %12d %9s" % (name, before, after, speedup))
+
+
+def main():
+    if len(sys.argv) == 4 and sys.argv[1] == "extract":
+        extract(sys.argv[2], sys.argv[3])
+    elif len(sys.argv) == 4 and sys.argv[1] == "compare":
+        compare(sys.argv[2], sys.argv[3])
+    else:
+        sys.exit(__doc__)
+
+
+if __name__ == "__main__":
+    main()
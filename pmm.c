@@ -0,0 +1,351 @@
+#include <stddef.h>
+#include "pmm.h"
+#include "mm.h"
+#include "rtc.h"
+#include "reclaim.h"
+#include "bitmap.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+extern void terminal_write_hex(uint32_t value);
+
+static inline uint32_t pmm_irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void pmm_irq_restore(uint32_t flags) {
+    __asm__ volatile ("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+// Per-frame state and a bitmap of frames in use (set) or free; the lowest
+// free frame is handed out first, which keeps free frames in long runs
+static page_frame_t pmm_frames[PMM_MAX_FRAMES];
+static bitmap_t pmm_free_map;
+static uint32_t pmm_free_bits[BITMAP_STORAGE_WORDS(PMM_MAX_FRAMES)];
+static uint32_t pmm_total_frames;
+static uint32_t pmm_memory_size;
+static pmm_stats_t pmm_stats;
+
+// Frames zeroed in the background, handed out before the free map
+static uint16_t pmm_zero_stack[PMM_ZERO_POOL_MAX];
+static uint32_t pmm_zero_top;
+
+static uint32_t pmm_zero_count(void);
+static uint32_t pmm_zero_scan(uint32_t nr_to_scan);
+
+static shrinker_t pmm_zero_shrinker = {
+    .name = "zero-pool",
+    .pool = RECLAIM_FRAMES,
+    .count = pmm_zero_count,
+    .scan = pmm_zero_scan,
+};
+
+// Installed RAM according to the CMOS (BIOS-reported) size registers
+static uint32_t pmm_detect_memory(void) {
+    uint32_t high = cmos_read(CMOS_HIGH_MEM_LOW) | ((uint32_t)cmos_read(CMOS_HIGH_MEM_HIGH) << 8);
+    if (high) {
+        return 0x01000000 + high * 0x10000;
+    }
+
+    uint32_t ext_kb = cmos_read(CMOS_EXT_MEM_LOW) | ((uint32_t)cmos_read(CMOS_EXT_MEM_HIGH) << 8);
+    if (ext_kb) {
+        return 0x00100000 + ext_kb * 1024;
+    }
+    return PMM_DEFAULT_MEMORY;
+}
+
+static inline uint32_t pmm_frame_index(uint32_t phys) {
+    return (phys - PMM_REGION_START) / PAGE_SIZE;
+}
+
+static inline uint32_t pmm_frame_addr(uint32_t index) {
+    return PMM_REGION_START + index * PAGE_SIZE;
+}
+
+void pmm_init(void) {
+    memset(pmm_frames, 0, sizeof(pmm_frames));
+    memset(&pmm_stats, 0, sizeof(pmm_stats));
+
+    pmm_memory_size = pmm_detect_memory();
+    pmm_total_frames = 0;
+    if (pmm_memory_size > PMM_REGION_START) {
+        pmm_total_frames = (pmm_memory_size - PMM_REGION_START) / PAGE_SIZE;
+    }
+    if (pmm_total_frames > PMM_MAX_FRAMES) {
+        pmm_total_frames = PMM_MAX_FRAMES;
+    }
+
+    // Identity map the region so frames can be filled and copied directly.
+    // Frames past the end of RAM stay marked in use.
+    page_directory_t* kdir = paging_get_kernel_directory();
+    bitmap_init(&pmm_free_map, pmm_free_bits, PMM_MAX_FRAMES);
+    for (uint32_t i = 0; i < PMM_MAX_FRAMES; i++) {
+        if (i < pmm_total_frames) {
+            uint32_t phys = pmm_frame_addr(i);
+            paging_map_page(kdir, phys, phys, PAGE_PRESENT | PAGE_WRITABLE);
+        } else {
+            bitmap_set(&pmm_free_map, i);
+        }
+    }
+
+    pmm_stats.total_frames = pmm_total_frames;
+    pmm_stats.free_frames = pmm_total_frames;
+
+    pmm_zero_top = 0;
+    register_shrinker(&pmm_zero_shrinker);
+}
+
+// Take a frame from the zero pool or the free map and give it one
+// reference; -1 if there is none
+static int pmm_take(int zeroed) {
+    uint32_t flags = pmm_irq_save();
+    int32_t index;
+    if (zeroed) {
+        if (pmm_zero_top == 0) {
+            pmm_irq_restore(flags);
+            return -1;
+        }
+        index = pmm_zero_stack[--pmm_zero_top];
+        pmm_stats.zeroed_frames--;
+        pmm_stats.zero_hits++;
+    } else {
+        index = bitmap_alloc_from(&pmm_free_map, 0);
+        if (index < 0) {
+            pmm_irq_restore(flags);
+            return -1;
+        }
+        pmm_stats.free_frames--;
+    }
+
+    memset(&pmm_frames[index], 0, sizeof(page_frame_t));
+    pmm_frames[index].refcount = 1;
+    pmm_frames[index].flags = PMM_FRAME_USED;
+    pmm_stats.allocations++;
+    pmm_irq_restore(flags);
+    return (int)index;
+}
+
+uint32_t pmm_alloc_frame(void) {
+    // Below the min watermark caches are asked to give frames back first
+    if (pmm_stats.free_frames < reclaim_get_watermarks(RECLAIM_FRAMES).min) {
+        reclaim_direct(RECLAIM_FRAMES, 1);
+    }
+
+    int index = pmm_take(0);
+    if (index < 0) {
+        pmm_stats.failed++;
+        return 0;
+    }
+    reclaim_check(RECLAIM_FRAMES);
+    return pmm_frame_addr(index);
+}
+
+uint32_t pmm_alloc_zeroed_frame(void) {
+    int index = pmm_take(1);
+    if (index >= 0) {
+        return pmm_frame_addr(index);
+    }
+
+    uint32_t phys = pmm_alloc_frame();
+    if (phys) {
+        memset((void*)phys, 0, PAGE_SIZE);
+    }
+    return phys;
+}
+
+uint32_t pmm_alloc_huge(void) {
+    uint32_t flags = pmm_irq_save();
+    int32_t index = -1;
+    if (pmm_stats.free_frames >= reclaim_get_watermarks(RECLAIM_FRAMES).high + PMM_HUGE_FRAMES) {
+        index = bitmap_alloc_range(&pmm_free_map, PMM_HUGE_FRAMES, PMM_HUGE_FRAMES);
+    }
+    if (index < 0) {
+        pmm_stats.huge_failed++;
+        pmm_irq_restore(flags);
+        return 0;
+    }
+
+    memset(&pmm_frames[index], 0, PMM_HUGE_FRAMES * sizeof(page_frame_t));
+    for (uint32_t i = 1; i < PMM_HUGE_FRAMES; i++) {
+        pmm_frames[index + i].flags = PMM_FRAME_USED | PMM_FRAME_TAIL;
+    }
+    pmm_frames[index].refcount = 1;
+    pmm_frames[index].flags = PMM_FRAME_USED | PMM_FRAME_HUGE;
+    pmm_stats.free_frames -= PMM_HUGE_FRAMES;
+    pmm_stats.huge_pages++;
+    pmm_stats.allocations++;
+    pmm_irq_restore(flags);
+    return pmm_frame_addr(index);
+}
+
+void pmm_split_huge(uint32_t phys) {
+    page_frame_t* head = pmm_frame(phys);
+    if (!head || !(head->flags & PMM_FRAME_HUGE)) {
+        return;
+    }
+
+    uint32_t flags = pmm_irq_save();
+    for (uint32_t i = 0; i < PMM_HUGE_FRAMES; i++) {
+        head[i].refcount = head->refcount;
+        head[i].flags = PMM_FRAME_USED;
+    }
+    pmm_stats.huge_pages--;
+    pmm_irq_restore(flags);
+}
+
+uint32_t pmm_zero_pool_refill(uint32_t max) {
+    uint32_t added = 0;
+    while (added < max) {
+        uint32_t flags = pmm_irq_save();
+        int32_t index = -1;
+        if (pmm_zero_top < PMM_ZERO_POOL_MAX) {
+            index = bitmap_alloc_from(&pmm_free_map, 0);
+        }
+        if (index < 0) {
+            pmm_irq_restore(flags);
+            break;
+        }
+        pmm_frames[index].flags = PMM_FRAME_ZEROED;
+        pmm_stats.free_frames--;
+        pmm_irq_restore(flags);
+
+        // Zero with interrupts on; the frame belongs to nobody meanwhile
+        memset((void*)pmm_frame_addr(index), 0, PAGE_SIZE);
+
+        flags = pmm_irq_save();
+        pmm_zero_stack[pmm_zero_top++] = (uint16_t)index;
+        pmm_stats.zeroed_frames++;
+        pmm_irq_restore(flags);
+        added++;
+    }
+    return added;
+}
+
+static uint32_t pmm_zero_count(void) {
+    return pmm_zero_top;
+}
+
+// Shrinker: hand parked zeroed frames back to the free map
+static uint32_t pmm_zero_scan(uint32_t nr_to_scan) {
+    uint32_t released = 0;
+    uint32_t flags = pmm_irq_save();
+    while (released < nr_to_scan && pmm_zero_top > 0) {
+        uint32_t index = pmm_zero_stack[--pmm_zero_top];
+        pmm_frames[index].flags = 0;
+        bitmap_clear(&pmm_free_map, index);
+        pmm_stats.zeroed_frames--;
+        pmm_stats.free_frames++;
+        released++;
+    }
+    pmm_irq_restore(flags);
+    return released;
+}
+
+uint32_t pmm_free_frames(void) {
+    return pmm_stats.free_frames;
+}
+
+page_frame_t* pmm_frame(uint32_t phys) {
+    if (phys < PMM_REGION_START) {
+        return NULL;
+    }
+    uint32_t index = pmm_frame_index(phys);
+    if (index >= pmm_total_frames) {
+        return NULL;
+    }
+    return &pmm_frames[index];
+}
+
+void pmm_get_frame(uint32_t phys) {
+    page_frame_t* frame = pmm_frame(phys);
+    if (!frame || !(frame->flags & PMM_FRAME_USED)) {
+        return;
+    }
+
+    uint32_t flags = pmm_irq_save();
+    frame->refcount++;
+    pmm_irq_restore(flags);
+}
+
+void pmm_free_frame(uint32_t phys) {
+    page_frame_t* frame = pmm_frame(phys);
+    if (!frame || !(frame->flags & PMM_FRAME_USED)) {
+        return;
+    }
+
+    uint32_t flags = pmm_irq_save();
+    if (frame->flags & PMM_FRAME_HUGE) {
+        if (--frame->refcount == 0) {
+            memset(frame, 0, PMM_HUGE_FRAMES * sizeof(page_frame_t));
+            bitmap_free_range(&pmm_free_map, pmm_frame_index(phys), PMM_HUGE_FRAMES);
+            pmm_stats.free_frames += PMM_HUGE_FRAMES;
+            pmm_stats.huge_pages--;
+            pmm_stats.frees++;
+        }
+    } else if (--frame->refcount == 0) {
+        frame->flags = 0;
+        bitmap_clear(&pmm_free_map, pmm_frame_index(phys));
+        pmm_stats.free_frames++;
+        pmm_stats.frees++;
+    }
+    pmm_irq_restore(flags);
+}
+
+uint32_t pmm_frame_phys(const page_frame_t* frame) {
+    return pmm_frame_addr((uint32_t)(frame - pmm_frames));
+}
+
+uint32_t pmm_frame_refcount(uint32_t phys) {
+    page_frame_t* frame = pmm_frame(phys);
+    return frame ? frame->refcount : 0;
+}
+
+pmm_stats_t pmm_get_stats(void) {
+    pmm_stats.shared_frames = 0;
+    for (uint32_t i = 0; i < pmm_total_frames; i++) {
+        if (pmm_frames[i].refcount > 1) {
+            pmm_stats.shared_frames++;
+        }
+    }
+    return pmm_stats;
+}
+
+void pmm_print_stats(void) {
+    pmm_stats_t stats = pmm_get_stats();
+
+    terminal_writestring("=== Physical Frames ===\n");
+    terminal_writestring("Memory: ");
+    terminal_write_dec(pmm_memory_size / 1024);
+    terminal_writestring(" KB, frames at 0x");
+    terminal_write_hex(PMM_REGION_START);
+    terminal_writestring("\n");
+
+    terminal_writestring("Frames: ");
+    terminal_write_dec(stats.total_frames - stats.free_frames);
+    terminal_writestring(" / ");
+    terminal_write_dec(stats.total_frames);
+    terminal_writestring(" used, ");
+    terminal_write_dec(stats.shared_frames);
+    terminal_writestring(" shared, ");
+    terminal_write_dec(stats.zeroed_frames);
+    terminal_writestring(" zeroed\n");
+
+    terminal_writestring("Huge pages: ");
+    terminal_write_dec(stats.huge_pages);
+    terminal_writestring(" x 4MB, ");
+    terminal_write_dec(stats.huge_failed);
+    terminal_writestring(" requests refused\n");
+
+    terminal_writestring("Allocations: ");
+    terminal_write_dec(stats.allocations);
+    terminal_writestring(", frees: ");
+    terminal_write_dec(stats.frees);
+    terminal_writestring(", failed: ");
+    terminal_write_dec(stats.failed);
+    terminal_writestring(", zero-pool hits: ");
+    terminal_write_dec(stats.zero_hits);
+    terminal_writestring("\n");
+}
@@ -0,0 +1,105 @@
+#ifndef PMM_H
+#define PMM_H
+
+#include <stdint.h>
+
+// Physical frames handed out for address spaces. Everything below the
+// region (kernel image, heap, DMA pool) stays with the static allocators.
+#define PMM_REGION_START    0x00800000  // 8MB, just past the boot identity map
+#define PMM_MAX_FRAMES      8192        // Up to 32MB of frames
+#define PMM_DEFAULT_MEMORY  0x02000000  // Assumed RAM size when CMOS reports nothing
+
+// A 4MB page is a run of frames starting on a 4MB boundary. The region
+// starts on one, so the run's first frame index is a multiple of its length.
+#define PMM_HUGE_SIZE       0x00400000
+#define PMM_HUGE_FRAMES     1024
+
+// CMOS memory size registers
+#define CMOS_EXT_MEM_LOW    0x17        // KB above 1MB (up to 64MB)
+#define CMOS_EXT_MEM_HIGH   0x18
+#define CMOS_HIGH_MEM_LOW   0x34        // 64KB units above 16MB
+#define CMOS_HIGH_MEM_HIGH  0x35
+
+// Frames kept zeroed ahead of time for new mappings (released under pressure)
+#define PMM_ZERO_POOL_MAX   64
+
+// Frame flags
+#define PMM_FRAME_USED      0x0001
+#define PMM_FRAME_ZEROED    0x0002  // Parked in the zero pool
+#define PMM_FRAME_LRU       0x0004  // On one of the page aging lists
+#define PMM_FRAME_ACTIVE    0x0008  // ... the active one
+#define PMM_FRAME_CACHE     0x0010  // Page cache page (pagecache.c)
+#define PMM_FRAME_REFERENCED 0x0020 // Page cache hit since the last reclaim pass
+#define PMM_FRAME_HUGE      0x0040  // First frame of a 4MB page; its refcount is the page's
+#define PMM_FRAME_TAIL      0x0080  // Any other frame of a 4MB page
+#define PMM_FRAME_KSM       0x0100  // Merged by ksm.c; mapped read-only wherever it is mapped
+
+struct address_space;
+struct page_cache;
+
+typedef struct page_frame {
+    uint16_t refcount;      // Mappings sharing the frame (copy-on-write)
+    uint16_t flags;
+
+    // Anonymous pages: one space that maps the frame, and where;
+    // page cache pages: the owning cache and the page index in the file
+    union {
+        struct address_space* mapping;
+        struct page_cache* cache;
+    };
+    union {
+        uint32_t vaddr;
+        uint32_t index;
+    };
+
+    // Page aging list links (swap.c, or pagecache.c for cache pages)
+    struct page_frame* lru_prev;
+    struct page_frame* lru_next;
+} page_frame_t;
+
+typedef struct pmm_stats {
+    uint32_t total_frames;
+    uint32_t free_frames;
+    uint32_t shared_frames;  // Frames with more than one reference
+    uint32_t zeroed_frames;  // Parked in the zero pool (not counted as free)
+    uint32_t zero_hits;      // Zeroed allocations served from the pool
+    uint32_t huge_pages;     // 4MB pages allocated (their frames count as used)
+    uint32_t huge_failed;    // 4MB requests refused (no aligned run, or too few free)
+    uint32_t allocations;
+    uint32_t frees;
+    uint32_t failed;
+} pmm_stats_t;
+
+void pmm_init(void);
+
+// Allocate a frame with one reference; returns its physical address or 0
+uint32_t pmm_alloc_frame(void);
+uint32_t pmm_alloc_zeroed_frame(void);
+
+// Allocate a 4MB page (PMM_HUGE_FRAMES frames, not zeroed) with one
+// reference held by its first frame; returns its physical address or 0.
+// Huge pages are only an optimization, so this never reclaims and never
+// takes frames from below the high watermark.
+uint32_t pmm_alloc_huge(void);
+
+// Turn a 4MB page into independent frames, each with the page's references
+void pmm_split_huge(uint32_t phys);
+
+// Take or drop a reference; the frame is freed when the last one goes
+// (for a 4MB page, all of its frames)
+void pmm_get_frame(uint32_t phys);
+void pmm_free_frame(uint32_t phys);
+
+// Lookup (NULL for addresses outside the managed region)
+page_frame_t* pmm_frame(uint32_t phys);
+uint32_t pmm_frame_phys(const page_frame_t* frame);
+uint32_t pmm_frame_refcount(uint32_t phys);
+
+// Prepare up to 'max' zeroed frames (background reclaim, when frames are plentiful)
+uint32_t pmm_zero_pool_refill(uint32_t max);
+
+uint32_t pmm_free_frames(void);
+pmm_stats_t pmm_get_stats(void);
+void pmm_print_stats(void);
+
+#endif // PMM_H
@@ -0,0 +1,272 @@
+#include <stddef.h>
+#include "radix.h"
+#include "mm.h"
+
+// Tag bitmap helpers
+
+static inline int tag_test(const radix_node_t* node, int tag, uint32_t offset) {
+    return (node->tags[tag][offset >> 5] >> (offset & 31)) & 1;
+}
+
+static inline void tag_mark(radix_node_t* node, int tag, uint32_t offset) {
+    node->tags[tag][offset >> 5] |= 1u << (offset & 31);
+}
+
+static inline void tag_unmark(radix_node_t* node, int tag, uint32_t offset) {
+    node->tags[tag][offset >> 5] &= ~(1u << (offset & 31));
+}
+
+static inline int tag_any(const radix_node_t* node, int tag) {
+    for (int i = 0; i < RADIX_TAG_WORDS; i++) {
+        if (node->tags[tag][i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Largest index a tree rooted at node can hold
+static inline uint32_t radix_maxindex(const radix_node_t* node) {
+    uint32_t bits = node->shift + RADIX_MAP_SHIFT;
+    return bits >= 32 ? 0xFFFFFFFF : (1u << bits) - 1;
+}
+
+static radix_node_t* radix_node_alloc(radix_root_t* root, uint8_t shift) {
+    radix_node_t* node = (radix_node_t*)kcalloc(1, sizeof(radix_node_t));
+    if (node) {
+        node->shift = shift;
+        root->nodes++;
+    }
+    return node;
+}
+
+static void radix_node_free(radix_root_t* root, radix_node_t* node) {
+    kfree(node);
+    root->nodes--;
+}
+
+// Leaf that holds index, or NULL
+static radix_node_t* radix_leaf(radix_root_t* root, uint32_t index) {
+    radix_node_t* node = root->node;
+    if (!node || index > radix_maxindex(node)) {
+        return NULL;
+    }
+    while (node && node->shift > 0) {
+        node = (radix_node_t*)node->slots[(index >> node->shift) & RADIX_MAP_MASK];
+    }
+    return node;
+}
+
+void radix_init(radix_root_t* root) {
+    root->node = NULL;
+    root->nodes = 0;
+}
+
+// Add levels on top until the root covers index; the old root becomes
+// slot 0 of the new one and passes its tag summary up
+static int radix_extend(radix_root_t* root, uint32_t index) {
+    if (!root->node) {
+        uint8_t shift = 0;
+        while (shift + RADIX_MAP_SHIFT < 32 && (index >> (shift + RADIX_MAP_SHIFT))) {
+            shift += RADIX_MAP_SHIFT;
+        }
+        root->node = radix_node_alloc(root, shift);
+        return root->node ? 0 : -1;
+    }
+
+    while (index > radix_maxindex(root->node)) {
+        radix_node_t* old = root->node;
+        radix_node_t* node = radix_node_alloc(root, old->shift + RADIX_MAP_SHIFT);
+        if (!node) {
+            return -1;
+        }
+        node->slots[0] = old;
+        node->count = 1;
+        for (int tag = 0; tag < RADIX_MAX_TAGS; tag++) {
+            if (tag_any(old, tag)) {
+                tag_mark(node, tag, 0);
+            }
+        }
+        old->parent = node;
+        old->offset = 0;
+        root->node = node;
+    }
+    return 0;
+}
+
+int radix_insert(radix_root_t* root, uint32_t index, void* item) {
+    if (!item || radix_extend(root, index) != 0) {
+        return -1;
+    }
+
+    radix_node_t* node = root->node;
+    while (node->shift > 0) {
+        uint32_t offset = (index >> node->shift) & RADIX_MAP_MASK;
+        radix_node_t* child = (radix_node_t*)node->slots[offset];
+        if (!child) {
+            child = radix_node_alloc(root, node->shift - RADIX_MAP_SHIFT);
+            if (!child) {
+                // Empty interior nodes left behind are reused by the next insert
+                return -1;
+            }
+            child->parent = node;
+            child->offset = offset;
+            node->slots[offset] = child;
+            node->count++;
+        }
+        node = child;
+    }
+
+    uint32_t offset = index & RADIX_MAP_MASK;
+    if (node->slots[offset]) {
+        return -1;
+    }
+    node->slots[offset] = item;
+    node->count++;
+    return 0;
+}
+
+void* radix_lookup(radix_root_t* root, uint32_t index) {
+    radix_node_t* leaf = radix_leaf(root, index);
+    return leaf ? leaf->slots[index & RADIX_MAP_MASK] : NULL;
+}
+
+// Clear a tag at one slot and drop it from the summaries above as long as
+// the node has no other tagged slot
+static void radix_tag_clear_node(radix_node_t* node, uint32_t offset, int tag) {
+    while (node) {
+        if (!tag_test(node, tag, offset)) {
+            return;
+        }
+        tag_unmark(node, tag, offset);
+        if (tag_any(node, tag)) {
+            return;
+        }
+        offset = node->offset;
+        node = node->parent;
+    }
+}
+
+void* radix_delete(radix_root_t* root, uint32_t index) {
+    radix_node_t* node = radix_leaf(root, index);
+    if (!node) {
+        return NULL;
+    }
+    uint32_t offset = index & RADIX_MAP_MASK;
+    void* item = node->slots[offset];
+    if (!item) {
+        return NULL;
+    }
+
+    for (int tag = 0; tag < RADIX_MAX_TAGS; tag++) {
+        radix_tag_clear_node(node, offset, tag);
+    }
+    node->slots[offset] = NULL;
+    node->count--;
+
+    // Free nodes that became empty, bottom up
+    while (node->count == 0) {
+        radix_node_t* parent = node->parent;
+        if (!parent) {
+            root->node = NULL;
+            radix_node_free(root, node);
+            return item;
+        }
+        parent->slots[node->offset] = NULL;
+        parent->count--;
+        radix_node_free(root, node);
+        node = parent;
+    }
+
+    // Drop root levels that only lead to slot 0
+    while (root->node->shift > 0 && root->node->count == 1 && root->node->slots[0]) {
+        radix_node_t* old = root->node;
+        root->node = (radix_node_t*)old->slots[0];
+        root->node->parent = NULL;
+        root->node->offset = 0;
+        radix_node_free(root, old);
+    }
+    return item;
+}
+
+void radix_tag_set(radix_root_t* root, uint32_t index, int tag) {
+    radix_node_t* leaf = radix_leaf(root, index);
+    if (!leaf || !leaf->slots[index & RADIX_MAP_MASK]) {
+        return;
+    }
+
+    // Mark upwards until a level already carries the tag
+    radix_node_t* node = leaf;
+    uint32_t offset = index & RADIX_MAP_MASK;
+    while (node && !tag_test(node, tag, offset)) {
+        tag_mark(node, tag, offset);
+        offset = node->offset;
+        node = node->parent;
+    }
+}
+
+void radix_tag_clear(radix_root_t* root, uint32_t index, int tag) {
+    radix_node_t* leaf = radix_leaf(root, index);
+    if (leaf) {
+        radix_tag_clear_node(leaf, index & RADIX_MAP_MASK, tag);
+    }
+}
+
+int radix_tag_get(radix_root_t* root, uint32_t index, int tag) {
+    radix_node_t* leaf = radix_leaf(root, index);
+    return leaf ? tag_test(leaf, tag, index & RADIX_MAP_MASK) : 0;
+}
+
+int radix_tagged(radix_root_t* root, int tag) {
+    return root->node ? tag_any(root->node, tag) : 0;
+}
+
+// Collect entries of the subtree covering [base, base + span) from first
+// onwards; tag < 0 takes every entry
+static uint32_t radix_gang_node(radix_node_t* node, uint32_t base, uint32_t first,
+                                void** results, uint32_t* indices, uint32_t max, int tag) {
+    uint32_t found = 0;
+    uint32_t offset = 0;
+    if (first > base) {
+        uint32_t skip = (first - base) >> node->shift;
+        if (skip >= RADIX_MAP_SIZE) {
+            return 0;
+        }
+        offset = skip;
+    }
+
+    for (; offset < RADIX_MAP_SIZE && found < max; offset++) {
+        void* slot = node->slots[offset];
+        if (!slot || (tag >= 0 && !tag_test(node, tag, offset))) {
+            continue;
+        }
+        uint32_t index = base + (offset << node->shift);
+        if (node->shift == 0) {
+            results[found] = slot;
+            if (indices) {
+                indices[found] = index;
+            }
+            found++;
+        } else {
+            found += radix_gang_node((radix_node_t*)slot, index, first, results + found,
+                                     indices ? indices + found : NULL, max - found, tag);
+        }
+    }
+    return found;
+}
+
+uint32_t radix_gang_lookup(radix_root_t* root, void** results, uint32_t* indices,
+                           uint32_t first, uint32_t max) {
+    if (!root->node || first > radix_maxindex(root->node)) {
+        return 0;
+    }
+    return radix_gang_node(root->node, 0, first, results, indices, max, -1);
+}
+
+uint32_t radix_gang_lookup_tag(radix_root_t* root, void** results, uint32_t* indices,
+                               uint32_t first, uint32_t max, int tag) {
+    if (!root->node || first > radix_maxindex(root->node) || !tag_any(root->node, tag)) {
+        return 0;
+    }
+    return radix_gang_node(root->node, 0, first, results, indices, max, tag);
+}
@@ -0,0 +1,49 @@
+#ifndef RADIX_H
+#define RADIX_H
+
+#include <stdint.h>
+
+// Radix tree keyed by a 32-bit index, 64 slots per node. Every entry can
+// carry a few tags, which are summarised up the tree so tagged entries are
+// found without visiting untagged subtrees.
+#define RADIX_MAP_SHIFT     6
+#define RADIX_MAP_SIZE      (1 << RADIX_MAP_SHIFT)
+#define RADIX_MAP_MASK      (RADIX_MAP_SIZE - 1)
+#define RADIX_TAG_WORDS     (RADIX_MAP_SIZE / 32)
+#define RADIX_MAX_TAGS      2
+
+typedef struct radix_node {
+    uint8_t shift;                  // Index bits below this level (0 for leaves)
+    uint8_t offset;                 // Slot in the parent
+    uint16_t count;                 // Occupied slots
+    struct radix_node* parent;
+    void* slots[RADIX_MAP_SIZE];    // Children, or entries in a leaf
+    uint32_t tags[RADIX_MAX_TAGS][RADIX_TAG_WORDS];
+} radix_node_t;
+
+typedef struct radix_root {
+    radix_node_t* node;             // NULL when empty
+    uint32_t nodes;                 // Allocated nodes (for statistics)
+} radix_root_t;
+
+void radix_init(radix_root_t* root);
+
+// Returns -1 if the index is taken or a node could not be allocated
+int radix_insert(radix_root_t* root, uint32_t index, void* item);
+void* radix_lookup(radix_root_t* root, uint32_t index);
+void* radix_delete(radix_root_t* root, uint32_t index);
+
+// Tags on present entries
+void radix_tag_set(radix_root_t* root, uint32_t index, int tag);
+void radix_tag_clear(radix_root_t* root, uint32_t index, int tag);
+int radix_tag_get(radix_root_t* root, uint32_t index, int tag);
+int radix_tagged(radix_root_t* root, int tag);
+
+// Up to max entries at or after first, in index order; indices may be NULL.
+// The tagged variant skips every subtree without the tag.
+uint32_t radix_gang_lookup(radix_root_t* root, void** results, uint32_t* indices,
+                           uint32_t first, uint32_t max);
+uint32_t radix_gang_lookup_tag(radix_root_t* root, void** results, uint32_t* indices,
+                               uint32_t first, uint32_t max, int tag);
+
+#endif // RADIX_H
@@ -0,0 +1,239 @@
+#include "rbtree.h"
+
+static inline int rb_is_black(const rb_node_t* node) {
+    return !node || node->color == RB_BLACK;
+}
+
+// Point whatever referred to old (its parent, or the root) at new
+static inline void rb_replace_child(rb_root_t* root, rb_node_t* parent, rb_node_t* old, rb_node_t* new) {
+    if (!parent) {
+        root->node = new;
+    } else if (parent->left == old) {
+        parent->left = new;
+    } else {
+        parent->right = new;
+    }
+}
+
+static void rb_rotate_left(rb_root_t* root, rb_node_t* node) {
+    rb_node_t* right = node->right;
+    node->right = right->left;
+    if (right->left) {
+        right->left->parent = node;
+    }
+    right->parent = node->parent;
+    rb_replace_child(root, node->parent, node, right);
+    right->left = node;
+    node->parent = right;
+}
+
+static void rb_rotate_right(rb_root_t* root, rb_node_t* node) {
+    rb_node_t* left = node->left;
+    node->left = left->right;
+    if (left->right) {
+        left->right->parent = node;
+    }
+    left->parent = node->parent;
+    rb_replace_child(root, node->parent, node, left);
+    left->right = node;
+    node->parent = left;
+}
+
+void rb_insert_color(rb_root_t* root, rb_node_t* node) {
+    rb_node_t* parent;
+
+    // A red node under a red parent: recolour while the uncle is red too,
+    // otherwise one or two rotations end it
+    while ((parent = node->parent) && parent->color == RB_RED) {
+        rb_node_t* gparent = parent->parent;
+        if (parent == gparent->left) {
+            rb_node_t* uncle = gparent->right;
+            if (!rb_is_black(uncle)) {
+                uncle->color = RB_BLACK;
+                parent->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+            if (parent->right == node) {
+                rb_rotate_left(root, parent);
+                rb_node_t* tmp = parent;
+                parent = node;
+                node = tmp;
+            }
+            parent->color = RB_BLACK;
+            gparent->color = RB_RED;
+            rb_rotate_right(root, gparent);
+        } else {
+            rb_node_t* uncle = gparent->left;
+            if (!rb_is_black(uncle)) {
+                uncle->color = RB_BLACK;
+                parent->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+            if (parent->left == node) {
+                rb_rotate_right(root, parent);
+                rb_node_t* tmp = parent;
+                parent = node;
+                node = tmp;
+            }
+            parent->color = RB_BLACK;
+            gparent->color = RB_RED;
+            rb_rotate_left(root, gparent);
+        }
+    }
+    root->node->color = RB_BLACK;
+}
+
+// After a black node was removed: node (possibly NULL, under parent) is
+// one black short on its paths
+static void rb_erase_color(rb_root_t* root, rb_node_t* node, rb_node_t* parent) {
+    while (rb_is_black(node) && node != root->node) {
+        if (parent->left == node) {
+            rb_node_t* sibling = parent->right;
+            if (sibling->color == RB_RED) {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_left(root, parent);
+                sibling = parent->right;
+            }
+            if (rb_is_black(sibling->left) && rb_is_black(sibling->right)) {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (rb_is_black(sibling->right)) {
+                sibling->left->color = RB_BLACK;
+                sibling->color = RB_RED;
+                rb_rotate_right(root, sibling);
+                sibling = parent->right;
+            }
+            sibling->color = parent->color;
+            parent->color = RB_BLACK;
+            sibling->right->color = RB_BLACK;
+            rb_rotate_left(root, parent);
+        } else {
+            rb_node_t* sibling = parent->left;
+            if (sibling->color == RB_RED) {
+                sibling->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_right(root, parent);
+                sibling = parent->left;
+            }
+            if (rb_is_black(sibling->left) && rb_is_black(sibling->right)) {
+                sibling->color = RB_RED;
+                node = parent;
+                parent = node->parent;
+                continue;
+            }
+            if (rb_is_black(sibling->left)) {
+                sibling->right->color = RB_BLACK;
+                sibling->color = RB_RED;
+                rb_rotate_left(root, sibling);
+                sibling = parent->left;
+            }
+            sibling->color = parent->color;
+            parent->color = RB_BLACK;
+            sibling->left->color = RB_BLACK;
+            rb_rotate_right(root, parent);
+        }
+        node = root->node;
+    }
+    if (node) {
+        node->color = RB_BLACK;
+    }
+}
+
+void rb_erase(rb_root_t* root, rb_node_t* node) {
+    rb_node_t* child;
+    rb_node_t* parent;
+    uint32_t color;
+
+    if (node->left && node->right) {
+        // Two children: the successor (leftmost of the right subtree) takes
+        // the node's place and colour, and is unlinked from where it was
+        rb_node_t* next = node->right;
+        while (next->left) {
+            next = next->left;
+        }
+        child = next->right;
+        parent = next->parent;
+        color = next->color;
+
+        if (parent == node) {
+            parent = next;
+        } else {
+            if (child) {
+                child->parent = parent;
+            }
+            parent->left = child;
+            next->right = node->right;
+            node->right->parent = next;
+        }
+        rb_replace_child(root, node->parent, node, next);
+        next->parent = node->parent;
+        next->color = node->color;
+        next->left = node->left;
+        node->left->parent = next;
+    } else {
+        child = node->left ? node->left : node->right;
+        parent = node->parent;
+        color = node->color;
+        if (child) {
+            child->parent = parent;
+        }
+        rb_replace_child(root, parent, node, child);
+    }
+
+    if (color == RB_BLACK) {
+        rb_erase_color(root, child, parent);
+    }
+}
+
+rb_node_t* rb_first(const rb_root_t* root) {
+    rb_node_t* node = root->node;
+    while (node && node->left) {
+        node = node->left;
+    }
+    return node;
+}
+
+rb_node_t* rb_last(const rb_root_t* root) {
+    rb_node_t* node = root->node;
+    while (node && node->right) {
+        node = node->right;
+    }
+    return node;
+}
+
+rb_node_t* rb_next(const rb_node_t* node) {
+    if (node->right) {
+        node = node->right;
+        while (node->left) {
+            node = node->left;
+        }
+        return (rb_node_t*)node;
+    }
+    // Up until we come from a left child
+    while (node->parent && node == node->parent->right) {
+        node = node->parent;
+    }
+    return node->parent;
+}
+
+rb_node_t* rb_prev(const rb_node_t* node) {
+    if (node->left) {
+        node = node->left;
+        while (node->right) {
+            node = node->right;
+        }
+        return (rb_node_t*)node;
+    }
+    while (node->parent && node == node->parent->left) {
+        node = node->parent;
+    }
+    return node->parent;
+}
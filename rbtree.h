@@ -0,0 +1,46 @@
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Intrusive red-black tree. Objects embed an rb_node_t; the tree never
+// allocates. Callers do the ordered descent themselves (it is the only part
+// that knows the key), link the new node where it ended with rb_link_node
+// and then rebalance with rb_insert_color. Height stays below 2 log2(n+1).
+#define RB_RED      0
+#define RB_BLACK    1
+
+typedef struct rb_node {
+    struct rb_node* parent;
+    struct rb_node* left;
+    struct rb_node* right;
+    uint32_t color;
+} rb_node_t;
+
+typedef struct rb_root {
+    rb_node_t* node;            // NULL when empty
+} rb_root_t;
+
+// Entry that embeds a node
+#define rb_entry(node, type, member) \
+    ((type*)((char*)(node) - offsetof(type, member)))
+
+static inline void rb_link_node(rb_node_t* node, rb_node_t* parent, rb_node_t** link) {
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    node->color = RB_RED;
+    *link = node;
+}
+
+void rb_insert_color(rb_root_t* root, rb_node_t* node);
+void rb_erase(rb_root_t* root, rb_node_t* node);
+
+// In-order traversal
+rb_node_t* rb_first(const rb_root_t* root);
+rb_node_t* rb_last(const rb_root_t* root);
+rb_node_t* rb_next(const rb_node_t* node);
+rb_node_t* rb_prev(const rb_node_t* node);
+
+#endif // RBTREE_H
@@ -0,0 +1,209 @@
+#include <stddef.h>
+#include "reclaim.h"
+#include "mm.h"
+#include "pmm.h"
+#include "ktime.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+
+static shrinker_t* shrinker_list = NULL;
+static reclaim_watermarks_t reclaim_wmark[RECLAIM_NR_POOLS];
+static reclaim_stats_t reclaim_stats[RECLAIM_NR_POOLS];
+static int reclaim_pending = 0;
+static int reclaim_active = 0;      // Shrinkers must not recurse into reclaim
+static uint64_t reclaim_last_ms = 0;
+
+static const char* reclaim_pool_names[RECLAIM_NR_POOLS] = {"heap", "frames"};
+
+static uint32_t reclaim_pool_free(reclaim_pool_t pool) {
+    if (pool == RECLAIM_HEAP) {
+        return (uint32_t)mm_free_memory();
+    }
+    return pmm_free_frames();
+}
+
+// Shrinkers may register before this runs; only the accounting is reset
+void reclaim_init(void) {
+    memset(reclaim_stats, 0, sizeof(reclaim_stats));
+    reclaim_pending = 0;
+    reclaim_active = 0;
+    reclaim_last_ms = 0;
+
+    // Heap: 1/64, 1/32 and 1/16 of it (16KB / 32KB / 64KB of the default 1MB)
+    uint32_t heap_bytes = mm_get_stats().total_memory;
+    reclaim_wmark[RECLAIM_HEAP].min = heap_bytes / 64;
+    reclaim_wmark[RECLAIM_HEAP].low = heap_bytes / 32;
+    reclaim_wmark[RECLAIM_HEAP].high = heap_bytes / 16;
+
+    // Frames: scaled to the managed region with a small floor
+    uint32_t frames_min = pmm_get_stats().total_frames / 128 + 4;
+    reclaim_wmark[RECLAIM_FRAMES].min = frames_min;
+    reclaim_wmark[RECLAIM_FRAMES].low = frames_min * 2;
+    reclaim_wmark[RECLAIM_FRAMES].high = frames_min * 3;
+}
+
+void register_shrinker(shrinker_t* shrinker) {
+    shrinker->calls = 0;
+    shrinker->freed = 0;
+    shrinker->next = NULL;
+
+    shrinker_t** link = &shrinker_list;
+    while (*link) {
+        link = &(*link)->next;
+    }
+    *link = shrinker;
+}
+
+void unregister_shrinker(shrinker_t* shrinker) {
+    for (shrinker_t** link = &shrinker_list; *link; link = &(*link)->next) {
+        if (*link == shrinker) {
+            *link = shrinker->next;
+            shrinker->next = NULL;
+            return;
+        }
+    }
+}
+
+// Ask every cache of the pool for a growing share of what it holds until
+// the target is met, so small shortages only trim the caches a little
+uint32_t reclaim_shrink(reclaim_pool_t pool, uint32_t target) {
+    if (reclaim_active || pool >= RECLAIM_NR_POOLS) {
+        return 0;
+    }
+    reclaim_active = 1;
+
+    uint32_t freed = 0;
+    for (int priority = RECLAIM_PRIORITY_MAX; priority >= 0; priority--) {
+        if (reclaim_pool_free(pool) >= target) {
+            break;
+        }
+
+        for (shrinker_t* s = shrinker_list; s; s = s->next) {
+            if (s->pool != pool) {
+                continue;
+            }
+
+            uint32_t count = s->count();
+            if (count == 0) {
+                continue;
+            }
+            uint32_t nr = count >> priority;
+            if (nr == 0) {
+                nr = 1;
+            }
+
+            uint32_t released = s->scan(nr);
+            s->calls++;
+            s->freed += released;
+            freed += released;
+
+            if (reclaim_pool_free(pool) >= target) {
+                break;
+            }
+        }
+    }
+
+    reclaim_stats[pool].freed += freed;
+    reclaim_active = 0;
+    return freed;
+}
+
+// Slow path of an allocation that found less than it needs (or dipped
+// below the min watermark); returns 0 if the allocation should be retried
+int reclaim_direct(reclaim_pool_t pool, uint32_t needed) {
+    if (reclaim_active || pool >= RECLAIM_NR_POOLS) {
+        return -1;
+    }
+
+    reclaim_stats[pool].direct_runs++;
+    reclaim_shrink(pool, needed + reclaim_wmark[pool].min);
+    reclaim_check(pool);
+
+    if (reclaim_pool_free(pool) < needed) {
+        reclaim_stats[pool].direct_failures++;
+        return -1;
+    }
+    return 0;
+}
+
+// Called after allocations; wakes the background pass below the low mark
+void reclaim_check(reclaim_pool_t pool) {
+    if (!reclaim_pending && reclaim_pool_free(pool) < reclaim_wmark[pool].low) {
+        reclaim_pending = 1;
+        reclaim_stats[pool].wakeups++;
+    }
+}
+
+void reclaim_poll(void) {
+    uint64_t now = ktime_get_ms();
+    if (!reclaim_pending && now - reclaim_last_ms < RECLAIM_INTERVAL_MS) {
+        return;
+    }
+    reclaim_last_ms = now;
+    reclaim_pending = 0;
+
+    for (int pool = 0; pool < RECLAIM_NR_POOLS; pool++) {
+        if (reclaim_pool_free(pool) < reclaim_wmark[pool].low) {
+            reclaim_stats[pool].background_runs++;
+            reclaim_shrink(pool, reclaim_wmark[pool].high);
+        }
+    }
+
+    // With frames to spare, zero a few ahead of time for new mappings
+    uint32_t free_frames = pmm_free_frames();
+    uint32_t high = reclaim_wmark[RECLAIM_FRAMES].high;
+    if (free_frames > high) {
+        uint32_t spare = free_frames - high;
+        pmm_zero_pool_refill(spare < RECLAIM_ZERO_BATCH ? spare : RECLAIM_ZERO_BATCH);
+    }
+}
+
+reclaim_watermarks_t reclaim_get_watermarks(reclaim_pool_t pool) {
+    return reclaim_wmark[pool];
+}
+
+void reclaim_print_stats(void) {
+    terminal_writestring("=== Memory Reclaim ===\n");
+    for (int pool = 0; pool < RECLAIM_NR_POOLS; pool++) {
+        terminal_writestring(reclaim_pool_names[pool]);
+        terminal_writestring(": free ");
+        terminal_write_dec(reclaim_pool_free(pool));
+        terminal_writestring(", watermarks ");
+        terminal_write_dec(reclaim_wmark[pool].min);
+        terminal_writestring("/");
+        terminal_write_dec(reclaim_wmark[pool].low);
+        terminal_writestring("/");
+        terminal_write_dec(reclaim_wmark[pool].high);
+        terminal_writestring("\n  direct ");
+        terminal_write_dec(reclaim_stats[pool].direct_runs);
+        terminal_writestring(" (");
+        terminal_write_dec(reclaim_stats[pool].direct_failures);
+        terminal_writestring(" failed), background ");
+        terminal_write_dec(reclaim_stats[pool].background_runs);
+        terminal_writestring(", wakeups ");
+        terminal_write_dec(reclaim_stats[pool].wakeups);
+        terminal_writestring(", released ");
+        terminal_write_dec(reclaim_stats[pool].freed);
+        terminal_writestring("\n");
+    }
+
+    terminal_writestring("Shrinkers:\n");
+    if (!shrinker_list) {
+        terminal_writestring("  (none)\n");
+    }
+    for (shrinker_t* s = shrinker_list; s; s = s->next) {
+        terminal_writestring("  ");
+        terminal_writestring(s->name);
+        terminal_writestring(" [");
+        terminal_writestring(reclaim_pool_names[s->pool]);
+        terminal_writestring("]: ");
+        terminal_write_dec(s->count());
+        terminal_writestring(" reclaimable, ");
+        terminal_write_dec(s->calls);
+        terminal_writestring(" calls, ");
+        terminal_write_dec(s->freed);
+        terminal_writestring(" released\n");
+    }
+}
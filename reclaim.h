@@ -0,0 +1,69 @@
+#ifndef RECLAIM_H
+#define RECLAIM_H
+
+#include <stdint.h>
+
+// Memory that shrinkers can give back. Heap amounts are in bytes, frame
+// amounts in 4KB frames.
+typedef enum {
+    RECLAIM_HEAP,
+    RECLAIM_FRAMES,
+    RECLAIM_NR_POOLS
+} reclaim_pool_t;
+
+// Scan passes go from 1/16 of each cache (priority 4) down to all of it
+#define RECLAIM_PRIORITY_MAX    4
+
+// How often the background pass looks at the watermarks when nobody woke it
+#define RECLAIM_INTERVAL_MS     100
+
+// Zeroed frames prepared by the background pass, at most this many per run
+#define RECLAIM_ZERO_BATCH      16
+
+// A cache that can release memory on demand
+typedef struct shrinker {
+    const char* name;
+    reclaim_pool_t pool;
+    uint32_t (*count)(void);                 // Units that could be released now
+    uint32_t (*scan)(uint32_t nr_to_scan);   // Release up to nr; returns units released
+    uint32_t calls;
+    uint32_t freed;
+    struct shrinker* next;
+} shrinker_t;
+
+// Below min allocations reclaim directly; below low the background pass is
+// woken and shrinks caches until free memory is back above high.
+typedef struct reclaim_watermarks {
+    uint32_t min;
+    uint32_t low;
+    uint32_t high;
+} reclaim_watermarks_t;
+
+typedef struct reclaim_stats {
+    uint32_t direct_runs;       // Reclaim from an allocation's slow path
+    uint32_t direct_failures;   // ... that still could not satisfy it
+    uint32_t background_runs;
+    uint32_t wakeups;
+    uint32_t freed;             // Units released by shrinkers
+} reclaim_stats_t;
+
+void reclaim_init(void);
+
+// Register a cache; shrinkers are called in registration order
+void register_shrinker(shrinker_t* shrinker);
+void unregister_shrinker(shrinker_t* shrinker);
+
+// Allocator hooks
+int reclaim_direct(reclaim_pool_t pool, uint32_t needed);
+void reclaim_check(reclaim_pool_t pool);
+
+// Shrink a pool until 'target' units are free; returns units released
+uint32_t reclaim_shrink(reclaim_pool_t pool, uint32_t target);
+
+// Background pass, called from the idle loop
+void reclaim_poll(void);
+
+reclaim_watermarks_t reclaim_get_watermarks(reclaim_pool_t pool);
+void reclaim_print_stats(void);
+
+#endif // RECLAIM_H
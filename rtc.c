@@ -0,0 +1,146 @@
+#include "rtc.h"
+#include "ktime.h"
+
+// I/O port functions
+static inline void outb(uint16_t port, uint8_t val) {
+    __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t ret;
+    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+uint8_t cmos_read(uint8_t reg) {
+    outb(CMOS_ADDRESS, reg);
+    return inb(CMOS_DATA);
+}
+
+static uint8_t rtc_bcd_to_bin(uint8_t value) {
+    return (value & 0x0F) + (value >> 4) * 10;
+}
+
+static void rtc_read_raw(rtc_time_t* time) {
+    while (cmos_read(RTC_STATUS_A) & RTC_A_UIP);
+
+    time->second = cmos_read(RTC_SECONDS);
+    time->minute = cmos_read(RTC_MINUTES);
+    time->hour = cmos_read(RTC_HOURS);
+    time->day = cmos_read(RTC_DAY);
+    time->month = cmos_read(RTC_MONTH);
+    time->year = cmos_read(RTC_YEAR);
+}
+
+void rtc_read_time(rtc_time_t* time) {
+    // An update can still land between registers; read until two snapshots agree
+    rtc_time_t last;
+    rtc_read_raw(time);
+    do {
+        last = *time;
+        rtc_read_raw(time);
+    } while (last.second != time->second || last.minute != time->minute ||
+             last.hour != time->hour || last.day != time->day ||
+             last.month != time->month || last.year != time->year);
+
+    uint8_t status_b = cmos_read(RTC_STATUS_B);
+    uint8_t pm = time->hour & RTC_HOUR_PM;
+    time->hour &= ~RTC_HOUR_PM;
+
+    if (!(status_b & RTC_B_BINARY)) {
+        time->second = rtc_bcd_to_bin(time->second);
+        time->minute = rtc_bcd_to_bin(time->minute);
+        time->hour = rtc_bcd_to_bin(time->hour);
+        time->day = rtc_bcd_to_bin(time->day);
+        time->month = rtc_bcd_to_bin(time->month);
+        time->year = rtc_bcd_to_bin(time->year);
+    }
+
+    if (!(status_b & RTC_B_24HOUR)) {
+        // 12-hour mode: 12 AM is 0, 12 PM is 12
+        time->hour %= 12;
+        if (pm) {
+            time->hour += 12;
+        }
+    }
+
+    // Two-digit year; no century register is read
+    time->year += time->year < 70 ? 2000 : 1900;
+}
+
+uint32_t rtc_time_to_unix(const rtc_time_t* time) {
+    static const uint16_t days_before_month[12] = {
+        0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+    };
+
+    if (time->month < 1 || time->month > 12 || time->year < 1970) {
+        return 0;
+    }
+
+    uint32_t year = time->year;
+    uint32_t days = (year - 1970) * 365;
+    days += (year - 1969) / 4;          // Leap days in earlier years (valid until 2100)
+    days += days_before_month[time->month - 1];
+    if (time->month > 2 && (year % 4) == 0) {
+        days++;
+    }
+    days += time->day - 1;
+
+    return days * 86400 + time->hour * 3600 + time->minute * 60 + time->second;
+}
+
+void rtc_unix_to_time(uint32_t seconds, rtc_time_t* time) {
+    static const uint8_t days_in_month[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+    uint32_t days = seconds / 86400;
+    uint32_t rest = seconds % 86400;
+    time->hour = rest / 3600;
+    time->minute = (rest / 60) % 60;
+    time->second = rest % 60;
+
+    uint16_t year = 1970;
+    for (;;) {
+        uint32_t year_days = (year % 4) == 0 ? 366 : 365;
+        if (days < year_days) {
+            break;
+        }
+        days -= year_days;
+        year++;
+    }
+    time->year = year;
+
+    uint8_t month = 0;
+    for (;;) {
+        uint32_t month_days = days_in_month[month] + (month == 1 && (year % 4) == 0);
+        if (days < month_days) {
+            break;
+        }
+        days -= month_days;
+        month++;
+    }
+    time->month = month + 1;
+    time->day = days + 1;
+}
+
+uint32_t rtc_get_unix_time(void) {
+    rtc_time_t time;
+    rtc_read_time(&time);
+    return rtc_time_to_unix(&time);
+}
+
+static uint64_t rtc_clocksource_read(void) {
+    return rtc_get_unix_time();
+}
+
+static clocksource_t rtc_clocksource = {
+    "rtc",
+    CLOCKSOURCE_RATING_RTC,
+    rtc_clocksource_read,
+    0xFFFFFFFF,
+    1,
+    0, 0
+};
+
+void rtc_init(void) {
+    clocksource_register(&rtc_clocksource);
+}
@@ -0,0 +1,46 @@
+#ifndef RTC_H
+#define RTC_H
+
+#include <stdint.h>
+
+// CMOS ports and registers
+#define CMOS_ADDRESS    0x70
+#define CMOS_DATA       0x71
+#define RTC_SECONDS     0x00
+#define RTC_MINUTES     0x02
+#define RTC_HOURS       0x04
+#define RTC_DAY         0x07
+#define RTC_MONTH       0x08
+#define RTC_YEAR        0x09
+#define RTC_STATUS_A    0x0A
+#define RTC_STATUS_B    0x0B
+
+#define RTC_A_UIP       0x80    // Update in progress
+#define RTC_B_24HOUR    0x02
+#define RTC_B_BINARY    0x04
+#define RTC_HOUR_PM     0x80
+
+typedef struct rtc_time {
+    uint8_t second;
+    uint8_t minute;
+    uint8_t hour;
+    uint8_t day;
+    uint8_t month;
+    uint16_t year;
+} rtc_time_t;
+
+// Raw CMOS register access (also used to size memory when no map is passed)
+uint8_t cmos_read(uint8_t reg);
+
+// Read a consistent snapshot of the clock
+void rtc_read_time(rtc_time_t* time);
+
+// Seconds since 1970-01-01 00:00:00 (the RTC is assumed to run in UTC)
+uint32_t rtc_time_to_unix(const rtc_time_t* time);
+void rtc_unix_to_time(uint32_t seconds, rtc_time_t* time);
+uint32_t rtc_get_unix_time(void);
+
+// Register the RTC as a (1 Hz) clock source
+void rtc_init(void);
+
+#endif // RTC_H
@@ -1,23 +1,47 @@
 #include <stddef.h>
 #include "scheduler.h"
 #include "isr.h"
+#include "vmm.h"
+#include "memcg.h"
+#include "bitmap.h"
+#include "klib.h"
+#include "mm.h"
+#include "tunable.h"
+#include "ktime.h"
 
-// Task management
-static task_t tasks[MAX_TASKS];
-static task_t* task_queue_head = NULL;
-static task_t* task_queue_tail = NULL;
+// Task management; the table and stacks are sized by tunables at init
+static task_t* tasks = NULL;
+static uint8_t* task_stacks = NULL;
 task_t* current_task = NULL;
-uint32_t next_task_id = 1;
-static uint32_t system_ticks = 0;
+
+// Ready queue and tick count, written on every timer tick. This is the
+// per-CPU part of the scheduler, so it gets a cache line of its own.
+static struct run_queue {
+    task_t* head;
+    task_t* tail;
+    uint32_t ticks;
+} __cacheline_aligned run_queue;
+
+// Free task slots, and task IDs handed out next-fit so a dead task's ID is
+// not reused until the rest have gone round
+static bitmap_t task_slots;
+static uint32_t* task_slot_bits = NULL;
+static bitmap_t task_ids;
+static uint32_t task_id_bits[BITMAP_STORAGE_WORDS(TASK_ID_MAX)];
 
 // External functions
 extern void terminal_writestring(const char* data);
 extern void terminal_setcolor(uint8_t color);
 extern void terminal_putchar(char c);
+extern void terminal_write_dec(uint32_t value);
 
 // Helper functions
 static void task_queue_add(task_t* task);
 static task_t* task_queue_remove_next(void);
+static void task_queue_remove(task_t* task);
+static task_t* task_alloc(void);
+static void task_release(task_t* task);
+static void task_reap(task_t* task);
 static void switch_to_task(task_t* task);
 
 // VGA colors
@@ -31,18 +55,99 @@ static inline uint8_t vga_entry_color(uint8_t fg, uint8_t bg) {
     return fg | bg << 4;
 }
 
+// Tunables
+TUNABLE_VAR(sched_max_tasks, MAX_TASKS);
+TUNABLE_VAR(sched_stack_size, TASK_STACK_SIZE);
+TUNABLE_VAR(sched_time_slice, TASK_TIME_SLICE);
+TUNABLE_VAR(sched_start_delay, SCHED_START_DELAY);
+
+STATIC_ASSERT(TASK_STACK_SIZE % 16 == 0, "CONFIG_SCHED_STACK_SIZE: stack tops must stay 16-byte aligned");
+
+#if CONFIG_TUNABLES
+// A new slice length also applies to existing tasks from their next turn
+static int sched_apply_time_slice(uint32_t value) {
+    for (int i = 0; i < task_table_size(); i++) {
+        tasks[i].time_slice = value;
+    }
+    return 0;
+}
+
+static tunable_t sched_tunables[] = {
+    {
+        .name = "sched.max_tasks",
+        .description = "Task table slots",
+        .type = TUNABLE_U32,
+        .flags = TUNABLE_BOOT,
+        .value = &sched_max_tasks,
+        .min = 2,
+        .max = MAX_TASKS_LIMIT,
+    },
+    {
+        .name = "sched.stack_size",
+        .description = "Kernel stack per task",
+        .type = TUNABLE_SIZE,
+        .flags = TUNABLE_BOOT,
+        .value = &sched_stack_size,
+        .min = TASK_STACK_MIN,
+        .max = TASK_STACK_MAX,
+    },
+    {
+        .name = "sched.time_slice",
+        .description = "Timer ticks per time slice",
+        .type = TUNABLE_U32,
+        .value = &sched_time_slice,
+        .min = 1,
+        .max = 1000,
+        .apply = sched_apply_time_slice,
+    },
+    {
+        .name = "sched.start_delay",
+        .description = "Ticks after boot before time slicing",
+        .type = TUNABLE_U32,
+        .value = &sched_start_delay,
+        .min = 0,
+        .max = 100000,
+    },
+};
+#endif
+
 // Initialize scheduler
 void scheduler_init(void) {
+#if CONFIG_TUNABLES
+    for (size_t i = 0; i < sizeof(sched_tunables) / sizeof(sched_tunables[0]); i++) {
+        tunable_register(&sched_tunables[i]);
+    }
+    sched_stack_size &= ~15u;   // Keep stack tops 16-byte aligned
+#endif
+    
+    // Task table, one block of stacks, and the slot bitmap
+    tasks = kmalloc_aligned(sched_max_tasks * sizeof(task_t), CACHE_LINE_SIZE);
+    task_stacks = kmalloc_aligned(sched_max_tasks * sched_stack_size, 16);
+    task_slot_bits = kcalloc(BITMAP_STORAGE_WORDS(sched_max_tasks), sizeof(uint32_t));
+    if (!tasks || !task_stacks || !task_slot_bits) {
+        kfree_aligned(tasks);
+        kfree_aligned(task_stacks);
+        kfree(task_slot_bits);
+        tasks = NULL;
+        terminal_writestring("Scheduler: no heap for the task table\n");
+        return;
+    }
+    
     // Clear task table
-    for (int i = 0; i < MAX_TASKS; i++) {
+    memset(tasks, 0, sched_max_tasks * sizeof(task_t));
+    for (uint32_t i = 0; i < sched_max_tasks; i++) {
         tasks[i].state = TASK_TERMINATED;
         tasks[i].id = 0;
+        tasks[i].stack = task_stacks + i * sched_stack_size;
     }
+    bitmap_init(&task_slots, task_slot_bits, sched_max_tasks);
+    bitmap_init(&task_ids, task_id_bits, TASK_ID_MAX);
+    bitmap_set(&task_ids, 0);   // 0 means "no task"
     
-    task_queue_head = NULL;
-    task_queue_tail = NULL;
+    run_queue.head = NULL;
+    run_queue.tail = NULL;
     current_task = NULL;
-    system_ticks = 0;
+    run_queue.ticks = 0;
     
     terminal_writestring("Scheduler initialized\n");
     
@@ -53,33 +158,28 @@ void scheduler_init(void) {
 
 // Create a new task
 uint32_t task_create(const char* name, void (*entry_point)(void)) {
-    // Find free task slot
-    task_t* task = NULL;
-    for (int i = 0; i < MAX_TASKS; i++) {
-        if (tasks[i].state == TASK_TERMINATED) {
-            task = &tasks[i];
-            break;
-        }
-    }
-    
+    task_t* task = task_alloc();
     if (!task) {
         return 0; // No free slots
     }
     
     // Initialize task
-    task->id = next_task_id++;
-    for (int i = 0; i < 32 && name[i]; i++) {
-        task->name[i] = name[i];
-    }
-    task->name[31] = '\0';
+    strlcpy(task->name, name, sizeof(task->name));
     
     task->state = TASK_READY;
-    task->time_slice = 10; // 10 timer ticks
+    task->time_slice = sched_time_slice;
     task->time_remaining = task->time_slice;
     task->sleep_until = 0;
+    task->mm = NULL;
+    
+    // Charged to the creator's group
+    task->memcg = memcg_current();
+    task->heap_bytes = 0;
+    task->mem_peak = 0;
+    task->killed = 0;
     
     // Set up stack (grows downward)
-    task->esp = (uint32_t)(task->stack + TASK_STACK_SIZE - 4);
+    task->esp = (uint32_t)(task->stack + sched_stack_size - 4);
     task->ebp = task->esp;
     task->eip = (uint32_t)entry_point;
     task->eflags = 0x202; // Enable interrupts
@@ -95,55 +195,201 @@ uint32_t task_create(const char* name, void (*entry_point)(void)) {
     return task->id;
 }
 
+// Duplicate a task (NULL for the current one); its address space is shared copy-on-write
+uint32_t task_fork(task_t* parent) {
+    if (!parent) {
+        parent = current_task;
+    }
+    if (!parent) {
+        return 0;
+    }
+    
+    task_t* task = task_alloc();
+    if (!task) {
+        return 0; // No free slots
+    }
+    
+    struct address_space* mm = NULL;
+    if (parent->mm) {
+        mm = vmm_clone(parent->mm, 1);
+        if (!mm) {
+            task_release(task);
+            return 0; // Out of frames for page tables
+        }
+    }
+    
+    // Registers and kernel stack are copied; stack pointers move with the stack
+    uint32_t id = task->id;
+    uint8_t* stack = task->stack;
+    *task = *parent;
+    task->stack = stack;
+    memcpy(task->stack, parent->stack, sched_stack_size);
+    int32_t stack_delta = (int32_t)(task->stack - parent->stack);
+    task->esp += stack_delta;
+    task->ebp += stack_delta;
+    
+    task->id = id;
+    task->mm = mm;
+    task->state = TASK_READY;
+    task->time_remaining = task->time_slice;
+    
+    // The child stays in the parent's group but starts its own counts
+    task->heap_bytes = 0;
+    task->mem_peak = mm ? mm->resident_pages * PAGE_SIZE : 0;
+    task->killed = 0;
+    
+    task_queue_add(task);
+    
+    return task->id;
+}
+
 // Add task to ready queue
 static void task_queue_add(task_t* task) {
     task->next = NULL;
     
-    if (task_queue_tail) {
-        task_queue_tail->next = task;
-        task_queue_tail = task;
+    if (run_queue.tail) {
+        run_queue.tail->next = task;
+        run_queue.tail = task;
     } else {
-        task_queue_head = task;
-        task_queue_tail = task;
+        run_queue.head = task;
+        run_queue.tail = task;
     }
 }
 
 // Remove next task from ready queue
 static task_t* task_queue_remove_next(void) {
-    if (!task_queue_head) {
+    if (!run_queue.head) {
         return NULL;
     }
     
-    task_t* task = task_queue_head;
-    task_queue_head = task->next;
+    task_t* task = run_queue.head;
+    run_queue.head = task->next;
     
-    if (!task_queue_head) {
-        task_queue_tail = NULL;
+    if (!run_queue.head) {
+        run_queue.tail = NULL;
     }
     
     task->next = NULL;
     return task;
 }
 
+// Take a task off the ready queue wherever it is
+static void task_queue_remove(task_t* task) {
+    task_t* prev = NULL;
+    for (task_t* t = run_queue.head; t; prev = t, t = t->next) {
+        if (t != task) {
+            continue;
+        }
+        if (prev) {
+            prev->next = t->next;
+        } else {
+            run_queue.head = t->next;
+        }
+        if (run_queue.tail == t) {
+            run_queue.tail = prev;
+        }
+        t->next = NULL;
+        return;
+    }
+}
+
+// Take a free slot and a fresh ID
+static task_t* task_alloc(void) {
+    int32_t slot = bitmap_alloc_from(&task_slots, 0);
+    if (slot < 0) {
+        return NULL;
+    }
+    int32_t id = bitmap_alloc(&task_ids);
+    if (id < 0) {
+        bitmap_clear(&task_slots, (uint32_t)slot);
+        return NULL;
+    }
+    tasks[slot].id = (uint32_t)id;
+    return &tasks[slot];
+}
+
+static void task_release(task_t* task) {
+    task->state = TASK_TERMINATED;
+    bitmap_clear(&task_ids, task->id);
+    bitmap_clear(&task_slots, (uint32_t)(task - tasks));
+}
+
+// Release a task that is not running
+static void task_reap(task_t* task) {
+    vmm_destroy(task->mm);
+    task->mm = NULL;
+    task->killed = 0;
+    task_release(task);
+}
+
+// Zero until scheduler_init has allocated the table
+int task_table_size(void) {
+    return tasks ? (int)sched_max_tasks : 0;
+}
+
+task_t* task_get(int slot) {
+    if (slot < 0 || slot >= task_table_size() || tasks[slot].state == TASK_TERMINATED) {
+        return NULL;
+    }
+    return &tasks[slot];
+}
+
+task_t* task_find(uint32_t id) {
+    for (int i = 0; i < task_table_size(); i++) {
+        if (tasks[i].state != TASK_TERMINATED && tasks[i].id == id) {
+            return &tasks[i];
+        }
+    }
+    return NULL;
+}
+
+const char* task_state_name(task_state_t state) {
+    switch (state) {
+        case TASK_READY:    return "READY";
+        case TASK_RUNNING:  return "RUNNING";
+        case TASK_SLEEPING: return "SLEEPING";
+        default:            return "DEAD";
+    }
+}
+
+void task_kill(task_t* task) {
+    if (!task || task->state == TASK_TERMINATED) {
+        return;
+    }
+    if (task == current_task) {
+        task->killed = 1;
+        return;
+    }
+    task_queue_remove(task);
+    task_reap(task);
+}
+
 // Timer interrupt handler for scheduling
 void scheduler_tick(struct registers* r) {
     (void)r; // Suppress unused parameter warning
-    system_ticks++;
+    run_queue.ticks++;
+    ktime_tick();
+    
+    // A task the OOM policy picked while it was running goes now
+    if (current_task && current_task->killed) {
+        task_exit();
+        return;
+    }
     
     // For now, just increment ticks - don't do complex scheduling
     // until we're sure the basic interrupt system is stable
     
     // Wake up sleeping tasks
-    for (int i = 0; i < MAX_TASKS; i++) {
+    for (int i = 0; i < task_table_size(); i++) {
         if (tasks[i].state == TASK_SLEEPING && 
-            tasks[i].sleep_until <= system_ticks) {
+            tasks[i].sleep_until <= run_queue.ticks) {
             tasks[i].state = TASK_READY;
             task_queue_add(&tasks[i]);
         }
     }
     
     // Only do scheduling if we have tasks and system is stable
-    if (current_task && system_ticks > 100) { // Wait 100 ticks before scheduling
+    if (current_task && run_queue.ticks > sched_start_delay) { // Let the system settle first
         current_task->time_remaining--;
         
         // Time slice expired?
@@ -156,6 +402,10 @@ void scheduler_tick(struct registers* r) {
 // Perform task switch
 void schedule(void) {
     task_t* next_task = task_queue_remove_next();
+    while (next_task && next_task->killed) {
+        task_reap(next_task);
+        next_task = task_queue_remove_next();
+    }
     
     if (!next_task) {
         return; // No tasks to run
@@ -183,6 +433,7 @@ static void switch_to_task(task_t* task) {
     }
     
     current_task = task;
+    vmm_activate(task->mm);
     
     // For now, simulate task switching without actual assembly
     // In a real implementation, this would switch CPU state
@@ -201,7 +452,7 @@ void task_yield(void) {
 void task_sleep(uint32_t ticks) {
     if (current_task) {
         current_task->state = TASK_SLEEPING;
-        current_task->sleep_until = system_ticks + ticks;
+        current_task->sleep_until = run_queue.ticks + ticks;
         schedule();
     }
 }
@@ -209,12 +460,140 @@ void task_sleep(uint32_t ticks) {
 // Terminate current task
 void task_exit(void) {
     if (current_task) {
-        current_task->state = TASK_TERMINATED;
+        task_t* task = current_task;
         current_task = NULL;
+        task_reap(task);
         schedule();
     }
 }
 
+// The task control block as it was before the hot/cold split: the name
+// ahead of the scheduling fields and the stack inline between them
+typedef struct legacy_task {
+    uint32_t id;
+    char name[32];
+    uint32_t state;
+    uint32_t esp, ebp, ebx, esi, edi, eflags, eip;
+    uint8_t stack[TASK_STACK_SIZE];
+    uint32_t time_slice;
+    uint32_t time_remaining;
+    uint32_t sleep_until;
+    struct address_space* mm;
+    struct mem_group* memcg;
+    uint32_t heap_bytes;
+    uint32_t mem_peak;
+    uint8_t killed;
+    struct legacy_task* next;
+} legacy_task_t;
+
+#define SCHED_BENCH_ROUNDS  256
+#define SCHED_BENCH_EVICT   (128 * 1024)    // Touched between scans
+
+// Lines and pages one sleeper scan reads per task, from the field offsets
+static void sched_bench_footprint(size_t state_off, size_t sleep_off, size_t stride,
+                                  uint32_t count, uint32_t* lines, uint32_t* pages) {
+    *lines = 0;
+    *pages = 0;
+    uint32_t last_line = 0xFFFFFFFF;
+    uint32_t last_page = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t offs[2] = { i * stride + state_off, i * stride + sleep_off };
+        for (int f = 0; f < 2; f++) {
+            uint32_t line = offs[f] / CACHE_LINE_SIZE;
+            uint32_t page = offs[f] / PAGE_SIZE;
+            *lines += line != last_line;
+            *pages += page != last_page;
+            last_line = line;
+            last_page = page;
+        }
+    }
+}
+
+static void sched_bench_evict(volatile uint8_t* buffer) {
+    for (uint32_t i = 0; i < SCHED_BENCH_EVICT; i += CACHE_LINE_SIZE) {
+        buffer[i]++;
+    }
+}
+
+static void sched_bench_report(const char* label, uint32_t ns, uint32_t lines,
+                               uint32_t pages) {
+    terminal_writestring(label);
+    terminal_write_dec(ns);
+    terminal_writestring(" ns/scan, ");
+    terminal_write_dec(lines);
+    terminal_writestring(" lines, ");
+    terminal_write_dec(pages);
+    terminal_writestring(" pages\n");
+}
+
+// The timer tick's sleeper scan over 'count' tasks, old layout against the
+// current one, each scan starting with the table pushed out of the cache
+void scheduler_benchmark(uint32_t count) {
+    legacy_task_t* legacy = kmalloc(count * sizeof(legacy_task_t));
+    task_t* split = kmalloc_aligned(count * sizeof(task_t), CACHE_LINE_SIZE);
+    uint8_t* evict = kmalloc(SCHED_BENCH_EVICT);
+    if (!legacy || !split || !evict) {
+        terminal_writestring("Out of memory\n");
+        kfree(legacy);
+        kfree_aligned(split);
+        kfree(evict);
+        return;
+    }
+    
+    // Everyone asleep for good, so the scans only read
+    for (uint32_t i = 0; i < count; i++) {
+        legacy[i].state = TASK_SLEEPING;
+        legacy[i].sleep_until = 0xFFFFFFFF;
+        split[i].state = TASK_SLEEPING;
+        split[i].sleep_until = 0xFFFFFFFF;
+    }
+    
+    uint32_t now = run_queue.ticks;
+    uint32_t woken = 0;
+    uint64_t legacy_ns = 0;
+    uint64_t split_ns = 0;
+    for (int round = 0; round < SCHED_BENCH_ROUNDS; round++) {
+        sched_bench_evict(evict);
+        uint64_t start = ktime_get_ns();
+        for (uint32_t i = 0; i < count; i++) {
+            woken += legacy[i].state == TASK_SLEEPING && legacy[i].sleep_until <= now;
+        }
+        legacy_ns += ktime_get_ns() - start;
+        
+        sched_bench_evict(evict);
+        start = ktime_get_ns();
+        for (uint32_t i = 0; i < count; i++) {
+            woken += split[i].state == TASK_SLEEPING && split[i].sleep_until <= now;
+        }
+        split_ns += ktime_get_ns() - start;
+    }
+    
+    uint32_t legacy_lines, legacy_pages, split_lines, split_pages;
+    sched_bench_footprint(offsetof(legacy_task_t, state), offsetof(legacy_task_t, sleep_until),
+                          sizeof(legacy_task_t), count, &legacy_lines, &legacy_pages);
+    sched_bench_footprint(offsetof(task_t, state), offsetof(task_t, sleep_until),
+                          sizeof(task_t), count, &split_lines, &split_pages);
+    
+    terminal_writestring("Sleeper scan over ");
+    terminal_write_dec(count);
+    terminal_writestring(" tasks (");
+    terminal_write_dec(sizeof(legacy_task_t));
+    terminal_writestring(" -> ");
+    terminal_write_dec(sizeof(task_t));
+    terminal_writestring(" bytes each)\n");
+    sched_bench_report("  inline stack:    ", (uint32_t)(legacy_ns / SCHED_BENCH_ROUNDS),
+                       legacy_lines, legacy_pages);
+    sched_bench_report("  hot/cold split:  ", (uint32_t)(split_ns / SCHED_BENCH_ROUNDS),
+                       split_lines, split_pages);
+    if (woken) {
+        terminal_writestring("  (scan mismatch)\n");
+    }
+    
+    kfree(legacy);
+    kfree_aligned(split);
+    kfree(evict);
+}
+
 // Demo task: Idle task (runs when nothing else is scheduled)
 void task_idle(void) {
     while (1) {
@@ -3,9 +3,18 @@
 
 #include <stdint.h>
 #include "isr.h"
+#include "cache.h"
+#include "config.h"
 
-#define MAX_TASKS 8
-#define TASK_STACK_SIZE 4096
+// Defaults (from Kconfig) and limits for the sched.* tunables (scheduler.c)
+#define MAX_TASKS CONFIG_SCHED_MAX_TASKS                // Task table slots
+#define MAX_TASKS_LIMIT 256
+#define TASK_ID_MAX 4096        // IDs fit the 16-bit heap block owner
+#define TASK_STACK_SIZE CONFIG_SCHED_STACK_SIZE         // Per-task kernel stack, from the heap
+#define TASK_STACK_MIN 1024
+#define TASK_STACK_MAX 0x10000
+#define TASK_TIME_SLICE CONFIG_SCHED_TIME_SLICE         // Timer ticks
+#define SCHED_START_DELAY CONFIG_SCHED_START_DELAY      // Ticks after boot before time slicing starts
 
 // Task states
 typedef enum {
@@ -15,11 +24,22 @@ typedef enum {
     TASK_TERMINATED
 } task_state_t;
 
-// Task control block
+// Task control block. The first cache line holds everything the timer
+// tick, the run queue and a context switch touch; the tick scans the whole
+// table, so each task costs it one line. Names, stacks and accounting
+// follow in the second line.
 typedef struct task {
+    // Hot: scheduling
     uint32_t id;
-    char name[32];
-    task_state_t state;
+    uint8_t state;          // task_state_t
+    uint8_t killed;         // Chosen by the OOM policy; reaped when next scheduled
+    uint32_t time_slice;
+    uint32_t time_remaining;
+    uint32_t sleep_until;
+    struct task* next;      // For task queue
+    
+    // Address space (NULL for kernel-only tasks)
+    struct address_space* mm;
     
     // CPU state
     uint32_t esp;           // Stack pointer
@@ -28,32 +48,48 @@ typedef struct task {
     uint32_t eflags;        // Flags register
     uint32_t eip;           // Instruction pointer
     
-    // Stack
-    uint8_t stack[TASK_STACK_SIZE];
+    // Cold, from the second line on
+    uint8_t* stack __cacheline_aligned;     // sched.stack_size bytes
     
-    // Scheduling info
-    uint32_t time_slice;
-    uint32_t time_remaining;
-    uint32_t sleep_until;
+    // Memory accounting (memcg.c)
+    struct mem_group* memcg;
+    uint32_t heap_bytes;    // Heap charged while this task was running
+    uint32_t mem_peak;      // Highest heap + resident usage in bytes
     
-    struct task* next;      // For task queue
-} task_t;
+    char name[32];
+} __cacheline_aligned task_t;
+
+STATIC_ASSERT(IN_FIRST_CACHE_LINE(task_t, eip), "task_t: hot fields outgrew a cache line");
+STATIC_ASSERT(offsetof(task_t, stack) >= CACHE_LINE_SIZE, "task_t: cold fields in the hot line");
+STATIC_ASSERT(sizeof(task_t) == 2 * CACHE_LINE_SIZE, "task_t: table entries are two lines");
 
 // Scheduler functions
 void scheduler_init(void);
 uint32_t task_create(const char* name, void (*entry_point)(void));
+uint32_t task_fork(task_t* parent);
 void task_yield(void);
 void task_sleep(uint32_t ticks);
 void task_exit(void);
 void scheduler_tick(struct registers* r);
 void schedule(void);
 
+// Task table access
+int task_table_size(void);
+task_t* task_get(int slot);
+task_t* task_find(uint32_t id);
+const char* task_state_name(task_state_t state);
+
+// Terminate another task now, or mark the current one to exit on its next tick
+void task_kill(task_t* task);
+
+// Compare the sleeper scan over the old and current task_t layouts
+void scheduler_benchmark(uint32_t count);
+
 // Task switching (implemented in assembly)
 extern void task_switch(uint32_t* old_esp, uint32_t new_esp);
 
 // Current task info
 extern task_t* current_task;
-extern uint32_t next_task_id;
 
 // Demo tasks
 void task_idle(void);
@@ -2,6 +2,29 @@
 #include "isr.h"
 #include "mm.h"
 #include "fs.h"
+#include "pci.h"
+#include "blkdev.h"
+#include "dma.h"
+#include "ktime.h"
+#include "rtc.h"
+#include "net.h"
+#include "socket.h"
+#include "ether.h"
+#include "e1000.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "ksm.h"
+#include "reclaim.h"
+#include "swap.h"
+#include "pagecache.h"
+#include "memcg.h"
+#include "kmem.h"
+#include "hashtable.h"
+#include "bitmap.h"
+#include "klib.h"
+#include "tunable.h"
+#include "gen_tables.h"
+#include "boottime.h"
 
 // External terminal functions from kernel.c
 extern void terminal_putchar(char c);
@@ -31,30 +54,6 @@ extern size_t terminal_column;
 static shell_state_t shell_state;
 static uint8_t keyboard_state = 0;
 
-// Scan code to ASCII conversion table (US QWERTY)
-static char scancode_ascii[] = {
-    0,    0,   '1', '2', '3', '4', '5', '6',  // 0x00-0x07
-    '7', '8', '9', '0', '-', '=',  0,   0,    // 0x08-0x0F
-    'q', 'w', 'e', 'r', 't', 'y', 'u', 'i',  // 0x10-0x17
-    'o', 'p', '[', ']',  0,   0,  'a', 's',  // 0x18-0x1F
-    'd', 'f', 'g', 'h', 'j', 'k', 'l', ';',  // 0x20-0x27
-    '\'', '`',  0, '\\', 'z', 'x', 'c', 'v',  // 0x28-0x2F
-    'b', 'n', 'm', ',', '.', '/',  0,  '*',  // 0x30-0x37
-    0,   ' '                                  // 0x38-0x39
-};
-
-// Shifted scan code to ASCII conversion table
-static char scancode_ascii_shift[] = {
-    0,    0,   '!', '@', '#', '$', '%', '^',  // 0x00-0x07
-    '&', '*', '(', ')', '_', '+',  0,   0,    // 0x08-0x0F
-    'Q', 'W', 'E', 'R', 'T', 'Y', 'U', 'I',  // 0x10-0x17
-    'O', 'P', '{', '}',  0,   0,  'A', 'S',  // 0x18-0x1F
-    'D', 'F', 'G', 'H', 'J', 'K', 'L', ':',  // 0x20-0x27
-    '"', '~',  0,  '|', 'Z', 'X', 'C', 'V',  // 0x28-0x2F
-    'B', 'N', 'M', '<', '>', '?',  0,  '*',  // 0x30-0x37
-    0,   ' '                                  // 0x38-0x39
-};
-
 // Built-in commands table
 static shell_command_t commands[] = {
     {"help",    "Show available commands",           cmd_help},
@@ -64,15 +63,59 @@ static shell_command_t commands[] = {
     {"clear",   "Clear the screen",                  cmd_clear},
     {"memtest", "Run memory allocation test",        cmd_memtest},
     {"version", "Show system version",               cmd_version},
-    {"uptime",  "Show system uptime (placeholder)", cmd_uptime},
+    {"uptime",  "Show system uptime",                cmd_uptime},
     {"tasks",   "Show running tasks",                cmd_tasks},
     {"starttasks", "Start demo multitasking tasks",     cmd_starttasks},
     {"enableints", "Enable interrupts",                 cmd_enableints},
     {"ls",      "List files in file system",        cmd_ls},
     {"cat",     "Display file contents",             cmd_cat},
+    {"lspci",   "List PCI devices and drivers",      cmd_lspci},
+    {"lsblk",   "List block devices",                cmd_lsblk},
+    {"diskbench", "Benchmark block devices [dev] [n]", cmd_diskbench},
+    {"date",    "Show wall-clock time (UTC)",        cmd_date},
+    {"clocksource", "List clock sources",             cmd_clocksource},
+    {"netstat", "Show interfaces and sockets",       cmd_netstat},
+    {"ifconfig", "Show or set interface addresses",  cmd_ifconfig},
+    {"netbench", "Benchmark TCP/UDP [ip|server] [kb]", cmd_netbench},
+    {"forktest", "Benchmark copy-on-write fork [pages]", cmd_forktest},
+    {"vmtest", "Reserve memory and fault it in on demand [MB]", cmd_vmtest},
+    {"hugebench", "Compare 4KB and 4MB pages for user memory [MB]", cmd_hugebench},
+    {"ksmtest", "Merge identical pages across spaces [spaces] [pages]", cmd_ksmtest},
+    {"swapon",  "Swap to a disk <dev> [sector] [pages]", cmd_swapon},
+    {"swaptest", "Touch more pages than RAM [pages]",  cmd_swaptest},
+    {"pcache",  "Page cache stats, or test <dev> [pages]", cmd_pcache},
+    {"memcg",   "Memory groups: create|limit|move|oomtest", cmd_memcg},
+    {"hashbench", "Benchmark the hash table [keys]",  cmd_hashbench},
+    {"bitbench", "Benchmark the bitmap allocator [bits]", cmd_bitbench},
+    {"strbench", "Benchmark the string routines [len]", cmd_strbench},
+    {"kmembench", "Benchmark the magazine caches [objects]", cmd_kmembench},
+    {"bench",   "Run the benchmark suite",           cmd_bench},
+#if CONFIG_TUNABLES
+    {"sysctl",  "Show or set tunables [name[=value]]", cmd_sysctl},
+#endif
+    {"cachebench", "Benchmark cache-aware layouts [tasks]", cmd_cachebench},
+    {"boottime", "Show load, decompression and init times", cmd_boottime},
     {NULL, NULL, NULL} // End marker
 };
 
+// Name lookup; nodes sit beside the command table, one per entry
+#define SHELL_NUM_COMMANDS (sizeof(commands) / sizeof(commands[0]) - 1)
+static hash_node_t command_nodes[SHELL_NUM_COMMANDS];
+static hash_table_t command_table;
+
+static uint32_t shell_command_hash(const void* key) {
+    return hash_fnv1a_str((const char*)key);
+}
+
+static int shell_command_match(const hash_node_t* node, const void* key) {
+    return strcmp(commands[node - command_nodes].name, (const char*)key) == 0;
+}
+
+static const hash_table_ops_t shell_command_ops = {
+    .hash = shell_command_hash,
+    .match = shell_command_match,
+};
+
 // Port I/O functions
 static inline uint8_t inb(uint16_t port) {
     uint8_t result;
@@ -85,30 +128,13 @@ static inline void outb(uint16_t port, uint8_t data) {
 }
 
 // Utility functions
-int shell_strlen(const char* str) {
-    int len = 0;
-    while (str[len]) len++;
-    return len;
-}
-
-void shell_strcpy(char* dest, const char* src) {
-    while ((*dest++ = *src++));
-}
-
-int shell_strcmp(const char* str1, const char* str2) {
-    while (*str1 && (*str1 == *str2)) {
-        str1++;
-        str2++;
-    }
-    return *(unsigned char*)str1 - *(unsigned char*)str2;
-}
-
-char* shell_strchr(const char* str, int c) {
-    while (*str) {
-        if (*str == c) return (char*)str;
+uint32_t shell_atoi(const char* str) {
+    uint32_t value = 0;
+    while (*str >= '0' && *str <= '9') {
+        value = value * 10 + (*str - '0');
         str++;
     }
-    return NULL;
+    return value;
 }
 
 // Initialize shell
@@ -121,6 +147,12 @@ void shell_init(void) {
     
     keyboard_init();
     
+    if (hash_table_init(&command_table, &shell_command_ops, SHELL_NUM_COMMANDS) == 0) {
+        for (size_t i = 0; i < SHELL_NUM_COMMANDS; i++) {
+            hash_table_insert(&command_table, &command_nodes[i], commands[i].name);
+        }
+    }
+    
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
     terminal_writestring("\n=== MiniCore-OS Shell Active ===\n");
     terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
@@ -143,16 +175,12 @@ uint8_t keyboard_read_scancode(void) {
 }
 
 // Convert scan code to ASCII
+// The tables come from genconfig.py, for the layout chosen in Kconfig
 char scancode_to_ascii(uint8_t scancode, uint8_t shift) {
-    if (scancode >= sizeof(scancode_ascii)) {
+    if (scancode >= KEYMAP_SIZE) {
         return 0;
     }
-    
-    if (shift && scancode < sizeof(scancode_ascii_shift)) {
-        return scancode_ascii_shift[scancode];
-    }
-    
-    return scancode_ascii[scancode];
+    return shift ? keymap_shift[scancode] : keymap_normal[scancode];
 }
 
 // Keyboard interrupt handler (called by IRQ1)
@@ -284,8 +312,14 @@ int shell_parse_command(char* input, char* argv[], int max_args) {
 
 // Find command in command table
 int shell_find_command(const char* name) {
+    if (command_table.buckets) {
+        hash_node_t* node = hash_table_lookup(&command_table, name);
+        return node ? (int)(node - command_nodes) : -1;
+    }
+    
+    // No heap for the table: scan
     for (int i = 0; commands[i].name != NULL; i++) {
-        if (shell_strcmp(name, commands[i].name) == 0) {
+        if (strcmp(name, commands[i].name) == 0) {
             return i;
         }
     }
@@ -298,23 +332,32 @@ void shell_execute_command(void) {
         return; // Empty command
     }
     
+    shell_run_line(shell_state.input_buffer);
+}
+
+// Run one command line as if typed; returns the handler's result
+int shell_run_line(const char* line) {
+    char buffer[SHELL_BUFFER_SIZE];
+    strlcpy(buffer, line, sizeof(buffer));
+    
     char* argv[SHELL_MAX_ARGS];
-    int argc = shell_parse_command(shell_state.input_buffer, argv, SHELL_MAX_ARGS);
+    int argc = shell_parse_command(buffer, argv, SHELL_MAX_ARGS);
     
     if (argc == 0) {
-        return;
+        return 0;
     }
     
     int cmd_index = shell_find_command(argv[0]);
     if (cmd_index >= 0) {
-        commands[cmd_index].handler(argc, argv);
-    } else {
-        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
-        terminal_writestring("Unknown command: ");
-        terminal_writestring(argv[0]);
-        terminal_writestring("\nType 'help' for available commands.\n");
-        terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+        return commands[cmd_index].handler(argc, argv);
     }
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+    terminal_writestring("Unknown command: ");
+    terminal_writestring(argv[0]);
+    terminal_writestring("\nType 'help' for available commands.\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    return -1;
 }
 
 // Main shell loop
@@ -327,6 +370,18 @@ void shell_run(void) {
         // Poll keyboard for input
         keyboard_handler();
         
+        // Answer ARP and finish TCP shutdowns while idle
+        net_poll();
+        
+        // Background reclaim keeps free memory above the low watermarks
+        reclaim_poll();
+        
+        // Collapse filled-in 4KB page tables into 4MB pages
+        vmm_huge_poll();
+        
+        // Merge identical user pages a few at a time
+        ksm_poll();
+        
         // Small delay to prevent excessive CPU usage
         for (volatile int i = 0; i < 1000; i++);
     }
@@ -362,14 +417,34 @@ int cmd_echo(int argc, char* argv[]) {
 
 int cmd_mem(int argc, char* argv[]) {
     if (argc > 1) {
-        if (shell_strcmp(argv[1], "stats") == 0) {
+        if (strcmp(argv[1], "stats") == 0) {
             mm_print_stats();
-        } else if (shell_strcmp(argv[1], "map") == 0) {
+        } else if (strcmp(argv[1], "map") == 0) {
             mm_print_memory_map();
-        } else if (shell_strcmp(argv[1], "debug") == 0) {
+        } else if (strcmp(argv[1], "debug") == 0) {
             mm_debug_heap();
+        } else if (strcmp(argv[1], "dma") == 0) {
+            if (argc > 2 && strcmp(argv[2], "test") == 0) {
+                dma_self_test();
+            } else {
+                dma_print_stats();
+            }
+        } else if (strcmp(argv[1], "frames") == 0) {
+            pmm_print_stats();
+        } else if (strcmp(argv[1], "reclaim") == 0) {
+            reclaim_print_stats();
+        } else if (strcmp(argv[1], "swap") == 0) {
+            swap_print_stats();
+        } else if (strcmp(argv[1], "pcache") == 0) {
+            pcache_print_stats();
+        } else if (strcmp(argv[1], "kmem") == 0) {
+            kmem_print_stats();
+        } else if (strcmp(argv[1], "huge") == 0) {
+            vmm_huge_print_stats();
+        } else if (strcmp(argv[1], "ksm") == 0) {
+            ksm_print_stats();
         } else {
-            terminal_writestring("Usage: mem [stats|map|debug]\n");
+            terminal_writestring("Usage: mem [stats|map|debug|dma [test]|frames|reclaim|swap|pcache|kmem|huge|ksm]\n");
         }
     } else {
         mm_print_stats();
@@ -425,25 +500,101 @@ int cmd_version(int argc, char* argv[]) {
     terminal_writestring("Phase 3: CLI Shell\n");
     terminal_writestring("Built with: GCC, NASM, GRUB\n");
     terminal_writestring("Features: Memory Management, Interactive Shell\n");
+    terminal_writestring("Configuration: " CONFIG_PROFILE " profile\n");
     return 0;
 }
 
+// Print a value with a leading zero below 10
+static void shell_write_2digit(uint32_t value) {
+    if (value < 10) {
+        terminal_putchar('0');
+    }
+    terminal_write_dec(value);
+}
+
 int cmd_uptime(int argc, char* argv[]) {
-    terminal_writestring("Uptime: Since boot (no timer implemented yet)\n");
+    uint64_t ms = ktime_get_ms();
+    uint32_t seconds = (uint32_t)(ms / 1000);
+    
+    terminal_writestring("Uptime: ");
+    terminal_write_dec(seconds / 3600);
+    terminal_putchar(':');
+    shell_write_2digit((seconds / 60) % 60);
+    terminal_putchar(':');
+    shell_write_2digit(seconds % 60);
+    terminal_putchar('.');
+    uint32_t millis = (uint32_t)(ms % 1000);
+    if (millis < 100) {
+        terminal_putchar('0');
+    }
+    shell_write_2digit(millis);
+    terminal_writestring("\n");
+    return 0;
+}
+
+int cmd_date(int argc, char* argv[]) {
+    rtc_time_t time;
+    rtc_unix_to_time(ktime_get_real_seconds(), &time);
+    
+    terminal_write_dec(time.year);
+    terminal_putchar('-');
+    shell_write_2digit(time.month);
+    terminal_putchar('-');
+    shell_write_2digit(time.day);
+    terminal_putchar(' ');
+    shell_write_2digit(time.hour);
+    terminal_putchar(':');
+    shell_write_2digit(time.minute);
+    terminal_putchar(':');
+    shell_write_2digit(time.second);
+    terminal_writestring(" UTC\n");
+    return 0;
+}
+
+int cmd_clocksource(int argc, char* argv[]) {
+    clocksource_print();
     return 0;
 }
 
+// Pad the current line with spaces up to a column
+static void shell_pad_to(size_t column) {
+    while (terminal_column < column) {
+        terminal_putchar(' ');
+    }
+}
+
 int cmd_tasks(int argc, char* argv[]) {
     terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
     terminal_writestring("Task Information:\n");
     terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
-    terminal_writestring("ID  Name        State     \n");
-    terminal_writestring("--- ----------- ----------\n");
-    terminal_writestring("1   idle        READY     \n");
-    terminal_writestring("2   counter     RUNNING   \n");
-    terminal_writestring("3   greeter     SLEEPING  \n");
-    terminal_writestring("\nMultitasking is active with timer-driven scheduling!\n");
-    terminal_writestring("Tasks automatically switch every 10 timer ticks.\n");
+    terminal_writestring("ID  Name        State     Group       Heap KB Pages Peak KB\n");
+    terminal_writestring("--- ----------- --------- ----------- ------- ----- -------\n");
+    
+    int count = 0;
+    for (int i = 0; i < task_table_size(); i++) {
+        task_t* task = task_get(i);
+        if (!task) {
+            continue;
+        }
+        count++;
+        terminal_write_dec(task->id);
+        shell_pad_to(4);
+        terminal_writestring(task->name);
+        shell_pad_to(16);
+        terminal_writestring(task->killed ? "KILLED" : task_state_name(task->state));
+        shell_pad_to(26);
+        terminal_writestring(task->memcg ? task->memcg->name : "kernel");
+        shell_pad_to(38);
+        terminal_write_dec(task->heap_bytes / 1024);
+        shell_pad_to(46);
+        terminal_write_dec(task->mm ? task->mm->resident_pages : 0);
+        shell_pad_to(52);
+        terminal_write_dec(task->mem_peak / 1024);
+        terminal_writestring("\n");
+    }
+    if (count == 0) {
+        terminal_writestring("No tasks (use starttasks)\n");
+    }
     return 0;
 }
 
@@ -539,6 +690,482 @@ int cmd_cat(int argc, char* argv[]) {
     return 0;
 }
 
+int cmd_lspci(int argc, char* argv[]) {
+    pci_print_devices();
+    return 0;
+}
+
+int cmd_lsblk(int argc, char* argv[]) {
+    blkdev_print_devices();
+    return 0;
+}
+
+int cmd_diskbench(int argc, char* argv[]) {
+    uint32_t num_requests = 256;
+    blkdev_t* only = NULL;
+    
+    for (int i = 1; i < argc; i++) {
+        if (argv[i][0] >= '0' && argv[i][0] <= '9') {
+            num_requests = shell_atoi(argv[i]);
+        } else {
+            only = blkdev_find(argv[i]);
+            if (!only) {
+                terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+                terminal_writestring("No such block device: ");
+                terminal_writestring(argv[i]);
+                terminal_writestring("\n");
+                terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+                return -1;
+            }
+        }
+    }
+    
+    if (blkdev_count() == 0) {
+        terminal_writestring("No block devices found.\n");
+        return -1;
+    }
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Disk Benchmark ===\n");
+    if (clocksource_current()) {
+        terminal_writestring("Timed with ");
+        terminal_writestring(clocksource_current()->name);
+        terminal_writestring("\n");
+    }
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    
+    for (int i = 0; i < blkdev_count(); i++) {
+        blkdev_t* dev = blkdev_get(i);
+        if (!only || dev == only) {
+            blkdev_benchmark(dev, num_requests);
+        }
+    }
+    return 0;
+}
+
+int cmd_netstat(int argc, char* argv[]) {
+    net_print_interfaces();
+    e1000_print_stats();
+    terminal_writestring("\n");
+    arp_print_cache();
+    terminal_writestring("\n");
+    socket_print_all();
+    return 0;
+}
+
+int cmd_ifconfig(int argc, char* argv[]) {
+    if (argc < 2) {
+        net_print_interfaces();
+        return 0;
+    }
+    
+    netif_t* netif = netif_find(argv[1]);
+    uint32_t ip = 0;
+    uint32_t netmask = IP_ADDR(255, 255, 255, 0);
+    if (!netif || argc < 3 || net_parse_ip(argv[2], &ip) != 0 ||
+        (argc > 3 && net_parse_ip(argv[3], &netmask) != 0)) {
+        terminal_writestring("Usage: ifconfig [<interface> <ip> [netmask]]\n");
+        return -1;
+    }
+    if (netif->flags & NETIF_F_LOOPBACK) {
+        terminal_writestring("The loopback address cannot be changed.\n");
+        return -1;
+    }
+    
+    netif->ip = ip;
+    netif->netmask = netmask;
+    return 0;
+}
+
+int cmd_netbench(int argc, char* argv[]) {
+    uint32_t ip = IP_LOOPBACK;
+    uint32_t total_kb = 1024;
+    int arg = 1;
+    
+    if (argc > 1 && strcmp(argv[1], "server") == 0) {
+        socket_bench_server();
+        return 0;
+    }
+    if (argc > arg && net_parse_ip(argv[arg], &ip) == 0) {
+        arg++;
+    }
+    if (argc > arg) {
+        total_kb = shell_atoi(argv[arg]);
+    }
+    if (total_kb == 0) {
+        terminal_writestring("Usage: netbench [ip] [kb] | netbench server\n");
+        return -1;
+    }
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Network Benchmark (");
+    net_print_ip(ip);
+    terminal_writestring(") ===\n");
+    if (clocksource_current()) {
+        terminal_writestring("Timed with ");
+        terminal_writestring(clocksource_current()->name);
+        terminal_writestring("\n");
+    }
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    
+    socket_benchmark(ip, total_kb);
+    net_print_interfaces();
+    e1000_print_stats();
+    return 0;
+}
+
+int cmd_forktest(int argc, char* argv[]) {
+    uint32_t pages = 256;
+    if (argc > 1) {
+        pages = shell_atoi(argv[1]);
+    }
+    if (pages == 0) {
+        terminal_writestring("Usage: forktest [pages]\n");
+        return -1;
+    }
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Fork Benchmark ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    
+    vmm_fork_benchmark(pages);
+    pmm_print_stats();
+    return 0;
+}
+
+int cmd_vmtest(int argc, char* argv[]) {
+    uint32_t mb = argc > 1 ? shell_atoi(argv[1]) : 64;
+    if (mb == 0 || mb > 1024) {
+        terminal_writestring("Usage: vmtest [MB] (1-1024)\n");
+        return -1;
+    }
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Demand Paging Test ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    
+    vmm_vma_test(mb);
+    return 0;
+}
+
+int cmd_hugebench(int argc, char* argv[]) {
+    uint32_t mb = argc > 1 ? shell_atoi(argv[1]) : 16;
+    if (mb < 4 || mb > 64 || (mb & 3)) {
+        terminal_writestring("Usage: hugebench [MB] (4-64, a multiple of 4)\n");
+        return -1;
+    }
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Huge Page Benchmark ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    
+    vmm_huge_benchmark(mb);
+    return 0;
+}
+
+int cmd_ksmtest(int argc, char* argv[]) {
+    uint32_t spaces = argc > 1 ? shell_atoi(argv[1]) : 4;
+    uint32_t pages = argc > 2 ? shell_atoi(argv[2]) : 256;
+    if (spaces < 2 || spaces > 8 || pages == 0 || pages > 1024) {
+        terminal_writestring("Usage: ksmtest [spaces] [pages] (2-8 spaces, 1-1024 pages each)\n");
+        return -1;
+    }
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Same-Page Merging Test ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    
+    ksm_test(spaces, pages);
+    return 0;
+}
+
+int cmd_swapon(int argc, char* argv[]) {
+    if (argc < 2) {
+        swap_print_stats();
+        return 0;
+    }
+    
+    blkdev_t* dev = blkdev_find(argv[1]);
+    if (!dev) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("No such block device: ");
+        terminal_writestring(argv[1]);
+        terminal_writestring("\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+        return -1;
+    }
+    
+    uint32_t start = argc > 2 ? shell_atoi(argv[2]) : 0;
+    uint32_t pages = argc > 3 ? shell_atoi(argv[3]) : 0;
+    if (swap_on(dev, start, pages) != 0) {
+        terminal_writestring("swapon failed (swap already active or bad range)\n");
+        return -1;
+    }
+    
+    swap_print_stats();
+    return 0;
+}
+
+int cmd_swaptest(int argc, char* argv[]) {
+    // Default: half again as many pages as there are frames
+    uint32_t pages = pmm_get_stats().total_frames * 3 / 2;
+    if (argc > 1) {
+        pages = shell_atoi(argv[1]);
+    }
+    if (pages == 0) {
+        terminal_writestring("Usage: swaptest [pages]\n");
+        return -1;
+    }
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Swap Benchmark ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    
+    swap_benchmark(pages);
+    swap_print_stats();
+    return 0;
+}
+
+int cmd_pcache(int argc, char* argv[]) {
+    if (argc < 2) {
+        pcache_print_stats();
+        return 0;
+    }
+    
+    blkdev_t* dev = blkdev_find(argv[1]);
+    if (!dev) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        terminal_writestring("No such block device: ");
+        terminal_writestring(argv[1]);
+        terminal_writestring("\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+        return -1;
+    }
+    uint32_t pages = argc > 2 ? shell_atoi(argv[2]) : 1024;
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Page Cache Benchmark ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    
+    pcache_benchmark(dev, pages);
+    pcache_print_stats();
+    return 0;
+}
+
+int cmd_hashbench(int argc, char* argv[]) {
+    uint32_t keys = argc > 1 ? shell_atoi(argv[1]) : 1000;
+    if (keys == 0 || keys > 8192) {
+        terminal_writestring("Usage: hashbench [keys] (1-8192)\n");
+        return -1;
+    }
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Hash Table Benchmark ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    
+    hash_table_benchmark(keys);
+    hash_table_print_stats(&command_table, "commands");
+    return 0;
+}
+
+int cmd_bitbench(int argc, char* argv[]) {
+    uint32_t bits = argc > 1 ? shell_atoi(argv[1]) : 65536;
+    if (bits == 0 || bits > 262144) {
+        terminal_writestring("Usage: bitbench [bits] (1-262144)\n");
+        return -1;
+    }
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Bitmap Allocator Benchmark ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    
+    bitmap_benchmark(bits);
+    return 0;
+}
+
+int cmd_strbench(int argc, char* argv[]) {
+    uint32_t len = argc > 1 ? shell_atoi(argv[1]) : 1024;
+    if (len > 65536) {
+        terminal_writestring("Usage: strbench [len] (0-65536)\n");
+        return -1;
+    }
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== String Routine Benchmark ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    
+    terminal_writestring(klib_has_sse2() ? "Active: SSE2\n" : "Active: word at a time\n");
+    klib_benchmark(len);
+    return 0;
+}
+
+int cmd_kmembench(int argc, char* argv[]) {
+    uint32_t count = argc > 1 ? shell_atoi(argv[1]) : 256;
+    if (count == 0 || count > 1024) {
+        terminal_writestring("Usage: kmembench [objects] (1-1024)\n");
+        return -1;
+    }
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Magazine Cache Benchmark ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    
+    kmem_benchmark(count);
+    return 0;
+}
+
+int cmd_cachebench(int argc, char* argv[]) {
+    uint32_t count = argc > 1 ? shell_atoi(argv[1]) : 64;
+    if (count == 0 || count > 128) {
+        terminal_writestring("Usage: cachebench [tasks] (1-128)\n");
+        return -1;
+    }
+    
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Cache Layout Benchmark ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    
+    scheduler_benchmark(count);
+    return 0;
+}
+
+int cmd_boottime(int argc, char* argv[]) {
+    boottime_print();
+    return 0;
+}
+
+// Benchmarks that need no devices; also the workload of the PGO training run
+static const char* bench_suite[] = {
+    "forktest 256",
+    "hugebench 8",
+    "hashbench 4096",
+    "bitbench 65536",
+    "strbench 4096",
+    "kmembench 256",
+    "cachebench 64",
+    NULL
+};
+
+int cmd_bench(int argc, char* argv[]) {
+    uint32_t elapsed_us[sizeof(bench_suite) / sizeof(bench_suite[0])];
+    uint32_t total_us = 0;
+    int failed = 0;
+    
+    for (int i = 0; bench_suite[i]; i++) {
+        uint32_t start = (uint32_t)ktime_get_us();
+        failed |= shell_run_line(bench_suite[i]) != 0;
+        elapsed_us[i] = (uint32_t)ktime_get_us() - start;
+        total_us += elapsed_us[i];
+    }
+    
+    // One line per benchmark, in a fixed format the host-side PGO report parses
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Benchmark Summary ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    for (int i = 0; bench_suite[i]; i++) {
+        terminal_writestring("bench: ");
+        terminal_writestring(bench_suite[i]);
+        shell_pad_to(28);
+        terminal_write_dec(elapsed_us[i]);
+        terminal_writestring(" us\n");
+    }
+    terminal_writestring("bench: total");
+    shell_pad_to(28);
+    terminal_write_dec(total_us);
+    terminal_writestring(" us\n");
+    return failed ? -1 : 0;
+}
+
+int cmd_memcg(int argc, char* argv[]) {
+    if (argc < 2) {
+        memcg_print_stats();
+        return 0;
+    }
+    
+    if (strcmp(argv[1], "create") == 0 && argc > 2) {
+        if (!memcg_create(argv[2])) {
+            terminal_writestring("Group exists or table full\n");
+            return -1;
+        }
+    } else if (strcmp(argv[1], "limit") == 0 && argc > 4) {
+        mem_group_t* group = memcg_find(argv[2]);
+        if (!group) {
+            terminal_writestring("No such group\n");
+            return -1;
+        }
+        memcg_set_limits(group, shell_atoi(argv[3]) * 1024, shell_atoi(argv[4]) * 1024);
+    } else if (strcmp(argv[1], "move") == 0 && argc > 3) {
+        task_t* task = task_find(shell_atoi(argv[2]));
+        mem_group_t* group = memcg_find(argv[3]);
+        if (!task || !group) {
+            terminal_writestring("No such task or group\n");
+            return -1;
+        }
+        memcg_attach(task, group);
+    } else if (strcmp(argv[1], "oomtest") == 0) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+        terminal_writestring("=== OOM Test ===\n");
+        terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+        memcg_oom_test(argc > 2 ? shell_atoi(argv[2]) : 512);
+    } else {
+        terminal_writestring("Usage: memcg [create <name> | limit <name> <soft KB> <hard KB> |\n");
+        terminal_writestring("             move <task> <name> | oomtest [limit KB]]\n");
+        return -1;
+    }
+    
+    memcg_print_stats();
+    return 0;
+}
+
+#if CONFIG_TUNABLES
+// sysctl, sysctl <name>, sysctl <name>=<value> or sysctl <name> <value>
+int cmd_sysctl(int argc, char* argv[]) {
+    if (argc < 2) {
+        tunable_print_all();
+        return 0;
+    }
+    
+    char* name = argv[1];
+    char* value = argc > 2 ? argv[2] : NULL;
+    char* equals = strchr(name, '=');
+    if (equals) {
+        *equals = '\0';
+        value = equals + 1;
+    }
+    
+    tunable_t* tunable = tunable_find(name);
+    if (!tunable) {
+        terminal_writestring("No such tunable: ");
+        terminal_writestring(name);
+        terminal_writestring("\n");
+        return -1;
+    }
+    
+    if (value) {
+        int result = tunable_set(tunable, value);
+        if (result != 0) {
+            terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+            if (result == -2) {
+                terminal_writestring("Boot-time tunable; set it on the kernel command line\n");
+            } else if (result == -3) {
+                terminal_writestring("Refused by the subsystem\n");
+            } else {
+                terminal_writestring("Bad value (range ");
+                terminal_write_dec(tunable->min);
+                terminal_writestring(" - ");
+                terminal_write_dec(tunable->max);
+                terminal_writestring(")\n");
+            }
+            terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+            return -1;
+        }
+    }
+    
+    tunable_print(tunable);
+    return 0;
+}
+#endif
+
 // Terminal control functions
 void shell_clear_screen(void) {
     terminal_clear();
@@ -3,10 +3,11 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "config.h"
 
 // Shell constants
-#define SHELL_BUFFER_SIZE 256
-#define SHELL_MAX_ARGS 16
+#define SHELL_BUFFER_SIZE CONFIG_SHELL_BUFFER_SIZE
+#define SHELL_MAX_ARGS CONFIG_SHELL_MAX_ARGS
 #define SHELL_PROMPT "minicore> "
 
 // Command structure
@@ -93,6 +94,7 @@ void shell_run(void);
 void shell_print_prompt(void);
 void shell_process_input(char c);
 void shell_execute_command(void);
+int shell_run_line(const char* line);
 
 // Keyboard handling
 void keyboard_init(void);
@@ -118,14 +120,35 @@ int cmd_starttasks(int argc, char* argv[]);
 int cmd_enableints(int argc, char* argv[]);
 int cmd_ls(int argc, char* argv[]);
 int cmd_cat(int argc, char* argv[]);
+int cmd_lspci(int argc, char* argv[]);
+int cmd_lsblk(int argc, char* argv[]);
+int cmd_diskbench(int argc, char* argv[]);
+int cmd_date(int argc, char* argv[]);
+int cmd_clocksource(int argc, char* argv[]);
+int cmd_netstat(int argc, char* argv[]);
+int cmd_ifconfig(int argc, char* argv[]);
+int cmd_netbench(int argc, char* argv[]);
+int cmd_forktest(int argc, char* argv[]);
+int cmd_vmtest(int argc, char* argv[]);
+int cmd_hugebench(int argc, char* argv[]);
+int cmd_ksmtest(int argc, char* argv[]);
+int cmd_swapon(int argc, char* argv[]);
+int cmd_swaptest(int argc, char* argv[]);
+int cmd_pcache(int argc, char* argv[]);
+int cmd_memcg(int argc, char* argv[]);
+int cmd_hashbench(int argc, char* argv[]);
+int cmd_bitbench(int argc, char* argv[]);
+int cmd_strbench(int argc, char* argv[]);
+int cmd_bench(int argc, char* argv[]);
+int cmd_sysctl(int argc, char* argv[]);
+int cmd_cachebench(int argc, char* argv[]);
+int cmd_boottime(int argc, char* argv[]);
+int cmd_kmembench(int argc, char* argv[]);
 
 // Utility functions
 void shell_clear_buffer(void);
 void shell_backspace(void);
-int shell_strlen(const char* str);
-void shell_strcpy(char* dest, const char* src);
-int shell_strcmp(const char* str1, const char* str2);
-char* shell_strchr(const char* str, int c);
+uint32_t shell_atoi(const char* str);
 
 // Terminal control functions
 void shell_clear_screen(void);
@@ -0,0 +1,727 @@
+#include <stddef.h>
+#include "socket.h"
+#include "net.h"
+#include "tcp.h"
+#include "ktime.h"
+#include "mm.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+extern void terminal_putchar(char c);
+extern void terminal_setcolor(uint8_t color);
+extern uint8_t vga_entry_color(int fg, int bg);
+
+// VGA colors
+#define VGA_COLOR_WHITE 15
+#define VGA_COLOR_LIGHT_RED 12
+
+// Benchmark parameters
+#define SOCKET_BENCH_TCP_PORT       5001
+#define SOCKET_BENCH_UDP_PORT       5002
+#define SOCKET_BENCH_CHUNK          8192
+#define SOCKET_BENCH_PINGS          1000
+#define SOCKET_BENCH_PING_SIZE      64
+#define SOCKET_BENCH_UDP_WAIT_MS    100     // Per datagram before counting it lost
+#define SOCKET_BENCH_UDP_MAX_LOST   16
+#define SOCKET_BENCH_SERVER_WAIT_MS 60000   // For the client to show up
+
+typedef struct socket {
+    int in_use;
+    int type;
+    uint32_t timeout_ms;
+
+    // SOCK_STREAM
+    tcp_pcb_t* pcb;
+
+    // SOCK_DGRAM
+    uint32_t local_ip;
+    uint16_t local_port;
+    netbuf_queue_t rx_queue;
+    uint32_t drops;
+} socket_t;
+
+static socket_t sockets[SOCKET_MAX];
+static uint16_t socket_next_udp_port = TCP_EPHEMERAL_PORT;
+
+static socket_t* socket_get(int sd) {
+    if (sd < 0 || sd >= SOCKET_MAX || !sockets[sd].in_use) {
+        return NULL;
+    }
+    return &sockets[sd];
+}
+
+static uint64_t socket_deadline(socket_t* sock) {
+    return ktime_get_ns() + (uint64_t)sock->timeout_ms * NSEC_PER_MSEC;
+}
+
+// Datagrams for a bound UDP socket wait here until recvfrom
+static void socket_udp_rx(void* ctx, netbuf_t* nb) {
+    socket_t* sock = (socket_t*)ctx;
+    if (sock->rx_queue.count >= SOCKET_UDP_QUEUE) {
+        sock->drops++;
+        netbuf_free(nb);
+        return;
+    }
+    netbuf_queue_push(&sock->rx_queue, nb);
+}
+
+int socket_create(int type) {
+    if (type != SOCK_STREAM && type != SOCK_DGRAM) {
+        return SOCKET_ERROR;
+    }
+
+    for (int sd = 0; sd < SOCKET_MAX; sd++) {
+        socket_t* sock = &sockets[sd];
+        if (sock->in_use) {
+            continue;
+        }
+
+        memset(sock, 0, sizeof(socket_t));
+        if (type == SOCK_STREAM) {
+            sock->pcb = tcp_open();
+            if (!sock->pcb) {
+                return SOCKET_ERROR;
+            }
+        }
+        sock->in_use = 1;
+        sock->type = type;
+        sock->timeout_ms = SOCKET_TIMEOUT_MS;
+        return sd;
+    }
+    return SOCKET_ERROR;
+}
+
+int socket_close(int sd) {
+    socket_t* sock = socket_get(sd);
+    if (!sock) {
+        return SOCKET_ERROR;
+    }
+
+    if (sock->type == SOCK_STREAM) {
+        tcp_close(sock->pcb);       // The stack finishes the shutdown
+        net_flush();
+    } else {
+        if (sock->local_port) {
+            udp_unbind(sock->local_port);
+        }
+        netbuf_queue_purge(&sock->rx_queue);
+    }
+    sock->in_use = 0;
+    return 0;
+}
+
+int socket_set_timeout(int sd, uint32_t timeout_ms) {
+    socket_t* sock = socket_get(sd);
+    if (!sock) {
+        return SOCKET_ERROR;
+    }
+    sock->timeout_ms = timeout_ms;
+    return 0;
+}
+
+int socket_bind(int sd, uint32_t ip, uint16_t port) {
+    socket_t* sock = socket_get(sd);
+    if (!sock) {
+        return SOCKET_ERROR;
+    }
+
+    if (sock->type == SOCK_STREAM) {
+        return tcp_bind(sock->pcb, ip, port) == 0 ? 0 : SOCKET_ERROR;
+    }
+
+    if (sock->local_port) {
+        return SOCKET_ERROR;
+    }
+    if (port == 0) {
+        // Ephemeral: first free port from the dynamic range
+        for (uint32_t tries = 0; tries < 0x4000 && port == 0; tries++) {
+            uint16_t candidate = socket_next_udp_port++;
+            if (socket_next_udp_port == 0) {
+                socket_next_udp_port = TCP_EPHEMERAL_PORT;
+            }
+            if (udp_bind(candidate, socket_udp_rx, sock) == 0) {
+                port = candidate;
+            }
+        }
+        if (port == 0) {
+            return SOCKET_ERROR;
+        }
+    } else if (udp_bind(port, socket_udp_rx, sock) != 0) {
+        return SOCKET_ERROR;
+    }
+
+    sock->local_ip = ip;
+    sock->local_port = port;
+    return 0;
+}
+
+int socket_listen(int sd, int backlog) {
+    socket_t* sock = socket_get(sd);
+    if (!sock || sock->type != SOCK_STREAM) {
+        return SOCKET_ERROR;
+    }
+    return tcp_listen(sock->pcb, backlog) == 0 ? 0 : SOCKET_ERROR;
+}
+
+int socket_accept(int sd, socket_addr_t* peer) {
+    socket_t* sock = socket_get(sd);
+    if (!sock || sock->type != SOCK_STREAM || sock->pcb->state != TCP_LISTEN) {
+        return SOCKET_ERROR;
+    }
+
+    uint64_t deadline = socket_deadline(sock);
+    tcp_pcb_t* pcb;
+    while ((pcb = tcp_accept(sock->pcb)) == NULL) {
+        if (ktime_get_ns() >= deadline) {
+            return SOCKET_TIMEDOUT;
+        }
+        net_poll();
+    }
+
+    // Hand the connection its own descriptor
+    int child_sd = -1;
+    for (int i = 0; i < SOCKET_MAX; i++) {
+        if (!sockets[i].in_use) {
+            child_sd = i;
+            break;
+        }
+    }
+    if (child_sd < 0) {
+        tcp_close(pcb);
+        return SOCKET_ERROR;
+    }
+
+    socket_t* child = &sockets[child_sd];
+    memset(child, 0, sizeof(socket_t));
+    child->in_use = 1;
+    child->type = SOCK_STREAM;
+    child->timeout_ms = sock->timeout_ms;
+    child->pcb = pcb;
+
+    if (peer) {
+        peer->ip = pcb->remote_ip;
+        peer->port = pcb->remote_port;
+    }
+    return child_sd;
+}
+
+int socket_connect(int sd, uint32_t ip, uint16_t port) {
+    socket_t* sock = socket_get(sd);
+    if (!sock || sock->type != SOCK_STREAM || tcp_connect(sock->pcb, ip, port) != 0) {
+        return SOCKET_ERROR;
+    }
+
+    uint64_t deadline = socket_deadline(sock);
+    while (sock->pcb->state == TCP_SYN_SENT) {
+        if (ktime_get_ns() >= deadline) {
+            return SOCKET_TIMEDOUT;
+        }
+        net_poll();
+    }
+    return sock->pcb->state == TCP_ESTABLISHED ? 0 : SOCKET_ERROR;
+}
+
+// Every call runs the stack once, so non-blocking callers make progress too
+int socket_send(int sd, const void* data, uint32_t len, int flags) {
+    socket_t* sock = socket_get(sd);
+    if (!sock || sock->type != SOCK_STREAM) {
+        return SOCKET_ERROR;
+    }
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint32_t sent = 0;
+    uint64_t deadline = socket_deadline(sock);
+
+    for (;;) {
+        net_poll();
+        int result = tcp_send(sock->pcb, bytes + sent, len - sent);
+        net_flush();
+        if (result == SOCKET_ERROR) {
+            return sent ? (int)sent : SOCKET_ERROR;
+        }
+        if (result > 0) {
+            sent += result;
+            deadline = socket_deadline(sock);
+        }
+        if (sent == len || (flags & SOCKET_NONBLOCK)) {
+            return sent ? (int)sent : SOCKET_WOULDBLOCK;
+        }
+        if (ktime_get_ns() >= deadline) {
+            return sent ? (int)sent : SOCKET_TIMEDOUT;
+        }
+    }
+}
+
+int socket_recv(int sd, void* buffer, uint32_t len, int flags) {
+    socket_t* sock = socket_get(sd);
+    if (!sock) {
+        return SOCKET_ERROR;
+    }
+    if (sock->type == SOCK_DGRAM) {
+        return socket_recvfrom(sd, buffer, len, NULL, flags);
+    }
+
+    uint64_t deadline = socket_deadline(sock);
+    for (;;) {
+        net_poll();
+        int result = tcp_recv(sock->pcb, buffer, len);
+        if (result != TCP_ERR_WOULDBLOCK || (flags & SOCKET_NONBLOCK)) {
+            return result;
+        }
+        if (ktime_get_ns() >= deadline) {
+            return SOCKET_TIMEDOUT;
+        }
+    }
+}
+
+int socket_sendto(int sd, const void* data, uint32_t len, uint32_t ip, uint16_t port) {
+    socket_t* sock = socket_get(sd);
+    if (!sock || sock->type != SOCK_DGRAM) {
+        return SOCKET_ERROR;
+    }
+    if (!sock->local_port && socket_bind(sd, 0, 0) != 0) {
+        return SOCKET_ERROR;
+    }
+
+    netbuf_t* nb = netbuf_alloc();
+    if (!nb) {
+        return SOCKET_ERROR;
+    }
+    uint8_t* payload = netbuf_put(nb, len);
+    if (!payload) {
+        netbuf_free(nb);
+        return SOCKET_ERROR;
+    }
+    memcpy(payload, data, len);
+
+    uint32_t src_ip = sock->local_ip;
+    if (!src_ip && net_is_local_ip(ip)) {
+        src_ip = ip;
+    }
+    int result = udp_output(nb, src_ip, sock->local_port, ip, port);
+    net_flush();
+    return result == 0 ? (int)len : SOCKET_ERROR;
+}
+
+int socket_recvfrom(int sd, void* buffer, uint32_t len, socket_addr_t* from, int flags) {
+    socket_t* sock = socket_get(sd);
+    if (!sock || sock->type != SOCK_DGRAM || !sock->local_port) {
+        return SOCKET_ERROR;
+    }
+
+    uint64_t deadline = socket_deadline(sock);
+    for (;;) {
+        net_poll();
+        netbuf_t* nb = netbuf_queue_pop(&sock->rx_queue);
+        if (nb) {
+            // Datagram semantics: whatever does not fit is discarded
+            uint32_t copied = nb->len < len ? nb->len : len;
+            memcpy(buffer, nb->data, copied);
+            if (from) {
+                from->ip = nb->src_ip;
+                from->port = nb->src_port;
+            }
+            netbuf_free(nb);
+            return copied;
+        }
+        if (flags & SOCKET_NONBLOCK) {
+            return SOCKET_WOULDBLOCK;
+        }
+        if (ktime_get_ns() >= deadline) {
+            return SOCKET_TIMEDOUT;
+        }
+    }
+}
+
+// Diagnostics
+
+static void socket_print_endpoint(uint32_t ip, uint16_t port) {
+    net_print_ip(ip);
+    terminal_putchar(':');
+    terminal_write_dec(port);
+}
+
+void socket_print_all(void) {
+    int count = 0;
+    for (int sd = 0; sd < SOCKET_MAX; sd++) {
+        socket_t* sock = &sockets[sd];
+        if (!sock->in_use) {
+            continue;
+        }
+        count++;
+
+        terminal_write_dec(sd);
+        if (sock->type == SOCK_STREAM) {
+            tcp_pcb_t* pcb = sock->pcb;
+            terminal_writestring(": tcp ");
+            socket_print_endpoint(pcb->local_ip, pcb->local_port);
+            terminal_writestring(" -> ");
+            socket_print_endpoint(pcb->remote_ip, pcb->remote_port);
+            terminal_putchar(' ');
+            terminal_writestring(tcp_state_name(pcb->state));
+            terminal_writestring(", ");
+            terminal_write_dec(pcb->retransmits);
+            terminal_writestring(" retransmits\n");
+        } else {
+            terminal_writestring(": udp ");
+            socket_print_endpoint(sock->local_ip, sock->local_port);
+            terminal_writestring(", ");
+            terminal_write_dec(sock->rx_queue.count);
+            terminal_writestring(" queued, ");
+            terminal_write_dec(sock->drops);
+            terminal_writestring(" drops\n");
+        }
+    }
+
+    if (count == 0) {
+        terminal_writestring("No open sockets.\n");
+    }
+}
+
+static void socket_bench_error(const char* message) {
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, 0));
+    terminal_writestring(message);
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, 0));
+}
+
+static void socket_bench_report_rate(const char* label, uint32_t bytes, uint64_t elapsed, int complete) {
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+    terminal_writestring(label);
+    terminal_write_dec(bytes / 1024);
+    terminal_writestring(" KB in ");
+    terminal_write_dec((uint32_t)(elapsed / NSEC_PER_USEC));
+    terminal_writestring(" us, ");
+    terminal_write_dec((uint32_t)((uint64_t)bytes * NSEC_PER_SEC / 1024 / elapsed));
+    terminal_writestring(" KB/s");
+    if (!complete) {
+        terminal_writestring(" (stalled)");
+    }
+    terminal_putchar('\n');
+}
+
+static void socket_bench_report_rtt(const char* label, uint32_t round_trips, uint64_t elapsed) {
+    if (round_trips) {
+        terminal_writestring(label);
+        terminal_write_dec((uint32_t)(elapsed / round_trips));
+        terminal_writestring(" ns/round trip\n");
+    }
+}
+
+// Blocking receive of exactly len bytes from a stream socket
+static int socket_recv_all(int sd, uint8_t* buffer, uint32_t len) {
+    uint32_t received = 0;
+    while (received < len) {
+        int n = socket_recv(sd, buffer + received, len - received, 0);
+        if (n <= 0) {
+            return n == 0 ? SOCKET_ERROR : n;
+        }
+        received += n;
+    }
+    return received;
+}
+
+// Both ends on loopback: a listener, a client and the accepted connection
+static int socket_bench_local_pair(int* server, int* client) {
+    *server = socket_create(SOCK_STREAM);
+    *client = socket_create(SOCK_STREAM);
+    if (*server < 0 || *client < 0 || socket_bind(*server, 0, SOCKET_BENCH_TCP_PORT) != 0 ||
+        socket_listen(*server, 1) != 0 || socket_connect(*client, IP_LOOPBACK, SOCKET_BENCH_TCP_PORT) != 0) {
+        return SOCKET_ERROR;
+    }
+    return socket_accept(*server, NULL);
+}
+
+// Bulk transfer over one loopback connection, sender and receiver interleaved
+static void socket_bench_local_stream(uint32_t total_bytes, uint8_t* tx, uint8_t* rx) {
+    int server, client;
+    int conn = socket_bench_local_pair(&server, &client);
+
+    if (conn < 0) {
+        socket_bench_error("  tcp: connection setup failed\n");
+    } else {
+        uint32_t sent = 0, received = 0;
+        uint64_t start = ktime_get_ns();
+        uint64_t last_progress = start;
+
+        while (received < total_bytes) {
+            if (sent < total_bytes) {
+                uint32_t chunk = total_bytes - sent < SOCKET_BENCH_CHUNK ? total_bytes - sent : SOCKET_BENCH_CHUNK;
+                int n = socket_send(client, tx, chunk, SOCKET_NONBLOCK);
+                if (n > 0) {
+                    sent += n;
+                } else if (n == SOCKET_ERROR) {
+                    break;
+                }
+            }
+
+            int n = socket_recv(conn, rx, SOCKET_BENCH_CHUNK, SOCKET_NONBLOCK);
+            if (n > 0) {
+                received += n;
+                last_progress = ktime_get_ns();
+            } else if (n != SOCKET_WOULDBLOCK) {
+                break;
+            } else if (ktime_get_ns() - last_progress > SOCKET_TIMEOUT_MS * NSEC_PER_MSEC) {
+                break;
+            }
+        }
+
+        socket_bench_report_rate("  tcp stream: ", received, ktime_get_ns() - start, received == total_bytes);
+    }
+
+    socket_close(conn);
+    socket_close(client);
+    socket_close(server);
+}
+
+// Small request/response exchanges; reports the mean round trip
+static void socket_bench_local_rr(uint8_t* tx, uint8_t* rx) {
+    int server, client;
+    int conn = socket_bench_local_pair(&server, &client);
+    uint32_t done = 0;
+    uint64_t start = ktime_get_ns();
+
+    if (conn < 0) {
+        socket_bench_error("  tcp rr: connection setup failed\n");
+    } else {
+        for (; done < SOCKET_BENCH_PINGS; done++) {
+            if (socket_send(client, tx, SOCKET_BENCH_PING_SIZE, 0) != SOCKET_BENCH_PING_SIZE ||
+                socket_recv_all(conn, rx, SOCKET_BENCH_PING_SIZE) < 0 ||
+                socket_send(conn, rx, SOCKET_BENCH_PING_SIZE, 0) != SOCKET_BENCH_PING_SIZE ||
+                socket_recv_all(client, rx, SOCKET_BENCH_PING_SIZE) < 0) {
+                break;
+            }
+        }
+    }
+    socket_bench_report_rtt("  tcp rr:     ", done, ktime_get_ns() - start);
+
+    socket_close(conn);
+    socket_close(client);
+    socket_close(server);
+}
+
+static void socket_bench_local_udp(uint8_t* tx, uint8_t* rx) {
+    int server = socket_create(SOCK_DGRAM);
+    int client = socket_create(SOCK_DGRAM);
+    uint32_t done = 0;
+    uint64_t start = ktime_get_ns();
+
+    if (server < 0 || client < 0 || socket_bind(server, 0, SOCKET_BENCH_UDP_PORT) != 0) {
+        socket_bench_error("  udp rr: socket setup failed\n");
+    } else {
+        for (; done < SOCKET_BENCH_PINGS; done++) {
+            socket_addr_t from;
+            if (socket_sendto(client, tx, SOCKET_BENCH_PING_SIZE, IP_LOOPBACK, SOCKET_BENCH_UDP_PORT) < 0 ||
+                socket_recvfrom(server, rx, SOCKET_BENCH_PING_SIZE, &from, 0) <= 0 ||
+                socket_sendto(server, rx, SOCKET_BENCH_PING_SIZE, from.ip, from.port) < 0 ||
+                socket_recvfrom(client, rx, SOCKET_BENCH_PING_SIZE, NULL, 0) <= 0) {
+                break;
+            }
+        }
+    }
+    socket_bench_report_rtt("  udp rr:     ", done, ktime_get_ns() - start);
+
+    socket_close(client);
+    socket_close(server);
+}
+
+// Remote peer running socket_bench_server. The stream starts with its
+// length; the server answers with one byte once everything has arrived.
+static void socket_bench_remote_stream(uint32_t ip, uint32_t total_bytes, uint8_t* tx) {
+    int sd = socket_create(SOCK_STREAM);
+    if (sd < 0 || socket_connect(sd, ip, SOCKET_BENCH_TCP_PORT) != 0) {
+        socket_bench_error("  tcp: cannot connect to server\n");
+        socket_close(sd);
+        return;
+    }
+
+    uint64_t start = ktime_get_ns();
+    uint32_t header = htonl(total_bytes);
+    uint32_t sent = 0;
+    int ok = socket_send(sd, &header, sizeof(header), 0) == sizeof(header);
+
+    while (ok && sent < total_bytes) {
+        uint32_t chunk = total_bytes - sent < SOCKET_BENCH_CHUNK ? total_bytes - sent : SOCKET_BENCH_CHUNK;
+        int n = socket_send(sd, tx, chunk, 0);
+        if (n <= 0) {
+            ok = 0;
+            break;
+        }
+        sent += n;
+    }
+
+    uint8_t done;
+    ok = ok && socket_recv_all(sd, &done, 1) == 1;
+    socket_bench_report_rate("  tcp stream: ", sent, ktime_get_ns() - start, ok);
+    socket_close(sd);
+}
+
+static void socket_bench_remote_rr(uint32_t ip, uint8_t* tx, uint8_t* rx) {
+    int sd = socket_create(SOCK_STREAM);
+    uint32_t done = 0;
+    uint64_t start = ktime_get_ns();
+
+    if (sd < 0 || socket_connect(sd, ip, SOCKET_BENCH_TCP_PORT) != 0) {
+        socket_bench_error("  tcp rr: cannot connect to server\n");
+    } else {
+        start = ktime_get_ns();
+        for (; done < SOCKET_BENCH_PINGS; done++) {
+            if (socket_send(sd, tx, SOCKET_BENCH_PING_SIZE, 0) != SOCKET_BENCH_PING_SIZE ||
+                socket_recv_all(sd, rx, SOCKET_BENCH_PING_SIZE) < 0) {
+                break;
+            }
+        }
+    }
+    socket_bench_report_rtt("  tcp rr:     ", done, ktime_get_ns() - start);
+    socket_close(sd);
+}
+
+static void socket_bench_remote_udp(uint32_t ip, uint8_t* tx, uint8_t* rx) {
+    int sd = socket_create(SOCK_DGRAM);
+    uint32_t done = 0, lost = 0;
+    uint64_t start = ktime_get_ns();
+
+    if (sd < 0) {
+        socket_bench_error("  udp rr: socket setup failed\n");
+        return;
+    }
+    socket_set_timeout(sd, SOCKET_BENCH_UDP_WAIT_MS);
+
+    // Datagrams may be lost for real here; give up after a run of losses
+    for (uint32_t i = 0; i < SOCKET_BENCH_PINGS && lost < SOCKET_BENCH_UDP_MAX_LOST; i++) {
+        if (socket_sendto(sd, tx, SOCKET_BENCH_PING_SIZE, ip, SOCKET_BENCH_UDP_PORT) < 0) {
+            break;
+        }
+        if (socket_recvfrom(sd, rx, SOCKET_BENCH_PING_SIZE, NULL, 0) > 0) {
+            done++;
+        } else {
+            lost++;
+        }
+    }
+    socket_bench_report_rtt("  udp rr:     ", done, ktime_get_ns() - start);
+    if (lost) {
+        terminal_writestring("  udp rr:     ");
+        terminal_write_dec(lost);
+        terminal_writestring(" datagrams lost\n");
+    }
+    socket_close(sd);
+}
+
+void socket_benchmark(uint32_t ip, uint32_t total_kb) {
+    uint8_t* tx = (uint8_t*)kmalloc(SOCKET_BENCH_CHUNK);
+    uint8_t* rx = (uint8_t*)kmalloc(SOCKET_BENCH_CHUNK);
+    if (!tx || !rx) {
+        socket_bench_error("netbench: out of memory\n");
+        kfree(tx);
+        kfree(rx);
+        return;
+    }
+    for (uint32_t i = 0; i < SOCKET_BENCH_CHUNK; i++) {
+        tx[i] = (uint8_t)i;
+    }
+
+    if ((ip >> 24) == 127) {
+        socket_bench_local_stream(total_kb * 1024, tx, rx);
+        socket_bench_local_rr(tx, rx);
+        socket_bench_local_udp(tx, rx);
+    } else {
+        socket_bench_remote_stream(ip, total_kb * 1024, tx);
+        socket_bench_remote_rr(ip, tx, rx);
+        socket_bench_remote_udp(ip, tx, rx);
+    }
+
+    // Let the closing handshakes finish
+    for (int i = 0; i < 16; i++) {
+        net_poll();
+    }
+
+    kfree(tx);
+    kfree(rx);
+}
+
+// Peer side of a remote benchmark: one stream, one echo connection, then
+// UDP echo until the client goes quiet
+static void socket_bench_serve(int listener, int udp, uint8_t* buffer) {
+    uint32_t stream_bytes = 0, round_trips = 0, datagrams = 0;
+
+    // Stream: length header, payload, one byte of acknowledgement
+    uint32_t header;
+    int conn = socket_accept(listener, NULL);
+    if (conn < 0 || socket_recv_all(conn, (uint8_t*)&header, sizeof(header)) < 0) {
+        socket_bench_error("netbench: no stream client\n");
+        socket_close(conn);
+        return;
+    }
+    header = ntohl(header);
+    while (stream_bytes < header) {
+        int n = socket_recv(conn, buffer, SOCKET_BENCH_CHUNK, 0);
+        if (n <= 0) {
+            break;
+        }
+        stream_bytes += n;
+    }
+    socket_send(conn, buffer, 1, 0);
+    socket_close(conn);
+
+    // Request/response: echo until the client closes
+    conn = socket_accept(listener, NULL);
+    if (conn >= 0) {
+        for (;;) {
+            int n = socket_recv(conn, buffer, SOCKET_BENCH_CHUNK, 0);
+            if (n <= 0 || socket_send(conn, buffer, n, 0) != n) {
+                break;
+            }
+            round_trips++;
+        }
+    }
+    socket_close(conn);
+
+    // UDP echo; after the first datagram a normal timeout ends the run
+    for (;;) {
+        socket_addr_t from;
+        int n = socket_recvfrom(udp, buffer, SOCKET_BENCH_CHUNK, &from, 0);
+        if (n < 0) {
+            break;
+        }
+        socket_sendto(udp, buffer, n, from.ip, from.port);
+        datagrams++;
+        socket_set_timeout(udp, SOCKET_TIMEOUT_MS);
+    }
+
+    terminal_writestring("Served ");
+    terminal_write_dec(stream_bytes / 1024);
+    terminal_writestring(" KB stream, ");
+    terminal_write_dec(round_trips);
+    terminal_writestring(" tcp round trips, ");
+    terminal_write_dec(datagrams);
+    terminal_writestring(" datagrams\n");
+}
+
+void socket_bench_server(void) {
+    uint8_t* buffer = (uint8_t*)kmalloc(SOCKET_BENCH_CHUNK);
+    int listener = socket_create(SOCK_STREAM);
+    int udp = socket_create(SOCK_DGRAM);
+
+    if (!buffer || listener < 0 || udp < 0 || socket_bind(listener, 0, SOCKET_BENCH_TCP_PORT) != 0 ||
+        socket_listen(listener, 1) != 0 || socket_bind(udp, 0, SOCKET_BENCH_UDP_PORT) != 0) {
+        socket_bench_error("netbench: cannot open server sockets\n");
+    } else {
+        socket_set_timeout(listener, SOCKET_BENCH_SERVER_WAIT_MS);
+        socket_set_timeout(udp, SOCKET_BENCH_SERVER_WAIT_MS);
+        terminal_writestring("Waiting for a client on TCP ");
+        terminal_write_dec(SOCKET_BENCH_TCP_PORT);
+        terminal_writestring(" / UDP ");
+        terminal_write_dec(SOCKET_BENCH_UDP_PORT);
+        terminal_writestring("...\n");
+        socket_bench_serve(listener, udp, buffer);
+    }
+
+    socket_close(udp);
+    socket_close(listener);
+    for (int i = 0; i < 16; i++) {
+        net_poll();
+    }
+    kfree(buffer);
+}
@@ -0,0 +1,51 @@
+#ifndef SOCKET_H
+#define SOCKET_H
+
+#include <stdint.h>
+
+// Socket descriptors are small integers into a fixed table
+#define SOCKET_MAX          16
+#define SOCKET_UDP_QUEUE    32      // Datagrams held per UDP socket
+#define SOCKET_TIMEOUT_MS   2000    // Default for blocking calls
+
+// Socket types
+#define SOCK_STREAM 1
+#define SOCK_DGRAM  2
+
+// Flags for send/recv
+#define SOCKET_NONBLOCK 0x01
+
+// Error returns (byte counts are >= 0)
+#define SOCKET_ERROR      (-1)
+#define SOCKET_WOULDBLOCK (-2)
+#define SOCKET_TIMEDOUT   (-3)
+
+// Endpoint, in host byte order
+typedef struct socket_addr {
+    uint32_t ip;
+    uint16_t port;
+} socket_addr_t;
+
+// Descriptor management
+int socket_create(int type);
+int socket_close(int sd);
+int socket_set_timeout(int sd, uint32_t timeout_ms);
+
+// Connection setup
+int socket_bind(int sd, uint32_t ip, uint16_t port);
+int socket_listen(int sd, int backlog);
+int socket_accept(int sd, socket_addr_t* peer);
+int socket_connect(int sd, uint32_t ip, uint16_t port);
+
+// Data transfer; blocking calls drive the network stack while they wait
+int socket_send(int sd, const void* data, uint32_t len, int flags);
+int socket_recv(int sd, void* buffer, uint32_t len, int flags);
+int socket_sendto(int sd, const void* data, uint32_t len, uint32_t ip, uint16_t port);
+int socket_recvfrom(int sd, void* buffer, uint32_t len, socket_addr_t* from, int flags);
+
+// Diagnostics and benchmarks
+void socket_print_all(void);
+void socket_benchmark(uint32_t ip, uint32_t total_kb);  // Loopback runs both ends
+void socket_bench_server(void);                         // Peer for a remote run
+
+#endif // SOCKET_H
@@ -0,0 +1,610 @@
+#include <stddef.h>
+#include "swap.h"
+#include "pmm.h"
+#include "reclaim.h"
+#include "ktime.h"
+#include "memcg.h"
+#include "bitmap.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+
+// Swap area
+static blkdev_t* swap_dev = NULL;
+static uint32_t swap_start_sector;
+static uint32_t swap_slots;
+static bitmap_t swap_slot_map;                      // Slots in use; next-fit for clusters
+static uint32_t swap_slot_bits[BITMAP_STORAGE_WORDS(SWAP_MAX_SLOTS)];
+static uint8_t swap_count[SWAP_MAX_SLOTS];          // Page table entries naming the slot
+
+// Two-list page aging: new and referenced pages sit on the active list,
+// pages that went a full pass without being referenced move to the inactive
+// list and are swapped out from its tail
+typedef struct lru_list {
+    page_frame_t* head;
+    page_frame_t* tail;
+    uint32_t count;
+} lru_list_t;
+
+static lru_list_t lru_active;
+static lru_list_t lru_inactive;
+static swap_stats_t swap_stats;
+
+// Separate request arrays: a swap-in may reclaim (and swap out) for frames
+static blk_request_t swap_out_reqs[SWAP_CLUSTER];
+static blk_request_t swap_in_reqs[SWAP_READAHEAD];
+
+static uint32_t swap_shrink_count(void);
+static uint32_t swap_shrink_scan(uint32_t nr_to_scan);
+
+static shrinker_t swap_shrinker = {
+    .name = "anon-swap",
+    .pool = RECLAIM_FRAMES,
+    .count = swap_shrink_count,
+    .scan = swap_shrink_scan,
+};
+
+// LRU lists
+
+static void lru_push_head(lru_list_t* list, page_frame_t* frame) {
+    frame->lru_prev = NULL;
+    frame->lru_next = list->head;
+    if (list->head) {
+        list->head->lru_prev = frame;
+    } else {
+        list->tail = frame;
+    }
+    list->head = frame;
+    list->count++;
+}
+
+static void lru_unlink(lru_list_t* list, page_frame_t* frame) {
+    if (frame->lru_prev) {
+        frame->lru_prev->lru_next = frame->lru_next;
+    } else {
+        list->head = frame->lru_next;
+    }
+    if (frame->lru_next) {
+        frame->lru_next->lru_prev = frame->lru_prev;
+    } else {
+        list->tail = frame->lru_prev;
+    }
+    frame->lru_prev = NULL;
+    frame->lru_next = NULL;
+    list->count--;
+}
+
+static inline lru_list_t* lru_list_of(page_frame_t* frame) {
+    return (frame->flags & PMM_FRAME_ACTIVE) ? &lru_active : &lru_inactive;
+}
+
+static void lru_move(page_frame_t* frame, int active) {
+    lru_unlink(lru_list_of(frame), frame);
+    if (active) {
+        frame->flags |= PMM_FRAME_ACTIVE;
+        lru_push_head(&lru_active, frame);
+    } else {
+        frame->flags &= ~PMM_FRAME_ACTIVE;
+        lru_push_head(&lru_inactive, frame);
+    }
+}
+
+void swap_lru_add(address_space_t* as, uint32_t vaddr, uint32_t phys, int active) {
+    page_frame_t* frame = pmm_frame(phys);
+    if (!frame || (frame->flags & PMM_FRAME_LRU)) {
+        return;
+    }
+
+    frame->mapping = as;
+    frame->vaddr = vaddr;
+    frame->flags |= PMM_FRAME_LRU;
+    if (active) {
+        frame->flags |= PMM_FRAME_ACTIVE;
+        lru_push_head(&lru_active, frame);
+    } else {
+        lru_push_head(&lru_inactive, frame);
+    }
+}
+
+void swap_lru_del(uint32_t phys) {
+    page_frame_t* frame = pmm_frame(phys);
+    if (!frame || !(frame->flags & PMM_FRAME_LRU)) {
+        return;
+    }
+
+    lru_unlink(lru_list_of(frame), frame);
+    frame->flags &= ~(PMM_FRAME_LRU | PMM_FRAME_ACTIVE);
+    frame->mapping = NULL;
+}
+
+// The mapping's page table entry, if it still maps this frame
+static page_entry_t* lru_frame_pte(page_frame_t* frame) {
+    if (!frame->mapping) {
+        return NULL;
+    }
+    page_entry_t* pte = vmm_get_pte(frame->mapping, frame->vaddr, 0);
+    if (!pte || !pte->present || ((uint32_t)pte->frame << 12) != pmm_frame_phys(frame)) {
+        return NULL;
+    }
+    return pte;
+}
+
+// Test and clear the accessed bit the MMU sets on every use
+static int lru_referenced(page_frame_t* frame, page_entry_t* pte) {
+    if (!pte->accessed) {
+        return 0;
+    }
+    pte->accessed = 0;
+    vmm_flush_page(frame->mapping, frame->vaddr);
+    return 1;
+}
+
+// Second chance on the active list: referenced pages go round again
+static void lru_shrink_active(uint32_t nr) {
+    for (uint32_t i = 0; i < nr && lru_active.tail; i++) {
+        page_frame_t* frame = lru_active.tail;
+        page_entry_t* pte = lru_frame_pte(frame);
+
+        if (pte && lru_referenced(frame, pte)) {
+            lru_move(frame, 1);
+        } else {
+            lru_move(frame, 0);
+            swap_stats.deactivations++;
+        }
+    }
+}
+
+// Slots
+
+// Next-fit search for 'count' consecutive free slots; -1 if none
+static int swap_alloc_slots(uint32_t count) {
+    int32_t first = bitmap_alloc_range(&swap_slot_map, count, 1);
+    if (first < 0) {
+        return -1;
+    }
+    for (uint32_t slot = (uint32_t)first; slot < (uint32_t)first + count; slot++) {
+        swap_count[slot] = 1;
+    }
+    swap_stats.used_slots += count;
+    return (int)first;
+}
+
+static void swap_free_slots(uint32_t first, uint32_t count) {
+    bitmap_free_range(&swap_slot_map, first, count);
+    for (uint32_t slot = first; slot < first + count; slot++) {
+        swap_count[slot] = 0;
+    }
+    swap_stats.used_slots -= count;
+}
+
+void swap_entry_dup(uint32_t slot) {
+    if (slot < swap_slots && swap_count[slot] < 0xFF) {
+        swap_count[slot]++;
+    }
+}
+
+void swap_entry_free(uint32_t slot) {
+    if (slot >= swap_slots || swap_count[slot] == 0) {
+        return;
+    }
+    if (--swap_count[slot] == 0) {
+        bitmap_clear(&swap_slot_map, slot);
+        swap_stats.used_slots--;
+    }
+}
+
+static void swap_prepare(blk_request_t* req, blk_op_t op, uint32_t slot, uint32_t phys) {
+    memset(req, 0, sizeof(blk_request_t));
+    req->op = op;
+    req->sector = swap_start_sector + slot * SWAP_SECTORS_PER_PAGE;
+    req->count = SWAP_SECTORS_PER_PAGE;
+    req->buffer = (void*)phys;
+}
+
+// Swap-out
+
+// Write the victims to consecutive slots with one device notification and
+// replace their mappings with swap entries; returns pages written
+static uint32_t swap_write_cluster(page_frame_t** victims, uint32_t count) {
+    uint32_t written = 0;
+
+    while (written < count) {
+        uint32_t batch = count - written;
+        int first = swap_alloc_slots(batch);
+        while (first < 0 && batch > 1) {
+            batch /= 2;
+            first = swap_alloc_slots(batch);
+        }
+        if (first < 0) {
+            break; // Swap is full
+        }
+
+        for (uint32_t i = 0; i < batch; i++) {
+            swap_prepare(&swap_out_reqs[i], BLK_OP_WRITE, first + i,
+                         pmm_frame_phys(victims[written + i]));
+            blkdev_submit(swap_dev, &swap_out_reqs[i]);
+        }
+        blkdev_unplug(swap_dev);
+
+        int failed = 0;
+        for (uint32_t i = 0; i < batch; i++) {
+            if (blkdev_wait(swap_dev, &swap_out_reqs[i]) != BLK_STATUS_OK) {
+                failed = 1;
+            }
+        }
+        if (failed) {
+            swap_free_slots(first, batch);
+            swap_stats.errors++;
+            break;
+        }
+        swap_stats.clusters++;
+
+        for (uint32_t i = 0; i < batch; i++) {
+            page_frame_t* frame = victims[written + i];
+            address_space_t* as = frame->mapping;
+            page_entry_t* pte = lru_frame_pte(frame);
+            uint32_t phys = pmm_frame_phys(frame);
+
+            // The sole owner of a copy-on-write page may write it once it is back
+            if (pte->available & VMM_PTE_COW) {
+                pte->writable = 1;
+            }
+            pte->present = 0;
+            pte->accessed = 0;
+            pte->dirty = 0;
+            pte->available = VMM_PTE_SWAP;
+            pte->frame = first + i;
+            vmm_flush_page(as, frame->vaddr);
+
+            as->resident_pages--;
+            as->swap_pages++;
+            memcg_uncharge_pages(as, 1);
+            frame->flags &= ~(PMM_FRAME_LRU | PMM_FRAME_ACTIVE);
+            frame->mapping = NULL;
+            pmm_free_frame(phys);
+        }
+        swap_stats.swap_outs += batch;
+        written += batch;
+    }
+
+    // Whatever could not be written goes back to be tried later
+    for (uint32_t i = written; i < count; i++) {
+        victims[i]->flags |= PMM_FRAME_ACTIVE;
+        lru_push_head(&lru_active, victims[i]);
+    }
+    return written;
+}
+
+// Scan the inactive tail: referenced pages are promoted, shared ones skipped
+// and the rest written out in clusters
+static uint32_t lru_shrink_inactive(uint32_t nr_scan, uint32_t nr_free) {
+    page_frame_t* victims[SWAP_CLUSTER];
+    uint32_t nvictims = 0;
+    uint32_t freed = 0;
+
+    for (uint32_t i = 0; i < nr_scan && freed + nvictims < nr_free && lru_inactive.tail; i++) {
+        page_frame_t* frame = lru_inactive.tail;
+        page_entry_t* pte = lru_frame_pte(frame);
+
+        if (!pte || frame->refcount > 1) {
+            lru_move(frame, 1); // Mapped elsewhere too; leave it alone for now
+            continue;
+        }
+        if (lru_referenced(frame, pte)) {
+            lru_move(frame, 1);
+            swap_stats.activations++;
+            continue;
+        }
+
+        lru_unlink(&lru_inactive, frame);
+        victims[nvictims++] = frame;
+        if (nvictims == SWAP_CLUSTER) {
+            uint32_t written = swap_write_cluster(victims, nvictims);
+            freed += written;
+            nvictims = 0;
+            if (written == 0) {
+                return freed;
+            }
+        }
+    }
+
+    if (nvictims > 0) {
+        freed += swap_write_cluster(victims, nvictims);
+    }
+    return freed;
+}
+
+uint32_t swap_reclaim(uint32_t nr) {
+    if (!swap_dev || nr == 0) {
+        return 0;
+    }
+
+    // Keep the inactive list at least as long as what we are asked to free
+    // (and about a third of all pages) so there is aged material to pick from
+    uint32_t total = lru_active.count + lru_inactive.count;
+    if (lru_inactive.count < nr || lru_inactive.count * 3 < total) {
+        lru_shrink_active(nr * 2 > lru_active.count ? lru_active.count : nr * 2);
+    }
+
+    uint32_t freed = lru_shrink_inactive(lru_inactive.count, nr);
+    if (freed < nr) {
+        // Everything left was referenced; age the active list once more
+        lru_shrink_active(lru_active.count);
+        freed += lru_shrink_inactive(lru_inactive.count, nr - freed);
+    }
+    return freed;
+}
+
+static uint32_t swap_shrink_count(void) {
+    if (!swap_dev || swap_stats.used_slots >= swap_slots) {
+        return 0;
+    }
+    return lru_active.count + lru_inactive.count;
+}
+
+static uint32_t swap_shrink_scan(uint32_t nr_to_scan) {
+    return swap_reclaim(nr_to_scan);
+}
+
+// Swap-in
+
+// The entry at vaddr if it names this slot
+static page_entry_t* swap_match(address_space_t* as, uint32_t vaddr, uint32_t slot) {
+    if (vaddr < VMM_USER_START || vaddr >= VMM_USER_END) {
+        return NULL;
+    }
+    page_entry_t* pte = vmm_get_pte(as, vaddr, 0);
+    if (!pte || pte->present || !(pte->available & VMM_PTE_SWAP) || pte->frame != slot) {
+        return NULL;
+    }
+    return pte;
+}
+
+// Read the faulting slot together with the rest of its aligned window;
+// neighbours that this space maps at the matching addresses (as written by
+// a clustered swap-out) come back in the same batch
+int swap_in(address_space_t* as, uint32_t vaddr) {
+    page_entry_t* fault_pte = vmm_get_pte(as, vaddr, 0);
+    if (!swap_dev || !fault_pte || fault_pte->present || !(fault_pte->available & VMM_PTE_SWAP)) {
+        return -1;
+    }
+
+    uint32_t fault_slot = fault_pte->frame;
+    uint32_t window = fault_slot & ~(SWAP_READAHEAD - 1);
+    page_entry_t* ptes[SWAP_READAHEAD];
+    uint32_t vaddrs[SWAP_READAHEAD];
+    uint32_t slots[SWAP_READAHEAD];
+    uint32_t count = 0;
+
+    for (uint32_t slot = window; slot < window + SWAP_READAHEAD && slot < swap_slots; slot++) {
+        uint32_t addr = vaddr + (slot - fault_slot) * PAGE_SIZE;
+        page_entry_t* pte = slot == fault_slot ? fault_pte : swap_match(as, addr, slot);
+        if (!pte) {
+            continue;
+        }
+
+        // The faulting page is charged and taken like a new one, reclaiming
+        // or killing as needed; readahead only uses what is already there
+        int charged = slot == fault_slot ? memcg_charge_pages(as, 1) == 0 :
+                                           memcg_charge_pages_optional(as, 1) == 0;
+        uint32_t frame = 0;
+        if (charged) {
+            frame = slot == fault_slot ? vmm_alloc_frame(as, 0) : pmm_alloc_frame();
+            if (!frame) {
+                memcg_uncharge_pages(as, 1);
+            }
+        }
+        if (!frame) {
+            if (slot == fault_slot) {
+                // Undo the readahead frames taken so far
+                for (uint32_t i = 0; i < count; i++) {
+                    pmm_free_frame((uint32_t)swap_in_reqs[i].buffer);
+                }
+                memcg_uncharge_pages(as, count);
+                return -1;
+            }
+            continue;
+        }
+
+        swap_prepare(&swap_in_reqs[count], BLK_OP_READ, slot, frame);
+        ptes[count] = pte;
+        vaddrs[count] = addr;
+        slots[count] = slot;
+        count++;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        blkdev_submit(swap_dev, &swap_in_reqs[i]);
+    }
+    blkdev_unplug(swap_dev);
+
+    int result = -1;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t frame = (uint32_t)swap_in_reqs[i].buffer;
+        if (blkdev_wait(swap_dev, &swap_in_reqs[i]) != BLK_STATUS_OK) {
+            swap_stats.errors++;
+            pmm_free_frame(frame);
+            memcg_uncharge_pages(as, 1);
+            continue;
+        }
+
+        page_entry_t* pte = ptes[i];
+        pte->available &= ~VMM_PTE_SWAP;
+        pte->frame = frame >> 12;
+        pte->accessed = 0;
+        pte->dirty = 0;
+        pte->present = 1;
+        swap_entry_free(slots[i]);
+
+        as->resident_pages++;
+        as->swap_pages--;
+        swap_stats.swap_ins++;
+
+        // Readahead pages start inactive so unused ones leave first
+        int faulted = slots[i] == fault_slot;
+        swap_lru_add(as, vaddrs[i], frame, faulted);
+        if (faulted) {
+            result = 0;
+        } else {
+            swap_stats.readahead++;
+        }
+    }
+
+    swap_stats.faults++;
+    return result;
+}
+
+// Setup and diagnostics
+
+int swap_on(blkdev_t* dev, uint32_t start_sector, uint32_t pages) {
+    if (!dev || swap_dev || start_sector >= dev->sector_count) {
+        return -1;
+    }
+
+    uint32_t available = (dev->sector_count - start_sector) / SWAP_SECTORS_PER_PAGE;
+    if (pages == 0 || pages > available) {
+        pages = available;
+    }
+    if (pages > SWAP_MAX_SLOTS) {
+        pages = SWAP_MAX_SLOTS;
+    }
+    if (pages == 0) {
+        return -1;
+    }
+
+    bitmap_init(&swap_slot_map, swap_slot_bits, pages);
+    memset(swap_count, 0, sizeof(swap_count));
+    swap_start_sector = start_sector;
+    swap_slots = pages;
+    swap_stats.total_slots = pages;
+    swap_stats.used_slots = 0;
+    swap_dev = dev;
+
+    register_shrinker(&swap_shrinker);
+    return 0;
+}
+
+int swap_enabled(void) {
+    return swap_dev != NULL;
+}
+
+swap_stats_t swap_get_stats(void) {
+    swap_stats.active_pages = lru_active.count;
+    swap_stats.inactive_pages = lru_inactive.count;
+    return swap_stats;
+}
+
+void swap_print_stats(void) {
+    swap_stats_t stats = swap_get_stats();
+
+    terminal_writestring("=== Swap ===\n");
+    if (swap_dev) {
+        terminal_writestring("Device: ");
+        terminal_writestring(swap_dev->name);
+        terminal_writestring(" from sector ");
+        terminal_write_dec(swap_start_sector);
+        terminal_writestring(", ");
+        terminal_write_dec(stats.used_slots);
+        terminal_writestring(" / ");
+        terminal_write_dec(stats.total_slots);
+        terminal_writestring(" slots used\n");
+    } else {
+        terminal_writestring("Device: none (use swapon)\n");
+    }
+
+    terminal_writestring("LRU: ");
+    terminal_write_dec(stats.active_pages);
+    terminal_writestring(" active, ");
+    terminal_write_dec(stats.inactive_pages);
+    terminal_writestring(" inactive (");
+    terminal_write_dec(stats.activations);
+    terminal_writestring(" activated, ");
+    terminal_write_dec(stats.deactivations);
+    terminal_writestring(" deactivated)\n");
+
+    terminal_writestring("Out: ");
+    terminal_write_dec(stats.swap_outs);
+    terminal_writestring(" pages in ");
+    terminal_write_dec(stats.clusters);
+    terminal_writestring(" clusters; in: ");
+    terminal_write_dec(stats.swap_ins);
+    terminal_writestring(" pages for ");
+    terminal_write_dec(stats.faults);
+    terminal_writestring(" faults (");
+    terminal_write_dec(stats.readahead);
+    terminal_writestring(" read ahead), errors: ");
+    terminal_write_dec(stats.errors);
+    terminal_writestring("\n");
+}
+
+// Benchmark
+
+static uint32_t swap_bench_tag(uint32_t page) {
+    return 0xA5000000 ^ (page * 2654435761u);
+}
+
+void swap_benchmark(uint32_t pages) {
+    if (!swap_dev) {
+        terminal_writestring("No swap device (use swapon)\n");
+        return;
+    }
+    if (pages > swap_slots - swap_stats.used_slots + pmm_free_frames()) {
+        terminal_writestring("Not enough frames and swap for that many pages\n");
+        return;
+    }
+
+    address_space_t* as = vmm_create();
+    if (!as) {
+        terminal_writestring("Failed to create an address space\n");
+        return;
+    }
+
+    swap_stats_t before = swap_get_stats();
+    uint32_t start = (uint32_t)ktime_get_us();
+
+    // Map and stamp every page; once frames run low reclaim swaps the oldest out
+    int ok = 1;
+    for (uint32_t p = 0; ok && p < pages; p++) {
+        uint32_t vaddr = VMM_USER_START + p * PAGE_SIZE;
+        uint32_t tag = swap_bench_tag(p);
+        ok = vmm_map_anon(as, vaddr, 1, PAGE_WRITABLE | PAGE_USER) == 0 &&
+             vmm_copy_to(as, vaddr, &tag, sizeof(tag)) == 0;
+    }
+    uint32_t fill_us = (uint32_t)ktime_get_us() - start;
+
+    // Read everything back in order; readahead should serve most pages
+    start = (uint32_t)ktime_get_us();
+    for (uint32_t p = 0; ok && p < pages; p++) {
+        uint32_t tag;
+        ok = vmm_copy_from(as, &tag, VMM_USER_START + p * PAGE_SIZE, sizeof(tag)) == 0 &&
+             tag == swap_bench_tag(p);
+    }
+    uint32_t verify_us = (uint32_t)ktime_get_us() - start;
+
+    swap_stats_t after = swap_get_stats();
+    terminal_writestring("Touched ");
+    terminal_write_dec(pages);
+    terminal_writestring(" pages in ");
+    terminal_write_dec(fill_us / 1000);
+    terminal_writestring(" ms, read back in ");
+    terminal_write_dec(verify_us / 1000);
+    terminal_writestring(" ms\n");
+    terminal_writestring("Swapped out ");
+    terminal_write_dec(after.swap_outs - before.swap_outs);
+    terminal_writestring(" pages in ");
+    terminal_write_dec(after.clusters - before.clusters);
+    terminal_writestring(" clusters, read ");
+    terminal_write_dec(after.swap_ins - before.swap_ins);
+    terminal_writestring(" pages on ");
+    terminal_write_dec(after.faults - before.faults);
+    terminal_writestring(" faults\n");
+    terminal_writestring("Resident ");
+    terminal_write_dec(as->resident_pages);
+    terminal_writestring(", in swap ");
+    terminal_write_dec(as->swap_pages);
+    terminal_writestring("\n");
+    terminal_writestring(ok ? "Data check: OK\n" : "Data check: FAILED\n");
+
+    vmm_destroy(as);
+}
@@ -0,0 +1,56 @@
+#ifndef SWAP_H
+#define SWAP_H
+
+#include <stdint.h>
+#include "blkdev.h"
+#include "vmm.h"
+
+// Swap area layout: page-sized slots from a start sector onwards
+#define SWAP_MAX_SLOTS          16384   // 64MB
+#define SWAP_SECTORS_PER_PAGE   (PAGE_SIZE / BLKDEV_SECTOR_SIZE)
+
+// Evicted pages are written in batches to consecutive slots, and a swap-in
+// fault reads the aligned window of slots around the faulting one
+#define SWAP_CLUSTER            16
+#define SWAP_READAHEAD          8       // Power of two
+
+typedef struct swap_stats {
+    uint32_t total_slots;
+    uint32_t used_slots;
+    uint32_t active_pages;      // Anonymous pages on the active list
+    uint32_t inactive_pages;
+    uint32_t activations;       // Inactive pages found referenced
+    uint32_t deactivations;
+    uint32_t swap_outs;         // Pages written
+    uint32_t clusters;          // Write batches
+    uint32_t swap_ins;          // Pages read, readahead included
+    uint32_t readahead;         // Pages read without a fault of their own
+    uint32_t faults;            // Faults that went to the device
+    uint32_t errors;
+} swap_stats_t;
+
+// Start swapping to 'pages' slots of dev from start_sector (0 = to the end)
+int swap_on(blkdev_t* dev, uint32_t start_sector, uint32_t pages);
+int swap_enabled(void);
+
+// Page aging lists of anonymous pages (maintained by the VMM)
+void swap_lru_add(address_space_t* as, uint32_t vaddr, uint32_t phys, int active);
+void swap_lru_del(uint32_t phys);
+
+// Swap entries held in page tables
+void swap_entry_dup(uint32_t slot);
+void swap_entry_free(uint32_t slot);
+
+// Bring a swapped-out page (and its readahead neighbours) back; 0 on success
+int swap_in(address_space_t* as, uint32_t vaddr);
+
+// Age the lists and swap out up to nr pages; returns frames freed
+uint32_t swap_reclaim(uint32_t nr);
+
+swap_stats_t swap_get_stats(void);
+void swap_print_stats(void);
+
+// Touch more anonymous memory than there are frames and check it survives
+void swap_benchmark(uint32_t pages);
+
+#endif // SWAP_H
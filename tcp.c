@@ -0,0 +1,742 @@
+#include <stddef.h>
+#include "tcp.h"
+#include "ktime.h"
+#include "mm.h"
+
+typedef struct tcp_header {
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint32_t seq;
+    uint32_t ack;
+    uint8_t data_offset;        // Header length in dwords, upper nibble
+    uint8_t flags;
+    uint16_t window;
+    uint16_t checksum;
+    uint16_t urgent;
+} __attribute__((packed)) tcp_header_t;
+
+#define TCP_FIN 0x01
+#define TCP_SYN 0x02
+#define TCP_RST 0x04
+#define TCP_PSH 0x08
+#define TCP_ACK 0x10
+
+// Sequence number comparisons modulo 2^32
+#define SEQ_LT(a, b)  ((int32_t)((a) - (b)) < 0)
+#define SEQ_LEQ(a, b) ((int32_t)((a) - (b)) <= 0)
+
+static tcp_pcb_t tcp_pcbs[TCP_MAX_PCBS];
+static uint16_t tcp_next_port = TCP_EPHEMERAL_PORT;
+static uint32_t tcp_iss_counter = 0;
+
+static const char* tcp_state_names[] = {
+    "CLOSED", "LISTEN", "SYN_SENT", "SYN_RCVD", "ESTABLISHED",
+    "FIN_WAIT_1", "FIN_WAIT_2", "CLOSE_WAIT", "CLOSING", "LAST_ACK"
+};
+
+const char* tcp_state_name(tcp_state_t state) {
+    return tcp_state_names[state];
+}
+
+static uint32_t tcp_new_iss(void) {
+    tcp_iss_counter += 64000;
+    return (uint32_t)(ktime_get_ns() >> 4) + tcp_iss_counter;
+}
+
+static uint16_t tcp_alloc_port(void) {
+    for (uint32_t tries = 0; tries < 0x4000; tries++) {
+        uint16_t port = tcp_next_port++;
+        if (tcp_next_port == 0) {
+            tcp_next_port = TCP_EPHEMERAL_PORT;
+        }
+
+        int used = 0;
+        for (int i = 0; i < TCP_MAX_PCBS; i++) {
+            if (tcp_pcbs[i].in_use && tcp_pcbs[i].local_port == port) {
+                used = 1;
+                break;
+            }
+        }
+        if (!used) {
+            return port;
+        }
+    }
+    return 0;
+}
+
+// The window is TCP_RCV_BUFFERS full segments' worth of bytes. The queue
+// may hold twice that many buffers, so a window filled with odd-sized
+// segments is still honoured, but tiny segments cannot exhaust the pool.
+static uint32_t tcp_rcv_window(tcp_pcb_t* pcb) {
+    uint32_t limit = TCP_RCV_BUFFERS * pcb->mss;
+    if (pcb->rcv_queue.count >= 2 * TCP_RCV_BUFFERS || pcb->rcv_bytes >= limit) {
+        return 0;
+    }
+    return limit - pcb->rcv_bytes;
+}
+
+static void tcp_release_rtx(tcp_pcb_t* pcb) {
+    while (pcb->rtx_count) {
+        netbuf_free(pcb->rtx[pcb->rtx_head].nb);
+        pcb->rtx_head = (pcb->rtx_head + 1) % TCP_MAX_INFLIGHT;
+        pcb->rtx_count--;
+    }
+}
+
+static void tcp_free(tcp_pcb_t* pcb) {
+    tcp_release_rtx(pcb);
+    netbuf_queue_purge(&pcb->rcv_queue);
+    pcb->in_use = 0;
+}
+
+// Entering CLOSED drops everything in flight; orphans go away entirely
+static void tcp_set_closed(tcp_pcb_t* pcb) {
+    pcb->state = TCP_CLOSED;
+    tcp_release_rtx(pcb);
+    if (pcb->orphan) {
+        tcp_free(pcb);
+    }
+}
+
+static tcp_pcb_t* tcp_alloc(void) {
+    for (int i = 0; i < TCP_MAX_PCBS; i++) {
+        if (!tcp_pcbs[i].in_use) {
+            tcp_pcb_t* pcb = &tcp_pcbs[i];
+            memset(pcb, 0, sizeof(tcp_pcb_t));
+            pcb->in_use = 1;
+            pcb->state = TCP_CLOSED;
+            pcb->mss = 536;
+            pcb->rto_ms = TCP_RTO_MIN_MS;
+            return pcb;
+        }
+    }
+    return NULL;
+}
+
+// Checksum unless the route goes over an interface that does not need one
+static void tcp_checksum(netbuf_t* nb, uint32_t src_ip, uint32_t dst_ip) {
+    uint32_t next_hop;
+    netif_t* netif = net_route(dst_ip, &next_hop);
+    if (netif && (netif->flags & NETIF_F_NO_CSUM)) {
+        return;
+    }
+
+    tcp_header_t* th = (tcp_header_t*)nb->data;
+    uint32_t pseudo = inet_pseudo_checksum(src_ip, dst_ip, IP_PROTO_TCP, nb->len);
+    th->checksum = htons(inet_checksum(nb->data, nb->len, pseudo));
+}
+
+// Build and send one segment; anything occupying sequence space is kept
+// for retransmission until acknowledged
+static int tcp_output(tcp_pcb_t* pcb, uint8_t flags, const void* data, uint32_t len, uint32_t seq) {
+    netbuf_t* nb = netbuf_alloc();
+    if (!nb) {
+        return -1;
+    }
+    if (len) {
+        memcpy(netbuf_put(nb, len), data, len);
+    }
+
+    tcp_header_t* th = (tcp_header_t*)netbuf_push(nb, sizeof(tcp_header_t));
+    uint32_t window = tcp_rcv_window(pcb);
+    th->src_port = htons(pcb->local_port);
+    th->dst_port = htons(pcb->remote_port);
+    th->seq = htonl(seq);
+    th->ack = htonl((flags & TCP_ACK) ? pcb->rcv_nxt : 0);
+    th->data_offset = (sizeof(tcp_header_t) / 4) << 4;
+    th->flags = flags;
+    th->window = htons(window > 0xFFFF ? 0xFFFF : window);
+    th->checksum = 0;
+    th->urgent = 0;
+    tcp_checksum(nb, pcb->local_ip, pcb->remote_ip);
+
+    if (flags & TCP_ACK) {
+        pcb->rcv_acked = pcb->rcv_nxt;
+        pcb->adv_wnd = window;
+    }
+
+    uint32_t seq_len = len + ((flags & (TCP_SYN | TCP_FIN)) ? 1 : 0);
+    if (seq_len) {
+        tcp_rtx_t* rtx = &pcb->rtx[(pcb->rtx_head + pcb->rtx_count) % TCP_MAX_INFLIGHT];
+        netbuf_get(nb);
+        rtx->nb = nb;
+        rtx->start = nb->data;
+        rtx->len = nb->len;
+        rtx->seq = seq;
+        rtx->seq_len = seq_len;
+        if (pcb->rtx_count++ == 0) {
+            pcb->rtx_deadline = ktime_get_ns() + pcb->rto_ms * NSEC_PER_MSEC;
+        }
+    }
+
+    pcb->segs_out++;
+    ipv4_output(nb, pcb->local_ip, pcb->remote_ip, IP_PROTO_TCP);
+    return 0;
+}
+
+static void tcp_send_ack(tcp_pcb_t* pcb) {
+    tcp_output(pcb, TCP_ACK, NULL, 0, pcb->snd_nxt);
+}
+
+// Answer a segment that has no connection
+static void tcp_send_reset(uint32_t src_ip, uint16_t src_port, uint32_t dst_ip, uint16_t dst_port,
+                           uint32_t seq, uint32_t ack, int with_ack) {
+    netbuf_t* nb = netbuf_alloc();
+    if (!nb) {
+        return;
+    }
+
+    tcp_header_t* th = (tcp_header_t*)netbuf_push(nb, sizeof(tcp_header_t));
+    memset(th, 0, sizeof(tcp_header_t));
+    th->src_port = htons(src_port);
+    th->dst_port = htons(dst_port);
+    th->seq = htonl(seq);
+    th->ack = htonl(ack);
+    th->data_offset = (sizeof(tcp_header_t) / 4) << 4;
+    th->flags = TCP_RST | (with_ack ? TCP_ACK : 0);
+    tcp_checksum(nb, src_ip, dst_ip);
+
+    ipv4_output(nb, src_ip, dst_ip, IP_PROTO_TCP);
+}
+
+static void tcp_try_fin(tcp_pcb_t* pcb) {
+    if (!pcb->fin_pending || pcb->rtx_count == TCP_MAX_INFLIGHT) {
+        return;
+    }
+
+    if (tcp_output(pcb, TCP_FIN | TCP_ACK, NULL, 0, pcb->snd_nxt) != 0) {
+        return;
+    }
+    pcb->snd_nxt++;
+    pcb->fin_pending = 0;
+    pcb->fin_sent = 1;
+    pcb->state = pcb->state == TCP_CLOSE_WAIT ? TCP_LAST_ACK : TCP_FIN_WAIT_1;
+}
+
+// Release every fully acknowledged segment
+static void tcp_ack_rtx(tcp_pcb_t* pcb, uint32_t ack) {
+    pcb->snd_una = ack;
+    while (pcb->rtx_count) {
+        tcp_rtx_t* rtx = &pcb->rtx[pcb->rtx_head];
+        if (!SEQ_LEQ(rtx->seq + rtx->seq_len, ack)) {
+            break;
+        }
+        netbuf_free(rtx->nb);
+        pcb->rtx_head = (pcb->rtx_head + 1) % TCP_MAX_INFLIGHT;
+        pcb->rtx_count--;
+    }
+
+    // Progress resets the backoff
+    pcb->rto_ms = TCP_RTO_MIN_MS;
+    pcb->retries = 0;
+    if (pcb->rtx_count) {
+        pcb->rtx_deadline = ktime_get_ns() + pcb->rto_ms * NSEC_PER_MSEC;
+    }
+}
+
+static tcp_pcb_t* tcp_lookup(uint32_t local_ip, uint16_t local_port, uint32_t remote_ip, uint16_t remote_port) {
+    for (int i = 0; i < TCP_MAX_PCBS; i++) {
+        tcp_pcb_t* pcb = &tcp_pcbs[i];
+        if (pcb->in_use && pcb->state != TCP_LISTEN && pcb->state != TCP_CLOSED &&
+            pcb->local_port == local_port && pcb->remote_port == remote_port &&
+            pcb->remote_ip == remote_ip && pcb->local_ip == local_ip) {
+            return pcb;
+        }
+    }
+
+    for (int i = 0; i < TCP_MAX_PCBS; i++) {
+        tcp_pcb_t* pcb = &tcp_pcbs[i];
+        if (pcb->in_use && pcb->state == TCP_LISTEN && pcb->local_port == local_port &&
+            (pcb->local_ip == 0 || pcb->local_ip == local_ip)) {
+            return pcb;
+        }
+    }
+    return NULL;
+}
+
+static uint16_t tcp_route_mss(uint32_t dst_ip) {
+    uint32_t next_hop;
+    netif_t* netif = net_route(dst_ip, &next_hop);
+    return netif ? netif->mtu - 40 : 536;
+}
+
+// A SYN for a listening socket creates a child in SYN_RECEIVED
+static void tcp_rx_listen(tcp_pcb_t* listener, netbuf_t* nb, uint32_t seq, uint8_t flags, uint16_t wnd) {
+    if (flags & TCP_RST) {
+        return;
+    }
+    if (flags & TCP_ACK) {
+        tcp_send_reset(nb->dst_ip, nb->dst_port, nb->src_ip, nb->src_port, 0, 0, 0);
+        return;
+    }
+    if (!(flags & TCP_SYN)) {
+        return;
+    }
+
+    int pending = 0;
+    for (int i = 0; i < TCP_MAX_PCBS; i++) {
+        if (tcp_pcbs[i].in_use && tcp_pcbs[i].parent == listener) {
+            pending++;
+        }
+    }
+    if (pending >= listener->backlog) {
+        return; // The peer retries its SYN
+    }
+
+    tcp_pcb_t* child = tcp_alloc();
+    if (!child) {
+        return;
+    }
+    child->parent = listener;
+    child->orphan = 1;              // Owned by the stack until accepted
+    child->local_ip = nb->dst_ip;
+    child->local_port = nb->dst_port;
+    child->remote_ip = nb->src_ip;
+    child->remote_port = nb->src_port;
+    child->mss = tcp_route_mss(child->remote_ip);
+    child->rcv_nxt = seq + 1;
+    child->snd_wnd = wnd;
+    child->snd_una = tcp_new_iss();
+    child->snd_nxt = child->snd_una;
+    child->state = TCP_SYN_RECEIVED;
+
+    if (tcp_output(child, TCP_SYN | TCP_ACK, NULL, 0, child->snd_nxt) != 0) {
+        tcp_free(child);
+        return;
+    }
+    child->snd_nxt++;
+}
+
+static void tcp_rx_syn_sent(tcp_pcb_t* pcb, netbuf_t* nb, uint32_t seq, uint32_t ack,
+                            uint8_t flags, uint16_t wnd) {
+    if ((flags & TCP_ACK) && ack != pcb->snd_nxt) {
+        if (!(flags & TCP_RST)) {
+            tcp_send_reset(nb->dst_ip, nb->dst_port, nb->src_ip, nb->src_port, ack, 0, 0);
+        }
+        return;
+    }
+    if (flags & TCP_RST) {
+        if (flags & TCP_ACK) {
+            pcb->reset = 1;         // Connection refused
+            tcp_set_closed(pcb);
+        }
+        return;
+    }
+    if (!(flags & TCP_SYN) || !(flags & TCP_ACK)) {
+        return; // Simultaneous open is not supported
+    }
+
+    pcb->rcv_nxt = seq + 1;
+    pcb->snd_wnd = wnd;
+    tcp_ack_rtx(pcb, ack);
+    pcb->state = TCP_ESTABLISHED;
+    tcp_send_ack(pcb);
+}
+
+// Segment processing for synchronized states. Returns 1 if the buffer was queued.
+static int tcp_rx_segment(tcp_pcb_t* pcb, netbuf_t* nb, uint32_t seq, uint32_t ack,
+                          uint8_t flags, uint16_t wnd) {
+    if (flags & TCP_RST) {
+        if (SEQ_LEQ(pcb->rcv_nxt, seq) && SEQ_LEQ(seq, pcb->rcv_nxt + pcb->adv_wnd)) {
+            pcb->reset = 1;
+            tcp_set_closed(pcb);
+        }
+        return 0;
+    }
+    if ((flags & TCP_SYN) || !(flags & TCP_ACK)) {
+        return 0; // Repeated SYN: our SYN-ACK is retransmitted by the timer
+    }
+
+    // Acknowledgement and window
+    if (SEQ_LT(pcb->snd_una, ack) && SEQ_LEQ(ack, pcb->snd_nxt)) {
+        tcp_ack_rtx(pcb, ack);
+        if (pcb->state == TCP_SYN_RECEIVED) {
+            pcb->state = TCP_ESTABLISHED;
+        }
+    } else if (pcb->state == TCP_SYN_RECEIVED) {
+        return 0;
+    }
+    pcb->snd_wnd = wnd;
+
+    int fin_acked = pcb->fin_sent && pcb->snd_una == pcb->snd_nxt;
+    if (fin_acked) {
+        if (pcb->state == TCP_FIN_WAIT_1) {
+            pcb->state = TCP_FIN_WAIT_2;
+        } else if (pcb->state == TCP_CLOSING || pcb->state == TCP_LAST_ACK) {
+            tcp_set_closed(pcb);
+            return 0;
+        }
+    }
+    tcp_try_fin(pcb);
+
+    // Trim anything already received
+    uint32_t len = nb->len;
+    if (SEQ_LT(seq, pcb->rcv_nxt) && len > 0) {
+        uint32_t trim = pcb->rcv_nxt - seq;
+        if (trim > len) {
+            trim = len;
+        }
+        netbuf_pull(nb, trim);
+        seq += trim;
+        len -= trim;
+    }
+
+    // Out of order (or a window probe): tell the peer what we expect
+    if (seq != pcb->rcv_nxt) {
+        tcp_send_ack(pcb);
+        return 0;
+    }
+
+    int queued = 0;
+    if (len > 0) {
+        int receiving = pcb->state == TCP_ESTABLISHED || pcb->state == TCP_FIN_WAIT_1 ||
+                        pcb->state == TCP_FIN_WAIT_2;
+        if (!receiving) {
+            return 0;
+        }
+        if (pcb->orphan && !pcb->parent) {
+            pcb->rcv_nxt += len;    // Closed by its owner; acknowledge and discard
+        } else if (len <= tcp_rcv_window(pcb)) {
+            pcb->rcv_nxt += len;
+            pcb->rcv_bytes += len;
+            netbuf_queue_push(&pcb->rcv_queue, nb);
+            queued = 1;
+        } else {
+            tcp_send_ack(pcb);      // Full: re-advertise the closed window
+            return 0;
+        }
+    }
+
+    if ((flags & TCP_FIN) && !pcb->fin_received) {
+        pcb->rcv_nxt++;
+        pcb->fin_received = 1;
+        tcp_send_ack(pcb);
+
+        switch (pcb->state) {
+        case TCP_ESTABLISHED:
+            pcb->state = TCP_CLOSE_WAIT;
+            break;
+        case TCP_FIN_WAIT_1:
+            pcb->state = TCP_CLOSING;
+            break;
+        case TCP_FIN_WAIT_2:
+            tcp_set_closed(pcb);    // No TIME_WAIT
+            break;
+        default:
+            break;
+        }
+        return queued;
+    }
+
+    // ACK every second full segment at once; the rest go out from tcp_timer
+    if (pcb->rcv_nxt - pcb->rcv_acked >= 2u * pcb->mss) {
+        tcp_send_ack(pcb);
+    }
+    return queued;
+}
+
+void tcp_rx(netbuf_t* nb) {
+    tcp_header_t* th = (tcp_header_t*)nb->data;
+    uint32_t header_len = nb->len >= sizeof(tcp_header_t) ? (th->data_offset >> 4) * 4 : 0;
+    if (header_len < sizeof(tcp_header_t) || header_len > nb->len) {
+        netbuf_free(nb);
+        return;
+    }
+    if (!nb->csum_verified) {
+        uint32_t pseudo = inet_pseudo_checksum(nb->src_ip, nb->dst_ip, IP_PROTO_TCP, nb->len);
+        if (inet_checksum(nb->data, nb->len, pseudo) != 0) {
+            netbuf_free(nb);
+            return;
+        }
+    }
+
+    uint32_t seq = ntohl(th->seq);
+    uint32_t ack = ntohl(th->ack);
+    uint8_t flags = th->flags;
+    uint16_t wnd = ntohs(th->window);
+    nb->src_port = ntohs(th->src_port);
+    nb->dst_port = ntohs(th->dst_port);
+    netbuf_pull(nb, header_len);
+
+    tcp_pcb_t* pcb = tcp_lookup(nb->dst_ip, nb->dst_port, nb->src_ip, nb->src_port);
+    if (!pcb) {
+        if (!(flags & TCP_RST)) {
+            uint32_t seq_len = nb->len + ((flags & (TCP_SYN | TCP_FIN)) ? 1 : 0);
+            if (flags & TCP_ACK) {
+                tcp_send_reset(nb->dst_ip, nb->dst_port, nb->src_ip, nb->src_port, ack, 0, 0);
+            } else {
+                tcp_send_reset(nb->dst_ip, nb->dst_port, nb->src_ip, nb->src_port, 0, seq + seq_len, 1);
+            }
+        }
+        netbuf_free(nb);
+        return;
+    }
+
+    pcb->segs_in++;
+    int queued = 0;
+    switch (pcb->state) {
+    case TCP_LISTEN:
+        tcp_rx_listen(pcb, nb, seq, flags, wnd);
+        break;
+    case TCP_SYN_SENT:
+        tcp_rx_syn_sent(pcb, nb, seq, ack, flags, wnd);
+        break;
+    default:
+        queued = tcp_rx_segment(pcb, nb, seq, ack, flags, wnd);
+        break;
+    }
+
+    if (!queued) {
+        netbuf_free(nb);
+    }
+}
+
+// Delayed ACKs, retransmission and zero-window probes
+void tcp_timer(void) {
+    uint64_t now = ktime_get_ns();
+
+    for (int i = 0; i < TCP_MAX_PCBS; i++) {
+        tcp_pcb_t* pcb = &tcp_pcbs[i];
+        if (!pcb->in_use || pcb->state == TCP_CLOSED || pcb->state == TCP_LISTEN) {
+            continue;
+        }
+
+        if (pcb->rcv_nxt != pcb->rcv_acked && pcb->state != TCP_SYN_SENT) {
+            tcp_send_ack(pcb);
+        }
+
+        if (now < pcb->rtx_deadline) {
+            continue;
+        }
+
+        if (pcb->rtx_count) {
+            if (++pcb->retries > TCP_MAX_RETRIES) {
+                pcb->reset = 1;     // Timed out
+                tcp_set_closed(pcb);
+                continue;
+            }
+
+            // Go-back-N: resend every segment nobody else still holds
+            for (uint32_t j = 0; j < pcb->rtx_count; j++) {
+                tcp_rtx_t* rtx = &pcb->rtx[(pcb->rtx_head + j) % TCP_MAX_INFLIGHT];
+                if (rtx->nb->refcount != 1) {
+                    continue;
+                }
+                rtx->nb->data = rtx->start;
+                rtx->nb->len = rtx->len;
+                netbuf_get(rtx->nb);
+                ipv4_output(rtx->nb, pcb->local_ip, pcb->remote_ip, IP_PROTO_TCP);
+                pcb->retransmits++;
+            }
+
+            pcb->rto_ms = pcb->rto_ms * 2 > TCP_RTO_MAX_MS ? TCP_RTO_MAX_MS : pcb->rto_ms * 2;
+            pcb->rtx_deadline = now + pcb->rto_ms * NSEC_PER_MSEC;
+        } else if (pcb->window_blocked && pcb->snd_wnd == 0) {
+            // An old sequence number forces the peer to answer with its window
+            tcp_output(pcb, TCP_ACK, NULL, 0, pcb->snd_nxt - 1);
+            pcb->rtx_deadline = now + pcb->rto_ms * NSEC_PER_MSEC;
+        }
+    }
+}
+
+// Connection management
+
+tcp_pcb_t* tcp_open(void) {
+    return tcp_alloc();
+}
+
+int tcp_bind(tcp_pcb_t* pcb, uint32_t ip, uint16_t port) {
+    if (port == 0) {
+        port = tcp_alloc_port();
+    }
+    // Connections still shutting down after close do not hold their port
+    for (int i = 0; i < TCP_MAX_PCBS; i++) {
+        tcp_pcb_t* other = &tcp_pcbs[i];
+        if (other != pcb && other->in_use && !other->orphan && other->local_port == port &&
+            (other->local_ip == 0 || ip == 0 || other->local_ip == ip)) {
+            return -1;
+        }
+    }
+    if (port == 0) {
+        return -1;
+    }
+
+    pcb->local_ip = ip;
+    pcb->local_port = port;
+    return 0;
+}
+
+int tcp_listen(tcp_pcb_t* pcb, int backlog) {
+    if (pcb->state != TCP_CLOSED || pcb->local_port == 0) {
+        return -1;
+    }
+    pcb->backlog = backlog > 0 ? backlog : 1;
+    pcb->state = TCP_LISTEN;
+    return 0;
+}
+
+tcp_pcb_t* tcp_accept(tcp_pcb_t* listener) {
+    for (int i = 0; i < TCP_MAX_PCBS; i++) {
+        tcp_pcb_t* pcb = &tcp_pcbs[i];
+        if (pcb->in_use && pcb->parent == listener &&
+            (pcb->state == TCP_ESTABLISHED || pcb->state == TCP_CLOSE_WAIT)) {
+            pcb->parent = NULL;
+            pcb->orphan = 0;
+            pcb->accepted = 1;
+            return pcb;
+        }
+    }
+    return NULL;
+}
+
+// Send the SYN; the caller polls until the state leaves SYN_SENT
+int tcp_connect(tcp_pcb_t* pcb, uint32_t ip, uint16_t port) {
+    uint32_t next_hop;
+    netif_t* netif = net_route(ip, &next_hop);
+    if (pcb->state != TCP_CLOSED || !netif) {
+        return -1;
+    }
+
+    if (!pcb->local_ip) {
+        pcb->local_ip = net_is_local_ip(ip) ? ip : netif->ip;
+    }
+    if (!pcb->local_port && tcp_bind(pcb, pcb->local_ip, 0) != 0) {
+        return -1;
+    }
+
+    pcb->remote_ip = ip;
+    pcb->remote_port = port;
+    pcb->mss = netif->mtu - 40;
+    pcb->snd_una = tcp_new_iss();
+    pcb->snd_nxt = pcb->snd_una;
+    pcb->snd_wnd = pcb->mss;
+    pcb->state = TCP_SYN_SENT;
+
+    if (tcp_output(pcb, TCP_SYN, NULL, 0, pcb->snd_nxt) != 0) {
+        pcb->state = TCP_CLOSED;
+        return -1;
+    }
+    pcb->snd_nxt++;
+    return 0;
+}
+
+void tcp_close(tcp_pcb_t* pcb) {
+    pcb->orphan = 1;
+    netbuf_queue_purge(&pcb->rcv_queue);
+    pcb->rcv_bytes = 0;
+
+    switch (pcb->state) {
+    case TCP_LISTEN:
+        // Abort connections nobody accepted
+        for (int i = 0; i < TCP_MAX_PCBS; i++) {
+            tcp_pcb_t* child = &tcp_pcbs[i];
+            if (child->in_use && child->parent == pcb) {
+                tcp_send_reset(child->local_ip, child->local_port, child->remote_ip,
+                               child->remote_port, child->snd_nxt, 0, 0);
+                tcp_set_closed(child);
+            }
+        }
+        tcp_set_closed(pcb);
+        break;
+    case TCP_CLOSED:
+    case TCP_SYN_SENT:
+        tcp_set_closed(pcb);
+        break;
+    case TCP_SYN_RECEIVED:
+    case TCP_ESTABLISHED:
+    case TCP_CLOSE_WAIT:
+        pcb->fin_pending = 1;
+        tcp_try_fin(pcb);
+        break;
+    default:
+        break; // FIN already sent
+    }
+}
+
+// Data transfer
+
+// Queue as much as the peer's window and the retransmit ring allow
+int tcp_send(tcp_pcb_t* pcb, const void* data, uint32_t len) {
+    if (pcb->reset) {
+        return -1;
+    }
+    if (pcb->state == TCP_SYN_SENT || pcb->state == TCP_SYN_RECEIVED) {
+        return TCP_ERR_WOULDBLOCK;
+    }
+    if ((pcb->state != TCP_ESTABLISHED && pcb->state != TCP_CLOSE_WAIT) ||
+        pcb->fin_pending || pcb->fin_sent) {
+        return -1;
+    }
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint32_t sent = 0;
+    pcb->window_blocked = 0;
+
+    while (sent < len && pcb->rtx_count < TCP_MAX_INFLIGHT) {
+        uint32_t in_flight = pcb->snd_nxt - pcb->snd_una;
+        if (in_flight >= pcb->snd_wnd) {
+            if (pcb->snd_wnd == 0 && pcb->rtx_count == 0) {
+                pcb->window_blocked = 1;
+                pcb->rtx_deadline = ktime_get_ns() + pcb->rto_ms * NSEC_PER_MSEC;
+            }
+            break;
+        }
+
+        uint32_t chunk = len - sent;
+        if (chunk > pcb->mss) {
+            chunk = pcb->mss;
+        }
+        if (chunk > pcb->snd_wnd - in_flight) {
+            chunk = pcb->snd_wnd - in_flight;
+        }
+
+        if (tcp_output(pcb, TCP_ACK | TCP_PSH, bytes + sent, chunk, pcb->snd_nxt) != 0) {
+            break;
+        }
+        pcb->snd_nxt += chunk;
+        sent += chunk;
+    }
+
+    return sent ? (int)sent : TCP_ERR_WOULDBLOCK;
+}
+
+// Copy out received data; 0 means the peer closed its side
+int tcp_recv(tcp_pcb_t* pcb, void* buffer, uint32_t len) {
+    uint8_t* out = (uint8_t*)buffer;
+    uint32_t copied = 0;
+
+    while (copied < len && pcb->rcv_queue.head) {
+        netbuf_t* nb = pcb->rcv_queue.head;
+        uint32_t chunk = nb->len < len - copied ? nb->len : len - copied;
+        memcpy(out + copied, nb->data, chunk);
+        netbuf_pull(nb, chunk);
+        copied += chunk;
+        pcb->rcv_bytes -= chunk;
+
+        if (nb->len == 0) {
+            netbuf_free(netbuf_queue_pop(&pcb->rcv_queue));
+        }
+    }
+
+    if (copied) {
+        // Tell a stalled sender as soon as the window has reopened usefully
+        if (tcp_rcv_window(pcb) >= pcb->adv_wnd + 2u * pcb->mss &&
+            pcb->state != TCP_CLOSED) {
+            tcp_send_ack(pcb);
+        }
+        return copied;
+    }
+
+    if (pcb->reset) {
+        return -1;
+    }
+    if (pcb->fin_received || pcb->state == TCP_CLOSED) {
+        return 0;
+    }
+    return TCP_ERR_WOULDBLOCK;
+}
+
+int tcp_readable(tcp_pcb_t* pcb) {
+    return pcb->rcv_queue.count > 0 || pcb->fin_received || pcb->reset ||
+           pcb->state == TCP_CLOSED;
+}
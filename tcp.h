@@ -0,0 +1,107 @@
+#ifndef TCP_H
+#define TCP_H
+
+#include <stdint.h>
+#include "net.h"
+
+// A deliberately small TCP: no options, fixed MSS from the route's MTU,
+// go-back-N retransmission and no out-of-order queue (segments beyond
+// rcv_nxt are dropped and re-requested with a duplicate ACK).
+#define TCP_MAX_PCBS       16
+#define TCP_MAX_INFLIGHT   16       // Unacknowledged segments per connection
+#define TCP_RCV_BUFFERS    8        // Receive queue budget, in full-sized segments
+#define TCP_RTO_MIN_MS     200
+#define TCP_RTO_MAX_MS     3200
+#define TCP_MAX_RETRIES    8
+#define TCP_EPHEMERAL_PORT 49152
+
+// Return values besides byte counts
+#define TCP_ERR_WOULDBLOCK (-2)
+
+typedef enum {
+    TCP_CLOSED,
+    TCP_LISTEN,
+    TCP_SYN_SENT,
+    TCP_SYN_RECEIVED,
+    TCP_ESTABLISHED,
+    TCP_FIN_WAIT_1,
+    TCP_FIN_WAIT_2,
+    TCP_CLOSE_WAIT,
+    TCP_CLOSING,
+    TCP_LAST_ACK
+} tcp_state_t;
+
+// A sent segment kept until it is acknowledged. The buffer is shared with
+// the device (or the loopback receiver) and only resent once they let go.
+typedef struct tcp_rtx {
+    netbuf_t* nb;
+    uint8_t* start;             // TCP header inside the buffer
+    uint32_t len;               // Header + payload
+    uint32_t seq;
+    uint32_t seq_len;           // Payload plus one for SYN/FIN
+} tcp_rtx_t;
+
+// Protocol control block
+typedef struct tcp_pcb {
+    int in_use;
+    int orphan;                 // Closed by the owner; freed once the state reaches CLOSED
+    int accepted;
+    int reset;                  // Connection refused or reset by the peer
+    tcp_state_t state;
+    struct tcp_pcb* parent;     // Listener a not-yet-accepted connection belongs to
+    int backlog;
+
+    uint32_t local_ip;
+    uint32_t remote_ip;
+    uint16_t local_port;
+    uint16_t remote_port;
+    uint16_t mss;
+
+    // Send side
+    uint32_t snd_una;
+    uint32_t snd_nxt;
+    uint32_t snd_wnd;
+    tcp_rtx_t rtx[TCP_MAX_INFLIGHT];
+    uint32_t rtx_head;
+    uint32_t rtx_count;
+    uint32_t rto_ms;
+    uint64_t rtx_deadline;      // ktime ns
+    uint32_t retries;           // Consecutive timeouts without progress
+    int window_blocked;         // A send found the peer's window closed
+    int fin_pending;            // Close requested, FIN not sent yet
+    int fin_sent;
+
+    // Receive side
+    uint32_t rcv_nxt;
+    netbuf_queue_t rcv_queue;
+    uint32_t rcv_bytes;
+    uint32_t rcv_acked;         // rcv_nxt as of the last ACK sent
+    uint32_t adv_wnd;           // Window in the last segment sent
+    int fin_received;
+
+    uint32_t segs_out;
+    uint32_t segs_in;
+    uint32_t retransmits;
+} tcp_pcb_t;
+
+// Connection management
+tcp_pcb_t* tcp_open(void);
+int tcp_bind(tcp_pcb_t* pcb, uint32_t ip, uint16_t port);
+int tcp_listen(tcp_pcb_t* pcb, int backlog);
+tcp_pcb_t* tcp_accept(tcp_pcb_t* listener);
+int tcp_connect(tcp_pcb_t* pcb, uint32_t ip, uint16_t port);
+void tcp_close(tcp_pcb_t* pcb);
+
+// Data transfer (non-blocking; callers poll the stack while waiting)
+int tcp_send(tcp_pcb_t* pcb, const void* data, uint32_t len);
+int tcp_recv(tcp_pcb_t* pcb, void* buffer, uint32_t len);
+int tcp_readable(tcp_pcb_t* pcb);
+
+// Called by the IPv4 layer and net_poll
+void tcp_rx(netbuf_t* nb);
+void tcp_timer(void);
+
+// Diagnostics
+const char* tcp_state_name(tcp_state_t state);
+
+#endif // TCP_H
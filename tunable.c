@@ -0,0 +1,293 @@
+#include "tunable.h"
+#include "klib.h"
+#include "mm.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_putchar(char c);
+extern void terminal_setcolor(uint8_t color);
+extern void terminal_write_dec(uint32_t value);
+
+// VGA colors
+#define VGA_COLOR_BLACK         0
+#define VGA_COLOR_LIGHT_GREY    7
+#define VGA_COLOR_LIGHT_CYAN    11
+#define VGA_COLOR_YELLOW        14
+#define VGA_COLOR_WHITE         15
+
+static inline uint8_t vga_entry_color(uint8_t fg, uint8_t bg) {
+    return fg | bg << 4;
+}
+
+#if CONFIG_TUNABLES
+
+#define TUNABLE_VALUE_MAX   32      // Longest value text taken from the command line
+
+static char tunable_cmdline_buf[TUNABLE_CMDLINE_MAX];
+static tunable_t* tunable_list;
+
+void tunable_init(const char* cmdline) {
+    tunable_cmdline_buf[0] = '\0';
+    if (cmdline) {
+        strlcpy(tunable_cmdline_buf, cmdline, sizeof(tunable_cmdline_buf));
+    }
+    tunable_list = NULL;
+}
+
+const char* tunable_cmdline(void) {
+    return tunable_cmdline_buf;
+}
+
+// Command-line tokens are separated by spaces; each is "name=value" or a bare name
+static const char* tunable_next_token(const char* p, size_t* len) {
+    while (*p == ' ') {
+        p++;
+    }
+    *len = 0;
+    while (p[*len] && p[*len] != ' ') {
+        (*len)++;
+    }
+    return *len ? p : NULL;
+}
+
+static size_t tunable_token_name_len(const char* token, size_t len) {
+    size_t n = 0;
+    while (n < len && token[n] != '=') {
+        n++;
+    }
+    return n;
+}
+
+static int tunable_name_is(const char* name, const char* token, size_t len) {
+    return strlen(name) == len && memcmp(name, token, len) == 0;
+}
+
+// The last occurrence wins, as when the same option is given twice
+static int tunable_cmdline_value(const char* name, char* value, size_t size) {
+    int found = 0;
+    size_t len;
+    const char* token = tunable_cmdline_buf;
+    while ((token = tunable_next_token(token, &len)) != NULL) {
+        size_t name_len = tunable_token_name_len(token, len);
+        if (tunable_name_is(name, token, name_len)) {
+            size_t value_len = name_len < len ? len - name_len - 1 : 0;
+            if (name_len == len) {
+                strlcpy(value, "1", size);
+            } else {
+                if (value_len >= size) {
+                    value_len = size - 1;
+                }
+                memcpy(value, token + name_len + 1, value_len);
+                value[value_len] = '\0';
+            }
+            found = 1;
+        }
+        token += len;
+    }
+    return found;
+}
+
+static int tunable_parse_u32(const char* text, uint32_t* out) {
+    uint32_t base = 10;
+    uint32_t value = 0;
+    if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+        base = 16;
+        text += 2;
+    }
+    if (!*text) {
+        return -1;
+    }
+    for (; *text; text++) {
+        uint32_t digit;
+        char c = *text;
+        if (c >= '0' && c <= '9') {
+            digit = (uint32_t)(c - '0');
+        } else if (base == 16 && c >= 'a' && c <= 'f') {
+            digit = (uint32_t)(c - 'a' + 10);
+        } else if (base == 16 && c >= 'A' && c <= 'F') {
+            digit = (uint32_t)(c - 'A' + 10);
+        } else {
+            break;
+        }
+        if (value > (0xFFFFFFFFu - digit) / base) {
+            return -1;
+        }
+        value = value * base + digit;
+    }
+    *out = value;
+    return *text ? -2 : 0;  // -2: trailing characters (a size suffix, maybe)
+}
+
+static int tunable_parse(const tunable_t* tunable, const char* text, uint32_t* out) {
+    uint32_t value;
+
+    if (tunable->type == TUNABLE_BOOL) {
+        if (!strcmp(text, "1") || !strcmp(text, "on") || !strcmp(text, "yes")) {
+            value = 1;
+        } else if (!strcmp(text, "0") || !strcmp(text, "off") || !strcmp(text, "no")) {
+            value = 0;
+        } else {
+            return -1;
+        }
+        *out = value;
+        return 0;
+    }
+
+    int result = tunable_parse_u32(text, &value);
+    if (result == -2 && tunable->type == TUNABLE_SIZE) {
+        const char* suffix = text + strlen(text) - 1;
+        uint32_t shift = 0;
+        if (*suffix == 'K' || *suffix == 'k') {
+            shift = 10;
+        } else if (*suffix == 'M' || *suffix == 'm') {
+            shift = 20;
+        }
+        // The suffix must directly follow the digits
+        uint32_t digits_value;
+        char digits[TUNABLE_VALUE_MAX];
+        size_t digits_len = (size_t)(suffix - text);
+        if (!shift || digits_len >= sizeof(digits)) {
+            return -1;
+        }
+        memcpy(digits, text, digits_len);
+        digits[digits_len] = '\0';
+        if (tunable_parse_u32(digits, &digits_value) != 0 ||
+            digits_value > (0xFFFFFFFFu >> shift)) {
+            return -1;
+        }
+        value = digits_value << shift;
+        result = 0;
+    }
+    if (result != 0 || value < tunable->min || value > tunable->max) {
+        return -1;
+    }
+    *out = value;
+    return 0;
+}
+
+int tunable_register(tunable_t* tunable) {
+    if (tunable_find(tunable->name)) {
+        return -1;
+    }
+
+    // Keep the registry sorted by name for sysctl
+    tunable_t** link = &tunable_list;
+    while (*link && strcmp((*link)->name, tunable->name) < 0) {
+        link = &(*link)->next;
+    }
+    tunable->next = *link;
+    *link = tunable;
+    tunable->flags &= ~TUNABLE_FROM_CMDLINE;
+
+    char text[TUNABLE_VALUE_MAX];
+    if (!tunable_cmdline_value(tunable->name, text, sizeof(text))) {
+        return 0;
+    }
+    uint32_t value;
+    if (tunable_parse(tunable, text, &value) != 0) {
+        terminal_setcolor(vga_entry_color(VGA_COLOR_YELLOW, VGA_COLOR_BLACK));
+        terminal_writestring("Ignoring bad command-line value: ");
+        terminal_writestring(tunable->name);
+        terminal_putchar('=');
+        terminal_writestring(text);
+        terminal_putchar('\n');
+        terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+        return -1;
+    }
+    *tunable->value = value;
+    tunable->flags |= TUNABLE_FROM_CMDLINE;
+    return 0;
+}
+
+tunable_t* tunable_find(const char* name) {
+    for (tunable_t* t = tunable_list; t; t = t->next) {
+        if (!strcmp(t->name, name)) {
+            return t;
+        }
+    }
+    return NULL;
+}
+
+int tunable_set(tunable_t* tunable, const char* text) {
+    uint32_t value;
+    if (tunable->flags & TUNABLE_BOOT) {
+        return -2;
+    }
+    if (tunable_parse(tunable, text, &value) != 0) {
+        return -1;
+    }
+    if (tunable->apply && tunable->apply(value) != 0) {
+        return -3;
+    }
+    *tunable->value = value;
+    return 0;
+}
+
+void tunable_print_value(const tunable_t* tunable) {
+    uint32_t value = *tunable->value;
+    if (tunable->type == TUNABLE_SIZE && value && !(value & 0xFFFFF)) {
+        terminal_write_dec(value >> 20);
+        terminal_putchar('M');
+    } else if (tunable->type == TUNABLE_SIZE && value && !(value & 0x3FF)) {
+        terminal_write_dec(value >> 10);
+        terminal_putchar('K');
+    } else {
+        terminal_write_dec(value);
+    }
+}
+
+static void tunable_pad(size_t written, size_t column) {
+    do {
+        terminal_putchar(' ');
+    } while (++written < column);
+}
+
+// One line: name, value, and what it is; boot-only ones are marked
+void tunable_print(const tunable_t* tunable) {
+    terminal_writestring(tunable->name);
+    tunable_pad(strlen(tunable->name), 22);
+    tunable_print_value(tunable);
+    terminal_writestring(tunable->flags & TUNABLE_FROM_CMDLINE ? " *" : "");
+    terminal_writestring(tunable->flags & TUNABLE_BOOT ? "  [boot] " : "  ");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+    terminal_writestring(tunable->description);
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    terminal_putchar('\n');
+}
+
+void tunable_print_all(void) {
+    terminal_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
+    terminal_writestring("=== Tunables ===\n");
+    terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+    terminal_writestring("Command line: ");
+    terminal_writestring(tunable_cmdline_buf);
+    terminal_putchar('\n');
+
+    for (tunable_t* t = tunable_list; t; t = t->next) {
+        tunable_print(t);
+    }
+
+    // Options nothing registered for, usually typos
+    size_t len;
+    const char* token = tunable_cmdline_buf;
+    while ((token = tunable_next_token(token, &len)) != NULL) {
+        size_t name_len = tunable_token_name_len(token, len);
+        int known = 0;
+        for (tunable_t* t = tunable_list; t && !known; t = t->next) {
+            known = tunable_name_is(t->name, token, name_len);
+        }
+        if (!known && name_len < len) {
+            terminal_setcolor(vga_entry_color(VGA_COLOR_YELLOW, VGA_COLOR_BLACK));
+            terminal_writestring("Unknown option: ");
+            for (size_t i = 0; i < len; i++) {
+                terminal_putchar(token[i]);
+            }
+            terminal_putchar('\n');
+            terminal_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK));
+        }
+        token += len;
+    }
+    terminal_writestring("* set on the command line; [boot] tunables only take effect there\n");
+}
+
+#endif // CONFIG_TUNABLES
@@ -0,0 +1,74 @@
+#ifndef TUNABLE_H
+#define TUNABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+// Runtime tunables. A subsystem describes each of its parameters with a
+// tunable_t and registers it at the top of its init function; registration
+// picks up a "name=value" given on the kernel command line, so the value
+// the subsystem reads right after is already the one asked for at boot.
+// The 'sysctl' command reads them and changes those that are not
+// TUNABLE_BOOT (sizes of structures allocated once at init).
+//
+// Registration never allocates, so the heap size can be a tunable too.
+//
+// Built without CONFIG_TUNABLES, each TUNABLE_VAR is an enumerator holding
+// its Kconfig default, so the code reading it folds; registration and the
+// command line compile away, and subsystems leave out their tunable_t.
+#define TUNABLE_CMDLINE_MAX     256     // Longer command lines are truncated
+
+typedef enum {
+    TUNABLE_U32,        // Decimal or 0x hex
+    TUNABLE_SIZE,       // Bytes; also accepts K and M suffixes
+    TUNABLE_BOOL        // 0/1, on/off, yes/no; a bare name means 1
+} tunable_type_t;
+
+// Flags
+#define TUNABLE_BOOT        0x01    // Only settable on the command line
+#define TUNABLE_FROM_CMDLINE 0x02   // Set by registration (not for callers)
+
+typedef struct tunable {
+    const char* name;               // "subsystem.parameter"
+    const char* description;
+    tunable_type_t type;
+    uint32_t flags;
+    uint32_t* value;                // The subsystem's variable, holding the default
+    uint32_t min;
+    uint32_t max;
+    // Optional; called on a runtime change after the range check, before
+    // the value is stored. Nonzero refuses the change.
+    int (*apply)(uint32_t value);
+    struct tunable* next;           // Registry, sorted by name
+} tunable_t;
+
+// Save the command line (NULL for none); call before any registration
+void tunable_init(const char* cmdline);
+const char* tunable_cmdline(void);
+
+// Add a tunable and apply its command-line value. Returns 0, or -1 if the
+// name is taken or the command-line value was rejected (the default stays).
+int tunable_register(tunable_t* tunable);
+
+tunable_t* tunable_find(const char* name);
+
+// Parse and store a new value at run time. Returns 0, or -1 for a value
+// that does not parse or is out of range, -2 for a TUNABLE_BOOT tunable,
+// -3 if the subsystem's apply hook refused it.
+int tunable_set(tunable_t* tunable, const char* text);
+
+// Printing, for sysctl
+void tunable_print_value(const tunable_t* tunable);
+void tunable_print(const tunable_t* tunable);
+void tunable_print_all(void);
+
+#if CONFIG_TUNABLES
+#define TUNABLE_VAR(name, value)    static uint32_t name = (value)
+#else
+#define TUNABLE_VAR(name, value)    enum { name = (value) }
+#define tunable_init(cmdline)       ((void)(cmdline))
+#define tunable_register(tunable)   ((void)0)
+#endif
+
+#endif // TUNABLE_H
@@ -0,0 +1,56 @@
+#include "lz4.h"
+#include "boottime.h"
+
+// C side of the compressed-kernel stub (lz4stub.asm). It runs with the
+// bootloader's flat segments and no paging, linked at 8MB so the kernel
+// can be unpacked to 1MB underneath it. Nothing here outlives the jump
+// to _start; the kernel later reuses this memory as page frames.
+
+#define VGA_MEMORY          ((volatile uint16_t*)0xB8000)
+#define VGA_ERROR_COLOR     0x4F00      // White on red
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// No terminal yet: write straight to the top line of the screen
+static void unlz4_fail(const char* message) {
+    volatile uint16_t* vga = VGA_MEMORY;
+    while (*message) {
+        *vga++ = VGA_ERROR_COLOR | (uint8_t)*message++;
+    }
+}
+
+// Unpack the kernel described by header and return its entry point, or 0
+// (after saying why) if the image is bad
+uint32_t unlz4_main(const boot_lz4_header_t* header, uint32_t entry_lo, uint32_t entry_hi) {
+    if (header->magic != BOOT_LZ4_MAGIC) {
+        unlz4_fail("LZ4 stub: no kernel image");
+        return 0;
+    }
+
+    uint8_t* dst = (uint8_t*)header->load_addr;
+    uint64_t start = rdtsc();
+    int unpacked = lz4_decompress((const uint8_t*)(header + 1), header->compressed_size,
+                                  dst, header->image_size);
+    uint64_t cycles = rdtsc() - start;
+    if (unpacked != (int)header->image_size) {
+        unlz4_fail("LZ4 stub: corrupt kernel image");
+        return 0;
+    }
+
+    // BSS, as the bootloader would have cleared it for an ELF kernel
+    for (uint32_t* p = (uint32_t*)(dst + header->image_size); p < (uint32_t*)header->bss_end; p++) {
+        *p = 0;
+    }
+
+    boot_image_info_t* info = (boot_image_info_t*)header->info_addr;
+    info->compressed = 1;
+    info->compressed_size = header->compressed_size;
+    info->image_size = header->image_size;
+    info->stub_entry_tsc = ((uint64_t)entry_hi << 32) | entry_lo;
+    info->decompress_cycles = cycles;
+    return header->entry;
+}
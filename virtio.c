@@ -0,0 +1,247 @@
+#include <stddef.h>
+#include "virtio.h"
+#include "mm.h"
+#include "dma.h"
+
+// I/O port functions
+static inline void outb(uint16_t port, uint8_t val) {
+    __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t ret;
+    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outw(uint16_t port, uint16_t val) {
+    __asm__ volatile ("outw %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint16_t inw(uint16_t port) {
+    uint16_t ret;
+    __asm__ volatile ("inw %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outl(uint16_t port, uint32_t val) {
+    __asm__ volatile ("outl %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t ret;
+    __asm__ volatile ("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// The device only observes memory, so a compiler barrier is enough on x86
+// except where a store must be ordered before a later load.
+#define virtio_barrier() __asm__ volatile ("" : : : "memory")
+#define virtio_mb()      __asm__ volatile ("lock; addl $0, (%%esp)" : : : "memory")
+
+// Event index slots that follow the avail and used rings
+#define vring_used_event(vq)  ((vq)->avail->ring[(vq)->size])
+
+static inline uint16_t vring_avail_event(virtqueue_t* vq) {
+    volatile uint16_t* event = (volatile uint16_t*)((uint8_t*)vq->used->ring +
+                                                    sizeof(vring_used_elem_t) * vq->size);
+    return *event;
+}
+
+// Reset the device and agree on features; returns the negotiated set
+uint32_t virtio_negotiate(uint16_t io_base, uint32_t wanted_features) {
+    outb(io_base + VIRTIO_PCI_STATUS, 0);
+    outb(io_base + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outb(io_base + VIRTIO_PCI_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+    uint32_t features = inl(io_base + VIRTIO_PCI_HOST_FEATURES) & wanted_features;
+    outl(io_base + VIRTIO_PCI_GUEST_FEATURES, features);
+    return features;
+}
+
+void virtio_driver_ok(uint16_t io_base) {
+    uint8_t status = inb(io_base + VIRTIO_PCI_STATUS);
+    outb(io_base + VIRTIO_PCI_STATUS, status | VIRTIO_STATUS_DRIVER_OK);
+}
+
+void virtio_fail(uint16_t io_base) {
+    uint8_t status = inb(io_base + VIRTIO_PCI_STATUS);
+    outb(io_base + VIRTIO_PCI_STATUS, status | VIRTIO_STATUS_FAILED);
+}
+
+// Reading the ISR register also acknowledges the interrupt
+uint8_t virtio_read_isr(uint16_t io_base) {
+    return inb(io_base + VIRTIO_PCI_ISR);
+}
+
+// Allocate the rings for a queue and hand them to the device
+virtqueue_t* virtqueue_create(uint16_t io_base, uint16_t index, int event_idx) {
+    outw(io_base + VIRTIO_PCI_QUEUE_SEL, index);
+    uint16_t size = inw(io_base + VIRTIO_PCI_QUEUE_NUM);
+    if (size == 0 || inl(io_base + VIRTIO_PCI_QUEUE_PFN) != 0) {
+        return NULL; // Queue does not exist or is already in use
+    }
+
+    // Legacy layout: descriptors and avail ring, then the used ring on the next page
+    uint32_t avail_end = sizeof(vring_desc_t) * size + sizeof(uint16_t) * (3 + size);
+    uint32_t used_offset = (avail_end + VIRTIO_QUEUE_ALIGN - 1) & ~(VIRTIO_QUEUE_ALIGN - 1);
+    uint32_t used_size = sizeof(uint16_t) * 3 + sizeof(vring_used_elem_t) * size;
+    uint32_t total = used_offset + ((used_size + VIRTIO_QUEUE_ALIGN - 1) & ~(VIRTIO_QUEUE_ALIGN - 1));
+
+    // Pool pages are page aligned, which satisfies VIRTIO_QUEUE_ALIGN
+    dma_addr_t ring_dma;
+    virtqueue_t* vq = (virtqueue_t*)kcalloc(1, sizeof(virtqueue_t));
+    void* ring_mem = dma_alloc_coherent(total, &ring_dma);
+    void** cookies = (void**)kcalloc(size, sizeof(void*));
+    if (!vq || !ring_mem || !cookies) {
+        kfree(vq);
+        dma_free_coherent(ring_mem, total);
+        kfree(cookies);
+        return NULL;
+    }
+
+    vq->io_base = io_base;
+    vq->index = index;
+    vq->size = size;
+    vq->event_idx = event_idx;
+    vq->ring_mem = ring_mem;
+    vq->ring_size = total;
+    vq->desc = (vring_desc_t*)ring_mem;
+    vq->avail = (vring_avail_t*)((uint8_t*)ring_mem + sizeof(vring_desc_t) * size);
+    vq->used = (vring_used_t*)((uint8_t*)ring_mem + used_offset);
+    vq->cookies = cookies;
+
+    // Chain all descriptors into the free list
+    for (uint16_t i = 0; i < size - 1; i++) {
+        vq->desc[i].next = i + 1;
+    }
+    vq->free_head = 0;
+    vq->num_free = size;
+
+    // Start with callbacks off; drivers enable them once an IRQ is routed
+    virtqueue_disable_cb(vq);
+
+    outl(io_base + VIRTIO_PCI_QUEUE_PFN, ring_dma >> 12);
+    return vq;
+}
+
+// Take the rings back from the device and free them
+void virtqueue_destroy(virtqueue_t* vq) {
+    outw(vq->io_base + VIRTIO_PCI_QUEUE_SEL, vq->index);
+    outl(vq->io_base + VIRTIO_PCI_QUEUE_PFN, 0);
+
+    dma_free_coherent(vq->ring_mem, vq->ring_size);
+    kfree(vq->cookies);
+    kfree(vq);
+}
+
+// Expose a descriptor chain to the device without notifying it
+int virtqueue_add(virtqueue_t* vq, const virtio_buf_t* bufs, int num_bufs, void* cookie) {
+    if (num_bufs <= 0 || vq->num_free < num_bufs) {
+        return -1;
+    }
+
+    uint16_t head = vq->free_head;
+    uint16_t idx = head;
+    uint16_t prev = head;
+
+    for (int i = 0; i < num_bufs; i++) {
+        vring_desc_t* d = &vq->desc[idx];
+        d->addr = bufs[i].addr;
+        d->len = bufs[i].len;
+        d->flags = bufs[i].device_writable ? VRING_DESC_F_WRITE : 0;
+        if (i + 1 < num_bufs) {
+            d->flags |= VRING_DESC_F_NEXT;
+        }
+        prev = idx;
+        idx = d->next;
+    }
+
+    vq->free_head = vq->desc[prev].next;
+    vq->num_free -= num_bufs;
+    vq->cookies[head] = cookie;
+
+    // Publish the chain, then the new index
+    vq->avail->ring[vq->avail->idx % vq->size] = head;
+    virtio_barrier();
+    vq->avail->idx++;
+
+    return 0;
+}
+
+// Notify the device about newly added buffers, unless it asked not to be.
+// Returns 1 if the device was notified.
+int virtqueue_kick(virtqueue_t* vq) {
+    uint16_t new_idx = vq->avail->idx;
+    uint16_t old_idx = vq->kicked_avail_idx;
+    if (new_idx == old_idx) {
+        return 0;
+    }
+
+    // The index store must be visible before reading the device's suppression state
+    virtio_mb();
+    vq->kicked_avail_idx = new_idx;
+
+    int needed;
+    if (vq->event_idx) {
+        // Notify only if the device's avail_event falls inside this batch
+        uint16_t event = vring_avail_event(vq);
+        needed = (uint16_t)(new_idx - event - 1) < (uint16_t)(new_idx - old_idx);
+    } else {
+        needed = !(vq->used->flags & VRING_USED_F_NO_NOTIFY);
+    }
+
+    if (needed) {
+        outw(vq->io_base + VIRTIO_PCI_QUEUE_NOTIFY, vq->index);
+        vq->notifications++;
+    }
+    return needed;
+}
+
+// Reap one completed chain; returns its cookie or NULL when none are pending
+void* virtqueue_get_buf(virtqueue_t* vq, uint32_t* len) {
+    volatile uint16_t* used_idx = &vq->used->idx;
+    if (vq->last_used_idx == *used_idx) {
+        return NULL;
+    }
+    virtio_barrier();
+
+    vring_used_elem_t* elem = &vq->used->ring[vq->last_used_idx % vq->size];
+    uint16_t head = elem->id;
+    if (len) {
+        *len = elem->len;
+    }
+    vq->last_used_idx++;
+
+    // Return the chain to the free list
+    uint16_t idx = head;
+    vq->num_free++;
+    while (vq->desc[idx].flags & VRING_DESC_F_NEXT) {
+        idx = vq->desc[idx].next;
+        vq->num_free++;
+    }
+    vq->desc[idx].next = vq->free_head;
+    vq->free_head = head;
+
+    void* cookie = vq->cookies[head];
+    vq->cookies[head] = NULL;
+    return cookie;
+}
+
+// Ask for an interrupt at the next completion
+void virtqueue_enable_cb(virtqueue_t* vq) {
+    vq->avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+    if (vq->event_idx) {
+        vring_used_event(vq) = vq->last_used_idx;
+    }
+    virtio_mb();
+}
+
+// Suppress completion interrupts (polling mode)
+void virtqueue_disable_cb(virtqueue_t* vq) {
+    vq->avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+    if (vq->event_idx) {
+        // Put the event as far behind the device as possible
+        vring_used_event(vq) = vq->last_used_idx + 0x8000;
+    }
+}
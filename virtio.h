@@ -0,0 +1,112 @@
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include <stdint.h>
+#include "dma.h"
+
+// Virtio PCI vendor ID (legacy/transitional devices use IDs 0x1000-0x103F)
+#define VIRTIO_VENDOR_ID 0x1AF4
+
+// Legacy PCI transport registers (offsets into I/O BAR0)
+#define VIRTIO_PCI_HOST_FEATURES  0x00
+#define VIRTIO_PCI_GUEST_FEATURES 0x04
+#define VIRTIO_PCI_QUEUE_PFN      0x08
+#define VIRTIO_PCI_QUEUE_NUM      0x0C
+#define VIRTIO_PCI_QUEUE_SEL      0x0E
+#define VIRTIO_PCI_QUEUE_NOTIFY   0x10
+#define VIRTIO_PCI_STATUS         0x12
+#define VIRTIO_PCI_ISR            0x13
+#define VIRTIO_PCI_CONFIG         0x14  // Device-specific config (no MSI-X)
+
+// Device status bits
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x01
+#define VIRTIO_STATUS_DRIVER      0x02
+#define VIRTIO_STATUS_DRIVER_OK   0x04
+#define VIRTIO_STATUS_FAILED      0x80
+
+// ISR status bits
+#define VIRTIO_ISR_QUEUE          0x01
+#define VIRTIO_ISR_CONFIG         0x02
+
+// Transport feature bits
+#define VIRTIO_RING_F_INDIRECT_DESC (1u << 28)
+#define VIRTIO_RING_F_EVENT_IDX     (1u << 29)
+
+// Descriptor and ring flags
+#define VRING_DESC_F_NEXT          0x01
+#define VRING_DESC_F_WRITE         0x02
+#define VRING_AVAIL_F_NO_INTERRUPT 0x01
+#define VRING_USED_F_NO_NOTIFY     0x01
+
+// Legacy rings are laid out with 4KB alignment
+#define VIRTIO_QUEUE_ALIGN 4096
+
+// Split virtqueue structures (shared with the device)
+typedef struct vring_desc {
+    uint64_t addr;      // Guest physical address
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed)) vring_desc_t;
+
+typedef struct vring_avail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];    // Followed by used_event when EVENT_IDX is negotiated
+} vring_avail_t;
+
+typedef struct vring_used_elem {
+    uint32_t id;
+    uint32_t len;
+} vring_used_elem_t;
+
+typedef struct vring_used {
+    uint16_t flags;
+    uint16_t idx;
+    vring_used_elem_t ring[]; // Followed by avail_event when EVENT_IDX is negotiated
+} vring_used_t;
+
+// One buffer of a descriptor chain (bus address, see dma.h)
+typedef struct virtio_buf {
+    dma_addr_t addr;
+    uint32_t len;
+    int device_writable;
+} virtio_buf_t;
+
+// Driver-side state of one virtqueue
+typedef struct virtqueue {
+    uint16_t io_base;
+    uint16_t index;
+    uint16_t size;
+    uint16_t num_free;
+    uint16_t free_head;
+    uint16_t last_used_idx;     // Next used entry to reap
+    uint16_t kicked_avail_idx;  // avail->idx when the device was last notified
+    int event_idx;              // VIRTIO_RING_F_EVENT_IDX negotiated
+
+    void* ring_mem;             // Coherent DMA memory
+    uint32_t ring_size;
+    vring_desc_t* desc;
+    vring_avail_t* avail;
+    vring_used_t* used;
+    void** cookies;             // Per head descriptor
+
+    uint32_t notifications;
+} virtqueue_t;
+
+// Device setup (legacy transport)
+uint32_t virtio_negotiate(uint16_t io_base, uint32_t wanted_features);
+void virtio_driver_ok(uint16_t io_base);
+void virtio_fail(uint16_t io_base);
+uint8_t virtio_read_isr(uint16_t io_base);
+
+// Virtqueue operations
+virtqueue_t* virtqueue_create(uint16_t io_base, uint16_t index, int event_idx);
+void virtqueue_destroy(virtqueue_t* vq);
+int virtqueue_add(virtqueue_t* vq, const virtio_buf_t* bufs, int num_bufs, void* cookie);
+int virtqueue_kick(virtqueue_t* vq);
+void* virtqueue_get_buf(virtqueue_t* vq, uint32_t* len);
+void virtqueue_enable_cb(virtqueue_t* vq);
+void virtqueue_disable_cb(virtqueue_t* vq);
+
+#endif // VIRTIO_H
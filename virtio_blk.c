@@ -0,0 +1,295 @@
+#include <stddef.h>
+#include "virtio_blk.h"
+#include "virtio.h"
+#include "blkdev.h"
+#include "pci.h"
+#include "mm.h"
+#include "dma.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+
+// I/O port functions
+static inline uint32_t inl(uint16_t port) {
+    uint32_t ret;
+    __asm__ volatile ("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// Request header read by the device
+typedef struct virtio_blk_req_hdr {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed)) virtio_blk_req_hdr_t;
+
+// Header and status byte of one request; these live in coherent memory
+typedef struct virtio_blk_cmd {
+    virtio_blk_req_hdr_t hdr;
+    volatile uint8_t status;
+} virtio_blk_cmd_t;
+
+// Per in-flight request state
+typedef struct virtio_blk_slot {
+    blk_request_t* req;
+    dma_sg_list_t sg;               // Mapping of the data buffer
+} virtio_blk_slot_t;
+
+// Driver instance
+typedef struct virtio_blk {
+    blkdev_t blk;
+    pci_device_t* pci;
+    uint16_t io_base;
+    virtqueue_t* vq;
+    int use_irq;
+
+    virtio_blk_slot_t* slots;
+    virtio_blk_cmd_t* cmds;         // One per slot
+    dma_addr_t cmds_dma;
+    uint16_t* free_slots;           // Stack of free slot indices
+    uint16_t num_free_slots;
+} virtio_blk_t;
+
+static virtio_blk_t virtio_blk_devices[VIRTIO_BLK_MAX_DEVICES];
+static int virtio_blk_num_devices = 0;
+
+static int virtio_blk_probe(pci_device_t* dev, const pci_device_id_t* id);
+
+static const pci_device_id_t virtio_blk_ids[] = {
+    {VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, PCI_ANY_ID},
+    {0, 0, 0}
+};
+
+static pci_driver_t virtio_blk_driver = {
+    "virtio-blk",
+    virtio_blk_ids,
+    virtio_blk_probe
+};
+
+// Interrupts are masked while the rings are touched so the IRQ path and a
+// polling caller never reap the same entry.
+static inline uint32_t virtio_blk_irq_save(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void virtio_blk_irq_restore(uint32_t flags) {
+    __asm__ volatile ("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+// Queue one request as a header / data segments / status descriptor chain
+static int virtio_blk_submit(blkdev_t* blk, blk_request_t* req) {
+    virtio_blk_t* vblk = (virtio_blk_t*)blk->driver_data;
+    uint32_t flags = virtio_blk_irq_save();
+
+    if (vblk->num_free_slots == 0) {
+        virtio_blk_irq_restore(flags);
+        return -1;
+    }
+
+    uint16_t slot_index = vblk->free_slots[vblk->num_free_slots - 1];
+    virtio_blk_slot_t* slot = &vblk->slots[slot_index];
+    dma_direction_t direction = req->op == BLK_OP_WRITE ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
+    int segments = dma_map_sg(&slot->sg, req->buffer, req->count * BLKDEV_SECTOR_SIZE,
+                              direction, DMA_MASK_32BIT);
+    if (segments < 0) {
+        // The buffer cannot be described to the device; fail it rather than retry
+        virtio_blk_irq_restore(flags);
+        req->status = BLK_STATUS_ERROR;
+        if (req->complete) {
+            req->complete(req);
+        }
+        return 0;
+    }
+    if (vblk->vq->num_free < segments + 2) {
+        dma_unmap_sg(&slot->sg);
+        virtio_blk_irq_restore(flags);
+        return -1;
+    }
+    vblk->num_free_slots--;
+
+    virtio_blk_cmd_t* cmd = &vblk->cmds[slot_index];
+    dma_addr_t cmd_dma = vblk->cmds_dma + slot_index * sizeof(virtio_blk_cmd_t);
+    cmd->hdr.type = req->op == BLK_OP_WRITE ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    cmd->hdr.reserved = 0;
+    cmd->hdr.sector = req->sector;
+    cmd->status = 0xFF;
+    slot->req = req;
+
+    virtio_buf_t bufs[DMA_SG_MAX_ENTRIES + 2];
+    bufs[0].addr = cmd_dma;
+    bufs[0].len = sizeof(virtio_blk_req_hdr_t);
+    bufs[0].device_writable = 0;
+    for (int i = 0; i < segments; i++) {
+        bufs[1 + i].addr = slot->sg.entries[i].addr;
+        bufs[1 + i].len = slot->sg.entries[i].len;
+        bufs[1 + i].device_writable = req->op == BLK_OP_READ;
+    }
+    bufs[segments + 1].addr = cmd_dma + offsetof(virtio_blk_cmd_t, status);
+    bufs[segments + 1].len = 1;
+    bufs[segments + 1].device_writable = 1;
+
+    virtqueue_add(vblk->vq, bufs, segments + 2, slot);
+
+    virtio_blk_irq_restore(flags);
+    return 0;
+}
+
+// One notification covers everything added since the last one
+static void virtio_blk_unplug(blkdev_t* blk) {
+    virtio_blk_t* vblk = (virtio_blk_t*)blk->driver_data;
+    uint32_t flags = virtio_blk_irq_save();
+
+    if (virtqueue_kick(vblk->vq)) {
+        blk->notifications++;
+    }
+
+    virtio_blk_irq_restore(flags);
+}
+
+// Complete every request the device has returned
+static int virtio_blk_poll(blkdev_t* blk) {
+    virtio_blk_t* vblk = (virtio_blk_t*)blk->driver_data;
+    uint32_t flags = virtio_blk_irq_save();
+    int completed = 0;
+
+    virtio_blk_slot_t* slot;
+    while ((slot = (virtio_blk_slot_t*)virtqueue_get_buf(vblk->vq, NULL)) != NULL) {
+        uint16_t slot_index = slot - vblk->slots;
+        blk_request_t* req = slot->req;
+        slot->req = NULL;
+        dma_unmap_sg(&slot->sg);
+        vblk->free_slots[vblk->num_free_slots++] = slot_index;
+
+        uint8_t status = vblk->cmds[slot_index].status;
+        req->status = status == VIRTIO_BLK_S_OK ? BLK_STATUS_OK : BLK_STATUS_ERROR;
+        if (req->complete) {
+            req->complete(req);
+        }
+        completed++;
+    }
+
+    if (vblk->use_irq) {
+        virtqueue_enable_cb(vblk->vq);
+    }
+
+    virtio_blk_irq_restore(flags);
+    return completed;
+}
+
+static const blkdev_ops_t virtio_blk_ops = {
+    virtio_blk_submit,
+    virtio_blk_unplug,
+    virtio_blk_poll
+};
+
+// Interrupt path: acknowledge and reap
+static void virtio_blk_irq(pci_device_t* dev) {
+    virtio_blk_t* vblk = (virtio_blk_t*)dev->driver_data;
+    if (!(virtio_read_isr(vblk->io_base) & VIRTIO_ISR_QUEUE)) {
+        return; // Not ours (shared line)
+    }
+
+    vblk->blk.interrupts++;
+    virtio_blk_poll(&vblk->blk);
+}
+
+// Undo a partial probe in reverse order and mark the device failed
+static void virtio_blk_teardown(virtio_blk_t* vblk) {
+    if (vblk->use_irq) {
+        pci_unregister_irq(vblk->pci);
+        vblk->use_irq = 0;
+    }
+    vblk->pci->driver_data = NULL;
+
+    if (vblk->cmds) {
+        dma_free_coherent(vblk->cmds, (vblk->vq->size / 3) * sizeof(virtio_blk_cmd_t));
+    }
+    kfree(vblk->free_slots);
+    kfree(vblk->slots);
+    virtqueue_destroy(vblk->vq);
+
+    virtio_fail(vblk->io_base);
+}
+
+static int virtio_blk_probe(pci_device_t* dev, const pci_device_id_t* id) {
+    (void)id;
+
+    if (virtio_blk_num_devices >= VIRTIO_BLK_MAX_DEVICES || !dev->bars[0].is_io) {
+        return -1;
+    }
+
+    virtio_blk_t* vblk = &virtio_blk_devices[virtio_blk_num_devices];
+    memset(vblk, 0, sizeof(virtio_blk_t));
+    vblk->pci = dev;
+    vblk->io_base = dev->bars[0].base;
+
+    pci_enable_device(dev);
+    pci_enable_bus_master(dev);
+
+    uint32_t features = virtio_negotiate(vblk->io_base, VIRTIO_RING_F_EVENT_IDX);
+    vblk->vq = virtqueue_create(vblk->io_base, 0, (features & VIRTIO_RING_F_EVENT_IDX) != 0);
+    if (!vblk->vq) {
+        virtio_fail(vblk->io_base);
+        return -1;
+    }
+
+    // A request takes at least three descriptors; contiguous buffers need no more
+    uint16_t depth = vblk->vq->size / 3;
+    vblk->slots = (virtio_blk_slot_t*)kcalloc(depth, sizeof(virtio_blk_slot_t));
+    vblk->free_slots = (uint16_t*)kcalloc(depth, sizeof(uint16_t));
+    vblk->cmds = (virtio_blk_cmd_t*)dma_alloc_coherent(depth * sizeof(virtio_blk_cmd_t),
+                                                       &vblk->cmds_dma);
+    if (!vblk->slots || !vblk->free_slots || !vblk->cmds) {
+        virtio_blk_teardown(vblk);
+        return -1;
+    }
+    for (uint16_t i = 0; i < depth; i++) {
+        vblk->free_slots[i] = depth - 1 - i;
+    }
+    vblk->num_free_slots = depth;
+
+    // Capacity is a 64-bit sector count; the block layer addresses 32 bits
+    uint32_t capacity_low = inl(vblk->io_base + VIRTIO_PCI_CONFIG);
+    uint32_t capacity_high = inl(vblk->io_base + VIRTIO_PCI_CONFIG + 4);
+
+    vblk->blk.name[0] = 'v';
+    vblk->blk.name[1] = 'd';
+    vblk->blk.name[2] = 'a' + virtio_blk_num_devices;
+    vblk->blk.name[3] = '\0';
+    vblk->blk.driver = "virtio-blk";
+    vblk->blk.sector_count = capacity_high ? 0xFFFFFFFF : capacity_low;
+    vblk->blk.queue_depth = depth;
+    vblk->blk.ops = &virtio_blk_ops;
+    vblk->blk.driver_data = vblk;
+    dev->driver_data = vblk;
+
+    // Completion by interrupt when the line is routable, polling otherwise
+    if (pci_register_irq(dev, virtio_blk_irq) == 0) {
+        vblk->use_irq = 1;
+        virtqueue_enable_cb(vblk->vq);
+    }
+
+    virtio_driver_ok(vblk->io_base);
+
+    if (blkdev_register(&vblk->blk) != 0) {
+        virtio_blk_teardown(vblk);
+        return -1;
+    }
+    virtio_blk_num_devices++;
+
+    terminal_writestring(vblk->blk.name);
+    terminal_writestring(": virtio-blk, ");
+    terminal_write_dec(vblk->blk.sector_count / 2048);
+    terminal_writestring(" MB, queue ");
+    terminal_write_dec(vblk->vq->size);
+    terminal_writestring(vblk->vq->event_idx ? ", event-idx\n" : "\n");
+
+    return 0;
+}
+
+void virtio_blk_init(void) {
+    pci_register_driver(&virtio_blk_driver);
+}
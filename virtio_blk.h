@@ -0,0 +1,22 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include <stdint.h>
+
+// Legacy/transitional virtio-blk PCI device ID
+#define VIRTIO_BLK_DEVICE_ID 0x1001
+#define VIRTIO_BLK_MAX_DEVICES 2
+
+// Request types
+#define VIRTIO_BLK_T_IN    0
+#define VIRTIO_BLK_T_OUT   1
+
+// Request status values written by the device
+#define VIRTIO_BLK_S_OK     0
+#define VIRTIO_BLK_S_IOERR  1
+#define VIRTIO_BLK_S_UNSUPP 2
+
+// Register the driver with the PCI layer
+void virtio_blk_init(void);
+
+#endif // VIRTIO_BLK_H
@@ -0,0 +1,1319 @@
+#include <stddef.h>
+#include "vmm.h"
+#include "pmm.h"
+#include "isr.h"
+#include "ktime.h"
+#include "swap.h"
+#include "memcg.h"
+#include "fs.h"
+#include "tunable.h"
+#include "ksm.h"
+
+// External terminal functions from kernel.c
+extern void terminal_writestring(const char* data);
+extern void terminal_write_dec(uint32_t value);
+extern void terminal_write_hex(uint32_t value);
+
+#define PAGE_FAULT_VECTOR 14
+#define CR0_PG            0x80000000
+#define CR4_PSE           0x00000010
+#define CPUID_EDX_PSE     0x00000008
+
+static address_space_t* vmm_current_space = NULL;
+static address_space_t* vmm_spaces = NULL;
+
+// vmm.huge_pages=0 keeps new faults to 4KB pages and stops collapsing
+TUNABLE_VAR(vmm_huge_enabled, CONFIG_VMM_HUGE_PAGES);
+#if CONFIG_TUNABLES
+static tunable_t vmm_huge_tunable = {
+    .name = "vmm.huge_pages",
+    .description = "Map anonymous memory with 4MB pages where possible",
+    .type = TUNABLE_BOOL,
+    .value = &vmm_huge_enabled,
+    .max = 1,
+};
+#endif
+
+static int vmm_huge_supported = 0;  // CPU has PSE, and CR4.PSE is set
+
+static struct {
+    uint32_t faults;        // Faults that mapped a 4MB page
+    uint32_t fallbacks;     // ... that could have, but had to map 4KB
+    uint32_t scanned;       // Page tables the collapse pass checked
+    uint32_t collapses;
+    uint32_t splits;
+} vmm_huge_stats;
+
+// Where the collapse pass resumes
+static address_space_t* vmm_huge_cursor = NULL;
+static uint32_t vmm_huge_cursor_pde = VMM_USER_FIRST_PDE;
+static uint64_t vmm_huge_last_ms = 0;
+
+static inline int vmm_paging_enabled(void) {
+    uint32_t cr0;
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    return (cr0 & CR0_PG) != 0;
+}
+
+// Stale translations only matter once the hardware walks these tables
+void vmm_flush_page(address_space_t* as, uint32_t vaddr) {
+    if (as == vmm_current_space && vmm_paging_enabled()) {
+        __asm__ volatile ("invlpg (%0)" : : "r"(vaddr) : "memory");
+    }
+}
+
+static void vmm_flush_all(address_space_t* as) {
+    if (as == vmm_current_space && vmm_paging_enabled()) {
+        __asm__ volatile ("mov %0, %%cr3" : : "r"((uint32_t)as->dir) : "memory");
+    }
+}
+
+// Tables and frames come from the identity-mapped frame region
+static inline page_table_t* vmm_pde_table(page_entry_t* pde) {
+    return (page_table_t*)(pde->frame << 12);
+}
+
+static inline uint32_t vmm_pte_addr(page_entry_t* pte) {
+    return pte->frame << 12;
+}
+
+// Directory entry covering vaddr; the directory frame is identity-mapped
+static inline page_entry_t* vmm_pde(address_space_t* as, uint32_t vaddr) {
+    return &as->dir->tables[vaddr >> 22];
+}
+
+static inline int vmm_pde_huge(const page_entry_t* pde) {
+    return pde->present && pde->page_size;
+}
+
+static page_table_t* vmm_alloc_table(address_space_t* as, uint32_t index) {
+    uint32_t frame = pmm_alloc_zeroed_frame();
+    if (!frame) {
+        return NULL;
+    }
+
+    page_entry_t* pde = &as->dir->tables[index];
+    memset(pde, 0, sizeof(page_entry_t));
+    pde->present = 1;
+    pde->writable = 1;
+    pde->user = 1; // Access is restricted per page
+    pde->frame = frame >> 12;
+    as->table_pages++;
+    vmm_flush_page(as, (uint32_t)paging_recursive_pte(index << 22));
+    return (page_table_t*)frame;
+}
+
+// The current space's tables are reached through the recursive mapping
+// once paging is on, others through their identity-mapped frames
+page_entry_t* vmm_get_pte(address_space_t* as, uint32_t vaddr, int create) {
+    uint32_t index = vaddr >> 22;
+    int loaded = as == vmm_current_space && paging_is_loaded(as->dir);
+    page_entry_t* pde = loaded ? paging_recursive_pde(vaddr) : &as->dir->tables[index];
+
+    if (!pde->present && (!create || !vmm_alloc_table(as, index))) {
+        return NULL;
+    }
+    if (pde->page_size) {
+        return NULL; // A 4MB page has no table to point into
+    }
+    if (loaded) {
+        return paging_recursive_pte(vaddr);
+    }
+    return &vmm_pde_table(pde)->pages[(vaddr >> 12) & 0x3FF];
+}
+
+static void vmm_page_fault(struct registers* r) {
+    uint32_t addr;
+    __asm__ volatile ("mov %%cr2, %0" : "=r"(addr));
+
+    if (vmm_handle_fault(vmm_current_space, addr, r->err_code) == 0) {
+        return;
+    }
+
+    terminal_writestring("Page fault at 0x");
+    terminal_write_hex(addr);
+    terminal_writestring(" (error 0x");
+    terminal_write_hex(r->err_code);
+    terminal_writestring(", eip 0x");
+    terminal_write_hex(r->eip);
+    terminal_writestring(")\nSystem Halted.\n");
+    while (1) {
+        __asm__ volatile ("cli; hlt");
+    }
+}
+
+static int vmm_cpu_has_pse(void) {
+    uint32_t eax = 1, ebx, ecx, edx;
+    __asm__ volatile ("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return (edx & CPUID_EDX_PSE) != 0;
+}
+
+void vmm_init(void) {
+    tunable_register(&vmm_huge_tunable);
+    vmm_current_space = NULL;
+    register_interrupt_handler(PAGE_FAULT_VECTOR, vmm_page_fault);
+
+    // Directory entries with page_size set only map 4MB with CR4.PSE on;
+    // setting it ahead of paging is allowed
+    if (CONFIG_VMM_HUGE_PAGES && vmm_cpu_has_pse()) {
+        uint32_t cr4;
+        __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+        __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4 | CR4_PSE));
+        vmm_huge_supported = 1;
+    }
+}
+
+address_space_t* vmm_create(void) {
+    address_space_t* as = (address_space_t*)kcalloc(1, sizeof(address_space_t));
+    if (!as) {
+        return NULL;
+    }
+
+    uint32_t frame = pmm_alloc_frame();
+    if (!frame) {
+        kfree(as);
+        return NULL;
+    }
+
+    // Kernel mappings are shared; the user range starts out empty
+    as->dir = (page_directory_t*)frame;
+    memcpy(as->dir, paging_get_kernel_directory(), sizeof(page_directory_t));
+    for (uint32_t i = VMM_USER_FIRST_PDE; i <= VMM_USER_LAST_PDE; i++) {
+        memset(&as->dir->tables[i], 0, sizeof(page_entry_t));
+    }
+    paging_set_recursive(as->dir);
+
+    as->memcg = memcg_current();
+    as->next = vmm_spaces;
+    vmm_spaces = as;
+    return as;
+}
+
+address_space_t* vmm_first_space(void) {
+    return vmm_spaces;
+}
+
+address_space_t* vmm_find_mapper(uint32_t phys, uint32_t vaddr, address_space_t* exclude) {
+    for (address_space_t* as = vmm_spaces; as; as = as->next) {
+        if (as == exclude) {
+            continue;
+        }
+        page_entry_t* pte = vmm_get_pte(as, vaddr, 0);
+        if (pte && pte->present && vmm_pte_addr(pte) == phys) {
+            return as;
+        }
+    }
+    return NULL;
+}
+
+// Drop one space's reference to a page, keeping the aging lists' reverse
+// mapping on a space that still maps it
+static void vmm_put_page(address_space_t* as, uint32_t vaddr, uint32_t phys) {
+    page_frame_t* frame = pmm_frame(phys);
+    if (frame && frame->refcount == 1) {
+        swap_lru_del(phys);
+    } else if (frame && frame->mapping == as) {
+        frame->mapping = vmm_find_mapper(phys, vaddr, as);
+    }
+    pmm_free_frame(phys);
+}
+
+void vmm_destroy(address_space_t* as) {
+    if (!as) {
+        return;
+    }
+    if (as == vmm_current_space) {
+        vmm_activate(NULL);
+    }
+
+    for (address_space_t** link = &vmm_spaces; *link; link = &(*link)->next) {
+        if (*link == as) {
+            *link = as->next;
+            break;
+        }
+    }
+    if (vmm_huge_cursor == as) {
+        vmm_huge_cursor = as->next;
+        vmm_huge_cursor_pde = VMM_USER_FIRST_PDE;
+    }
+    ksm_space_destroyed(as);
+
+    for (uint32_t i = VMM_USER_FIRST_PDE; i <= VMM_USER_LAST_PDE; i++) {
+        page_entry_t* pde = &as->dir->tables[i];
+        if (!pde->present) {
+            continue;
+        }
+        if (pde->page_size) {
+            pmm_free_frame(vmm_pte_addr(pde));
+            continue;
+        }
+
+        page_table_t* table = vmm_pde_table(pde);
+        for (int j = 0; j < 1024; j++) {
+            page_entry_t* pte = &table->pages[j];
+            if (pte->present) {
+                vmm_put_page(as, (i << 22) | (j << 12), vmm_pte_addr(pte));
+            } else if (pte->available & VMM_PTE_SWAP) {
+                swap_entry_free(pte->frame);
+            }
+        }
+        pmm_free_frame((uint32_t)table);
+    }
+
+    while (as->vmas.node) {
+        vma_t* vma = rb_entry(as->vmas.node, vma_t, node);
+        rb_erase(&as->vmas, &vma->node);
+        kfree(vma);
+    }
+
+    memcg_uncharge_pages(as, as->resident_pages);
+    pmm_free_frame((uint32_t)as->dir);
+    kfree(as);
+}
+
+// Out of frames even after reclaim, the OOM policy frees a task's memory
+// rather than failing
+uint32_t vmm_alloc_frame(address_space_t* as, int zeroed) {
+    uint32_t frame = zeroed ? pmm_alloc_zeroed_frame() : pmm_alloc_frame();
+    if (!frame && memcg_out_of_memory(as) == 0) {
+        frame = zeroed ? pmm_alloc_zeroed_frame() : pmm_alloc_frame();
+    }
+    return frame;
+}
+
+// Frame for a new user page, charged to the space's group
+static uint32_t vmm_alloc_user_frame(address_space_t* as) {
+    if (memcg_charge_pages(as, 1) != 0) {
+        return 0;
+    }
+
+    uint32_t frame = vmm_alloc_frame(as, 1);
+    if (!frame) {
+        memcg_uncharge_pages(as, 1);
+    }
+    return frame;
+}
+
+int vmm_map_anon(address_space_t* as, uint32_t vaddr, uint32_t pages, uint32_t flags) {
+    if (!as || (vaddr & (PAGE_SIZE - 1)) || vaddr < VMM_USER_START ||
+        pages > (VMM_USER_END - vaddr) / PAGE_SIZE) {
+        return -1;
+    }
+
+    for (uint32_t p = 0; p < pages; p++, vaddr += PAGE_SIZE) {
+        page_entry_t* pte = vmm_get_pte(as, vaddr, 1);
+        if (!pte || pte->present || (pte->available & VMM_PTE_SWAP)) {
+            return -1;
+        }
+
+        uint32_t frame = vmm_alloc_user_frame(as);
+        if (!frame) {
+            return -1;
+        }
+
+        memset(pte, 0, sizeof(page_entry_t));
+        pte->present = 1;
+        pte->writable = (flags & PAGE_WRITABLE) ? 1 : 0;
+        pte->user = (flags & PAGE_USER) ? 1 : 0;
+        pte->frame = frame >> 12;
+        as->resident_pages++;
+        swap_lru_add(as, vaddr, frame, 1);
+    }
+    return 0;
+}
+
+// 4MB pages
+
+static void vmm_set_huge(address_space_t* as, uint32_t base, uint32_t frame, uint32_t flags) {
+    page_entry_t* pde = vmm_pde(as, base);
+    memset(pde, 0, sizeof(page_entry_t));
+    pde->present = 1;
+    pde->writable = (flags & PAGE_WRITABLE) ? 1 : 0;
+    pde->user = (flags & PAGE_USER) ? 1 : 0;
+    pde->page_size = 1;
+    pde->frame = frame >> 12;
+    as->huge_pages++;
+}
+
+static void vmm_unmap_huge(address_space_t* as, uint32_t base) {
+    page_entry_t* pde = vmm_pde(as, base);
+    pmm_free_frame(vmm_pte_addr(pde));
+    memset(pde, 0, sizeof(page_entry_t));
+    as->huge_pages--;
+    as->resident_pages -= PMM_HUGE_FRAMES;
+    memcg_uncharge_pages(as, PMM_HUGE_FRAMES);
+    vmm_flush_page(as, base);
+}
+
+// Map the same frames through a page table of 4KB entries instead, each
+// page then aged, swapped and shared on its own
+static int vmm_split_huge(address_space_t* as, uint32_t base) {
+    page_entry_t huge = *vmm_pde(as, base);
+    uint32_t frame = vmm_pte_addr(&huge);
+    page_table_t* table = vmm_alloc_table(as, base >> 22);
+    if (!table) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < PMM_HUGE_FRAMES; i++) {
+        page_entry_t* pte = &table->pages[i];
+        pte->present = 1;
+        pte->writable = huge.writable;
+        pte->user = huge.user;
+        pte->accessed = huge.accessed;
+        pte->dirty = huge.dirty;
+        pte->frame = (frame >> 12) + i;
+    }
+    pmm_split_huge(frame);
+    for (uint32_t i = 0; i < PMM_HUGE_FRAMES; i++) {
+        swap_lru_add(as, base + i * PAGE_SIZE, frame + i * PAGE_SIZE, 1);
+    }
+
+    as->huge_pages--;
+    vmm_huge_stats.splits++;
+    vmm_flush_page(as, base);
+    return 0;
+}
+
+static int vmm_huge_allowed(vma_t* vma) {
+    return CONFIG_VMM_HUGE_PAGES && vmm_huge_enabled && vmm_huge_supported &&
+           vma->type == VMA_ANON && !(vma->flags & VMA_NOHUGE);
+}
+
+// First touch of a 4MB block the area covers whole and nothing maps yet:
+// one zeroed 4MB page instead of a page table and a 4KB page. The charge
+// and the frames are optional; -1 falls back to 4KB.
+static int vmm_huge_fault(address_space_t* as, vma_t* vma, uint32_t addr) {
+    uint32_t base = addr & ~(PMM_HUGE_SIZE - 1);
+    if (!vmm_huge_allowed(vma) || base < vma->start || vma->end - base < PMM_HUGE_SIZE ||
+        vmm_pde(as, base)->present) {
+        return -1;
+    }
+
+    if (memcg_charge_pages_optional(as, PMM_HUGE_FRAMES) != 0) {
+        vmm_huge_stats.fallbacks++;
+        return -1;
+    }
+    uint32_t frame = pmm_alloc_huge();
+    if (!frame) {
+        memcg_uncharge_pages(as, PMM_HUGE_FRAMES);
+        vmm_huge_stats.fallbacks++;
+        return -1;
+    }
+
+    memset((void*)frame, 0, PMM_HUGE_SIZE);
+    vmm_set_huge(as, base, frame, vma->flags);
+    as->resident_pages += PMM_HUGE_FRAMES;
+    as->demand_faults++;
+    vmm_huge_stats.faults++;
+    vmm_flush_page(as, base);
+    return 0;
+}
+
+// Virtual memory areas
+
+// Link an area into the tree. The descent meets both neighbours of the
+// new range, so comparing against every node on the way finds overlaps.
+static int vmm_insert_vma(address_space_t* as, vma_t* vma) {
+    rb_node_t** link = &as->vmas.node;
+    rb_node_t* parent = NULL;
+    while (*link) {
+        vma_t* other = rb_entry(*link, vma_t, node);
+        parent = *link;
+        if (vma->end <= other->start) {
+            link = &parent->left;
+        } else if (vma->start >= other->end) {
+            link = &parent->right;
+        } else {
+            return -1; // Overlaps
+        }
+    }
+    rb_link_node(&vma->node, parent, link);
+    rb_insert_color(&as->vmas, &vma->node);
+    as->vma_count++;
+    as->reserved_pages += (vma->end - vma->start) / PAGE_SIZE;
+    return 0;
+}
+
+static vma_t* vmm_new_vma(address_space_t* as, uint32_t start, uint32_t len, vma_type_t type, uint32_t flags) {
+    if (!as || (start & (PAGE_SIZE - 1)) || start < VMM_USER_START || len == 0 ||
+        len > VMM_USER_END - start) {
+        return NULL;
+    }
+
+    vma_t* vma = (vma_t*)kcalloc(1, sizeof(vma_t));
+    if (!vma) {
+        return NULL;
+    }
+    vma->start = start;
+    vma->end = start + ((len + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+    vma->type = type;
+    vma->flags = flags & (PAGE_WRITABLE | PAGE_USER | VMA_NOHUGE);
+    if (vmm_insert_vma(as, vma) != 0) {
+        kfree(vma);
+        return NULL;
+    }
+    return vma;
+}
+
+int vmm_reserve_anon(address_space_t* as, uint32_t vaddr, uint32_t len, uint32_t flags) {
+    return vmm_new_vma(as, vaddr, len, VMA_ANON, flags) ? 0 : -1;
+}
+
+int vmm_reserve_file(address_space_t* as, uint32_t vaddr, const uint8_t* data, uint32_t size, uint32_t flags) {
+    vma_t* vma = vmm_new_vma(as, vaddr, size, VMA_FILE, flags);
+    if (!vma) {
+        return -1;
+    }
+    vma->file_data = data;
+    vma->file_size = size;
+    return 0;
+}
+
+int vmm_reserve_stack(address_space_t* as, uint32_t top, uint32_t size, uint32_t max_size, uint32_t flags) {
+    size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    max_size = (max_size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (size == 0 || size > max_size || top < VMM_USER_START + max_size) {
+        return -1;
+    }
+
+    vma_t* vma = vmm_new_vma(as, top - size, size, VMA_STACK, flags);
+    if (!vma) {
+        return -1;
+    }
+    vma->limit = top - max_size;
+    return 0;
+}
+
+// First area that ends above addr: the one containing it, or the next one
+// up (a stack that may grow down to it). The area found last is tried
+// first; faults tend to come in runs within one area.
+static vma_t* vmm_vma_above(address_space_t* as, uint32_t addr) {
+    as->vma_lookups++;
+    vma_t* vma = as->vma_cache;
+    if (vma && addr >= vma->start && addr < vma->end) {
+        as->vma_cache_hits++;
+        return vma;
+    }
+
+    vma = NULL;
+    rb_node_t* node = as->vmas.node;
+    while (node) {
+        vma_t* candidate = rb_entry(node, vma_t, node);
+        if (addr < candidate->end) {
+            vma = candidate;
+            if (addr >= candidate->start) {
+                break;
+            }
+            node = node->left;
+        } else {
+            node = node->right;
+        }
+    }
+    if (vma && addr >= vma->start) {
+        as->vma_cache = vma;
+    }
+    return vma;
+}
+
+vma_t* vmm_find_vma(address_space_t* as, uint32_t addr) {
+    vma_t* vma = vmm_vma_above(as, addr);
+    return vma && addr >= vma->start ? vma : NULL;
+}
+
+// Extend a stack area down to the page of addr, within its limit and
+// keeping a guard gap above the area below
+static int vmm_grow_stack(address_space_t* as, vma_t* vma, uint32_t addr) {
+    uint32_t start = addr & ~(PAGE_SIZE - 1);
+    if (vma->type != VMA_STACK || start < vma->limit) {
+        return -1;
+    }
+
+    rb_node_t* prev = rb_prev(&vma->node);
+    if (prev && start < rb_entry(prev, vma_t, node)->end + VMA_STACK_GUARD) {
+        return -1;
+    }
+
+    as->reserved_pages += (vma->start - start) / PAGE_SIZE;
+    vma->start = start;
+    return 0;
+}
+
+// First access to a page no PTE maps: give it a frame if an area covers it
+static int vmm_fault_in(address_space_t* as, uint32_t addr, uint32_t error) {
+    vma_t* vma = vmm_vma_above(as, addr);
+    if (!vma || (addr < vma->start && vmm_grow_stack(as, vma, addr) != 0)) {
+        return -1; // Invalid access
+    }
+    if (((error & PF_WRITE) && !(vma->flags & PAGE_WRITABLE)) ||
+        ((error & PF_USER) && !(vma->flags & PAGE_USER))) {
+        return -1;
+    }
+
+    if (vmm_huge_fault(as, vma, addr) == 0) {
+        return 0;
+    }
+
+    uint32_t vaddr = addr & ~(PAGE_SIZE - 1);
+    page_entry_t* pte = vmm_get_pte(as, vaddr, 1);
+    if (!pte) {
+        return -1;
+    }
+    uint32_t frame = vmm_alloc_user_frame(as);
+    if (!frame) {
+        return -1;
+    }
+
+    if (vma->type == VMA_FILE) {
+        uint32_t offset = vaddr - vma->start;
+        if (offset < vma->file_size) {
+            uint32_t len = vma->file_size - offset;
+            memcpy((void*)frame, vma->file_data + offset, len < PAGE_SIZE ? len : PAGE_SIZE);
+        }
+    }
+
+    memset(pte, 0, sizeof(page_entry_t));
+    pte->present = 1;
+    pte->writable = (vma->flags & PAGE_WRITABLE) ? 1 : 0;
+    pte->user = (vma->flags & PAGE_USER) ? 1 : 0;
+    pte->frame = frame >> 12;
+    as->resident_pages++;
+    as->demand_faults++;
+    swap_lru_add(as, vaddr, frame, 1);
+    return 0;
+}
+
+// Unmap [start, end), dropping frames and swap slots
+static void vmm_release_range(address_space_t* as, uint32_t start, uint32_t end) {
+    uint32_t vaddr = start;
+    while (vaddr < end) {
+        // 4MB pages lie inside one area, so a released area covers them whole
+        if (vmm_pde_huge(vmm_pde(as, vaddr))) {
+            vmm_unmap_huge(as, vaddr);
+            vaddr += PMM_HUGE_SIZE;
+            continue;
+        }
+        page_entry_t* pte = vmm_get_pte(as, vaddr, 0);
+        if (!pte) {
+            vaddr = (vaddr & ~0x3FFFFF) + 0x400000; // No table for the rest of this 4MB
+            continue;
+        }
+        if (pte->present) {
+            vmm_put_page(as, vaddr, vmm_pte_addr(pte));
+            as->resident_pages--;
+            memcg_uncharge_pages(as, 1);
+        } else if (pte->available & VMM_PTE_SWAP) {
+            swap_entry_free(pte->frame);
+            as->swap_pages--;
+        }
+        memset(pte, 0, sizeof(page_entry_t));
+        vmm_flush_page(as, vaddr);
+        vaddr += PAGE_SIZE;
+    }
+}
+
+int vmm_unreserve(address_space_t* as, uint32_t vaddr) {
+    vma_t* vma = as ? vmm_find_vma(as, vaddr) : NULL;
+    if (!vma) {
+        return -1;
+    }
+
+    vmm_release_range(as, vma->start, vma->end);
+    rb_erase(&as->vmas, &vma->node);
+    if (as->vma_cache == vma) {
+        as->vma_cache = NULL;
+    }
+    as->vma_count--;
+    as->reserved_pages -= (vma->end - vma->start) / PAGE_SIZE;
+    kfree(vma);
+    return 0;
+}
+
+static uint32_t vmm_resident_in(address_space_t* as, uint32_t start, uint32_t end) {
+    uint32_t count = 0;
+    uint32_t vaddr = start;
+    while (vaddr < end) {
+        if (vmm_pde_huge(vmm_pde(as, vaddr))) {
+            count++;
+            vaddr += PAGE_SIZE;
+            continue;
+        }
+        page_entry_t* pte = vmm_get_pte(as, vaddr, 0);
+        if (!pte) {
+            vaddr = (vaddr & ~0x3FFFFF) + 0x400000;
+            continue;
+        }
+        count += pte->present;
+        vaddr += PAGE_SIZE;
+    }
+    return count;
+}
+
+void vmm_print_vmas(address_space_t* as) {
+    static const char* type_names[] = { "anon ", "file ", "stack" };
+    for (rb_node_t* node = rb_first(&as->vmas); node; node = rb_next(node)) {
+        vma_t* vma = rb_entry(node, vma_t, node);
+        terminal_writestring("  0x");
+        terminal_write_hex(vma->start);
+        terminal_writestring("-0x");
+        terminal_write_hex(vma->end);
+        terminal_writestring(" ");
+        terminal_writestring(type_names[vma->type]);
+        terminal_writestring((vma->flags & PAGE_WRITABLE) ? " rw " : " ro ");
+        terminal_write_dec(vmm_resident_in(as, vma->start, vma->end));
+        terminal_writestring("/");
+        terminal_write_dec((vma->end - vma->start) / PAGE_SIZE);
+        terminal_writestring(" pages\n");
+    }
+}
+
+address_space_t* vmm_clone(address_space_t* src, int cow) {
+    if (!src) {
+        return NULL;
+    }
+
+    address_space_t* dst = vmm_create();
+    if (!dst) {
+        return NULL;
+    }
+    dst->memcg = src->memcg;
+
+    for (rb_node_t* node = rb_first(&src->vmas); node; node = rb_next(node)) {
+        vma_t* vma = (vma_t*)kmalloc(sizeof(vma_t));
+        if (!vma) {
+            vmm_destroy(dst);
+            return NULL;
+        }
+        // Same ranges as the source's, so they cannot overlap
+        *vma = *rb_entry(node, vma_t, node);
+        vmm_insert_vma(dst, vma);
+    }
+
+    for (uint32_t i = VMM_USER_FIRST_PDE; i <= VMM_USER_LAST_PDE; i++) {
+        page_entry_t* pde = &src->dir->tables[i];
+        if (!pde->present) {
+            continue;
+        }
+        // Copy-on-write works on 4KB pages; the collapse pass can merge
+        // the block again once one side is left with it
+        if (pde->page_size && vmm_split_huge(src, i << 22) != 0) {
+            vmm_destroy(dst);
+            return NULL;
+        }
+
+        page_table_t* src_table = vmm_pde_table(pde);
+        page_table_t* dst_table = vmm_alloc_table(dst, i);
+        if (!dst_table) {
+            vmm_destroy(dst);
+            return NULL;
+        }
+
+        for (int j = 0; j < 1024; j++) {
+            page_entry_t* spte = &src_table->pages[j];
+            page_entry_t* dpte = &dst_table->pages[j];
+            if (!spte->present) {
+                // Swapped-out pages share the slot until one side reads it back
+                if (spte->available & VMM_PTE_SWAP) {
+                    swap_entry_dup(spte->frame);
+                    *dpte = *spte;
+                    dst->swap_pages++;
+                }
+                continue;
+            }
+
+            if (cow) {
+                // Both sides lose write access until one of them writes
+                if (spte->writable) {
+                    spte->writable = 0;
+                    spte->available |= VMM_PTE_COW;
+                }
+                pmm_get_frame(vmm_pte_addr(spte));
+                *dpte = *spte;
+            } else {
+                uint32_t frame = pmm_alloc_frame();
+                if (!frame) {
+                    vmm_destroy(dst);
+                    return NULL;
+                }
+                memcpy((void*)frame, (void*)vmm_pte_addr(spte), PAGE_SIZE);
+                *dpte = *spte;
+                dpte->frame = frame >> 12;
+                if (dpte->available & VMM_PTE_COW) {
+                    dpte->available &= ~VMM_PTE_COW;
+                    dpte->writable = 1;
+                }
+                swap_lru_add(dst, (i << 22) | (j << 12), frame, 1);
+            }
+            dst->resident_pages++;
+            memcg_force_charge_pages(dst, 1);
+        }
+    }
+
+    if (cow) {
+        vmm_flush_all(src);
+    }
+    return dst;
+}
+
+int vmm_handle_fault(address_space_t* as, uint32_t addr, uint32_t error) {
+    if (!as || addr < VMM_USER_START || addr >= VMM_USER_END) {
+        return -1;
+    }
+
+    if (vmm_pde_huge(vmm_pde(as, addr))) {
+        return -1; // Mapped, and 4MB pages are never copy-on-write
+    }
+
+    page_entry_t* pte = vmm_get_pte(as, addr, 0);
+    if (pte && !pte->present && (pte->available & VMM_PTE_SWAP)) {
+        as->swap_faults++;
+        return swap_in(as, addr & ~(PAGE_SIZE - 1));
+    }
+    if (!pte || !pte->present) {
+        return vmm_fault_in(as, addr, error);
+    }
+    if (!(error & PF_WRITE) || !(pte->available & VMM_PTE_COW)) {
+        return -1;
+    }
+
+    as->cow_faults++;
+
+    // The last sharer can simply take the frame back
+    uint32_t old_frame = vmm_pte_addr(pte);
+    if (pmm_frame_refcount(old_frame) > 1) {
+        // Already charged to this space while shared, so only the frame
+        uint32_t frame = vmm_alloc_frame(as, 0);
+        if (!frame) {
+            return -1;
+        }
+        memcpy((void*)frame, (void*)old_frame, PAGE_SIZE);
+        pte->frame = frame >> 12;
+        vmm_put_page(as, addr & ~(PAGE_SIZE - 1), old_frame);
+        swap_lru_add(as, addr & ~(PAGE_SIZE - 1), frame, 1);
+        as->cow_copies++;
+    }
+
+    pte->available &= ~VMM_PTE_COW;
+    pte->writable = 1;
+    vmm_flush_page(as, addr & ~(PAGE_SIZE - 1));
+    return 0;
+}
+
+void vmm_activate(address_space_t* as) {
+    vmm_current_space = as;
+    if (vmm_paging_enabled()) {
+        page_directory_t* dir = as ? as->dir : paging_get_kernel_directory();
+        __asm__ volatile ("mov %0, %%cr3" : : "r"((uint32_t)dir) : "memory");
+    }
+}
+
+address_space_t* vmm_current(void) {
+    return vmm_current_space;
+}
+
+// Where a mapped page is in memory, or NULL if the access would fault
+static uint8_t* vmm_lookup(address_space_t* as, uint32_t vaddr, int write) {
+    page_entry_t* entry = vmm_pde(as, vaddr);
+    uint32_t offset = vaddr & (PMM_HUGE_SIZE - 1);
+    if (!vmm_pde_huge(entry)) {
+        entry = vmm_get_pte(as, vaddr, 0);
+        offset = vaddr & (PAGE_SIZE - 1);
+    }
+    if (!entry || !entry->present || (write && !entry->writable)) {
+        return NULL;
+    }
+
+    entry->accessed = 1;
+    if (write) {
+        entry->dirty = 1;
+    }
+    return (uint8_t*)(vmm_pte_addr(entry) | offset);
+}
+
+// Walk to the byte backing vaddr the way the MMU would, faulting as needed
+static uint8_t* vmm_translate(address_space_t* as, uint32_t vaddr, int write) {
+    uint8_t* addr = vmm_lookup(as, vaddr, write);
+    if (addr) {
+        return addr;
+    }
+
+    page_entry_t* pte = vmm_get_pte(as, vaddr, 0);
+    uint32_t error = PF_USER | (write ? PF_WRITE : 0);
+    if ((pte && pte->present) || vmm_pde_huge(vmm_pde(as, vaddr))) {
+        error |= PF_PRESENT;
+    }
+    if (vmm_handle_fault(as, vaddr, error) != 0) {
+        return NULL;
+    }
+    return vmm_lookup(as, vaddr, write);
+}
+
+int vmm_copy_to(address_space_t* as, uint32_t vaddr, const void* src, uint32_t len) {
+    const uint8_t* from = (const uint8_t*)src;
+    while (len > 0) {
+        uint32_t chunk = PAGE_SIZE - (vaddr & (PAGE_SIZE - 1));
+        if (chunk > len) {
+            chunk = len;
+        }
+
+        uint8_t* to = vmm_translate(as, vaddr, 1);
+        if (!to) {
+            return -1;
+        }
+        memcpy(to, from, chunk);
+
+        vaddr += chunk;
+        from += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+int vmm_copy_from(address_space_t* as, void* dst, uint32_t vaddr, uint32_t len) {
+    uint8_t* to = (uint8_t*)dst;
+    while (len > 0) {
+        uint32_t chunk = PAGE_SIZE - (vaddr & (PAGE_SIZE - 1));
+        if (chunk > len) {
+            chunk = len;
+        }
+
+        uint8_t* from = vmm_translate(as, vaddr, 0);
+        if (!from) {
+            return -1;
+        }
+        memcpy(to, from, chunk);
+
+        vaddr += chunk;
+        to += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+
+// Collapsing 4KB pages into 4MB pages
+
+// Replace the page table of the 4MB block at base with a 4MB page, if the
+// block lies in one anonymous area, every page in it is this space's alone
+// (not shared, not in swap) and at most VMM_HUGE_MAX_NONE are unmapped.
+// Mapped pages are copied over; the rest of the 4MB page is zero.
+static int vmm_collapse(address_space_t* as, uint32_t base) {
+    page_entry_t* pde = vmm_pde(as, base);
+    vma_t* vma = vmm_find_vma(as, base);
+    if (!pde->present || pde->page_size || !vma || !vmm_huge_allowed(vma) ||
+        vma->end - base < PMM_HUGE_SIZE) {
+        return -1;
+    }
+
+    page_table_t* table = vmm_pde_table(pde);
+    uint32_t none = 0;
+    for (uint32_t i = 0; i < PMM_HUGE_FRAMES; i++) {
+        page_entry_t* pte = &table->pages[i];
+        if (!pte->present) {
+            if ((pte->available & VMM_PTE_SWAP) || ++none > VMM_HUGE_MAX_NONE) {
+                return -1;
+            }
+        } else if (pmm_frame_refcount(vmm_pte_addr(pte)) != 1) {
+            return -1; // Shared (a copy-on-write tag alone is stale)
+        }
+    }
+
+    if (memcg_charge_pages_optional(as, none) != 0) {
+        return -1;
+    }
+    uint32_t frame = pmm_alloc_huge();
+    if (!frame) {
+        memcg_uncharge_pages(as, none);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < PMM_HUGE_FRAMES; i++) {
+        page_entry_t* pte = &table->pages[i];
+        void* dst = (void*)(frame + i * PAGE_SIZE);
+        if (pte->present) {
+            memcpy(dst, (void*)vmm_pte_addr(pte), PAGE_SIZE);
+            vmm_put_page(as, base + i * PAGE_SIZE, vmm_pte_addr(pte));
+        } else {
+            memset(dst, 0, PAGE_SIZE);
+        }
+    }
+    pmm_free_frame((uint32_t)table);
+    as->table_pages--;
+
+    vmm_set_huge(as, base, frame, vma->flags);
+    as->resident_pages += none;
+    vmm_huge_stats.collapses++;
+    vmm_flush_all(as);
+    return 0;
+}
+
+// Check up to 'tables' page tables, resuming where the last pass stopped
+// and moving on through every space; returns how many were collapsed
+static uint32_t vmm_huge_scan(uint32_t tables) {
+    uint32_t collapsed = 0;
+    // At most one space's worth of directory entries per pass
+    for (uint32_t i = VMM_USER_FIRST_PDE; i <= VMM_USER_LAST_PDE && tables > 0; i++) {
+        if (!vmm_huge_cursor) {
+            vmm_huge_cursor = vmm_spaces;
+            vmm_huge_cursor_pde = VMM_USER_FIRST_PDE;
+            if (!vmm_huge_cursor) {
+                break;
+            }
+        }
+
+        address_space_t* as = vmm_huge_cursor;
+        page_entry_t* pde = &as->dir->tables[vmm_huge_cursor_pde];
+        if (pde->present && !pde->page_size) {
+            tables--;
+            vmm_huge_stats.scanned++;
+            if (vmm_collapse(as, vmm_huge_cursor_pde << 22) == 0) {
+                collapsed++;
+            }
+        }
+
+        if (++vmm_huge_cursor_pde > VMM_USER_LAST_PDE) {
+            vmm_huge_cursor = as->next;
+            vmm_huge_cursor_pde = VMM_USER_FIRST_PDE;
+        }
+    }
+    return collapsed;
+}
+
+void vmm_huge_poll(void) {
+    if (!CONFIG_VMM_HUGE_PAGES || !vmm_huge_enabled || !vmm_huge_supported) {
+        return;
+    }
+
+    uint64_t now = ktime_get_ms();
+    if (now - vmm_huge_last_ms < VMM_HUGE_SCAN_MS) {
+        return;
+    }
+    vmm_huge_last_ms = now;
+    vmm_huge_scan(VMM_HUGE_SCAN_TABLES);
+}
+
+void vmm_huge_print_stats(void) {
+    terminal_writestring("=== Huge Pages ===\n");
+    terminal_writestring("4MB pages: ");
+    if (!vmm_huge_supported) {
+        terminal_writestring("unavailable (no PSE, or not built in)\n");
+    } else {
+        terminal_writestring(vmm_huge_enabled ? "enabled, " : "disabled (vmm.huge_pages), ");
+        terminal_write_dec(pmm_get_stats().huge_pages);
+        terminal_writestring(" mapped\n");
+    }
+
+    terminal_writestring("Faults: ");
+    terminal_write_dec(vmm_huge_stats.faults);
+    terminal_writestring(" mapped 4MB, ");
+    terminal_write_dec(vmm_huge_stats.fallbacks);
+    terminal_writestring(" fell back to 4KB\n");
+
+    terminal_writestring("Collapse: ");
+    terminal_write_dec(vmm_huge_stats.scanned);
+    terminal_writestring(" tables checked, ");
+    terminal_write_dec(vmm_huge_stats.collapses);
+    terminal_writestring(" collapsed, ");
+    terminal_write_dec(vmm_huge_stats.splits);
+    terminal_writestring(" split by fork\n");
+}
+
+// Benchmark
+
+static void vmm_bench_line(const char* label, uint32_t us, uint32_t frames) {
+    terminal_writestring(label);
+    terminal_write_dec(us);
+    terminal_writestring(" us, ");
+    terminal_write_dec(frames);
+    terminal_writestring(" frames\n");
+}
+
+// Tag word stored at the start of each page
+static uint32_t vmm_bench_tag(uint32_t page, uint32_t generation) {
+    return (generation << 24) ^ (page * 2654435761u);
+}
+
+static int vmm_bench_check(address_space_t* as, uint32_t first, uint32_t count, uint32_t generation) {
+    for (uint32_t p = first; p < first + count; p++) {
+        uint32_t value;
+        if (vmm_copy_from(as, &value, VMM_USER_START + p * PAGE_SIZE, sizeof(value)) != 0 ||
+            value != vmm_bench_tag(p, generation)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int vmm_bench_fill(address_space_t* as, uint32_t first, uint32_t count, uint32_t generation) {
+    for (uint32_t p = first; p < first + count; p++) {
+        uint32_t value = vmm_bench_tag(p, generation);
+        if (vmm_copy_to(as, VMM_USER_START + p * PAGE_SIZE, &value, sizeof(value)) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void vmm_fork_benchmark(uint32_t pages) {
+    pmm_stats_t stats = pmm_get_stats();
+    // Parent, an eager copy and the child's copies all need frames
+    if (pages == 0 || pages * 3 > stats.free_frames) {
+        terminal_writestring("Not enough free frames (");
+        terminal_write_dec(stats.free_frames);
+        terminal_writestring(" available)\n");
+        return;
+    }
+
+    address_space_t* parent = vmm_create();
+    if (!parent || vmm_map_anon(parent, VMM_USER_START, pages, PAGE_WRITABLE | PAGE_USER) != 0 ||
+        vmm_bench_fill(parent, 0, pages, 1) != 0) {
+        terminal_writestring("Failed to populate the parent address space\n");
+        vmm_destroy(parent);
+        return;
+    }
+
+    terminal_writestring("Parent: ");
+    terminal_write_dec(pages);
+    terminal_writestring(" pages in ");
+    terminal_write_dec(parent->table_pages);
+    terminal_writestring(" page tables\n");
+
+    // Eager copy of every page, for comparison
+    uint32_t free_before = pmm_get_stats().free_frames;
+    uint32_t start = (uint32_t)ktime_get_us();
+    address_space_t* copy = vmm_clone(parent, 0);
+    uint32_t elapsed = (uint32_t)ktime_get_us() - start;
+    if (!copy) {
+        terminal_writestring("Full copy failed\n");
+        vmm_destroy(parent);
+        return;
+    }
+    vmm_bench_line("Full copy:  ", elapsed, free_before - pmm_get_stats().free_frames);
+    vmm_destroy(copy);
+
+    // Copy-on-write clone only builds page tables
+    free_before = pmm_get_stats().free_frames;
+    start = (uint32_t)ktime_get_us();
+    address_space_t* child = vmm_clone(parent, 1);
+    elapsed = (uint32_t)ktime_get_us() - start;
+    if (!child) {
+        terminal_writestring("Copy-on-write clone failed\n");
+        vmm_destroy(parent);
+        return;
+    }
+    vmm_bench_line("COW clone:  ", elapsed, free_before - pmm_get_stats().free_frames);
+
+    // The child dirties half of the pages; each write copies one frame
+    uint32_t half = pages / 2;
+    free_before = pmm_get_stats().free_frames;
+    start = (uint32_t)ktime_get_us();
+    int ok = vmm_bench_fill(child, 0, half, 2) == 0;
+    elapsed = (uint32_t)ktime_get_us() - start;
+    vmm_bench_line("Child writes: ", elapsed, free_before - pmm_get_stats().free_frames);
+
+    // The parent is now the sole owner of those frames and keeps them
+    free_before = pmm_get_stats().free_frames;
+    start = (uint32_t)ktime_get_us();
+    ok = ok && vmm_bench_fill(parent, 0, half, 3) == 0;
+    elapsed = (uint32_t)ktime_get_us() - start;
+    vmm_bench_line("Parent writes: ", elapsed, free_before - pmm_get_stats().free_frames);
+
+    ok = ok && vmm_bench_check(child, 0, half, 2) == 0 && vmm_bench_check(parent, 0, half, 3) == 0 &&
+         vmm_bench_check(child, half, pages - half, 1) == 0 &&
+         vmm_bench_check(parent, half, pages - half, 1) == 0;
+
+    terminal_writestring("COW faults: child ");
+    terminal_write_dec(child->cow_faults);
+    terminal_writestring(" (");
+    terminal_write_dec(child->cow_copies);
+    terminal_writestring(" copied), parent ");
+    terminal_write_dec(parent->cow_faults);
+    terminal_writestring(" (");
+    terminal_write_dec(parent->cow_copies);
+    terminal_writestring(" copied)\n");
+    terminal_writestring("Still shared: ");
+    terminal_write_dec(pmm_get_stats().shared_frames);
+    terminal_writestring(" frames\n");
+    terminal_writestring(ok ? "Data check: OK\n" : "Data check: FAILED\n");
+
+    vmm_destroy(child);
+    vmm_destroy(parent);
+}
+
+#define VMM_TEST_FILE_ADDR  0x80000000
+#define VMM_TEST_STRIDE     64          // Pages between touched pages
+
+void vmm_vma_test(uint32_t mb) {
+    uint32_t pages = mb * (0x100000 / PAGE_SIZE);
+    uint32_t touched = (pages + VMM_TEST_STRIDE - 1) / VMM_TEST_STRIDE;
+    pmm_stats_t stats = pmm_get_stats();
+    // Touched pages, their page tables and a few stack and file pages
+    if (touched + mb / 4 + 32 > stats.free_frames) {
+        terminal_writestring("Not enough free frames (");
+        terminal_write_dec(stats.free_frames);
+        terminal_writestring(" available)\n");
+        return;
+    }
+
+    fs_file_t* file = fs_find_file("welcome.txt");
+    address_space_t* as = vmm_create();
+    uint32_t flags = PAGE_WRITABLE | PAGE_USER;
+    // Sparse use is what 4MB pages would hide, so the big area keeps to 4KB
+    if (!file || !as ||
+        vmm_reserve_anon(as, VMM_USER_START, mb * 0x100000, flags | VMA_NOHUGE) != 0 ||
+        vmm_reserve_file(as, VMM_TEST_FILE_ADDR, file->data, file->size, PAGE_USER) != 0 ||
+        vmm_reserve_stack(as, VMM_USER_END, 4 * PAGE_SIZE, 256 * PAGE_SIZE, flags) != 0) {
+        terminal_writestring("Failed to set up the address space\n");
+        vmm_destroy(as);
+        return;
+    }
+    uint32_t free_before = pmm_get_stats().free_frames;
+    int ok = 1;
+
+    // Sparse writes and reads across the reservation
+    for (uint32_t p = 0; p < pages; p += VMM_TEST_STRIDE) {
+        ok &= vmm_copy_to(as, VMM_USER_START + p * PAGE_SIZE, &p, sizeof(p)) == 0;
+    }
+    for (uint32_t p = 0; p < pages; p += VMM_TEST_STRIDE) {
+        uint32_t value = 0;
+        ok &= vmm_copy_from(as, &value, VMM_USER_START + p * PAGE_SIZE, sizeof(value)) == 0 && value == p;
+    }
+
+    // The file comes in on the first read
+    uint8_t head[16];
+    uint32_t len = file->size < sizeof(head) ? file->size : sizeof(head);
+    ok &= vmm_copy_from(as, head, VMM_TEST_FILE_ADDR, len) == 0 && memcmp(head, file->data, len) == 0;
+
+    // A write 16 pages under the stack grows it
+    uint32_t value = 0x57AC;
+    ok &= vmm_copy_to(as, VMM_USER_END - 20 * PAGE_SIZE, &value, sizeof(value)) == 0;
+
+    // Outside every area, read-only, and past the stack's limit
+    uint32_t refused = 0;
+    refused += vmm_copy_to(as, VMM_TEST_FILE_ADDR + 0x10000000, &value, sizeof(value)) != 0;
+    refused += vmm_copy_to(as, VMM_TEST_FILE_ADDR, &value, sizeof(value)) != 0;
+    refused += vmm_copy_to(as, VMM_USER_END - 512 * PAGE_SIZE, &value, sizeof(value)) != 0;
+    ok &= refused == 3;
+
+    terminal_writestring("Reserved: ");
+    terminal_write_dec(as->reserved_pages);
+    terminal_writestring(" pages in ");
+    terminal_write_dec(as->vma_count);
+    terminal_writestring(" areas\nResident: ");
+    terminal_write_dec(as->resident_pages);
+    terminal_writestring(" pages (");
+    terminal_write_dec(as->demand_faults);
+    terminal_writestring(" demand faults), ");
+    terminal_write_dec(free_before - pmm_get_stats().free_frames);
+    terminal_writestring(" frames with page tables\n");
+    vmm_print_vmas(as);
+    terminal_writestring("Lookups: ");
+    terminal_write_dec(as->vma_lookups);
+    terminal_writestring(" (");
+    terminal_write_dec(as->vma_cache_hits);
+    terminal_writestring(" from the last-hit cache)\nRefused: ");
+    terminal_write_dec(refused);
+    terminal_writestring(" of 3 invalid accesses\n");
+
+    // Dropping the big area gives its frames back
+    uint32_t resident = as->resident_pages;
+    ok &= vmm_unreserve(as, VMM_USER_START) == 0 && as->resident_pages == resident - touched;
+    terminal_writestring(ok ? "Data check: OK\n" : "Data check: FAILED\n");
+    vmm_destroy(as);
+}
+
+#define VMM_HUGE_BENCH_PASSES   4   // Read passes over the populated range
+
+// Time read passes over every page. With paging off the walk is done in
+// software, but it touches the same entries the MMU would: a directory
+// entry and a page table entry per 4KB page, only the directory entry
+// for a 4MB one.
+static uint32_t vmm_huge_bench_walk(address_space_t* as, uint32_t pages, uint32_t generation, int* ok) {
+    uint32_t start = (uint32_t)ktime_get_us();
+    for (int pass = 0; pass < VMM_HUGE_BENCH_PASSES; pass++) {
+        *ok &= vmm_bench_check(as, 0, pages, generation) == 0;
+    }
+    return (uint32_t)ktime_get_us() - start;
+}
+
+static void vmm_huge_bench_line(const char* label, uint32_t map_us, const char* map,
+                                uint32_t walk_us, uint32_t entries, const char* size) {
+    terminal_writestring(label);
+    terminal_write_dec(map_us);
+    terminal_writestring(map);
+    terminal_write_dec(walk_us);
+    terminal_writestring(" us to read, ");
+    terminal_write_dec(entries);
+    terminal_writestring(size);
+    terminal_writestring(" entries\n");
+}
+
+void vmm_huge_benchmark(uint32_t mb) {
+    if (!vmm_huge_supported || !vmm_huge_enabled) {
+        terminal_writestring("4MB pages are unavailable or disabled (vmm.huge_pages)\n");
+        return;
+    }
+
+    uint32_t len = mb * 0x100000;
+    uint32_t pages = len / PAGE_SIZE;
+    pmm_stats_t stats = pmm_get_stats();
+    // The 4KB pages and their tables, plus a 4MB page to collapse into
+    if (pages == 0 || pages + mb + PMM_HUGE_FRAMES > stats.free_frames) {
+        terminal_writestring("Not enough free frames (");
+        terminal_write_dec(stats.free_frames);
+        terminal_writestring(" available)\n");
+        return;
+    }
+
+    uint32_t flags = PAGE_WRITABLE | PAGE_USER;
+    address_space_t* as = vmm_create();
+    if (!as || vmm_reserve_anon(as, VMM_USER_START, len, flags | VMA_NOHUGE) != 0) {
+        terminal_writestring("Failed to set up the address space\n");
+        vmm_destroy(as);
+        return;
+    }
+
+    // 4KB pages: a fault and a page table entry each
+    uint32_t start = (uint32_t)ktime_get_us();
+    int ok = vmm_bench_fill(as, 0, pages, 1) == 0;
+    uint32_t fault_us = (uint32_t)ktime_get_us() - start;
+    uint32_t walk_us = vmm_huge_bench_walk(as, pages, 1, &ok);
+    vmm_huge_bench_line("4KB pages:  ", fault_us, " us to populate, ", walk_us, as->resident_pages, " x 4KB");
+
+    // Let the area use 4MB pages and collapse it block by block
+    vmm_find_vma(as, VMM_USER_START)->flags &= ~VMA_NOHUGE;
+    uint32_t tables = as->table_pages;
+    start = (uint32_t)ktime_get_us();
+    for (uint32_t base = VMM_USER_START; base < VMM_USER_START + len; base += PMM_HUGE_SIZE) {
+        vmm_collapse(as, base);
+    }
+    uint32_t collapse_us = (uint32_t)ktime_get_us() - start;
+    walk_us = vmm_huge_bench_walk(as, pages, 1, &ok);
+    vmm_huge_bench_line("Collapsed:  ", collapse_us, " us to collapse, ", walk_us, as->huge_pages, " x 4MB");
+    terminal_writestring("            ");
+    terminal_write_dec(tables - as->table_pages);
+    terminal_writestring(" of ");
+    terminal_write_dec(tables);
+    terminal_writestring(" page tables freed\n");
+    vmm_destroy(as);
+
+    // 4MB pages from the first touch
+    as = vmm_create();
+    if (!as || vmm_reserve_anon(as, VMM_USER_START, len, flags) != 0) {
+        terminal_writestring("Failed to set up the address space\n");
+        vmm_destroy(as);
+        return;
+    }
+    start = (uint32_t)ktime_get_us();
+    ok &= vmm_bench_fill(as, 0, pages, 2) == 0;
+    fault_us = (uint32_t)ktime_get_us() - start;
+    walk_us = vmm_huge_bench_walk(as, pages, 2, &ok);
+    vmm_huge_bench_line("4MB faults: ", fault_us, " us to populate, ", walk_us, as->huge_pages, " x 4MB");
+    terminal_writestring("            ");
+    terminal_write_dec(as->demand_faults);
+    terminal_writestring(" faults, ");
+    terminal_write_dec(as->table_pages);
+    terminal_writestring(" page tables\n");
+
+    terminal_writestring(ok ? "Data check: OK\n" : "Data check: FAILED\n");
+    vmm_destroy(as);
+}
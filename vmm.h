@@ -0,0 +1,152 @@
+#ifndef VMM_H
+#define VMM_H
+
+#include <stdint.h>
+#include "mm.h"
+#include "rbtree.h"
+
+// User part of every address space; the rest mirrors the kernel directory
+#define VMM_USER_START      0x40000000
+#define VMM_USER_END        0xC0000000
+#define VMM_USER_FIRST_PDE  (VMM_USER_START >> 22)
+#define VMM_USER_LAST_PDE   ((VMM_USER_END >> 22) - 1)
+
+// Page table entry "available" bits used by the VMM
+#define VMM_PTE_COW         0x1     // Shared after fork; copy on the next write
+#define VMM_PTE_SWAP        0x2     // Not present; the frame field holds a swap slot
+
+// Page fault error code bits
+#define PF_PRESENT          0x01    // Protection violation (clear: page not present)
+#define PF_WRITE            0x02
+#define PF_USER             0x04
+
+struct mem_group;
+
+// Virtual memory areas: what each reserved part of the user range holds.
+// Their pages get frames on first access (demand paging); a fault outside
+// every area is an invalid access.
+typedef enum {
+    VMA_ANON,           // Zero-filled
+    VMA_FILE,           // Private copy of file data, zero past its end
+    VMA_STACK           // Zero-filled; grows down on faults below it
+} vma_type_t;
+
+typedef struct vma {
+    rb_node_t node;             // Space's tree, ordered by start
+    uint32_t start;             // Page aligned
+    uint32_t end;               // Exclusive, page aligned
+    uint8_t type;               // vma_type_t
+    uint8_t flags;              // PAGE_WRITABLE, PAGE_USER, VMA_NOHUGE
+    uint16_t reserved;
+    const uint8_t* file_data;   // VMA_FILE: contents at start
+    uint32_t file_size;
+    uint32_t limit;             // VMA_STACK: lowest address it may grow down to
+} vma_t;
+
+// Gap kept free under a growing stack, so it never runs into the area below
+#define VMA_STACK_GUARD     PAGE_SIZE
+
+// Area flag, besides PAGE_WRITABLE and PAGE_USER: keep to 4KB pages
+#define VMA_NOHUGE          0x80
+
+// Transparent huge pages. A fault in an anonymous area that covers the
+// whole 4MB-aligned block around it maps one 4MB page (a directory entry
+// with page_size set) when a free 4MB run exists, else a 4KB page as
+// before. A background pass later collapses page tables of such blocks
+// that have filled up into 4MB pages. fork splits 4MB pages back into
+// 4KB ones, which is what copy-on-write works on.
+#define VMM_HUGE_SCAN_MS    1000    // Between collapse passes
+#define VMM_HUGE_SCAN_TABLES 8      // Page tables a pass may collapse-check
+#define VMM_HUGE_MAX_NONE   64      // Unmapped pages a block may have and still collapse
+
+// An address space: a page directory plus the frames its user range maps
+typedef struct address_space {
+    page_directory_t* dir;
+    rb_root_t vmas;             // vma_t by start address
+    vma_t* vma_cache;           // Last area a lookup found
+    uint32_t vma_count;
+    uint32_t reserved_pages;    // Pages covered by areas
+    uint32_t demand_faults;     // Pages given a frame on first access
+    uint32_t vma_lookups;
+    uint32_t vma_cache_hits;
+    uint32_t resident_pages;    // Present user pages (shared ones included)
+    uint32_t table_pages;       // Page tables owned by this space
+    uint32_t huge_pages;        // 4MB pages mapped (1024 resident pages each)
+    uint32_t cow_faults;        // Write faults on copy-on-write pages
+    uint32_t cow_copies;        // ... that had to copy (the rest were sole owners)
+    uint32_t swap_pages;        // Pages currently out in swap
+    uint32_t swap_faults;       // Faults that had to read from swap
+    struct mem_group* memcg;    // Group its resident pages are charged to
+    struct address_space* next; // All address spaces
+} address_space_t;
+
+// Registers the page fault handler
+void vmm_init(void);
+
+// Create an empty address space, or tear one down and release its frames
+address_space_t* vmm_create(void);
+void vmm_destroy(address_space_t* as);
+
+// Frame for a user page of as (not charged), falling back on the OOM
+// policy when memory runs out; 0 if even that fails
+uint32_t vmm_alloc_frame(address_space_t* as, int zeroed);
+
+// Map zero-filled anonymous pages now; these need no area
+int vmm_map_anon(address_space_t* as, uint32_t vaddr, uint32_t pages, uint32_t flags);
+
+// Reserve an area; no frames are taken until its pages are touched.
+// Returns -1 if the range is outside the user range, unaligned or overlaps
+// another area. A stack area covers [top - size, top) and may grow down
+// to top - max_size. Flags are PAGE_WRITABLE, PAGE_USER and VMA_NOHUGE.
+int vmm_reserve_anon(address_space_t* as, uint32_t vaddr, uint32_t len, uint32_t flags);
+int vmm_reserve_file(address_space_t* as, uint32_t vaddr, const uint8_t* data, uint32_t size, uint32_t flags);
+int vmm_reserve_stack(address_space_t* as, uint32_t top, uint32_t size, uint32_t max_size, uint32_t flags);
+
+// Remove the area containing vaddr and release its pages
+int vmm_unreserve(address_space_t* as, uint32_t vaddr);
+
+// Area containing addr, or NULL
+vma_t* vmm_find_vma(address_space_t* as, uint32_t addr);
+void vmm_print_vmas(address_space_t* as);
+
+// fork: share every page copy-on-write (or copy eagerly when cow is 0)
+address_space_t* vmm_clone(address_space_t* src, int cow);
+
+// Resolve a fault at addr; returns 0 if the access can be retried
+int vmm_handle_fault(address_space_t* as, uint32_t addr, uint32_t error);
+
+// Page table access for the page aging code
+page_entry_t* vmm_get_pte(address_space_t* as, uint32_t vaddr, int create);
+void vmm_flush_page(address_space_t* as, uint32_t vaddr);
+
+// Another space that maps phys at vaddr (shared after fork), or NULL
+address_space_t* vmm_find_mapper(uint32_t phys, uint32_t vaddr, address_space_t* exclude);
+
+// Head of the list of all address spaces (linked through next)
+address_space_t* vmm_first_space(void);
+
+// Make an address space current (NULL selects the kernel directory)
+void vmm_activate(address_space_t* as);
+address_space_t* vmm_current(void);
+
+// Access user memory through the page tables, taking faults as the MMU would
+int vmm_copy_to(address_space_t* as, uint32_t vaddr, const void* src, uint32_t len);
+int vmm_copy_from(address_space_t* as, void* dst, uint32_t vaddr, uint32_t len);
+
+// Compare eager copying against copy-on-write cloning of a populated space
+void vmm_fork_benchmark(uint32_t pages);
+
+// Background collapse of 4KB page tables into 4MB pages; call from the
+// idle loop. It runs at most every VMM_HUGE_SCAN_MS.
+void vmm_huge_poll(void);
+void vmm_huge_print_stats(void);
+
+// Populate mb megabytes with 4KB pages, collapse them, and compare with
+// 4MB pages mapped at fault time
+void vmm_huge_benchmark(uint32_t mb);
+
+// Reserve mb megabytes and a file and stack area, touch them sparsely and
+// check what got committed and which accesses were refused
+void vmm_vma_test(uint32_t mb);
+
+#endif // VMM_H